@@ -0,0 +1,43 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+/// Helpers shared by the drivers in bench/. Each driver prints one table; its arguments and
+/// defaults are described at the top of its file.
+
+/// @return the seconds fn() took.
+template <typename F>
+double timeIt(F &&fn)
+{
+    auto start = std::chrono::steady_clock::now();
+    fn();
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+/// @brief Make the compiler believe `value` is used, so the work producing it is not optimized away.
+template <typename T>
+void doNotOptimize(const T &value)
+{
+    asm volatile("" : : "r,m"(value) : "memory");
+}
+
+/// @return argv[i] as a number, or `fallback` when it was not given.
+inline size_t argOr(int argc, char **argv, int i, size_t fallback)
+{
+    return argc > i ? std::strtoull(argv[i], nullptr, 10) : fallback;
+}
+
+/// @return the sample below which a share `p` (0 to 1) of the samples fall. Reorders `samples`.
+template <typename T>
+T percentile(std::vector<T> &samples, double p)
+{
+    if (samples.empty())
+        return T{};
+    size_t i = std::min(samples.size() - 1, static_cast<size_t>(p * samples.size()));
+    std::nth_element(samples.begin(), samples.begin() + i, samples.end());
+    return samples[i];
+}
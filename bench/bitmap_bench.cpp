@@ -0,0 +1,119 @@
+// Throughput, in GB/s, of the kernels behind BITCOUNT, BITOP and BITPOS: each variant in Bitmap.hpp
+// against a plain byte loop, over a buffer larger than the caches and, for BITCOUNT, one that fits
+// in L2. The best of 5 runs counts. Variants the CPU lacks are skipped.
+// Usage: bitmap_bench [megabytes, default 256]
+#include <algorithm>
+#include <array>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "Bench.hpp"
+#include "Bitmap.hpp"
+
+template <typename F>
+static double bestOf5(F &&fn)
+{
+    double best = 1e9;
+    for (int run = 0; run < 5; ++run)
+        best = std::min(best, timeIt(fn));
+    return best;
+}
+
+static uint64_t byteTableCount(const uint8_t *p, size_t n)
+{
+    static const auto table = []
+    {
+        std::array<uint8_t, 256> t{};
+        for (int i = 0; i < 256; ++i)
+            t[i] = static_cast<uint8_t>(__builtin_popcount(i));
+        return t;
+    }();
+    uint64_t count = 0;
+    for (size_t i = 0; i < n; ++i)
+        count += table[p[i]];
+    return count;
+}
+
+__attribute__((noinline)) static void byteLoopAnd(uint8_t *out, const uint8_t *a, const uint8_t *b, size_t n)
+{
+    for (size_t i = 0; i < n; ++i)
+    {
+        out[i] = a[i] & b[i];
+        asm volatile("" : : "r"(out) : "memory"); // Keep the loop byte by byte.
+    }
+}
+
+static void bitcount(const char *label, const uint8_t *p, size_t n, size_t repeat)
+{
+    const CpuFeatures &cpu = CpuFeatures::get();
+    uint64_t sink = 0;
+    auto gbs = [&](auto &&count)
+    {
+        double seconds = bestOf5([&]
+                                 { for (size_t r = 0; r < repeat; ++r) sink += count(p, n); });
+        return double(n) * repeat / seconds / 1e9;
+    };
+    std::printf("BITCOUNT %-10s byte table %5.1f   SWAR %5.1f", label, gbs(byteTableCount), gbs(Bitmap::popcountScalar));
+    if (cpu.popcnt)
+        std::printf("   POPCNT %5.1f", gbs(Bitmap::popcountPopcnt));
+    if (cpu.avx2)
+        std::printf("   AVX2 %5.1f", gbs(Bitmap::popcountAvx2));
+    std::printf("\n");
+    doNotOptimize(sink);
+}
+
+int main(int argc, char **argv)
+{
+    size_t n = argOr(argc, argv, 1, 256) << 20;
+    constexpr size_t IN_CACHE = 128 << 10;
+    const CpuFeatures &cpu = CpuFeatures::get();
+
+    std::mt19937_64 rng(1);
+    std::string a(n, 0), b(n, 0), out(n, 0);
+    for (size_t i = 0; i + 8 <= n; i += 8)
+    {
+        uint64_t x = rng(), y = rng();
+        std::memcpy(&a[i], &x, 8);
+        std::memcpy(&b[i], &y, 8);
+    }
+    auto *pa = reinterpret_cast<const uint8_t *>(a.data());
+    auto *pb = reinterpret_cast<const uint8_t *>(b.data());
+    auto *po = reinterpret_cast<uint8_t *>(out.data());
+
+    bitcount((std::to_string(n >> 20) + " MB").c_str(), pa, n, 1);
+    bitcount("128 KB", pa, IN_CACHE, n / IN_CACHE);
+
+    // BITOP AND of two sources reads 2n bytes and writes n.
+    double bytes = 3.0 * n;
+    std::vector<std::string_view> sources{a, b};
+    double byte_loop = bestOf5([&]
+                               { byteLoopAnd(po, pa, pb, n); });
+    double two_pass = bestOf5([&]
+                              {
+                                  std::memcpy(po, pa, n);
+                                  Bitmap::combineScalar<Bitmap::Op::And>(po, pb, n); });
+    double blocked = bestOf5([&]
+                             { Bitmap::bitop(Bitmap::Op::And, po, n, sources); });
+    std::printf("BITOP AND  byte loop %5.1f   two-pass words %5.1f   blocked (bitop) %5.1f\n", bytes / byte_loop / 1e9, bytes / two_pass / 1e9, bytes / blocked / 1e9);
+
+    // BITPOS 1 over zeros, with the only set bit in the last byte.
+    std::string zeros(n, 0);
+    zeros[n - 1] = 1;
+    auto *pz = reinterpret_cast<const uint8_t *>(zeros.data());
+    size_t sink = 0;
+    double words = bestOf5([&]
+                           { sink += Bitmap::findByteOtherThanScalar(pz, n, 0); });
+    std::printf("BITPOS     64-bit words %5.1f", n / words / 1e9);
+    if (cpu.avx2)
+    {
+        double avx2 = bestOf5([&]
+                              { sink += Bitmap::findByteOtherThanAvx2(pz, n, 0); });
+        std::printf("   AVX2 %5.1f", n / avx2 / 1e9);
+    }
+    std::printf("\n");
+    doNotOptimize(sink);
+    return 0;
+}
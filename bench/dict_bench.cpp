@@ -0,0 +1,94 @@
+// Dict against std::unordered_map<std::string, V>: insert, lookups that hit and lookups that miss,
+// in ns per operation, over keys inserted in one order and looked up in another, and the memory
+// each holds per key: Dict::memoryUsage(), and for the map every byte it allocates (nodes and
+// buckets) counted by its allocator.
+// Usage: dict_bench [keys, default 1000000]
+#include <cstdio>
+#include <functional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "Bench.hpp"
+#include "Dict.hpp"
+
+static size_t allocated_bytes = 0;
+
+/// @brief std::allocator that adds up what is currently allocated through it in allocated_bytes.
+template <typename T>
+struct CountingAllocator
+{
+    using value_type = T;
+
+    CountingAllocator() = default;
+    template <typename U>
+    CountingAllocator(const CountingAllocator<U> &) {}
+
+    T *allocate(size_t n)
+    {
+        allocated_bytes += n * sizeof(T);
+        return std::allocator<T>().allocate(n);
+    }
+
+    void deallocate(T *p, size_t n)
+    {
+        allocated_bytes -= n * sizeof(T);
+        std::allocator<T>().deallocate(p, n);
+    }
+
+    template <typename U>
+    bool operator==(const CountingAllocator<U> &) const
+    {
+        return true;
+    }
+};
+
+int main(int argc, char **argv)
+{
+    size_t n = argOr(argc, argv, 1, 1000000);
+    std::vector<std::string> keys(n), missing(n);
+    std::vector<size_t> order(n);
+    for (size_t i = 0; i < n; ++i)
+    {
+        keys[i] = "key:" + std::to_string(i * 2654435761u % 1000000007);
+        missing[i] = "miss:" + std::to_string(i);
+        order[i] = i * 7919 % n;
+    }
+
+    auto run = [&](const char *name, auto &&insert, auto &&contains, auto &&memory)
+    {
+        size_t found = 0;
+        double insert_s = timeIt([&]
+                                 { for (const std::string &key : keys) insert(key); });
+        double hit_s = timeIt([&]
+                              { for (size_t i : order) found += contains(keys[i]); });
+        double miss_s = timeIt([&]
+                               { for (const std::string &key : missing) found += contains(key); });
+        doNotOptimize(found);
+        std::printf("%-14s insert %6.1f ns   hit %6.1f ns   miss %6.1f ns   %5.1f bytes/key\n", name, insert_s * 1e9 / n,
+                    hit_s * 1e9 / n, miss_s * 1e9 / n, static_cast<double>(memory()) / n);
+    };
+
+    std::printf("%zu keys\n", n);
+    {
+        Dict<long> dict;
+        run("Dict", [&](const std::string &key)
+            { *dict.tryEmplace(key).first = 1; },
+            [&](const std::string &key)
+            { return dict.find(key) != nullptr; },
+            [&]
+            { return dict.memoryUsage(); });
+    }
+    {
+        // The keys are short enough for the strings' inline buffer, like Dict's inline keys.
+        std::unordered_map<std::string, long, std::hash<std::string>, std::equal_to<std::string>,
+                           CountingAllocator<std::pair<const std::string, long>>>
+            map;
+        run("unordered_map", [&](const std::string &key)
+            { map[key] = 1; },
+            [&](const std::string &key)
+            { return map.count(key); },
+            [&]
+            { return allocated_bytes; });
+    }
+    return 0;
+}
@@ -0,0 +1,90 @@
+// Cache hit ratio and throughput of the eviction policies under a Zipfian workload, the way a
+// cache in front of a database sees it: GET a key, and on a miss SET it and evict while the
+// keyspace is over its memory limit. The limit holds `cache_pct` percent of the keys; "ideal" is
+// the hit ratio of a cache that always holds exactly the hottest keys. The eviction clock is
+// simulated, one 100 ms cron tick every `ops_per_tick` requests, so the result does not depend
+// on how fast the machine replays the requests. Half of the requests warm the cache and are not
+// counted.
+// Usage: eviction_bench [keys] [requests] [cache_pct] [zipf_s_percent] [ops_per_tick]
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <random>
+#include <string>
+#include <vector>
+#include "Bench.hpp"
+#include "Keyspace.hpp"
+
+int main(int argc, char **argv)
+{
+    const size_t keys = argOr(argc, argv, 1, 1000000);
+    const size_t requests = argOr(argc, argv, 2, 4000000);
+    const size_t cache_pct = argOr(argc, argv, 3, 10);
+    const double s = argOr(argc, argv, 4, 99) / 100.0;
+    const size_t ops_per_tick = std::max<size_t>(1, argOr(argc, argv, 5, 10000));
+
+    // Rank r (0 is the hottest) is drawn with probability proportional to 1 / (r + 1)^s.
+    std::vector<double> cdf(keys);
+    double sum = 0;
+    for (size_t r = 0; r < keys; ++r)
+        cdf[r] = sum += 1.0 / std::pow(static_cast<double>(r + 1), s);
+    for (double &c : cdf)
+        c /= sum;
+    std::vector<std::string> names(keys);
+    for (size_t r = 0; r < keys; ++r)
+        names[r] = "key:" + std::to_string(r);
+    std::mt19937_64 rng(7);
+    std::uniform_real_distribution<double> uniform(0, 1);
+    std::vector<uint32_t> trace(requests);
+    for (uint32_t &r : trace)
+        r = static_cast<uint32_t>(std::lower_bound(cdf.begin(), cdf.end(), uniform(rng)) - cdf.begin());
+
+    const std::string payload(100, 'v');
+    const size_t cached_keys = keys * cache_pct / 100;
+    size_t limit;
+    {
+        Keyspace sizing;
+        for (size_t r = 0; r < cached_keys; ++r)
+            sizing.set(names[r], RedisObject::fromString(payload));
+        limit = sizing.usedMemory();
+    }
+    std::printf("%zu keys, %zu requests, zipf s=%.2f, maxmemory %zu bytes (%zu keys)\n",
+                keys, requests, s, limit, cached_keys);
+    std::printf("%-16s %10s %12s %12s\n", "policy", "hit ratio", "ops/s", "evicted");
+    std::printf("%-16s %9.2f%% %12s %12s\n", "ideal", cached_keys ? cdf[cached_keys - 1] * 100 : 0.0, "-", "-");
+
+    for (EvictionPolicy policy : {EvictionPolicy::AllKeysLru, EvictionPolicy::AllKeysLfu, EvictionPolicy::AllKeysRandom})
+    {
+        Keyspace keyspace;
+        keyspace.setEvictionPolicy(policy);
+        long long now_ms = Keyspace::nowMs();
+        keyspace.updateClock(now_ms);
+        size_t hits = 0;
+        auto run = [&](size_t begin, size_t end)
+        {
+            for (size_t i = begin; i < end; ++i)
+            {
+                if (i % ops_per_tick == 0)
+                    keyspace.updateClock(now_ms += Eviction::LRU_CLOCK_RESOLUTION_MS);
+                const std::string &key = names[trace[i]];
+                if (keyspace.get(key))
+                {
+                    ++hits;
+                    continue;
+                }
+                keyspace.set(key, RedisObject::fromString(payload));
+                while (keyspace.usedMemory() > limit && keyspace.evictOne() != 0)
+                {
+                }
+            }
+        };
+        run(0, requests / 2);
+        hits = 0;
+        double seconds = timeIt([&]
+                                { run(requests / 2, requests); });
+        size_t measured = requests - requests / 2;
+        std::printf("%-16s %9.2f%% %12.0f %12llu\n", std::string(evictionPolicyName(policy)).c_str(),
+                    100.0 * hits / measured, measured / seconds, static_cast<unsigned long long>(keyspace.evictedKeys()));
+    }
+}
@@ -0,0 +1,130 @@
+// KEYS-style walk over a keyspace matching each key against a pattern: GlobPattern against a
+// backtracking matcher with the structure of redis' stringmatchlen(), which retries every star.
+// 1% of the keys are 30 'a's plus digits, which the a*a*...*b patterns make exponential for the
+// backtracking matcher; it is stopped after 2 s and its time extrapolated to the whole walk.
+// Usage: glob_bench [keys, default 10000000]
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <string_view>
+#include <utility>
+#include "Bench.hpp"
+#include "Glob.hpp"
+#include "Keyspace.hpp"
+
+/// @brief Match one byte against the class whose body starts at p, after the `[`; moves p past the `]`.
+static bool backtrackClass(const char *&p, const char *end, unsigned char c)
+{
+    bool negate = p < end && *p == '^';
+    if (negate)
+        ++p;
+    bool match = false;
+    for (; p < end && *p != ']'; ++p)
+    {
+        if (*p == '\\' && p + 1 < end)
+        {
+            ++p;
+            match |= static_cast<unsigned char>(*p) == c;
+        }
+        else if (p + 2 < end && p[1] == '-' && p[2] != ']')
+        {
+            unsigned char lo = p[0], hi = p[2];
+            if (lo > hi)
+                std::swap(lo, hi);
+            match |= c >= lo && c <= hi;
+            p += 2;
+        }
+        else
+        {
+            match |= static_cast<unsigned char>(*p) == c;
+        }
+    }
+    if (p < end)
+        ++p;
+    return match != negate;
+}
+
+/// @brief The backtracking matcher: at every star, try the rest of the pattern at every position.
+static bool backtrackMatch(const char *p, const char *p_end, const char *s, const char *s_end)
+{
+    while (p < p_end)
+    {
+        if (*p == '*')
+        {
+            while (p < p_end && *p == '*')
+                ++p;
+            if (p == p_end)
+                return true;
+            for (const char *at = s; at <= s_end; ++at)
+            {
+                if (backtrackMatch(p, p_end, at, s_end))
+                    return true;
+            }
+            return false;
+        }
+        if (s == s_end)
+            return false;
+        if (*p == '?')
+        {
+            ++p;
+        }
+        else if (*p == '[')
+        {
+            ++p;
+            if (!backtrackClass(p, p_end, *s))
+                return false;
+        }
+        else
+        {
+            char c = *p;
+            if (c == '\\' && p + 1 < p_end)
+                c = *++p;
+            if (c != *s)
+                return false;
+            ++p;
+        }
+        ++s;
+    }
+    return s == s_end;
+}
+
+int main(int argc, char **argv)
+{
+    size_t n = argOr(argc, argv, 1, 10000000);
+    Keyspace keyspace;
+    std::string adversarial(30, 'a');
+    for (size_t i = 0; i < n; ++i)
+    {
+        std::string key = i % 100 == 0 ? adversarial + std::to_string(i) : i % 2 ? "user:" + std::to_string(i) + ":name" : "session:" + std::to_string(i);
+        keyspace.set(key, RedisObject::fromString("v"));
+    }
+    std::printf("%zu keys, 1%% of them 30 'a's plus digits\n", n);
+    std::printf("%-22s %9s %13s %15s\n", "pattern", "matched", "GlobPattern", "backtracking");
+
+    const char *patterns[] = {"user:*", "*:name", "*12345*", "user:*:name", "u?er:[0-4]*:n*e", "a*a*a*b", "a*a*a*a*a*a*b", "*a*a*a*a*a*a*a*a*b*"};
+    for (std::string_view pattern : patterns)
+    {
+        GlobPattern glob(pattern);
+        size_t matched = 0;
+        double compiled_s = timeIt([&]
+                                   { keyspace.forEachKey([&](std::string_view key, const RedisObject &)
+                                                         { matched += glob.matches(key); }); });
+
+        size_t visited = 0, backtrack_matched = 0;
+        bool cut = false;
+        auto start = std::chrono::steady_clock::now();
+        double backtrack_s = timeIt([&]
+                                    { keyspace.forEachKey([&](std::string_view key, const RedisObject &)
+                                                          {
+                                                              if (cut)
+                                                                  return;
+                                                              backtrack_matched += backtrackMatch(pattern.data(), pattern.data() + pattern.size(), key.data(), key.data() + key.size());
+                                                              if (++visited % 1024 == 0 && std::chrono::steady_clock::now() - start > std::chrono::seconds(2))
+                                                                  cut = true; }); });
+        doNotOptimize(backtrack_matched);
+        if (cut)
+            backtrack_s *= double(n) / visited;
+        std::printf("%-22s %9zu %10.0f ms %s%10.0f ms\n", std::string(pattern).c_str(), matched, compiled_s * 1e3, cut ? ">= " : "   ", backtrack_s * 1e3);
+    }
+    return 0;
+}
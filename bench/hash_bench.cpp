@@ -0,0 +1,98 @@
+// Hashes on both sides of hash-max-listpack-entries: heap bytes per field and HSET/HGET cost of
+// HashType at several field counts, against a std::unordered_map<std::string, std::string> per
+// hash. Every size stores the same number of fields in total, split into hashes of that size
+// ("field:N" with values of about 10 bytes); HSET fills them, HGET looks up random fields.
+// Usage: hash_bench [total_fields, default 1000000] [max_listpack_entries, default 128]
+#include <algorithm>
+#include <cstdio>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <malloc.h>
+#include "Bench.hpp"
+#include "HashType.hpp"
+
+static size_t heapBytes()
+{
+    struct mallinfo2 info = mallinfo2();
+    return info.uordblks + info.hblkhd;
+}
+
+int main(int argc, char **argv)
+{
+    size_t total = argOr(argc, argv, 1, 1000000);
+    HashLimits limits;
+    limits.max_listpack_entries = argOr(argc, argv, 2, limits.max_listpack_entries);
+    constexpr size_t QUERIES = 1000000;
+    const size_t max = limits.max_listpack_entries;
+
+    std::mt19937_64 rng(7);
+    std::vector<std::string> fields, values;
+    for (size_t i = 0; i < 2 * max + 1; ++i)
+    {
+        fields.push_back("field:" + std::to_string(i));
+        values.push_back("v" + std::to_string(rng() % 1000000000));
+    }
+    size_t sink = 0;
+
+    std::printf("%zu fields, hash-max-listpack-entries %zu\n", total, max);
+    std::printf("%-8s %-10s %8s %9s %9s    %8s %9s %9s\n", "fields", "encoding", "B/field", "HSET ns", "HGET ns",
+                "umap B", "HSET ns", "HGET ns");
+    std::vector<size_t> sizes = {4, 16, max / 2, max, max + 1, 2 * max};
+    std::sort(sizes.begin(), sizes.end());
+    sizes.erase(std::unique(sizes.begin(), sizes.end()), sizes.end());
+    for (size_t n : sizes)
+    {
+        if (n == 0)
+            continue;
+        size_t count = std::max<size_t>(1, total / n);
+        std::vector<std::pair<uint32_t, uint32_t>> picks(QUERIES);
+        for (auto &[hash, field] : picks)
+        {
+            hash = static_cast<uint32_t>(rng() % count);
+            field = static_cast<uint32_t>(rng() % n);
+        }
+
+        size_t heap_before = heapBytes();
+        std::vector<RedisObject> hashes(count);
+        double set_s = timeIt([&]
+                              {
+                                  for (RedisObject &hash : hashes)
+                                  {
+                                      hash = HashType::create();
+                                      for (size_t f = 0; f < n; ++f)
+                                          HashType::set(hash, fields[f], values[f], limits);
+                                  } });
+        double bytes = double(heapBytes() - heap_before) / (count * n);
+        double get_s = timeIt([&]
+                              {
+                                  std::string_view value;
+                                  for (auto [hash, field] : picks)
+                                      sink += HashType::get(hashes[hash], fields[field], value) ? value.size() : 0; });
+        const char *encoding = hashes[0].encodingName();
+        hashes = {};
+
+        heap_before = heapBytes();
+        std::vector<std::unordered_map<std::string, std::string>> maps(count);
+        double map_set_s = timeIt([&]
+                                  {
+                                      for (auto &map : maps)
+                                          for (size_t f = 0; f < n; ++f)
+                                              map[fields[f]] = values[f]; });
+        double map_bytes = double(heapBytes() - heap_before) / (count * n);
+        double map_get_s = timeIt([&]
+                                  {
+                                      for (auto [hash, field] : picks)
+                                      {
+                                          auto it = maps[hash].find(fields[field]);
+                                          sink += it != maps[hash].end() ? it->second.size() : 0;
+                                      } });
+        maps = {};
+
+        std::printf("%-8zu %-10s %8.1f %9.1f %9.1f    %8.1f %9.1f %9.1f\n", n, encoding, bytes,
+                    set_s * 1e9 / (count * n), get_s * 1e9 / QUERIES,
+                    map_bytes, map_set_s * 1e9 / (count * n), map_get_s * 1e9 / QUERIES);
+    }
+    doNotOptimize(sink);
+}
@@ -0,0 +1,80 @@
+// PFCOUNT and PFMERGE building blocks on dense HyperLogLogs of 100k elements each: the cached
+// count, a count that unpacks the registers again, counting several keys (which merges them
+// first) and a single merge, each with the SIMD kernels against HllDense::mergeScalar().
+// Usage: hll_bench
+#include <cstdint>
+#include <cstdio>
+#include <random>
+#include <string>
+#include <vector>
+#include "Bench.hpp"
+#include "HyperLogLogType.hpp"
+
+/// @brief Print the ns per call of fn() over `iterations` calls.
+template <typename F>
+static void report(const char *name, int iterations, F &&fn)
+{
+    uint64_t sink = 0;
+    double seconds = timeIt([&]
+                            { for (int i = 0; i < iterations; ++i) sink += fn(); });
+    doNotOptimize(sink);
+    std::printf("%-36s %10.1f ns\n", name, seconds * 1e9 / iterations);
+}
+
+int main()
+{
+    constexpr int KEYS = 10;
+    std::mt19937_64 rng(7);
+    HllLimits limits;
+    std::vector<RedisObject> hlls;
+    for (int k = 0; k < KEYS; ++k)
+    {
+        hlls.push_back(HyperLogLogType::create());
+        for (int i = 0; i < 100000; ++i)
+            HyperLogLogType::add(hlls.back(), std::to_string(rng()), limits);
+    }
+    const CpuFeatures &cpu = CpuFeatures::get();
+    std::printf("kernels: avx2 %s, ssse3 %s\n", cpu.avx2 ? "yes" : "no", cpu.ssse3 ? "yes" : "no");
+
+    // Counting keys the way PFCOUNT with several keys does: merge into one byte per register, then estimate.
+    auto countMerged = [&](int keys, bool simd)
+    {
+        alignas(32) uint8_t registers[Hll::REGISTERS] = {};
+        for (int k = 0; k < keys; ++k)
+        {
+            const HllDense &dense = hlls[k].as<HllDense>();
+            if (simd)
+                dense.mergeInto(registers);
+            else
+                dense.mergeScalar(registers);
+        }
+        return Hll::estimate(registers);
+    };
+
+    report("PFCOUNT 1 key, cached", 10000000, [&]
+           { return HyperLogLogType::count(hlls[0]); });
+    report("PFCOUNT 1 key, uncached, SIMD", 20000, [&]
+           { return countMerged(1, true); });
+    report("PFCOUNT 1 key, uncached, scalar", 20000, [&]
+           { return countMerged(1, false); });
+    report("PFCOUNT 2 keys, SIMD", 20000, [&]
+           { return countMerged(2, true); });
+    report("PFCOUNT 2 keys, scalar", 20000, [&]
+           { return countMerged(2, false); });
+    report("PFCOUNT 10 keys, SIMD", 20000, [&]
+           { return countMerged(KEYS, true); });
+    report("PFCOUNT 10 keys, scalar", 20000, [&]
+           { return countMerged(KEYS, false); });
+
+    alignas(32) static uint8_t registers[Hll::REGISTERS];
+    const HllDense &dense = hlls[0].as<HllDense>();
+    report("merge of 1 dense HLL, SIMD", 100000, [&]
+           {
+               dense.mergeInto(registers);
+               return registers[5]; });
+    report("merge of 1 dense HLL, scalar", 100000, [&]
+           {
+               dense.mergeScalar(registers);
+               return registers[5]; });
+    return 0;
+}
@@ -0,0 +1,55 @@
+// Intersection of two sorted integer arrays, as SINTER does for two intsets: std::set_intersection
+// against IntSet::intersectSorted(), which picks the SIMD kernel the CPU supports or gallops when
+// one side is much smaller. In us per intersection.
+// Usage: intset_bench
+#include <algorithm>
+#include <cstdio>
+#include <random>
+#include <set>
+#include <vector>
+#include "Bench.hpp"
+#include "IntSet.hpp"
+
+template <typename T>
+static std::vector<T> sortedDistinct(size_t n, int64_t range, std::mt19937_64 &rng)
+{
+    std::set<T> values;
+    while (values.size() < n)
+        values.insert(static_cast<T>(rng() % range));
+    return {values.begin(), values.end()};
+}
+
+template <typename T>
+static void run(const char *name, size_t na, size_t nb, int64_t range)
+{
+    std::mt19937_64 rng(3);
+    std::vector<T> a = sortedDistinct<T>(na, range, rng);
+    std::vector<T> b = sortedDistinct<T>(nb, range, rng);
+    std::vector<T> out(std::min(na, nb));
+    size_t reps = 20000000 / (na + nb) + 1;
+    size_t sink = 0;
+    double std_s = timeIt([&]
+                          {
+                              for (size_t r = 0; r < reps; ++r)
+                                  sink += std::set_intersection(a.begin(), a.end(), b.begin(), b.end(), out.begin()) - out.begin(); });
+    double intset_s = timeIt([&]
+                             {
+                                 for (size_t r = 0; r < reps; ++r)
+                                     sink += IntSet::intersectSorted(a.data(), na, b.data(), nb, out.data()); });
+    doNotOptimize(sink);
+    std::printf("%-30s %10.1f us %10.1f us   %4.1fx\n", name, std_s * 1e6 / reps, intset_s * 1e6 / reps, std_s / intset_s);
+}
+
+int main()
+{
+    const CpuFeatures &cpu = CpuFeatures::get();
+    std::printf("kernels: avx2 %s, sse4.1 %s\n", cpu.avx2 ? "yes" : "no", cpu.sse41 ? "yes" : "no");
+    std::printf("%-30s %13s %13s\n", "", "set_intersection", "IntSet");
+    run<int32_t>("int32 1M x 1M, 50% overlap", 1000000, 1000000, 2000000);
+    run<int32_t>("int32 1M x 1M, sparse", 1000000, 1000000, 1000000000);
+    run<int16_t>("int16 20k x 20k", 20000, 20000, 60000);
+    run<int64_t>("int64 1M x 1M, 50% overlap", 1000000, 1000000, 2000000);
+    run<int32_t>("int32 1k x 1M (gallop)", 1000, 1000000, 2000000);
+    run<int32_t>("int32 512 x 512", 512, 512, 1500);
+    return 0;
+}
@@ -0,0 +1,57 @@
+// MGET of 100 random existing keys through Keyspace::readMany(), with the prefetch window of
+// --prefetch-batch-max-size off (0) and at 8, 16 and 32 keys. Memory latency only dominates once
+// the keyspace is well beyond the caches, so use as many keys as RAM allows (about 115 bytes of RSS each).
+// Usage: mget_bench [keys, default 5000000]
+#include <cstdio>
+#include <random>
+#include <string>
+#include <vector>
+#include "Bench.hpp"
+#include "Keyspace.hpp"
+
+int main(int argc, char **argv)
+{
+    size_t n = argOr(argc, argv, 1, 5000000);
+    constexpr size_t KEYS_PER_MGET = 100;
+    constexpr size_t MGETS = 2000;
+
+    Keyspace keyspace;
+    double load_s = timeIt([&]
+                           {
+                               for (size_t i = 0; i < n; ++i)
+                                   keyspace.set("key:" + std::to_string(i), RedisObject::fromString("value"));
+                               // Finish any incremental rehash so every batch size sees the same tables.
+                               for (int i = 0; i < 2000; ++i)
+                                   keyspace.rehashStep(std::chrono::seconds(1)); });
+    std::printf("%zu keys loaded in %.1f s, used_memory %.2f GB\n", n, load_s, keyspace.usedMemory() / 1e9);
+
+    std::mt19937_64 rng(42);
+    std::vector<std::string> names(KEYS_PER_MGET);
+    std::vector<std::string_view> keys(KEYS_PER_MGET);
+    // 0 and 16 run twice: the first run of each also warms up the allocator and page tables.
+    for (size_t batch : {0, 16, 0, 16, 8, 32})
+    {
+        keyspace.setPrefetchBatch(batch);
+        double total = 0;
+        size_t found = 0;
+        for (size_t q = 0; q < MGETS; ++q)
+        {
+            for (size_t k = 0; k < KEYS_PER_MGET; ++k)
+            {
+                names[k] = "key:" + std::to_string(rng() % n);
+                keys[k] = names[k];
+            }
+            total += timeIt([&]
+                            {
+                                found += keyspace.readMany(keys, [](const std::vector<const RedisObject *> &values)
+                                                           {
+                                                               size_t present = 0;
+                                                               for (const RedisObject *value : values)
+                                                                   present += value != nullptr;
+                                                               return present; }); });
+        }
+        doNotOptimize(found);
+        std::printf("prefetch batch %2zu   MGET %zu keys %7.2f us   %5.0f ns/key\n", batch, KEYS_PER_MGET, total / MGETS * 1e6, total / MGETS / KEYS_PER_MGET * 1e9);
+    }
+    return 0;
+}
@@ -0,0 +1,329 @@
+// Closed-loop load generator for the server over loopback TCP, like redis-benchmark: `connections`
+// clients spread over `threads` client threads each keep `pipeline` requests in flight, 90% GETs
+// and 10% SETs of 32-byte values on 100k preloaded keys. The first second warms up; after it, ops/s
+// and the latency percentiles of every request are reported. Given the server's pid, it also counts
+// the syscalls every server thread makes per request through the raw_syscalls:sys_enter tracepoint,
+// like `strace -c -f` but without slowing the server down (needs root and a mounted tracefs).
+// Raise `ulimit -n` on both sides for thousands of connections.
+// Usage: net_bench <port> [connections, default 50] [threads, default 1] [seconds, default 10] [pipeline, default 1] [server_pid]
+// e.g.   mount -t tracefs nodev /sys/kernel/tracing   # once, for the syscall count
+//        server --port 6390 --io-mode uring --io-threads 2 & net_bench 6390 1000 1 10 1 $!
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <arpa/inet.h>
+#include <linux/perf_event.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include "Bench.hpp"
+
+using Clock = std::chrono::steady_clock;
+
+static constexpr size_t KEYS = 100000;
+static constexpr size_t VALUE_SIZE = 32;
+
+/// @brief Counts the syscalls made by every thread of a process, or nothing when that is not possible.
+/// Threads the process starts later are not counted, so it is created once every connection is up.
+class SyscallCounter
+{
+public:
+    explicit SyscallCounter(int pid)
+    {
+        if (pid <= 0)
+            return;
+        long long id = -1;
+        for (const char *path : {"/sys/kernel/tracing/events/raw_syscalls/sys_enter/id",
+                                 "/sys/kernel/debug/tracing/events/raw_syscalls/sys_enter/id"})
+        {
+            std::ifstream in(path);
+            if (in >> id)
+                break;
+        }
+        if (id < 0)
+            return;
+        std::error_code ec;
+        for (const auto &task : std::filesystem::directory_iterator("/proc/" + std::to_string(pid) + "/task", ec))
+        {
+            perf_event_attr attr{};
+            attr.size = sizeof(attr);
+            attr.type = PERF_TYPE_TRACEPOINT;
+            attr.config = static_cast<uint64_t>(id);
+            int tid = std::atoi(task.path().filename().c_str());
+            int fd = static_cast<int>(syscall(__NR_perf_event_open, &attr, tid, -1, -1, 0));
+            if (fd < 0)
+            {
+                closeAll();
+                return;
+            }
+            fds_.push_back(fd);
+        }
+    }
+
+    ~SyscallCounter() { closeAll(); }
+
+    bool available() const { return !fds_.empty(); }
+
+    /// @return syscalls made since the counter was created.
+    uint64_t read() const
+    {
+        uint64_t total = 0;
+        for (int fd : fds_)
+        {
+            uint64_t count = 0;
+            if (::read(fd, &count, sizeof(count)) == sizeof(count))
+                total += count;
+        }
+        return total;
+    }
+
+private:
+    std::vector<int> fds_;
+
+    void closeAll()
+    {
+        for (int fd : fds_)
+            close(fd);
+        fds_.clear();
+    }
+};
+
+/// @return the length of the RESP reply at the front of `p`, or 0 while it is incomplete.
+/// Only the replies of GET and SET (a line or a bulk string) are expected.
+static size_t replyLength(const char *p, size_t len)
+{
+    const char *eol = static_cast<const char *>(memchr(p, '\n', len));
+    if (eol == nullptr)
+        return 0;
+    size_t line = eol - p + 1;
+    if (p[0] != '$')
+        return line;
+    long long bulk = std::strtoll(p + 1, nullptr, 10);
+    if (bulk < 0)
+        return line;
+    size_t total = line + static_cast<size_t>(bulk) + 2;
+    return total <= len ? total : 0;
+}
+
+static std::string encode(const std::vector<std::string> &args)
+{
+    std::string out = "*" + std::to_string(args.size()) + "\r\n";
+    for (const std::string &arg : args)
+        out += "$" + std::to_string(arg.size()) + "\r\n" + arg + "\r\n";
+    return out;
+}
+
+static std::string keyName(size_t i)
+{
+    return "key:" + std::to_string(i);
+}
+
+static int connectTo(int port)
+{
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (fd < 0 || connect(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) != 0)
+    {
+        std::perror("connect");
+        std::exit(EXIT_FAILURE);
+    }
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    return fd;
+}
+
+/// @brief Send `requests` and wait for one reply to each.
+static void roundTrip(int fd, const std::string &requests, size_t replies)
+{
+    if (send(fd, requests.data(), requests.size(), MSG_NOSIGNAL) != static_cast<ssize_t>(requests.size()))
+        std::exit(EXIT_FAILURE);
+    std::string in;
+    size_t pos = 0;
+    char buf[64 * 1024];
+    while (replies > 0)
+    {
+        size_t n = replyLength(in.data() + pos, in.size() - pos);
+        if (n != 0)
+        {
+            pos += n;
+            --replies;
+            continue;
+        }
+        ssize_t received = recv(fd, buf, sizeof(buf), 0);
+        if (received <= 0)
+            std::exit(EXIT_FAILURE);
+        in.append(buf, received);
+    }
+}
+
+struct Connection
+{
+    int fd = -1;
+    std::string in;
+    size_t outstanding = 0;
+    Clock::time_point sent;
+};
+
+struct ThreadResult
+{
+    uint64_t ops = 0;
+    std::vector<uint64_t> latencies_ns;
+};
+
+/// @brief Keep every connection busy with `pipeline` requests until `stop`; count what finishes after `measure_from`.
+static void runClients(std::vector<Connection> &connections, size_t pipeline, uint64_t seed, Clock::time_point measure_from,
+                       const std::atomic<bool> &stop, ThreadResult &result)
+{
+    int epoll_fd = epoll_create1(0);
+    for (size_t i = 0; i < connections.size(); ++i)
+    {
+        epoll_event ev{};
+        ev.events = EPOLLIN;
+        ev.data.u64 = i;
+        epoll_ctl(epoll_fd, EPOLL_CTL_ADD, connections[i].fd, &ev);
+    }
+    const std::string value(VALUE_SIZE, 'v');
+    uint64_t rng = seed | 1;
+    std::string batch;
+    auto sendBatch = [&](Connection &c)
+    {
+        batch.clear();
+        for (size_t i = 0; i < pipeline; ++i)
+        {
+            rng ^= rng << 13;
+            rng ^= rng >> 7;
+            rng ^= rng << 17;
+            std::string key = keyName(rng % KEYS);
+            batch += (rng >> 32) % 10 == 0 ? encode({"SET", key, value}) : encode({"GET", key});
+        }
+        c.sent = Clock::now();
+        c.outstanding = pipeline;
+        if (send(c.fd, batch.data(), batch.size(), MSG_NOSIGNAL) != static_cast<ssize_t>(batch.size()))
+        {
+            std::perror("send");
+            std::exit(EXIT_FAILURE);
+        }
+    };
+    for (Connection &c : connections)
+        sendBatch(c);
+
+    epoll_event events[256];
+    char buf[64 * 1024];
+    while (!stop.load(std::memory_order_relaxed))
+    {
+        int n = epoll_wait(epoll_fd, events, 256, 100);
+        for (int e = 0; e < n; ++e)
+        {
+            Connection &c = connections[events[e].data.u64];
+            ssize_t received = recv(c.fd, buf, sizeof(buf), 0);
+            if (received <= 0)
+            {
+                std::fprintf(stderr, "the server closed a connection\n");
+                std::exit(EXIT_FAILURE);
+            }
+            c.in.append(buf, received);
+            size_t pos = 0;
+            auto now = Clock::now();
+            while (size_t len = replyLength(c.in.data() + pos, c.in.size() - pos))
+            {
+                pos += len;
+                --c.outstanding;
+                if (now >= measure_from)
+                {
+                    ++result.ops;
+                    result.latencies_ns.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(now - c.sent).count());
+                }
+            }
+            c.in.erase(0, pos);
+            if (c.outstanding == 0)
+                sendBatch(c);
+        }
+    }
+    close(epoll_fd);
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 2)
+    {
+        std::fprintf(stderr, "usage: net_bench <port> [connections] [threads] [seconds] [pipeline] [server_pid]\n");
+        return EXIT_FAILURE;
+    }
+    const int port = std::atoi(argv[1]);
+    const size_t connections = std::max<size_t>(1, argOr(argc, argv, 2, 50));
+    const size_t threads = std::clamp<size_t>(argOr(argc, argv, 3, 1), 1, connections);
+    const size_t seconds = std::max<size_t>(1, argOr(argc, argv, 4, 10));
+    const size_t pipeline = std::max<size_t>(1, argOr(argc, argv, 5, 1));
+    const int server_pid = static_cast<int>(argOr(argc, argv, 6, 0));
+
+    {
+        int fd = connectTo(port);
+        const std::string value(VALUE_SIZE, 'v');
+        for (size_t i = 0; i < KEYS; i += 1000)
+        {
+            std::string requests;
+            for (size_t k = i; k < i + 1000 && k < KEYS; ++k)
+                requests += encode({"SET", keyName(k), value});
+            roundTrip(fd, requests, std::min<size_t>(1000, KEYS - i));
+        }
+        close(fd);
+    }
+
+    std::vector<std::vector<Connection>> groups(threads);
+    for (size_t i = 0; i < connections; ++i)
+        groups[i % threads].emplace_back().fd = connectTo(port);
+
+    SyscallCounter syscalls(server_pid);
+    std::atomic<bool> stop{false};
+    auto measure_from = Clock::now() + std::chrono::seconds(1);
+    std::vector<ThreadResult> results(threads);
+    std::vector<std::thread> workers;
+    for (size_t t = 0; t < threads; ++t)
+        workers.emplace_back([&, t]
+                             { runClients(groups[t], pipeline, 0x9E3779B97F4A7C15ULL * (t + 1), measure_from, stop, results[t]); });
+
+    std::this_thread::sleep_until(measure_from);
+    uint64_t syscalls_before = syscalls.read();
+    auto start = Clock::now();
+    std::this_thread::sleep_for(std::chrono::seconds(seconds));
+    uint64_t syscalls_after = syscalls.read();
+    double elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+    stop.store(true);
+    for (std::thread &worker : workers)
+        worker.join();
+
+    uint64_t ops = 0;
+    std::vector<uint64_t> latencies;
+    for (ThreadResult &result : results)
+    {
+        ops += result.ops;
+        latencies.insert(latencies.end(), result.latencies_ns.begin(), result.latencies_ns.end());
+    }
+    std::printf("%zu connections, %zu client threads, pipeline %zu, %zu s\n", connections, threads, pipeline, seconds);
+    std::printf("%12s %10s %10s %10s %12s\n", "ops/s", "p50 us", "p99 us", "p99.9 us", "syscalls/op");
+    char per_op[32] = "n/a";
+    if (syscalls.available() && ops > 0)
+        std::snprintf(per_op, sizeof(per_op), "%.3f", double(syscalls_after - syscalls_before) / ops);
+    double p50 = percentile(latencies, 0.5) / 1e3;
+    double p99 = percentile(latencies, 0.99) / 1e3;
+    double p999 = percentile(latencies, 0.999) / 1e3;
+    std::printf("%12.0f %10.1f %10.1f %10.1f %12s\n", ops / elapsed, p50, p99, p999, per_op);
+    for (auto &group : groups)
+        for (Connection &c : group)
+            close(c.fd);
+}
@@ -0,0 +1,47 @@
+// Quicklist against std::deque<std::string>: push to the back, then pop from the front, in ns per
+// element, and the heap bytes each element took (from mallinfo2()), for several element sizes.
+// Usage: quicklist_bench [elements, default 5000000]
+#include <cstdio>
+#include <deque>
+#include <string>
+#include <malloc.h>
+#include "Bench.hpp"
+#include "Quicklist.hpp"
+
+int main(int argc, char **argv)
+{
+    size_t n = argOr(argc, argv, 1, 5000000);
+    std::printf("%zu elements\n", n);
+    for (size_t len : {8, 32, 100})
+    {
+        std::string value(len, 'x');
+        std::string out;
+        {
+            size_t heap_before = mallinfo2().uordblks;
+            Quicklist list;
+            double push_s = timeIt([&]
+                                   { for (size_t i = 0; i < n; ++i) list.pushBack(value); });
+            size_t heap = mallinfo2().uordblks - heap_before;
+            double pop_s = timeIt([&]
+                                  { for (size_t i = 0; i < n; ++i) list.popFront(out); });
+            std::printf("%4zuB  quicklist  push %6.1f ns  pop %6.1f ns  %6.1f B/elem\n", len, push_s * 1e9 / n, pop_s * 1e9 / n, double(heap) / n);
+        }
+        {
+            size_t heap_before = mallinfo2().uordblks;
+            std::deque<std::string> deque;
+            double push_s = timeIt([&]
+                                   { for (size_t i = 0; i < n; ++i) deque.push_back(value); });
+            size_t heap = mallinfo2().uordblks - heap_before;
+            double pop_s = timeIt([&]
+                                  {
+                                      for (size_t i = 0; i < n; ++i)
+                                      {
+                                          out = std::move(deque.front());
+                                          deque.pop_front();
+                                      } });
+            std::printf("%4zuB  deque      push %6.1f ns  pop %6.1f ns  %6.1f B/elem\n", len, push_s * 1e9 / n, pop_s * 1e9 / n, double(heap) / n);
+        }
+        doNotOptimize(out);
+    }
+    return 0;
+}
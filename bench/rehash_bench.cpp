@@ -0,0 +1,62 @@
+// Latency of single inserts while a Dict doubles again and again: p50, p99, p99.9 and the worst
+// insert, in ns, with the incremental rehash, with every rehash finished by the insert that starts
+// it (what Dict did before the rehash became incremental), and for std::unordered_map. One line
+// per doubling-sized window of inserts, then one for all of them.
+// Usage: rehash_bench [keys, default 8000000]
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "Bench.hpp"
+#include "Dict.hpp"
+
+int main(int argc, char **argv)
+{
+    size_t n = argOr(argc, argv, 1, 8000000);
+    std::vector<std::string> keys(n);
+    for (size_t i = 0; i < n; ++i)
+        keys[i] = "key:" + std::to_string(i * 2654435761u % 1000000007);
+
+    std::vector<uint32_t> ns(n);
+    auto report = [&](const char *name, size_t begin, size_t end)
+    {
+        std::vector<uint32_t> window(ns.begin() + begin, ns.begin() + end);
+        uint32_t worst = *std::max_element(window.begin(), window.end());
+        std::printf("%-22s %9zu-%-9zu p50 %5u   p99 %6u   p99.9 %7u   max %10u\n", name, begin, end,
+                    percentile(window, 0.5), percentile(window, 0.99), percentile(window, 0.999), worst);
+    };
+    auto run = [&](const char *name, auto &&insert)
+    {
+        for (size_t i = 0; i < n; ++i)
+        {
+            auto start = std::chrono::steady_clock::now();
+            insert(keys[i]);
+            ns[i] = static_cast<uint32_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count());
+        }
+        for (size_t begin = 1024; begin < n; begin *= 2)
+            report(name, begin, std::min(n, begin * 2));
+        report(name, 0, n);
+    };
+
+    std::printf("%zu inserts, ns per insert\n", n);
+    {
+        Dict<long> dict;
+        run("Dict incremental", [&](const std::string &key)
+            { *dict.tryEmplace(key).first = 1; });
+    }
+    {
+        Dict<long> dict;
+        run("Dict all at once", [&](const std::string &key)
+            {
+                *dict.tryEmplace(key).first = 1;
+                dict.rehashStep(dict.capacity()); });
+    }
+    {
+        std::unordered_map<std::string, long> map;
+        run("unordered_map", [&](const std::string &key)
+            { map[key] = 1; });
+    }
+    return 0;
+}
@@ -0,0 +1,89 @@
+// Stream ingest and reads against std::map<StreamID, vector<pair<string, string>>>: appending
+// entries of 3 fields (time and heap bytes per entry), a full forward and reverse scan, and
+// XRANGE COUNT 100 from random start IDs.
+// Usage: stream_bench [entries, default 1000000]
+#include <cstdio>
+#include <map>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+#include <malloc.h>
+#include "Bench.hpp"
+#include "Stream.hpp"
+
+int main(int argc, char **argv)
+{
+    size_t n = argOr(argc, argv, 1, 1000000);
+    constexpr size_t QUERIES = 100000;
+    constexpr size_t COUNT = 100;
+    constexpr uint64_t BASE_MS = 1700000000000;
+
+    std::vector<std::string> values(n);
+    for (size_t i = 0; i < n; ++i)
+        values[i] = std::to_string(i * 7919 % 100000);
+    // Ten entries per millisecond, like a busy producer.
+    auto idOf = [&](size_t i)
+    { return StreamID{BASE_MS + i / 10, i % 10}; };
+    std::mt19937_64 rng(1);
+    std::vector<StreamID> starts(QUERIES);
+    for (StreamID &start : starts)
+        start = idOf(rng() % n);
+    size_t sink = 0;
+
+    std::printf("%zu entries\n", n);
+    {
+        StreamLimits limits;
+        Stream stream;
+        size_t heap_before = mallinfo2().uordblks;
+        double append_s = timeIt([&]
+                                 {
+                                     for (size_t i = 0; i < n; ++i)
+                                     {
+                                         std::string_view fields[6] = {"sensor", "temp-3", "value", values[i], "unit", "C"};
+                                         stream.append(idOf(i), fields, limits);
+                                     } });
+        size_t heap = mallinfo2().uordblks - heap_before;
+        auto visit = [&](const Stream::Entry &entry)
+        { sink += entry.fields[1].second.size(); };
+        double forward_s = timeIt([&]
+                                  { stream.range({}, StreamID::max(), false, 0, visit); });
+        double reverse_s = timeIt([&]
+                                  { stream.range({}, StreamID::max(), true, 0, visit); });
+        double xrange_s = timeIt([&]
+                                 {
+                                     for (StreamID start : starts)
+                                         stream.range(start, StreamID::max(), false, COUNT, visit); });
+        std::printf("Stream    append %6.0f ms %6.1f B/entry   scan %5.1f ms  reverse %5.1f ms   XRANGE COUNT %zu %5.2f us\n",
+                    append_s * 1e3, double(heap) / n, forward_s * 1e3, reverse_s * 1e3, COUNT, xrange_s * 1e6 / QUERIES);
+    }
+    {
+        std::map<StreamID, std::vector<std::pair<std::string, std::string>>> map;
+        size_t heap_before = mallinfo2().uordblks;
+        double append_s = timeIt([&]
+                                 {
+                                     for (size_t i = 0; i < n; ++i)
+                                         map.emplace_hint(map.end(), idOf(i), std::vector<std::pair<std::string, std::string>>{{"sensor", "temp-3"}, {"value", values[i]}, {"unit", "C"}}); });
+        size_t heap = mallinfo2().uordblks - heap_before;
+        double forward_s = timeIt([&]
+                                  {
+                                      for (const auto &[id, fields] : map)
+                                          sink += fields[1].second.size(); });
+        double reverse_s = timeIt([&]
+                                  {
+                                      for (auto it = map.rbegin(); it != map.rend(); ++it)
+                                          sink += it->second[1].second.size(); });
+        double xrange_s = timeIt([&]
+                                 {
+                                     for (StreamID start : starts)
+                                     {
+                                         auto it = map.lower_bound(start);
+                                         for (size_t k = 0; k < COUNT && it != map.end(); ++k, ++it)
+                                             sink += it->second[1].second.size();
+                                     } });
+        std::printf("std::map  append %6.0f ms %6.1f B/entry   scan %5.1f ms  reverse %5.1f ms   XRANGE COUNT %zu %5.2f us\n",
+                    append_s * 1e3, double(heap) / n, forward_s * 1e3, reverse_s * 1e3, COUNT, xrange_s * 1e6 / QUERIES);
+    }
+    doNotOptimize(sink);
+    return 0;
+}
@@ -0,0 +1,122 @@
+// SortedSet (skiplist plus member dict) against a std::map<pair<score, member>> with an
+// unordered_map index, the obvious alternative: ZADD inserts and updates, ZRANGE by rank and by
+// score (10 members from a random start), ZRANK, in ns per operation, and heap bytes per member.
+// std::map has no ranks, so its rank operations walk from the start and run fewer queries.
+// Usage: zset_bench [members, default 1000000]
+#include <cstdio>
+#include <iterator>
+#include <map>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <malloc.h>
+#include "Bench.hpp"
+#include "SortedSet.hpp"
+
+static size_t heapBytes()
+{
+    struct mallinfo2 info = mallinfo2();
+    return info.uordblks + info.hblkhd;
+}
+
+int main(int argc, char **argv)
+{
+    size_t n = argOr(argc, argv, 1, 1000000);
+    constexpr size_t QUERIES = 200000;
+    constexpr size_t WALK_QUERIES = 200; // For the O(n) rank walks of std::map.
+    constexpr int RANGE = 10;
+
+    std::mt19937_64 rng(7);
+    std::vector<std::string> members(n);
+    std::vector<double> scores(n);
+    for (size_t i = 0; i < n; ++i)
+    {
+        members[i] = "user:" + std::to_string(rng() % 100000000);
+        scores[i] = static_cast<double>(rng() % 10000000);
+    }
+    std::vector<size_t> picks(QUERIES);
+    for (size_t &pick : picks)
+        pick = rng() % n;
+    size_t sink = 0;
+
+    std::printf("%zu members            insert   update   range/rank  range/score   rank     B/member\n", n);
+    {
+        size_t heap_before = heapBytes();
+        SortedSet zset;
+        double insert_s = timeIt([&]
+                                 { for (size_t i = 0; i < n; ++i) zset.set(members[i], scores[i]); });
+        double bytes = double(heapBytes() - heap_before) / zset.size();
+        double update_s = timeIt([&]
+                                 { for (size_t i : picks) zset.set(members[i], scores[i] + 1); });
+        double by_rank_s = timeIt([&]
+                                  {
+                                      for (size_t i : picks)
+                                      {
+                                          const SortedSet::Node *node = zset.byRank(i % zset.size());
+                                          for (int k = 0; k < RANGE && node != nullptr; ++k, node = node->next())
+                                              sink += node->member().size();
+                                      } });
+        double by_score_s = timeIt([&]
+                                   {
+                                       for (size_t i : picks)
+                                       {
+                                           const SortedSet::Node *node = zset.firstInRange(ScoreRange{scores[i], 1e18});
+                                           for (int k = 0; k < RANGE && node != nullptr; ++k, node = node->next())
+                                               sink += node->member().size();
+                                       } });
+        double rank_s = timeIt([&]
+                               { for (size_t i : picks) sink += zset.rank(members[i]).value_or(0); });
+        std::printf("skiplist+dict        %6.0f ns %6.0f ns %8.0f ns %10.0f ns %7.0f ns %8.1f\n", insert_s * 1e9 / n, update_s * 1e9 / QUERIES,
+                    by_rank_s * 1e9 / QUERIES, by_score_s * 1e9 / QUERIES, rank_s * 1e9 / QUERIES, bytes);
+    }
+    {
+        size_t heap_before = heapBytes();
+        std::map<std::pair<double, std::string>, char> ordered;
+        std::unordered_map<std::string, double> index;
+        auto set = [&](const std::string &member, double score)
+        {
+            auto [it, inserted] = index.try_emplace(member, score);
+            if (!inserted)
+            {
+                if (it->second == score)
+                    return;
+                ordered.erase({it->second, member});
+                it->second = score;
+            }
+            ordered.emplace(std::make_pair(score, member), 0);
+        };
+        double insert_s = timeIt([&]
+                                 { for (size_t i = 0; i < n; ++i) set(members[i], scores[i]); });
+        double bytes = double(heapBytes() - heap_before) / index.size();
+        double update_s = timeIt([&]
+                                 { for (size_t i : picks) set(members[i], scores[i] + 1); });
+        double by_rank_s = timeIt([&]
+                                  {
+                                      for (size_t q = 0; q < WALK_QUERIES; ++q)
+                                      {
+                                          auto it = std::next(ordered.begin(), picks[q] % ordered.size());
+                                          for (int k = 0; k < RANGE && it != ordered.end(); ++k, ++it)
+                                              sink += it->first.second.size();
+                                      } });
+        double by_score_s = timeIt([&]
+                                   {
+                                       for (size_t i : picks)
+                                       {
+                                           auto it = ordered.lower_bound({scores[i], std::string()});
+                                           for (int k = 0; k < RANGE && it != ordered.end(); ++k, ++it)
+                                               sink += it->first.second.size();
+                                       } });
+        double rank_s = timeIt([&]
+                               {
+                                   for (size_t q = 0; q < WALK_QUERIES; ++q)
+                                   {
+                                       const std::string &member = members[picks[q]];
+                                       sink += std::distance(ordered.begin(), ordered.find({index.at(member), member}));
+                                   } });
+        std::printf("std::map+index       %6.0f ns %6.0f ns %8.0f ns %10.0f ns %7.0f ns %8.1f\n", insert_s * 1e9 / n, update_s * 1e9 / QUERIES,
+                    by_rank_s * 1e9 / WALK_QUERIES, by_score_s * 1e9 / QUERIES, rank_s * 1e9 / WALK_QUERIES, bytes);
+    }
+    doNotOptimize(sink);
+    return 0;
+}
@@ -0,0 +1,396 @@
+#pragma once
+
+#include <algorithm>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+#include <vector>
+#include "CpuFeatures.hpp"
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+/// @brief Kernels behind the bitmap commands, like redis' bitops.c. A bitmap is a string whose bit 0
+/// is the most significant bit of its first byte. Bitmaps run to hundreds of megabytes, so the loops
+/// that touch every byte (BITCOUNT, BITOP, BITPOS) have AVX2 versions chosen at run time, with
+/// POPCNT or plain 64-bit word fallbacks.
+namespace Bitmap
+{
+    /// @brief BITOP operations.
+    enum class Op
+    {
+        And,
+        Or,
+        Xor,
+        Not,
+    };
+
+    /// @brief What BITFIELD does when SET or INCRBY overflows a field.
+    enum class Overflow
+    {
+        Wrap, // Keep the low bits, two's complement style.
+        Sat,  // Stick at the largest or smallest value.
+        Fail, // Leave the field alone and reply with a null.
+    };
+
+    /// @brief Population count of a word without the POPCNT instruction, which baseline x86-64 lacks.
+    inline uint64_t popcountWord(uint64_t x)
+    {
+        x = x - ((x >> 1) & 0x5555555555555555ull);
+        x = (x & 0x3333333333333333ull) + ((x >> 2) & 0x3333333333333333ull);
+        x = (x + (x >> 4)) & 0x0f0f0f0f0f0f0f0full;
+        return (x * 0x0101010101010101ull) >> 56;
+    }
+
+    /// @brief popcount() a word at a time, without SIMD.
+    inline uint64_t popcountScalar(const uint8_t *p, size_t n)
+    {
+        uint64_t count = 0;
+        size_t i = 0;
+        for (; i + 8 <= n; i += 8)
+        {
+            uint64_t word;
+            std::memcpy(&word, p + i, 8);
+            count += popcountWord(word);
+        }
+        uint64_t tail = 0;
+        std::memcpy(&tail, p + i, n - i);
+        return count + popcountWord(tail);
+    }
+
+#if defined(__x86_64__)
+    __attribute__((target("popcnt"))) inline uint64_t popcountPopcnt(const uint8_t *p, size_t n)
+    {
+        // Four counters, so the adds do not wait on each other.
+        uint64_t c0 = 0, c1 = 0, c2 = 0, c3 = 0;
+        size_t i = 0;
+        for (; i + 32 <= n; i += 32)
+        {
+            uint64_t w[4];
+            std::memcpy(w, p + i, 32);
+            c0 += __builtin_popcountll(w[0]);
+            c1 += __builtin_popcountll(w[1]);
+            c2 += __builtin_popcountll(w[2]);
+            c3 += __builtin_popcountll(w[3]);
+        }
+        return c0 + c1 + c2 + c3 + popcountScalar(p + i, n - i);
+    }
+
+    /// @brief Bits set in each byte of v, looked up a nibble at a time with a byte shuffle.
+    __attribute__((target("avx2"))) inline __m256i popcountBytesAvx2(__m256i v)
+    {
+        const __m256i lookup = _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+                                                0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+        const __m256i low = _mm256_set1_epi8(0x0f);
+        return _mm256_add_epi8(_mm256_shuffle_epi8(lookup, _mm256_and_si256(v, low)),
+                               _mm256_shuffle_epi8(lookup, _mm256_and_si256(_mm256_srli_epi16(v, 4), low)));
+    }
+
+    __attribute__((target("avx2"))) inline uint64_t popcountAvx2(const uint8_t *p, size_t n)
+    {
+        const __m256i zero = _mm256_setzero_si256();
+        __m256i total = zero;
+        size_t i = 0;
+        for (; i + 128 <= n; i += 128)
+        {
+            // Four vectors add up to at most 32 per byte, then one sum of absolute differences
+            // folds the bytes into the 64-bit lanes.
+            const __m256i *v = reinterpret_cast<const __m256i *>(p + i);
+            __m256i bytes = _mm256_add_epi8(_mm256_add_epi8(popcountBytesAvx2(_mm256_loadu_si256(v)), popcountBytesAvx2(_mm256_loadu_si256(v + 1))),
+                                            _mm256_add_epi8(popcountBytesAvx2(_mm256_loadu_si256(v + 2)), popcountBytesAvx2(_mm256_loadu_si256(v + 3))));
+            total = _mm256_add_epi64(total, _mm256_sad_epu8(bytes, zero));
+        }
+        alignas(32) uint64_t lanes[4];
+        _mm256_store_si256(reinterpret_cast<__m256i *>(lanes), total);
+        return lanes[0] + lanes[1] + lanes[2] + lanes[3] + popcountPopcnt(p + i, n - i);
+    }
+#endif
+
+    /// @return number of bits set in p[0, n).
+    inline uint64_t popcount(const uint8_t *p, size_t n)
+    {
+#if defined(__x86_64__)
+        // AVX2 implies POPCNT, which popcountAvx2() uses for its tail.
+        if (CpuFeatures::get().avx2 && CpuFeatures::get().popcnt)
+            return popcountAvx2(p, n);
+        if (CpuFeatures::get().popcnt)
+            return popcountPopcnt(p, n);
+#endif
+        return popcountScalar(p, n);
+    }
+
+    template <Op op>
+    inline uint64_t combineWord(uint64_t a, uint64_t b)
+    {
+        if constexpr (op == Op::And)
+            return a & b;
+        else if constexpr (op == Op::Or)
+            return a | b;
+        else if constexpr (op == Op::Xor)
+            return a ^ b;
+        else
+            return ~b;
+    }
+
+    /// @brief combine() without SIMD.
+    template <Op op>
+    inline void combineScalar(uint8_t *dst, const uint8_t *src, size_t n)
+    {
+        size_t i = 0;
+        for (; i + 8 <= n; i += 8)
+        {
+            uint64_t a, b;
+            std::memcpy(&a, dst + i, 8);
+            std::memcpy(&b, src + i, 8);
+            a = combineWord<op>(a, b);
+            std::memcpy(dst + i, &a, 8);
+        }
+        for (; i < n; ++i)
+            dst[i] = static_cast<uint8_t>(combineWord<op>(dst[i], src[i]));
+    }
+
+#if defined(__x86_64__)
+    template <Op op>
+    __attribute__((target("avx2"))) inline __m256i combineAvx2(__m256i a, __m256i b)
+    {
+        if constexpr (op == Op::And)
+            return _mm256_and_si256(a, b);
+        else if constexpr (op == Op::Or)
+            return _mm256_or_si256(a, b);
+        else if constexpr (op == Op::Xor)
+            return _mm256_xor_si256(a, b);
+        else
+            return _mm256_xor_si256(b, _mm256_set1_epi8(-1));
+    }
+
+    template <Op op>
+    __attribute__((target("avx2"))) inline void combineAvx2(uint8_t *dst, const uint8_t *src, size_t n)
+    {
+        size_t i = 0;
+        for (; i + 64 <= n; i += 64)
+        {
+            __m256i *d = reinterpret_cast<__m256i *>(dst + i);
+            const __m256i *s = reinterpret_cast<const __m256i *>(src + i);
+            __m256i r0 = combineAvx2<op>(_mm256_loadu_si256(d), _mm256_loadu_si256(s));
+            __m256i r1 = combineAvx2<op>(_mm256_loadu_si256(d + 1), _mm256_loadu_si256(s + 1));
+            _mm256_storeu_si256(d, r0);
+            _mm256_storeu_si256(d + 1, r1);
+        }
+        combineScalar<op>(dst + i, src + i, n - i);
+    }
+#endif
+
+    template <Op op>
+    inline void combine(uint8_t *dst, const uint8_t *src, size_t n)
+    {
+#if defined(__x86_64__)
+        if (CpuFeatures::get().avx2)
+            return combineAvx2<op>(dst, src, n);
+#endif
+        combineScalar<op>(dst, src, n);
+    }
+
+    /// @brief dst[i] = dst[i] op src[i] for i in [0, n); for Op::Not, dst[i] = ~src[i].
+    inline void combine(Op op, uint8_t *dst, const uint8_t *src, size_t n)
+    {
+        switch (op)
+        {
+        case Op::And:
+            return combine<Op::And>(dst, src, n);
+        case Op::Or:
+            return combine<Op::Or>(dst, src, n);
+        case Op::Xor:
+            return combine<Op::Xor>(dst, src, n);
+        case Op::Not:
+            return combine<Op::Not>(dst, src, n);
+        }
+    }
+
+    /// @brief BITOP: out[0, n) = sources[0] op sources[1] op ..., where a source shorter than n reads
+    /// as zeros past its end (Op::Not takes one source). Works through the sources a block at a time,
+    /// so the block of out stays in cache while every source is folded into it.
+    inline void bitop(Op op, uint8_t *out, size_t n, const std::vector<std::string_view> &sources)
+    {
+        constexpr size_t BLOCK = 16 * 1024;
+        for (size_t base = 0; base < n; base += BLOCK)
+        {
+            size_t len = std::min(BLOCK, n - base);
+            auto part = [&](std::string_view s)
+            {
+                return s.size() > base ? std::min(len, s.size() - base) : 0;
+            };
+            auto bytes = [&](std::string_view s)
+            {
+                return reinterpret_cast<const uint8_t *>(s.data()) + base;
+            };
+            size_t have = part(sources[0]);
+            if (op == Op::Not)
+                combine(op, out + base, bytes(sources[0]), have);
+            else
+                std::memcpy(out + base, bytes(sources[0]), have);
+            std::memset(out + base + have, 0, len - have);
+            for (size_t k = 1; k < sources.size(); ++k)
+            {
+                have = part(sources[k]);
+                combine(op, out + base, bytes(sources[k]), have);
+                if (op == Op::And)
+                    std::memset(out + base + have, 0, len - have);
+            }
+        }
+    }
+
+    /// @brief findByteOtherThan() a word at a time, without SIMD.
+    inline size_t findByteOtherThanScalar(const uint8_t *p, size_t n, uint8_t skip)
+    {
+        const uint64_t pattern = skip * 0x0101010101010101ull;
+        size_t i = 0;
+        for (; i + 8 <= n; i += 8)
+        {
+            uint64_t word;
+            std::memcpy(&word, p + i, 8);
+            if (word != pattern)
+                break;
+        }
+        while (i < n && p[i] == skip)
+            ++i;
+        return i;
+    }
+
+#if defined(__x86_64__)
+    __attribute__((target("avx2"))) inline size_t findByteOtherThanAvx2(const uint8_t *p, size_t n, uint8_t skip)
+    {
+        const __m256i pattern = _mm256_set1_epi8(static_cast<char>(skip));
+        size_t i = 0;
+        for (; i + 64 <= n; i += 64)
+        {
+            const __m256i *v = reinterpret_cast<const __m256i *>(p + i);
+            __m256i same = _mm256_and_si256(_mm256_cmpeq_epi8(_mm256_loadu_si256(v), pattern),
+                                            _mm256_cmpeq_epi8(_mm256_loadu_si256(v + 1), pattern));
+            if (static_cast<uint32_t>(_mm256_movemask_epi8(same)) != 0xffffffffu)
+                break;
+        }
+        return i + findByteOtherThanScalar(p + i, n - i, skip);
+    }
+#endif
+
+    /// @return index of the first byte of p[0, n) that is not `skip`, or n.
+    inline size_t findByteOtherThan(const uint8_t *p, size_t n, uint8_t skip)
+    {
+#if defined(__x86_64__)
+        if (CpuFeatures::get().avx2)
+            return findByteOtherThanAvx2(p, n, skip);
+#endif
+        return findByteOtherThanScalar(p, n, skip);
+    }
+
+    /// @brief BITPOS over the bytes p[0, n): the position of the first bit equal to `bit`, ignoring the
+    /// bits of first_mask in p[0] and of last_mask in p[n - 1], for ranges that start or end mid-byte.
+    /// @return the bit position from p, or -1 when there is none.
+    inline int64_t findBit(const uint8_t *p, size_t n, bool bit, uint8_t first_mask = 0, uint8_t last_mask = 0)
+    {
+        if (n == 0)
+            return -1;
+        const uint8_t skip = bit ? 0x00 : 0xff;
+        auto masked = [&](size_t i, uint8_t mask)
+        {
+            return static_cast<uint8_t>(bit ? p[i] & ~mask : p[i] | mask);
+        };
+        auto position = [&](size_t i, uint8_t byte)
+        {
+            return static_cast<int64_t>(i * 8 + std::countl_zero(static_cast<uint8_t>(bit ? byte : ~byte)));
+        };
+        uint8_t byte = masked(0, n == 1 ? first_mask | last_mask : first_mask);
+        if (byte != skip)
+            return position(0, byte);
+        if (n == 1)
+            return -1;
+        size_t i = 1 + findByteOtherThan(p + 1, n - 2, skip);
+        if (i < n - 1)
+            return position(i, p[i]);
+        byte = masked(n - 1, last_mask);
+        return byte != skip ? position(n - 1, byte) : -1;
+    }
+
+    /// @brief The unsigned field of `bits` bits (1 to 64) at bit `offset` of s; bits past the end read as 0.
+    inline uint64_t getField(std::string_view s, uint64_t offset, unsigned bits)
+    {
+        uint64_t value = 0;
+        for (unsigned j = 0; j < bits; ++j, ++offset)
+        {
+            uint64_t byte = offset >> 3;
+            unsigned bit = byte < s.size() ? (static_cast<uint8_t>(s[byte]) >> (7 - (offset & 7))) & 1 : 0;
+            value = (value << 1) | bit;
+        }
+        return value;
+    }
+
+    /// @brief getField() as a two's complement number.
+    inline int64_t getSignedField(std::string_view s, uint64_t offset, unsigned bits)
+    {
+        uint64_t value = getField(s, offset, bits);
+        if (bits < 64 && (value >> (bits - 1)) & 1)
+            value |= ~0ull << bits;
+        return static_cast<int64_t>(value);
+    }
+
+    /// @brief Store the low `bits` bits of value at bit `offset` of p, which must be long enough.
+    inline void setField(uint8_t *p, uint64_t offset, unsigned bits, uint64_t value)
+    {
+        for (unsigned j = 0; j < bits; ++j, ++offset)
+        {
+            unsigned bit = (value >> (bits - 1 - j)) & 1;
+            uint8_t mask = static_cast<uint8_t>(0x80 >> (offset & 7));
+            p[offset >> 3] = static_cast<uint8_t>(bit ? p[offset >> 3] | mask : p[offset >> 3] & ~mask);
+        }
+    }
+
+    /// @brief value + incr for an unsigned field of `bits` bits (1 to 63), under the overflow policy.
+    /// SET passes the new value with incr 0, so a value out of range overflows as well.
+    /// @return false when it overflows under Overflow::Fail.
+    inline bool addUnsigned(uint64_t value, int64_t incr, unsigned bits, Overflow overflow, uint64_t &result)
+    {
+        const uint64_t max = (1ull << bits) - 1;
+        __int128 sum = static_cast<__int128>(value) + incr;
+        if (sum >= 0 && sum <= static_cast<__int128>(max))
+        {
+            result = static_cast<uint64_t>(sum);
+            return true;
+        }
+        if (overflow == Overflow::Fail)
+            return false;
+        if (overflow == Overflow::Wrap)
+            result = (value + static_cast<uint64_t>(incr)) & max;
+        else
+            result = sum < 0 ? 0 : max;
+        return true;
+    }
+
+    /// @brief addUnsigned() for a signed field of `bits` bits (1 to 64).
+    inline bool addSigned(int64_t value, int64_t incr, unsigned bits, Overflow overflow, int64_t &result)
+    {
+        const int64_t max = bits == 64 ? INT64_MAX : static_cast<int64_t>((1ull << (bits - 1)) - 1);
+        const int64_t min = -max - 1;
+        __int128 sum = static_cast<__int128>(value) + incr;
+        if (sum >= min && sum <= max)
+        {
+            result = static_cast<int64_t>(sum);
+            return true;
+        }
+        if (overflow == Overflow::Fail)
+            return false;
+        if (overflow == Overflow::Wrap)
+        {
+            uint64_t wrapped = static_cast<uint64_t>(value) + static_cast<uint64_t>(incr);
+            if (bits < 64)
+                wrapped = (wrapped >> (bits - 1)) & 1 ? wrapped | (~0ull << bits) : wrapped & ~(~0ull << bits);
+            result = static_cast<int64_t>(wrapped);
+        }
+        else
+        {
+            result = sum < min ? min : max;
+        }
+        return true;
+    }
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include "Client.hpp"
+
+/// @brief Clients blocked in commands such as XREAD BLOCK, by the keys they wait on, like redis'
+/// blocking_keys. A write to one of those keys calls signal(), which flags the waiting clients
+/// ready and asks their backends to run the blocked commands again.
+class BlockingKeys
+{
+public:
+    /// @brief Register a client under its BlockState::keys.
+    void block(Client &c)
+    {
+        std::lock_guard lock(mutex_);
+        c.blocked.ready.store(false);
+        for (const std::string &key : c.blocked.keys)
+            clients_[key].push_back(&c);
+        ++blocked_;
+    }
+
+    /// @brief Forget a blocked client; after this no other thread touches it.
+    void unblock(Client &c)
+    {
+        std::lock_guard lock(mutex_);
+        for (const std::string &key : c.blocked.keys)
+        {
+            auto it = clients_.find(key);
+            if (it == clients_.end())
+                continue;
+            std::erase(it->second, &c);
+            if (it->second.empty())
+                clients_.erase(it);
+        }
+        --blocked_;
+    }
+
+    /// @brief Wake the clients blocked on `key`. Cheap when nobody is blocked.
+    void signal(std::string_view key)
+    {
+        // block() registers before the blocked command looks at its keys a second time, so a
+        // write missed by that look finds the client here.
+        if (blocked_.load() == 0)
+            return;
+        std::lock_guard lock(mutex_);
+        auto it = clients_.find(std::string(key));
+        if (it == clients_.end())
+            return;
+        for (Client *c : it->second)
+        {
+            c->blocked.ready.store(true);
+            c->wake();
+        }
+    }
+
+private:
+    std::mutex mutex_;
+    std::unordered_map<std::string, std::vector<Client *>> clients_;
+    std::atomic<size_t> blocked_{0};
+};
@@ -0,0 +1,199 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <chrono>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include <cerrno>
+#include "Protocol.hpp"
+#include "QueryBuffer.hpp"
+#include "ReplyBuffer.hpp"
+
+/// @brief What a client blocked in a command such as XREAD BLOCK waits for, like redis' blockingState.
+/// The command runs again once one of the keys changes or the deadline passes, see RedisServer::blockClient().
+struct BlockState
+{
+    bool active = false;                            // The client waits; its next commands stay in the query buffer.
+    bool retrying = false;                          // The blocked command is running again.
+    std::vector<std::string> argv;                  // The command to run again, e.g. XREAD with "$" resolved to an ID.
+    std::vector<std::string> keys;                  // Keys whose change wakes the client.
+    std::chrono::steady_clock::time_point deadline; // When the command gives up; time_point::max() for never.
+    std::atomic<bool> ready{false};                 // Set by whichever thread changed one of the keys.
+};
+
+/// @brief Per-connection state shared by every I/O backend.
+/// The event loop owns one of these for each accepted socket; the thread-per-connection mode keeps one on the stack of the connection thread.
+struct Client
+{
+    /// Bytes asked for by a read when no larger frame is pending.
+    static constexpr size_t READ_CHUNK = 16 * 1024;
+
+    int fd = -1;
+    QueryBuffer query;                  // Bytes received but not yet executed; sockets are read straight into it.
+    std::vector<std::string_view> argv; // Arguments of the command being executed, viewing `query`.
+    size_t query_need = 0;              // Size the pending frame needs before it is worth scanning again.
+    FrameState frame;                   // Where scanning the pending frame stopped.
+    ReplyBuffer reply;                  // Replies produced by command handlers, not yet written to the socket.
+    bool close_asap = false;            // Set when the connection should be closed once the current batch is handled.
+    bool owns_fd = true;                // False when another object (e.g. an asio socket) closes the descriptor.
+    long long dirty = 0;                // Keyspace changes made by this client's commands; decides propagation.
+    std::vector<std::string> propagate_argv; // When not empty, sent to replicas instead of the command, e.g. XADD with the ID it generated.
+    BlockState blocked;                 // Set while the client waits in a blocking command.
+    std::function<void()> wake;         // Set by backends that can block clients: asks them, from any thread, to run the blocked command again soon.
+    std::function<void()> notify_output; // Set by every backend: asks it, from any thread, to write what queueOutput() left.
+
+    explicit Client(int fd, bool owns_fd = true) : fd(fd), owns_fd(owns_fd) {}
+    Client(const Client &) = delete;
+    Client &operator=(const Client &) = delete;
+
+    ~Client()
+    {
+        if (fd != -1 && owns_fd)
+        {
+            close(fd);
+        }
+    }
+
+    /// @brief Queue raw RESP bytes to be sent to this client.
+    void addReply(std::string_view data)
+    {
+        reply.append(data);
+    }
+
+    /// @brief Queue a bulk string reply.
+    void addReplyBulk(std::string_view value)
+    {
+        addReplyBulkHeader(value.size());
+        reply.append(value);
+        reply.append("\r\n");
+    }
+
+    /// @brief Queue a bulk string reply; large values are referenced rather than copied.
+    void addReplyBulk(const SharedString &value)
+    {
+        if (value->size() < ReplyBuffer::REF_THRESHOLD)
+        {
+            addReplyBulk(std::string_view(*value));
+            return;
+        }
+        addReplyBulkHeader(value->size());
+        reply.appendRef(value);
+        reply.append("\r\n");
+    }
+
+    void addReplyNull()
+    {
+        reply.append("$-1\r\n");
+    }
+
+    void addReplyInteger(long long value)
+    {
+        addReplyPrefixed(':', value);
+    }
+
+    void addReplyArrayLen(long long len)
+    {
+        addReplyPrefixed('*', len);
+    }
+
+    /// @brief How many bytes the next read should ask for.
+    /// While a frame of known size is pending, enough to receive it whole, so its bytes land in
+    /// their final place without the buffer growing (and copying) step by step.
+    size_t readSize() const
+    {
+        if (query_need > query.size())
+            return std::max(READ_CHUNK, query_need - query.size());
+        return READ_CHUNK;
+    }
+
+    /// @brief Receive into the query buffer.
+    /// @return recv()'s result.
+    ssize_t readQuery()
+    {
+        size_t n = readSize();
+        ssize_t received = recv(fd, query.prepare(n), n, 0);
+        if (received > 0)
+            query.commit(static_cast<size_t>(received));
+        return received;
+    }
+
+    /// @brief Queue bytes for this client from a thread that does not own it, e.g. commands propagated to a replica.
+    /// They go out behind the replies already queued, written by the client's own loop.
+    void queueOutput(std::string_view data)
+    {
+        bool first;
+        {
+            std::lock_guard lock(outbox_mutex_);
+            first = outbox_.empty();
+            outbox_.append(data);
+        }
+        if (first && notify_output)
+            notify_output();
+    }
+
+    /// @brief Move the bytes other threads queued behind the replies. Only the owning loop calls this.
+    void takeOutput()
+    {
+        std::lock_guard lock(outbox_mutex_);
+        if (outbox_.empty())
+            return;
+        reply.append(outbox_);
+        outbox_.clear();
+    }
+
+    bool hasPendingReplies() const
+    {
+        return !reply.empty();
+    }
+
+    /// @brief Write as much of the pending replies as the socket accepts, gathering them with writev.
+    /// @return false on a fatal socket error, true otherwise (including EAGAIN on a non-blocking socket).
+    bool flushReplies()
+    {
+        iovec iov[ReplyBuffer::MAX_IOV];
+        while (hasPendingReplies())
+        {
+            msghdr msg{};
+            msg.msg_iov = iov;
+            msg.msg_iovlen = reply.fillIov(iov, ReplyBuffer::MAX_IOV);
+            // sendmsg rather than writev so a closed peer gives EPIPE instead of SIGPIPE.
+            ssize_t n = sendmsg(fd, &msg, MSG_NOSIGNAL);
+            if (n < 0)
+            {
+                if (errno == EINTR)
+                    continue;
+                return errno == EAGAIN || errno == EWOULDBLOCK;
+            }
+            reply.consume(n);
+        }
+        return true;
+    }
+
+private:
+    std::mutex outbox_mutex_;
+    std::string outbox_; // Filled by queueOutput(), drained by takeOutput().
+
+    void addReplyBulkHeader(size_t len)
+    {
+        addReplyPrefixed('$', static_cast<long long>(len));
+    }
+
+    void addReplyPrefixed(char prefix, long long value)
+    {
+        char header[32];
+        header[0] = prefix;
+        char *end = std::to_chars(header + 1, header + sizeof(header) - 2, value).ptr;
+        *end++ = '\r';
+        *end++ = '\n';
+        reply.append(std::string_view(header, end - header));
+    }
+};
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <cctype>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/// @brief Arguments of the command being executed, the command name first.
+/// They are views into the client's query buffer and stay valid until the handler returns;
+/// a handler copies whatever it keeps (e.g. SET copies the value once, into the keyspace).
+class CommandArgs
+{
+public:
+    explicit CommandArgs(const std::vector<std::string_view> &argv) : argv_(argv) {}
+
+    size_t size() const
+    {
+        return argv_.size();
+    }
+
+    std::string_view operator[](size_t i) const
+    {
+        return argv_[i];
+    }
+
+    std::string_view name() const
+    {
+        return argv_[0];
+    }
+
+    /// @brief Copy an argument, for values that outlive the command.
+    std::string str(size_t i) const
+    {
+        return std::string(argv_[i]);
+    }
+
+    /// @brief Case-insensitive comparison of an argument with an (ASCII) keyword such as "PX".
+    bool equalsIgnoreCase(size_t i, std::string_view word) const
+    {
+        std::string_view arg = argv_[i];
+        if (arg.size() != word.size())
+            return false;
+        for (size_t j = 0; j < arg.size(); ++j)
+        {
+            if (std::tolower(static_cast<unsigned char>(arg[j])) != std::tolower(static_cast<unsigned char>(word[j])))
+                return false;
+        }
+        return true;
+    }
+
+    auto begin() const
+    {
+        return argv_.begin();
+    }
+
+    auto end() const
+    {
+        return argv_.end();
+    }
+
+private:
+    const std::vector<std::string_view> &argv_;
+};
@@ -0,0 +1,107 @@
+#pragma once
+
+#include <array>
+#include <bit>
+#include <cstdint>
+#include <stdexcept>
+#include <string_view>
+
+/// @brief Flags of a command, as reported by COMMAND INFO.
+enum CommandFlags : uint32_t
+{
+    CMD_WRITE = 1 << 0,    // May modify the keyspace; propagated to replicas.
+    CMD_READONLY = 1 << 1, // Only reads the keyspace.
+    CMD_ADMIN = 1 << 2,    // Server administration, e.g. replication.
+    CMD_FAST = 1 << 3,     // O(1) or O(log N).
+    CMD_DENYOOM = 1 << 4,  // May use more memory; refused while over maxmemory.
+};
+
+/// @brief Immutable command table with case-insensitive O(1) lookup by name.
+/// The open addressing index is built at compile time; a name collision or an
+/// undersized index is a compile error.
+/// @tparam Command entry type with a `std::string_view name` member.
+template <typename Command, size_t N>
+class CommandTable
+{
+public:
+    constexpr explicit CommandTable(const Command (&commands)[N])
+    {
+        for (size_t i = 0; i < N; ++i)
+        {
+            commands_[i] = commands[i];
+            size_t slot = hash(commands[i].name) & (SLOTS - 1);
+            while (slots_[slot] != 0)
+            {
+                if (equalsIgnoreCase(commands_[slots_[slot] - 1].name, commands[i].name))
+                    throw std::logic_error("duplicate command name");
+                slot = (slot + 1) & (SLOTS - 1);
+            }
+            slots_[slot] = static_cast<uint16_t>(i + 1);
+        }
+    }
+
+    /// @return the command called `name` (any case), or nullptr.
+    constexpr const Command *find(std::string_view name) const
+    {
+        size_t slot = hash(name) & (SLOTS - 1);
+        while (slots_[slot] != 0)
+        {
+            const Command &cmd = commands_[slots_[slot] - 1];
+            if (equalsIgnoreCase(cmd.name, name))
+                return &cmd;
+            slot = (slot + 1) & (SLOTS - 1);
+        }
+        return nullptr;
+    }
+
+    constexpr size_t size() const
+    {
+        return N;
+    }
+
+    constexpr auto begin() const
+    {
+        return commands_.begin();
+    }
+
+    constexpr auto end() const
+    {
+        return commands_.end();
+    }
+
+private:
+    // At most half full, so probe sequences stay short.
+    static constexpr size_t SLOTS = std::bit_ceil(N * 2);
+
+    std::array<Command, N> commands_{};
+    std::array<uint16_t, SLOTS> slots_{}; // Index + 1 into commands_, 0 for an empty slot.
+
+    static constexpr char toLower(char ch)
+    {
+        return ch >= 'A' && ch <= 'Z' ? static_cast<char>(ch + ('a' - 'A')) : ch;
+    }
+
+    /// Case-folded FNV-1a.
+    static constexpr uint32_t hash(std::string_view name)
+    {
+        uint32_t h = 2166136261u;
+        for (char ch : name)
+        {
+            h ^= static_cast<unsigned char>(toLower(ch));
+            h *= 16777619u;
+        }
+        return h;
+    }
+
+    static constexpr bool equalsIgnoreCase(std::string_view a, std::string_view b)
+    {
+        if (a.size() != b.size())
+            return false;
+        for (size_t i = 0; i < a.size(); ++i)
+        {
+            if (toLower(a[i]) != toLower(b[i]))
+                return false;
+        }
+        return true;
+    }
+};
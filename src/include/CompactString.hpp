@@ -0,0 +1,128 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+
+/// @brief 24-byte string that keeps up to INLINE_CAPACITY bytes inside the object itself.
+/// Longer strings live in one exactly sized heap block. Used for dictionary keys, so a short
+/// key costs no allocation and is compared without leaving the slot's cache line.
+class CompactString
+{
+public:
+    static constexpr size_t INLINE_CAPACITY = 22;
+
+    CompactString()
+    {
+        raw_[TAG] = 0;
+    }
+
+    explicit CompactString(std::string_view s)
+    {
+        assign(s);
+    }
+
+    CompactString(const CompactString &other)
+    {
+        assign(other.view());
+    }
+
+    CompactString(CompactString &&other) noexcept
+    {
+        std::memcpy(raw_, other.raw_, sizeof(raw_));
+        other.raw_[TAG] = 0;
+    }
+
+    CompactString &operator=(const CompactString &other)
+    {
+        if (this != &other)
+        {
+            release();
+            assign(other.view());
+        }
+        return *this;
+    }
+
+    CompactString &operator=(CompactString &&other) noexcept
+    {
+        if (this != &other)
+        {
+            release();
+            std::memcpy(raw_, other.raw_, sizeof(raw_));
+            other.raw_[TAG] = 0;
+        }
+        return *this;
+    }
+
+    ~CompactString()
+    {
+        release();
+    }
+
+    std::string_view view() const
+    {
+        if (isInline())
+            return std::string_view(reinterpret_cast<const char *>(raw_), raw_[TAG]);
+        return std::string_view(heapPtr(), heapLen());
+    }
+
+    size_t size() const
+    {
+        return isInline() ? raw_[TAG] : heapLen();
+    }
+
+    bool isInline() const
+    {
+        return raw_[TAG] != HEAP_TAG;
+    }
+
+    /// @return bytes allocated outside the object.
+    size_t heapBytes() const
+    {
+        return isInline() ? 0 : heapLen();
+    }
+
+private:
+    static constexpr size_t TAG = 23; // Last byte: inline length, or HEAP_TAG.
+    static constexpr unsigned char HEAP_TAG = 0xFF;
+
+    // Inline: bytes [0, 22) hold the data. Heap: pointer in [0, 8), length in [8, 16).
+    alignas(8) unsigned char raw_[24];
+
+    void assign(std::string_view s)
+    {
+        if (s.size() <= INLINE_CAPACITY)
+        {
+            std::memcpy(raw_, s.data(), s.size());
+            raw_[TAG] = static_cast<unsigned char>(s.size());
+            return;
+        }
+        char *p = new char[s.size()];
+        std::memcpy(p, s.data(), s.size());
+        size_t len = s.size();
+        std::memcpy(raw_, &p, sizeof(p));
+        std::memcpy(raw_ + 8, &len, sizeof(len));
+        raw_[TAG] = HEAP_TAG;
+    }
+
+    void release()
+    {
+        if (!isInline())
+            delete[] heapPtr();
+        raw_[TAG] = 0;
+    }
+
+    char *heapPtr() const
+    {
+        char *p;
+        std::memcpy(&p, raw_, sizeof(p));
+        return p;
+    }
+
+    size_t heapLen() const
+    {
+        size_t len;
+        std::memcpy(&len, raw_ + 8, sizeof(len));
+        return len;
+    }
+};
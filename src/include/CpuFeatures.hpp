@@ -0,0 +1,25 @@
+#pragma once
+
+/// @brief Instruction set extensions of the CPU the server runs on, probed once.
+/// The build targets baseline x86-64, so kernels that need more are compiled with
+/// __attribute__((target(...))) and chosen at run time from these flags.
+struct CpuFeatures
+{
+#if defined(__x86_64__)
+    bool popcnt = __builtin_cpu_supports("popcnt");
+    bool ssse3 = __builtin_cpu_supports("ssse3");
+    bool sse41 = __builtin_cpu_supports("sse4.1");
+    bool avx2 = __builtin_cpu_supports("avx2");
+#else
+    bool popcnt = false;
+    bool ssse3 = false;
+    bool sse41 = false;
+    bool avx2 = false;
+#endif
+
+    static const CpuFeatures &get()
+    {
+        static const CpuFeatures features;
+        return features;
+    }
+};
@@ -0,0 +1,583 @@
+#pragma once
+
+#include <bit>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <new>
+#include <string_view>
+#include <utility>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#include "CompactString.hpp"
+
+/// @brief Open addressing hash table from string keys to V, laid out like a Swiss table.
+/// Every slot has a control byte holding 7 bits of the key's hash (or EMPTY / DELETED). A lookup
+/// compares a whole group of 16 control bytes with one SSE2 instruction and only touches the slots
+/// whose byte matches, so most misses never read a key. Keys and values sit directly in a flat slot
+/// array (short keys inside the slot, see CompactString): no per-entry node, no pointer chasing.
+///
+/// Resizing never moves every entry at once. A bigger table (or a smaller one, once erases leave the
+/// table mostly empty) is allocated next to the old one and entries migrate a few groups at a time:
+/// on every insert/erase and from rehashStep(), which the server calls when it has spare time. Until
+/// the old table is drained, lookups search both.
+template <typename V>
+class Dict
+{
+public:
+    /// Old-table groups migrated by every insert or erase while rehashing.
+    static constexpr size_t REHASH_GROUPS_PER_OP = 1;
+
+    Dict() = default;
+    Dict(const Dict &) = delete;
+    Dict &operator=(const Dict &) = delete;
+
+    ~Dict()
+    {
+        table_.destroy();
+        old_.destroy();
+    }
+
+    static size_t hashKey(std::string_view key)
+    {
+        return std::hash<std::string_view>{}(key);
+    }
+
+    size_t size() const
+    {
+        return size_;
+    }
+
+    size_t capacity() const
+    {
+        return table_.capacity;
+    }
+
+    bool isRehashing() const
+    {
+        return old_.ctrl != nullptr;
+    }
+
+    /// @return bytes held by the tables: control bytes, slots and out-of-line keys.
+    size_t memoryUsage() const
+    {
+        return (table_.capacity + old_.capacity) * (1 + sizeof(Slot)) + key_heap_bytes_;
+    }
+
+    /// @return bytes held by the entries themselves: their slots and out-of-line keys, not the free slots.
+    size_t entryMemoryUsage() const
+    {
+        return size_ * (1 + sizeof(Slot)) + key_heap_bytes_;
+    }
+
+    /// @param hash hashKey(key), when the caller already has it.
+    V *find(std::string_view key, size_t hash)
+    {
+        Slot *slot = findSlot(key, hash);
+        return slot == nullptr ? nullptr : &slot->value;
+    }
+
+    V *find(std::string_view key)
+    {
+        return find(key, hashKey(key));
+    }
+
+    const V *find(std::string_view key, size_t hash) const
+    {
+        const Slot *slot = findSlot(key, hash);
+        return slot == nullptr ? nullptr : &slot->value;
+    }
+
+    const V *find(std::string_view key) const
+    {
+        return find(key, hashKey(key));
+    }
+
+    /// @brief First step of a batched lookup: start loading the control bytes of the group `hash`
+    /// probes first, in both tables while rehashing. Lookups of many keys call this for all of them
+    /// before probing any, so their cache misses overlap instead of adding up.
+    void prefetch(size_t hash) const
+    {
+        table_.prefetchGroup(hash);
+        if (isRehashing())
+            old_.prefetchGroup(hash);
+    }
+
+    /// @brief Second step, once prefetch() had time to land: start loading the slots of that group
+    /// whose control byte matches the hash, i.e. the keys a lookup compares.
+    void prefetchSlots(size_t hash) const
+    {
+        table_.prefetchMatches(hash);
+        if (isRehashing())
+            old_.prefetchMatches(hash);
+    }
+
+    /// @brief Find `key`, inserting it with a default constructed value when it is missing.
+    /// @return the key's value and whether it was inserted.
+    std::pair<V *, bool> tryEmplace(std::string_view key, size_t hash)
+    {
+        if (isRehashing())
+            rehashGroups(REHASH_GROUPS_PER_OP);
+        if (Slot *slot = findSlot(key, hash))
+            return {&slot->value, false};
+        if (table_.growth_left == 0)
+            grow();
+        size_t i = table_.findInsertIndex(hash);
+        Slot *slot = table_.place(i, hash, CompactString(key), V{});
+        key_heap_bytes_ += slot->key.heapBytes();
+        ++size_;
+        return {&slot->value, true};
+    }
+
+    std::pair<V *, bool> tryEmplace(std::string_view key)
+    {
+        return tryEmplace(key, hashKey(key));
+    }
+
+    /// @return true if the key existed.
+    bool erase(std::string_view key, size_t hash)
+    {
+        if (isRehashing())
+            rehashGroups(REHASH_GROUPS_PER_OP);
+        for (Table *table : {&table_, &old_})
+        {
+            size_t i = table->findIndex(key, hash);
+            if (i == NPOS)
+                continue;
+            key_heap_bytes_ -= table->slots[i].key.heapBytes();
+            table->erase(i);
+            --size_;
+            if (!isRehashing() && table_.capacity > GROUP && size_ * 8 < table_.capacity)
+                shrink();
+            return true;
+        }
+        return false;
+    }
+
+    bool erase(std::string_view key)
+    {
+        return erase(key, hashKey(key));
+    }
+
+    /// @brief Migrate up to `groups` groups of the old table.
+    /// @return true while a rehash is still in progress.
+    bool rehashStep(size_t groups)
+    {
+        if (isRehashing())
+            rehashGroups(groups);
+        return isRehashing();
+    }
+
+    /// @brief Call fn(std::string_view key, V &value) for every entry.
+    template <typename F>
+    void forEach(F &&fn)
+    {
+        for (Table *table : {&table_, &old_})
+        {
+            for (size_t i = 0; i < table->capacity; ++i)
+            {
+                if (table->ctrl[i] >= 0)
+                    fn(table->slots[i].key.view(), table->slots[i].value);
+            }
+        }
+    }
+
+    template <typename F>
+    void forEach(F &&fn) const
+    {
+        for (const Table *table : {&table_, &old_})
+        {
+            for (size_t i = 0; i < table->capacity; ++i)
+            {
+                if (table->ctrl[i] >= 0)
+                    fn(table->slots[i].key.view(), static_cast<const V &>(table->slots[i].value));
+            }
+        }
+    }
+
+    /// @brief Call fn(std::string_view key, V &value) for the entries of one group, to walk the dict a
+    /// little at a time (e.g. the active expire cycle). fn must not insert or erase.
+    /// An entry moved by the incremental rehash between two calls may be missed until the next round.
+    /// @param cursor 0 to start a round, otherwise the value returned by the previous call.
+    /// @return the cursor of the next group, 0 once the round is complete.
+    template <typename F>
+    size_t scan(size_t cursor, F &&fn)
+    {
+        size_t groups = table_.capacity / GROUP;
+        if (cursor >= groups)
+            return 0;
+        for (Table *table : {&table_, &old_})
+        {
+            if (cursor >= table->capacity / GROUP)
+                continue;
+            for (size_t i = cursor * GROUP; i < (cursor + 1) * GROUP; ++i)
+            {
+                if (table->ctrl[i] >= 0)
+                    fn(table->slots[i].key.view(), table->slots[i].value);
+            }
+        }
+        return cursor + 1 == groups ? 0 : cursor + 1;
+    }
+
+    /// @brief Call fn(std::string_view key, const V &value) for the entries of one step of a full walk
+    /// that survives resizing, like redis' dictScan, for SCAN and its kin. A step covers the entries
+    /// whose probe sequence starts at the cursor's group, wherever the probe placed them. Cursors
+    /// count group numbers with their bits reversed, so when the table doubles or halves between two
+    /// calls, the groups already walked map onto a prefix of the new order: every entry present for
+    /// the whole walk is passed at least once, some may be passed twice. While rehashing, a step covers
+    /// the cursor's group in the smaller table and every group it maps to in the larger one.
+    /// fn must not insert or erase.
+    /// @param cursor 0 to start a walk, otherwise the value returned by the previous call.
+    /// @return the cursor of the next step, 0 once the walk is complete.
+    template <typename F>
+    size_t stableScan(size_t cursor, F &&fn) const
+    {
+        if (size_ == 0)
+            return 0;
+        if (!isRehashing())
+        {
+            size_t mask = table_.capacity / GROUP - 1;
+            table_.forEachHomedAt(cursor & mask, fn);
+            return nextCursor(cursor, mask);
+        }
+        const Table *small = &table_;
+        const Table *large = &old_;
+        if (small->capacity > large->capacity)
+            std::swap(small, large);
+        size_t small_mask = small->capacity / GROUP - 1;
+        size_t large_mask = large->capacity / GROUP - 1;
+        small->forEachHomedAt(cursor & small_mask, fn);
+        do
+        {
+            large->forEachHomedAt(cursor & large_mask, fn);
+            cursor = nextCursor(cursor, large_mask);
+        } while ((cursor & (small_mask ^ large_mask)) != 0);
+        return cursor;
+    }
+
+    /// @brief Call fn(std::string_view key, V &value) for up to `count` entries, starting at a random
+    /// group, to sample the dict (e.g. for eviction). fn must not insert or erase.
+    /// @param random any random number; it picks the starting group.
+    /// @return number of entries passed to fn.
+    template <typename F>
+    size_t sample(size_t count, size_t random, F &&fn)
+    {
+        size_t groups = table_.capacity / GROUP;
+        if (groups == 0 || size_ == 0)
+            return 0;
+        size_t seen = 0;
+        size_t cursor = random % groups;
+        // A sparse table may need many groups for a few entries; like redis' dictGetSomeKeys, give up eventually.
+        for (size_t visited = 0; visited < groups && visited < count * 10 && seen < count; ++visited)
+        {
+            cursor = scan(cursor, [&](std::string_view key, V &value)
+                          {
+                              if (seen < count)
+                              {
+                                  fn(key, value);
+                                  ++seen;
+                              } });
+        }
+        return seen;
+    }
+
+    void clear()
+    {
+        table_.destroy();
+        old_.destroy();
+        table_ = Table{};
+        old_ = Table{};
+        size_ = key_heap_bytes_ = rehash_pos_ = 0;
+    }
+
+private:
+    static constexpr size_t GROUP = 16;
+    static constexpr size_t NPOS = static_cast<size_t>(-1);
+    static constexpr int8_t EMPTY = -128;
+    static constexpr int8_t DELETED = -2;
+
+    struct Slot
+    {
+        CompactString key;
+        [[no_unique_address]] V value; // An empty V, as in a StringSet, takes no room.
+    };
+
+    static int8_t h2(size_t hash)
+    {
+        return static_cast<int8_t>(hash & 0x7F);
+    }
+
+    static size_t h1(size_t hash)
+    {
+        return hash >> 7;
+    }
+
+    /// @brief Add one to the bits of `cursor` under `mask`, carrying from the highest bit down.
+    static size_t nextCursor(size_t cursor, size_t mask)
+    {
+        cursor |= ~mask;
+        return reverseBits(reverseBits(cursor) + 1);
+    }
+
+    static size_t reverseBits(size_t v)
+    {
+        static_assert(sizeof(size_t) == 8);
+        v = ((v >> 1) & 0x5555555555555555ULL) | ((v & 0x5555555555555555ULL) << 1);
+        v = ((v >> 2) & 0x3333333333333333ULL) | ((v & 0x3333333333333333ULL) << 2);
+        v = ((v >> 4) & 0x0F0F0F0F0F0F0F0FULL) | ((v & 0x0F0F0F0F0F0F0F0FULL) << 4);
+        return __builtin_bswap64(v);
+    }
+
+    /// GCC treats a function whose only effect is __builtin_prefetch as pure and deletes calls to
+    /// it, so the prefetch helpers below go through a volatile asm where one is available.
+    static void prefetchLine(const void *address)
+    {
+#if defined(__x86_64__) || defined(__i386__)
+        asm volatile("prefetcht0 %0" : : "m"(*static_cast<const char *>(address)));
+#else
+        __builtin_prefetch(address);
+#endif
+    }
+
+#if defined(__SSE2__)
+    static uint32_t matchByte(const int8_t *group, int8_t value)
+    {
+        __m128i ctrl = _mm_load_si128(reinterpret_cast<const __m128i *>(group));
+        return static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(ctrl, _mm_set1_epi8(value))));
+    }
+
+    /// EMPTY and DELETED are the only negative control bytes below -1.
+    static uint32_t matchEmptyOrDeleted(const int8_t *group)
+    {
+        __m128i ctrl = _mm_load_si128(reinterpret_cast<const __m128i *>(group));
+        return static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpgt_epi8(_mm_set1_epi8(-1), ctrl)));
+    }
+#else
+    static uint32_t matchByte(const int8_t *group, int8_t value)
+    {
+        uint32_t mask = 0;
+        for (size_t i = 0; i < GROUP; ++i)
+            mask |= static_cast<uint32_t>(group[i] == value) << i;
+        return mask;
+    }
+
+    static uint32_t matchEmptyOrDeleted(const int8_t *group)
+    {
+        uint32_t mask = 0;
+        for (size_t i = 0; i < GROUP; ++i)
+            mask |= static_cast<uint32_t>(group[i] < -1) << i;
+        return mask;
+    }
+#endif
+
+    static uint32_t matchEmpty(const int8_t *group)
+    {
+        return matchByte(group, EMPTY);
+    }
+
+    /// @brief One slot array with its control bytes. Dict owns the memory and frees it with destroy().
+    struct Table
+    {
+        int8_t *ctrl = nullptr; // One byte per slot: EMPTY, DELETED or the H2 bits of the slot's key.
+        Slot *slots = nullptr;
+        size_t capacity = 0;    // 0 or a power of two, at least GROUP.
+        size_t growth_left = 0; // EMPTY slots that may still be filled before the table is replaced (max load 7/8).
+
+        static Table allocate(size_t capacity)
+        {
+            Table t;
+            t.ctrl = static_cast<int8_t *>(::operator new(capacity, std::align_val_t(GROUP)));
+            std::memset(t.ctrl, EMPTY, capacity);
+            t.slots = static_cast<Slot *>(::operator new(capacity * sizeof(Slot), std::align_val_t(alignof(Slot))));
+            t.capacity = capacity;
+            t.growth_left = capacity - capacity / 8;
+            return t;
+        }
+
+        /// Groups are visited in triangular order, which reaches every group of a power-of-two table.
+        size_t findIndex(std::string_view key, size_t hash) const
+        {
+            if (capacity == 0)
+                return NPOS;
+            size_t mask = capacity / GROUP - 1;
+            size_t group = h1(hash) & mask;
+            int8_t tag = h2(hash);
+            for (size_t step = 1;; ++step)
+            {
+                const int8_t *group_ctrl = ctrl + group * GROUP;
+                for (uint32_t match = matchByte(group_ctrl, tag); match != 0; match &= match - 1)
+                {
+                    size_t i = group * GROUP + std::countr_zero(match);
+                    if (slots[i].key.view() == key)
+                        return i;
+                }
+                if (matchEmpty(group_ctrl) != 0)
+                    return NPOS;
+                group = (group + step) & mask;
+            }
+        }
+
+        void prefetchGroup(size_t hash) const
+        {
+            if (capacity != 0)
+                prefetchLine(ctrl + (h1(hash) & (capacity / GROUP - 1)) * GROUP);
+        }
+
+        void prefetchMatches(size_t hash) const
+        {
+            if (capacity == 0)
+                return;
+            size_t group = h1(hash) & (capacity / GROUP - 1);
+            for (uint32_t match = matchByte(ctrl + group * GROUP, h2(hash)); match != 0; match &= match - 1)
+            {
+                // A slot may straddle two cache lines.
+                const Slot *slot = &slots[group * GROUP + std::countr_zero(match)];
+                prefetchLine(slot);
+                prefetchLine(reinterpret_cast<const char *>(slot + 1) - 1);
+            }
+        }
+
+        /// @brief Call fn(key, value) for the entries whose probe sequence starts at group `home`.
+        /// An insert takes the first free slot on the sequence and findIndex() stops at the first group
+        /// with an EMPTY byte, so they all sit in the groups up to that one.
+        template <typename F>
+        void forEachHomedAt(size_t home, F &fn) const
+        {
+            size_t mask = capacity / GROUP - 1;
+            size_t group = home;
+            for (size_t step = 1;; ++step)
+            {
+                for (size_t i = group * GROUP; i < (group + 1) * GROUP; ++i)
+                {
+                    if (ctrl[i] >= 0 && (h1(hashKey(slots[i].key.view())) & mask) == home)
+                        fn(slots[i].key.view(), static_cast<const V &>(slots[i].value));
+                }
+                if (matchEmpty(ctrl + group * GROUP) != 0)
+                    return;
+                group = (group + step) & mask;
+            }
+        }
+
+        /// @return the first EMPTY or DELETED slot on the hash's probe sequence.
+        size_t findInsertIndex(size_t hash) const
+        {
+            size_t mask = capacity / GROUP - 1;
+            size_t group = h1(hash) & mask;
+            for (size_t step = 1;; ++step)
+            {
+                uint32_t free = matchEmptyOrDeleted(ctrl + group * GROUP);
+                if (free != 0)
+                    return group * GROUP + std::countr_zero(free);
+                group = (group + step) & mask;
+            }
+        }
+
+        Slot *place(size_t i, size_t hash, CompactString &&key, V &&value)
+        {
+            if (ctrl[i] == EMPTY)
+                --growth_left;
+            ctrl[i] = h2(hash);
+            return new (&slots[i]) Slot{std::move(key), std::move(value)};
+        }
+
+        void erase(size_t i)
+        {
+            slots[i].~Slot();
+            // A probe only moves past a group that has no EMPTY byte. If this group still has one, no key
+            // was ever placed beyond it on its account, so the slot can become EMPTY again instead of a tombstone.
+            if (matchEmpty(ctrl + i / GROUP * GROUP) != 0)
+            {
+                ctrl[i] = EMPTY;
+                ++growth_left;
+            }
+            else
+            {
+                ctrl[i] = DELETED;
+            }
+        }
+
+        void destroy()
+        {
+            if (ctrl == nullptr)
+                return;
+            for (size_t i = 0; i < capacity; ++i)
+            {
+                if (ctrl[i] >= 0)
+                    slots[i].~Slot();
+            }
+            ::operator delete(ctrl, std::align_val_t(GROUP));
+            ::operator delete(slots, std::align_val_t(alignof(Slot)));
+        }
+    };
+
+    Table table_;           // Receives every insert.
+    Table old_;             // Being drained into table_ while rehashing, empty otherwise.
+    size_t rehash_pos_ = 0; // Slots of old_ below this index have been migrated.
+    size_t size_ = 0;       // Entries in both tables.
+    size_t key_heap_bytes_ = 0;
+
+    Slot *findSlot(std::string_view key, size_t hash) const
+    {
+        size_t i = table_.findIndex(key, hash);
+        if (i != NPOS)
+            return &table_.slots[i];
+        if (isRehashing())
+        {
+            i = old_.findIndex(key, hash);
+            if (i != NPOS)
+                return &old_.slots[i];
+        }
+        return nullptr;
+    }
+
+    /// @brief Start replacing the table: twice as large, or the same size when tombstones used up the room.
+    /// The old entries fill at most half of the new table, and each operation drains a group of the old
+    /// table while adding at most one entry, so the new table cannot fill up before the old one is empty.
+    void grow()
+    {
+        if (isRehashing())
+            rehashGroups(old_.capacity / GROUP); // Not reached by the bound above; kept as a safety net.
+        size_t capacity = table_.capacity == 0 ? GROUP : table_.capacity;
+        if (size_ + 1 > capacity / 2)
+            capacity *= 2;
+        startRehash(capacity);
+    }
+
+    /// @brief Start replacing a table that is less than 1/8 full with one half as large. The old
+    /// entries fill at most a quarter of the new table, so the bound of grow() holds here too.
+    void shrink()
+    {
+        startRehash(table_.capacity / 2);
+    }
+
+    void startRehash(size_t capacity)
+    {
+        old_ = table_;
+        table_ = Table::allocate(capacity);
+        rehash_pos_ = 0;
+    }
+
+    /// @brief Move every entry of the next `groups` old-table groups into the new table.
+    void rehashGroups(size_t groups)
+    {
+        size_t end = std::min(old_.capacity, rehash_pos_ + groups * GROUP);
+        for (; rehash_pos_ < end; ++rehash_pos_)
+        {
+            if (old_.ctrl[rehash_pos_] < 0)
+                continue;
+            Slot &slot = old_.slots[rehash_pos_];
+            size_t hash = hashKey(slot.key.view());
+            table_.place(table_.findInsertIndex(hash), hash, std::move(slot.key), std::move(slot.value));
+            slot.~Slot();
+            // A tombstone keeps the probe chains of the old entries not migrated yet intact.
+            old_.ctrl[rehash_pos_] = DELETED;
+        }
+        if (rehash_pos_ == old_.capacity)
+        {
+            old_.destroy();
+            old_ = Table{};
+            rehash_pos_ = 0;
+        }
+    }
+};
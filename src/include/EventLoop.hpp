@@ -0,0 +1,293 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include <iostream>
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include "Client.hpp"
+
+/// @brief Edge-triggered epoll reactor that owns a listening socket and every client accepted from it.
+/// A client left blocked by a command (Client::blocked) is handed to the read handler again once it
+/// is woken, through an eventfd any thread may write, or once its deadline passes. The same eventfd
+/// tells the loop that another thread queued output for one of its clients (Client::queueOutput()).
+class EventLoop
+{
+public:
+    /// Called after bytes were read into a client's query buffer, and when a blocked client is due.
+    /// Replies are queued on the client and flushed by the loop.
+    using ReadHandler = std::function<void(Client &)>;
+    /// Called before a client is closed.
+    using CloseHandler = std::function<void(Client &)>;
+
+    EventLoop(int listen_fd, ReadHandler on_read, CloseHandler on_close) : listen_fd_(listen_fd), on_read_(std::move(on_read)), on_close_(std::move(on_close))
+    {
+        epoll_fd_ = epoll_create1(EPOLL_CLOEXEC);
+        if (epoll_fd_ < 0)
+        {
+            std::cerr << "epoll_create1 failed\n";
+            std::exit(EXIT_FAILURE);
+        }
+        setNonBlocking(listen_fd_);
+        epoll_event ev{};
+        ev.events = EPOLLIN | EPOLLET;
+        ev.data.fd = listen_fd_;
+        if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, listen_fd_, &ev) < 0)
+        {
+            std::cerr << "epoll_ctl failed for listening socket\n";
+            std::exit(EXIT_FAILURE);
+        }
+        wake_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        ev.events = EPOLLIN | EPOLLET;
+        ev.data.fd = wake_fd_;
+        if (wake_fd_ < 0 || epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, wake_fd_, &ev) < 0)
+        {
+            std::cerr << "Failed to set up the wake-up eventfd\n";
+            std::exit(EXIT_FAILURE);
+        }
+    }
+
+    ~EventLoop()
+    {
+        for (auto &[fd, client] : clients_)
+            on_close_(*client);
+        clients_.clear();
+        if (wake_fd_ != -1)
+        {
+            close(wake_fd_);
+        }
+        if (epoll_fd_ != -1)
+        {
+            close(epoll_fd_);
+        }
+    }
+
+    EventLoop(const EventLoop &) = delete;
+    EventLoop &operator=(const EventLoop &) = delete;
+
+    static void setNonBlocking(int fd)
+    {
+        int flags = fcntl(fd, F_GETFL, 0);
+        fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+    }
+
+    /// @brief Run the reactor forever.
+    void run()
+    {
+        epoll_event events[MAX_EVENTS];
+        while (true)
+        {
+            int n = epoll_wait(epoll_fd_, events, MAX_EVENTS, blockedTimeoutMs());
+            if (n < 0)
+            {
+                if (errno == EINTR)
+                    continue;
+                std::cerr << "epoll_wait failed\n";
+                std::exit(EXIT_FAILURE);
+            }
+            for (int i = 0; i < n; ++i)
+            {
+                int fd = events[i].data.fd;
+                if (fd == listen_fd_)
+                {
+                    acceptClients();
+                    continue;
+                }
+                if (fd == wake_fd_)
+                {
+                    uint64_t count;
+                    while (read(wake_fd_, &count, sizeof(count)) > 0)
+                    {
+                    }
+                    takePostedOutput();
+                    continue;
+                }
+                auto it = clients_.find(fd);
+                if (it == clients_.end())
+                    continue;
+                Client &client = *it->second;
+                uint32_t ev = events[i].events;
+                bool alive = !(ev & (EPOLLERR | EPOLLHUP));
+                if (alive && (ev & EPOLLIN))
+                    alive = readFromClient(client);
+                if (!alive)
+                {
+                    closeClient(fd);
+                    continue;
+                }
+                if (client.blocked.active)
+                    blocked_.insert(fd);
+                // Fresh replies (EPOLLIN) and a drained socket buffer (EPOLLOUT) both mean there may be something to write.
+                pending_writes_.push_back(fd);
+            }
+            if (!blocked_.empty())
+                serveBlockedClients();
+            handlePendingWrites();
+        }
+    }
+
+private:
+    static constexpr int MAX_EVENTS = 1024;
+
+    int listen_fd_;
+    int epoll_fd_ = -1;
+    int wake_fd_ = -1; // Written by Client::wake() and Client::notify_output from any thread.
+    ReadHandler on_read_;
+    CloseHandler on_close_;
+    std::unordered_map<int, std::unique_ptr<Client>> clients_;
+    std::vector<int> pending_writes_; // Clients to flush before the next epoll_wait.
+    std::unordered_set<int> blocked_; // Clients waiting in a blocking command.
+    std::mutex posted_mutex_;
+    std::vector<int> posted_; // Clients other threads queued output for, see Client::notify_output.
+
+    /// @return how long epoll_wait may sleep before a blocked client times out, -1 for no limit.
+    int blockedTimeoutMs()
+    {
+        auto deadline = std::chrono::steady_clock::time_point::max();
+        for (int fd : blocked_)
+            deadline = std::min(deadline, clients_[fd]->blocked.deadline);
+        if (deadline == std::chrono::steady_clock::time_point::max())
+            return -1;
+        auto left = std::chrono::ceil<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now());
+        return static_cast<int>(std::clamp<long long>(left.count(), 0, INT32_MAX));
+    }
+
+    /// @brief Run the blocked commands of the clients that were woken or timed out.
+    void serveBlockedClients()
+    {
+        auto now = std::chrono::steady_clock::now();
+        for (auto it = blocked_.begin(); it != blocked_.end();)
+        {
+            Client &client = *clients_[*it];
+            if (client.blocked.ready.load() || now >= client.blocked.deadline)
+            {
+                on_read_(client);
+                pending_writes_.push_back(*it);
+            }
+            it = client.blocked.active ? std::next(it) : blocked_.erase(it);
+        }
+    }
+
+    void acceptClients()
+    {
+        // Edge-triggered: drain the accept queue until EAGAIN.
+        while (true)
+        {
+            int fd = accept4(listen_fd_, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+            if (fd < 0)
+            {
+                if (errno == EINTR)
+                    continue;
+                if (errno != EAGAIN && errno != EWOULDBLOCK)
+                    std::cerr << "Failed to accept client connection\n";
+                return;
+            }
+            int one = 1;
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+            // EPOLLOUT is registered once; being edge-triggered it only fires when a full socket buffer drains.
+            epoll_event ev{};
+            ev.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+            ev.data.fd = fd;
+            if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &ev) < 0)
+            {
+                close(fd);
+                continue;
+            }
+            auto client = std::make_unique<Client>(fd);
+            client->wake = [wake_fd = wake_fd_]
+            {
+                uint64_t one = 1;
+                ssize_t written = write(wake_fd, &one, sizeof(one));
+                (void)written;
+            };
+            client->notify_output = [this, fd]
+            {
+                {
+                    std::lock_guard lock(posted_mutex_);
+                    posted_.push_back(fd);
+                }
+                uint64_t one = 1;
+                ssize_t written = write(wake_fd_, &one, sizeof(one));
+                (void)written;
+            };
+            clients_.emplace(fd, std::move(client));
+        }
+    }
+
+    /// @return false when the peer closed the connection or the socket failed.
+    bool readFromClient(Client &client)
+    {
+        while (true)
+        {
+            ssize_t n = client.readQuery();
+            if (n > 0)
+            {
+                on_read_(client);
+                if (client.close_asap)
+                    return true;
+                continue;
+            }
+            if (n == 0)
+                return false;
+            if (errno == EINTR)
+                continue;
+            return errno == EAGAIN || errno == EWOULDBLOCK;
+        }
+    }
+
+    /// @brief Move the output other threads queued for clients of this loop behind their replies, to be written with them.
+    /// A client closed meanwhile is skipped; another one that got its descriptor merely finds nothing to take.
+    void takePostedOutput()
+    {
+        std::vector<int> posted;
+        {
+            std::lock_guard lock(posted_mutex_);
+            posted.swap(posted_);
+        }
+        for (int fd : posted)
+        {
+            auto it = clients_.find(fd);
+            if (it == clients_.end())
+                continue;
+            it->second->takeOutput();
+            pending_writes_.push_back(fd);
+        }
+    }
+
+    /// @brief Write out the replies of every client served in this iteration: one gathered write per client.
+    /// Whatever the socket does not accept stays queued until EPOLLOUT reports it writable again.
+    void handlePendingWrites()
+    {
+        for (int fd : pending_writes_)
+        {
+            auto it = clients_.find(fd);
+            if (it == clients_.end())
+                continue;
+            Client &client = *it->second;
+            if (!client.flushReplies() || (client.close_asap && !client.hasPendingReplies()))
+                closeClient(fd);
+        }
+        pending_writes_.clear();
+    }
+
+    void closeClient(int fd)
+    {
+        epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, fd, nullptr);
+        auto it = clients_.find(fd);
+        if (it == clients_.end())
+            return;
+        on_close_(*it->second);
+        blocked_.erase(fd);
+        clients_.erase(it); // Client destructor closes the socket.
+    }
+};
@@ -0,0 +1,199 @@
+#pragma once
+
+#include <algorithm>
+#include <cctype>
+#include <charconv>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+/// @brief What to do when the keyspace grows past maxmemory, like redis' maxmemory-policy.
+enum class EvictionPolicy
+{
+    NoEviction,    // Reject commands that would use more memory.
+    AllKeysLru,    // Evict the least recently used key.
+    AllKeysLfu,    // Evict the least frequently used key.
+    AllKeysRandom, // Evict any key.
+    VolatileLru,   // Evict the least recently used key among the keys with a TTL.
+    VolatileTtl,   // Evict the key with a TTL that expires first.
+};
+
+inline constexpr std::pair<EvictionPolicy, std::string_view> EVICTION_POLICY_NAMES[] = {
+    {EvictionPolicy::NoEviction, "noeviction"},
+    {EvictionPolicy::AllKeysLru, "allkeys-lru"},
+    {EvictionPolicy::AllKeysLfu, "allkeys-lfu"},
+    {EvictionPolicy::AllKeysRandom, "allkeys-random"},
+    {EvictionPolicy::VolatileLru, "volatile-lru"},
+    {EvictionPolicy::VolatileTtl, "volatile-ttl"},
+};
+
+inline bool parseEvictionPolicy(std::string_view name, EvictionPolicy &policy)
+{
+    for (const auto &[value, policy_name] : EVICTION_POLICY_NAMES)
+    {
+        if (policy_name == name)
+        {
+            policy = value;
+            return true;
+        }
+    }
+    return false;
+}
+
+inline std::string_view evictionPolicyName(EvictionPolicy policy)
+{
+    for (const auto &[value, name] : EVICTION_POLICY_NAMES)
+    {
+        if (value == policy)
+            return name;
+    }
+    return "unknown";
+}
+
+/// @brief Parse a memory size such as "100mb" or "1gb", like redis' memtoull (kb/mb/gb are powers of 1024).
+inline bool parseMemorySize(std::string_view s, unsigned long long &bytes)
+{
+    std::string unit;
+    const char *end = s.data() + s.size();
+    auto [ptr, ec] = std::from_chars(s.data(), end, bytes);
+    if (ec != std::errc() || ptr == s.data())
+        return false;
+    for (; ptr != end; ++ptr)
+        unit += static_cast<char>(std::tolower(static_cast<unsigned char>(*ptr)));
+    const std::pair<std::string_view, unsigned long long> units[] = {
+        {"", 1}, {"b", 1}, {"k", 1000}, {"kb", 1024}, {"m", 1000 * 1000}, {"mb", 1024 * 1024}, {"g", 1000ULL * 1000 * 1000}, {"gb", 1024ULL * 1024 * 1024}};
+    for (const auto &[name, multiplier] : units)
+    {
+        if (unit == name)
+            return !__builtin_mul_overflow(bytes, multiplier, &bytes);
+    }
+    return false;
+}
+
+/// @brief Access tracking stored in the 24 access bits of every RedisObject.
+/// With an LRU policy they hold the time of the last access in LRU_CLOCK_RESOLUTION_MS units,
+/// with an LFU policy a 16-bit time in minutes of the last decrement and an 8-bit logarithmic
+/// access counter, exactly like redis' robj->lru field.
+namespace Eviction
+{
+    inline constexpr uint32_t LRU_CLOCK_MAX = (1 << 24) - 1;
+    inline constexpr long long LRU_CLOCK_RESOLUTION_MS = 100; // Wraps after about 19 days.
+    inline constexpr uint8_t LFU_INIT_VAL = 5;                // New keys get a chance to collect hits before being evicted.
+    inline constexpr int LFU_LOG_FACTOR = 10;                 // 255 is reached after about 1M hits.
+    inline constexpr long long LFU_DECAY_TIME = 1;            // Minutes for the counter to lose one point while idle.
+
+    inline uint32_t lruClock(long long now_ms)
+    {
+        return static_cast<uint32_t>(now_ms / LRU_CLOCK_RESOLUTION_MS) & LRU_CLOCK_MAX;
+    }
+
+    /// @return milliseconds since the access recorded in `lru`, at least the clock resolution apart.
+    inline unsigned long long lruIdleTime(uint32_t lru, uint32_t clock)
+    {
+        uint32_t ticks = clock >= lru ? clock - lru : clock + (LRU_CLOCK_MAX - lru);
+        return static_cast<unsigned long long>(ticks) * LRU_CLOCK_RESOLUTION_MS;
+    }
+
+    inline uint32_t lfuTimeInMinutes(long long now_ms)
+    {
+        return static_cast<uint32_t>(now_ms / 60000) & 0xFFFF;
+    }
+
+    /// @return the LFU counter after the decay owed for the time since its last decrement.
+    inline uint8_t lfuDecrAndReturn(uint32_t bits, uint32_t now_minutes)
+    {
+        uint32_t last = bits >> 8;
+        uint8_t counter = bits & 0xFF;
+        uint32_t elapsed = now_minutes >= last ? now_minutes - last : 0xFFFF - last + now_minutes;
+        long long periods = elapsed / LFU_DECAY_TIME;
+        return periods >= counter ? 0 : static_cast<uint8_t>(counter - periods);
+    }
+
+    /// @brief Increment a counter with a probability that falls as it grows, so 8 bits cover millions of hits.
+    inline uint8_t lfuLogIncr(uint8_t counter)
+    {
+        if (counter == 255)
+            return counter;
+        // xorshift: cheap, and good enough for a coin flip.
+        thread_local uint32_t state = 2463534242u;
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        double r = static_cast<double>(state) / UINT32_MAX;
+        double base = std::max(0, counter - LFU_INIT_VAL);
+        return r < 1.0 / (base * LFU_LOG_FACTOR + 1) ? static_cast<uint8_t>(counter + 1) : counter;
+    }
+
+    /// @return access bits for a key created now.
+    inline uint32_t initialBits(bool lfu, long long now_ms)
+    {
+        return lfu ? (lfuTimeInMinutes(now_ms) << 8) | LFU_INIT_VAL : lruClock(now_ms);
+    }
+
+    /// @return access bits for a key accessed now.
+    inline uint32_t touchedBits(bool lfu, uint32_t bits, long long now_ms)
+    {
+        if (!lfu)
+            return lruClock(now_ms);
+        uint32_t minutes = lfuTimeInMinutes(now_ms);
+        return (minutes << 8) | lfuLogIncr(lfuDecrAndReturn(bits, minutes));
+    }
+}
+
+/// @brief The best eviction candidates seen so far, kept across evictions like redis' EvictionPoolLRU.
+/// Every eviction samples a few keys and merges them in, so a key's chance to be evicted does not
+/// depend on it being sampled in the same round as the victim.
+class EvictionPool
+{
+public:
+    static constexpr size_t SIZE = 16;
+
+    struct Candidate
+    {
+        unsigned long long idle = 0; // Higher is a better victim.
+        std::string key;
+        size_t shard = 0;
+    };
+
+    /// @brief Offer a sampled key; it is kept if the pool has room or it beats the worst candidate.
+    void offer(unsigned long long idle, std::string_view key, size_t shard)
+    {
+        if (size_ == SIZE && idle <= entries_[0].idle)
+            return;
+        for (size_t i = 0; i < size_; ++i)
+        {
+            if (entries_[i].shard == shard && entries_[i].key == key)
+                return;
+        }
+        // Entries are sorted by ascending idle time; a full pool drops its worst candidate.
+        size_t pos = std::upper_bound(entries_, entries_ + size_, idle, [](unsigned long long v, const Candidate &c)
+                                      { return v < c.idle; }) -
+                     entries_;
+        if (size_ == SIZE)
+        {
+            std::move(entries_ + 1, entries_ + pos, entries_);
+            --pos;
+        }
+        else
+        {
+            std::move_backward(entries_ + pos, entries_ + size_, entries_ + size_ + 1);
+            ++size_;
+        }
+        entries_[pos].idle = idle;
+        entries_[pos].key.assign(key);
+        entries_[pos].shard = shard;
+    }
+
+    /// @brief Remove the best candidate.
+    bool pop(Candidate &out)
+    {
+        if (size_ == 0)
+            return false;
+        out = std::move(entries_[--size_]);
+        return true;
+    }
+
+private:
+    Candidate entries_[SIZE];
+    size_t size_ = 0;
+};
@@ -0,0 +1,308 @@
+#pragma once
+
+#include <algorithm>
+#include <bitset>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+/// @brief Glob-style pattern as redis' stringmatchlen() understands it, for KEYS and SCAN MATCH:
+/// `*` matches any run of bytes, `?` any one byte, `[abc]`, `[^abc]` and `[a-z]` one byte of (or not
+/// of) a class, and `\` makes the next byte literal.
+///
+/// The pattern is compiled once into a small program and then matched against many strings. The
+/// stars split it into segments that each match a fixed number of bytes. The first segment must
+/// match at the start of the string (unless the pattern starts with `*`), the last one at its end
+/// (unless the pattern ends with `*`), and the ones in between are searched for left to right,
+/// each at the leftmost place after the previous one. Taking the leftmost place never loses a
+/// match, so no star is ever retried: `a*a*a*a*b` costs one pass over the string, where a
+/// backtracking matcher takes exponential time. Patterns that come down to plain literals, the
+/// usual `prefix:*`, `*suffix`, `*part*`, `prefix*suffix` and exact names, skip the program.
+class GlobPattern
+{
+public:
+    explicit GlobPattern(std::string_view pattern)
+    {
+        bool star = false;
+        size_t segment_begin = 0;
+        for (size_t p = 0; p < pattern.size();)
+        {
+            char c = pattern[p];
+            if (c == '*')
+            {
+                closeSegment(segment_begin);
+                if (ops_.empty())
+                    leading_star_ = true;
+                while (p < pattern.size() && pattern[p] == '*')
+                    ++p;
+                star = true;
+                trailing_star_ = true;
+                continue;
+            }
+            trailing_star_ = false;
+            if (c == '?')
+            {
+                ops_.push_back({Op::AnyByte, 0, 0});
+                ++p;
+            }
+            else if (c == '[')
+            {
+                p = parseClass(pattern, p + 1);
+            }
+            else
+            {
+                if (c == '\\' && p + 1 < pattern.size())
+                    c = pattern[++p];
+                ops_.push_back({Op::Byte, static_cast<uint8_t>(c), 0});
+                ++p;
+            }
+        }
+        closeSegment(segment_begin);
+        chooseKind(star);
+    }
+
+    /// @return true if the whole of `s` matches the pattern.
+    bool matches(std::string_view s) const
+    {
+        switch (kind_)
+        {
+        case Kind::Everything:
+            return true;
+        case Kind::Exact:
+            return s == first();
+        case Kind::Prefix:
+            return s.starts_with(first());
+        case Kind::Suffix:
+            return s.ends_with(first());
+        case Kind::Contains:
+            return s.find(first()) != std::string_view::npos;
+        case Kind::PrefixSuffix:
+            return s.size() >= first().size() + last().size() && s.starts_with(first()) && s.ends_with(last());
+        case Kind::Program:
+            break;
+        }
+        return run(s);
+    }
+
+    /// @return true if the pattern has no wildcard, so literal() is the only string it matches.
+    bool isLiteral() const
+    {
+        return kind_ == Kind::Exact;
+    }
+
+    std::string_view literal() const
+    {
+        return first();
+    }
+
+private:
+    /// One byte of a segment: a given byte, any byte, or a byte of classes_[index].
+    struct Op
+    {
+        enum Type : uint8_t
+        {
+            Byte,
+            AnyByte,
+            Class,
+        };
+        Type type;
+        uint8_t byte;
+        uint16_t index;
+    };
+
+    /// A run of ops between two stars, ops_[begin, end).
+    struct Segment
+    {
+        size_t begin;
+        size_t end;
+        std::string literal; // The bytes to find, when every op is a Byte; empty otherwise.
+
+        size_t length() const
+        {
+            return end - begin;
+        }
+    };
+
+    enum class Kind : uint8_t
+    {
+        Everything,   // Only stars.
+        Exact,        // literal
+        Prefix,       // literal*
+        Suffix,       // *literal
+        Contains,     // *literal*
+        PrefixSuffix, // literal*literal
+        Program,      // Anything else: run().
+    };
+
+    std::vector<Op> ops_;
+    std::vector<std::bitset<256>> classes_;
+    std::vector<Segment> segments_;
+    bool leading_star_ = false;
+    bool trailing_star_ = false;
+    Kind kind_ = Kind::Program;
+
+    std::string_view first() const
+    {
+        return segments_.empty() ? std::string_view() : std::string_view(segments_.front().literal);
+    }
+
+    std::string_view last() const
+    {
+        return segments_.back().literal;
+    }
+
+    /// @brief Compile the class whose body starts at pattern[p], after the `[`.
+    /// @return the position after its closing `]`, or the end of a pattern that never closes it.
+    size_t parseClass(std::string_view pattern, size_t p)
+    {
+        std::bitset<256> bytes;
+        bool negate = p < pattern.size() && pattern[p] == '^';
+        if (negate)
+            ++p;
+        for (; p < pattern.size() && pattern[p] != ']'; ++p)
+        {
+            if (pattern[p] == '\\' && p + 1 < pattern.size())
+            {
+                bytes.set(static_cast<uint8_t>(pattern[++p]));
+            }
+            else if (p + 2 < pattern.size() && pattern[p + 1] == '-' && pattern[p + 2] != ']')
+            {
+                uint8_t lo = static_cast<uint8_t>(pattern[p]);
+                uint8_t hi = static_cast<uint8_t>(pattern[p + 2]);
+                if (lo > hi)
+                    std::swap(lo, hi);
+                for (unsigned b = lo; b <= hi; ++b)
+                    bytes.set(b);
+                p += 2;
+            }
+            else
+            {
+                bytes.set(static_cast<uint8_t>(pattern[p]));
+            }
+        }
+        if (negate)
+            bytes.flip();
+        ops_.push_back({Op::Class, 0, static_cast<uint16_t>(classes_.size())});
+        classes_.push_back(bytes);
+        return p < pattern.size() ? p + 1 : p;
+    }
+
+    /// @brief End the segment that started at ops_[begin], if it has any op.
+    void closeSegment(size_t &begin)
+    {
+        if (ops_.size() == begin)
+            return;
+        Segment segment{begin, ops_.size(), {}};
+        if (std::all_of(ops_.begin() + begin, ops_.end(), [](const Op &op)
+                        { return op.type == Op::Byte; }))
+        {
+            for (size_t i = begin; i < ops_.size(); ++i)
+                segment.literal.push_back(static_cast<char>(ops_[i].byte));
+        }
+        segments_.push_back(std::move(segment));
+        begin = ops_.size();
+    }
+
+    void chooseKind(bool star)
+    {
+        if (segments_.empty())
+        {
+            kind_ = star ? Kind::Everything : Kind::Exact;
+            return;
+        }
+        for (const Segment &segment : segments_)
+        {
+            if (segment.literal.empty())
+                return;
+        }
+        if (segments_.size() == 1 && !star)
+            kind_ = Kind::Exact;
+        else if (segments_.size() == 1 && leading_star_ && trailing_star_)
+            kind_ = Kind::Contains;
+        else if (segments_.size() == 1)
+            kind_ = leading_star_ ? Kind::Suffix : Kind::Prefix;
+        else if (segments_.size() == 2 && !leading_star_ && !trailing_star_)
+            kind_ = Kind::PrefixSuffix;
+    }
+
+    bool opMatches(const Op &op, uint8_t c) const
+    {
+        switch (op.type)
+        {
+        case Op::Byte:
+            return op.byte == c;
+        case Op::AnyByte:
+            return true;
+        case Op::Class:
+            return classes_[op.index].test(c);
+        }
+        return false;
+    }
+
+    /// @return true if the segment matches s at `at`; the caller checked that it fits.
+    bool matchAt(const Segment &segment, std::string_view s, size_t at) const
+    {
+        if (!segment.literal.empty())
+            return std::memcmp(s.data() + at, segment.literal.data(), segment.literal.size()) == 0;
+        for (size_t i = segment.begin; i < segment.end; ++i)
+        {
+            if (!opMatches(ops_[i], static_cast<uint8_t>(s[at++])))
+                return false;
+        }
+        return true;
+    }
+
+    /// @return the leftmost place in s[begin, end) where the segment matches, or npos.
+    size_t find(const Segment &segment, std::string_view s, size_t begin, size_t end) const
+    {
+        if (end - begin < segment.length())
+            return std::string_view::npos;
+        if (!segment.literal.empty())
+        {
+            size_t at = s.substr(begin, end - begin).find(segment.literal);
+            return at == std::string_view::npos ? at : begin + at;
+        }
+        for (size_t at = begin; at + segment.length() <= end; ++at)
+        {
+            if (matchAt(segment, s, at))
+                return at;
+        }
+        return std::string_view::npos;
+    }
+
+    bool run(std::string_view s) const
+    {
+        size_t begin = 0;
+        size_t end = s.size();
+        size_t first = 0;
+        size_t last = segments_.size();
+        if (!leading_star_)
+        {
+            const Segment &segment = segments_[first++];
+            if (segment.length() > end || !matchAt(segment, s, 0))
+                return false;
+            begin = segment.length();
+        }
+        if (!trailing_star_)
+        {
+            // Without any star, the single segment must have used up the whole string.
+            if (first == last)
+                return begin == end;
+            const Segment &segment = segments_[--last];
+            if (segment.length() > end - begin || !matchAt(segment, s, end - segment.length()))
+                return false;
+            end -= segment.length();
+        }
+        for (size_t i = first; i < last; ++i)
+        {
+            size_t at = find(segments_[i], s, begin, end);
+            if (at == std::string_view::npos)
+                return false;
+            begin = at + segments_[i].length();
+        }
+        return true;
+    }
+};
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <string_view>
+#include "CompactString.hpp"
+#include "Dict.hpp"
+
+/// @brief Field/value table of a hash that outgrew its listpack encoding.
+/// Values are CompactStrings, so a short value sits in the slot next to its field; the bytes of the
+/// longer ones are counted as they change, so memoryUsage() is O(1).
+class HashDict
+{
+public:
+    size_t size() const
+    {
+        return fields_.size();
+    }
+
+    size_t memoryUsage() const
+    {
+        return sizeof(*this) + fields_.memoryUsage() + value_bytes_;
+    }
+
+    const CompactString *find(std::string_view field) const
+    {
+        return fields_.find(field);
+    }
+
+    /// @return true if the field is new.
+    bool set(std::string_view field, std::string_view value)
+    {
+        auto [slot, inserted] = fields_.tryEmplace(field);
+        value_bytes_ -= slot->heapBytes();
+        *slot = CompactString(value);
+        value_bytes_ += slot->heapBytes();
+        return inserted;
+    }
+
+    /// @return true if the field existed.
+    bool erase(std::string_view field)
+    {
+        const CompactString *value = fields_.find(field);
+        if (value == nullptr)
+            return false;
+        value_bytes_ -= value->heapBytes();
+        return fields_.erase(field);
+    }
+
+    /// @brief Call fn(std::string_view field, std::string_view value) for every field.
+    template <typename F>
+    void forEach(F &&fn) const
+    {
+        fields_.forEach([&](std::string_view field, const CompactString &value)
+                        { fn(field, value.view()); });
+    }
+
+    /// @brief One Dict::stableScan() step: calls fn(std::string_view field, std::string_view value).
+    /// @return the next cursor, 0 once the walk is complete.
+    template <typename F>
+    size_t scan(size_t cursor, F &&fn) const
+    {
+        return fields_.stableScan(cursor, [&](std::string_view field, const CompactString &value)
+                                  { fn(field, value.view()); });
+    }
+
+private:
+    Dict<CompactString> fields_;
+    size_t value_bytes_ = 0; // Heap bytes of the values, see CompactString::heapBytes().
+};
@@ -0,0 +1,126 @@
+#pragma once
+
+#include <string_view>
+#include "RedisObject.hpp"
+
+/// @brief Largest hash kept in the listpack encoding, like redis' hash-max-listpack-* settings.
+struct HashLimits
+{
+    size_t max_listpack_entries = 128; // Fields (hash-max-listpack-entries).
+    size_t max_listpack_value = 64;    // Bytes of a field or a value (hash-max-listpack-value).
+};
+
+/// @brief Operations on a hash object whatever its encoding, like redis' t_hash.c.
+/// A hash starts as a Listpack of alternating fields and values and is converted to a HashDict,
+/// for good, once it grows past the HashLimits.
+namespace HashType
+{
+    inline RedisObject create()
+    {
+        return RedisObject::create<Listpack>(ObjType::Hash, ObjEncoding::Listpack);
+    }
+
+    /// @return number of fields.
+    inline size_t length(const RedisObject &hash)
+    {
+        if (hash.encoding() == ObjEncoding::Listpack)
+            return hash.as<Listpack>().size() / 2;
+        return hash.as<HashDict>().size();
+    }
+
+    /// @param value receives a view of the value, valid until the hash changes.
+    inline bool get(const RedisObject &hash, std::string_view field, std::string_view &value)
+    {
+        if (hash.encoding() == ObjEncoding::Listpack)
+        {
+            const Listpack &lp = hash.as<Listpack>();
+            size_t pos = lp.find(field, 1);
+            if (pos == lp.end())
+                return false;
+            value = lp.get(lp.next(pos));
+            return true;
+        }
+        const CompactString *found = hash.as<HashDict>().find(field);
+        if (found == nullptr)
+            return false;
+        value = found->view();
+        return true;
+    }
+
+    /// @brief Call fn(std::string_view field, std::string_view value) for every field.
+    template <typename F>
+    void forEach(const RedisObject &hash, F &&fn)
+    {
+        if (hash.encoding() == ObjEncoding::Listpack)
+        {
+            const Listpack &lp = hash.as<Listpack>();
+            for (size_t pos = lp.begin(); pos != lp.end();)
+            {
+                std::string_view field = lp.get(pos, &pos);
+                fn(field, lp.get(pos, &pos));
+            }
+            return;
+        }
+        hash.as<HashDict>().forEach(fn);
+    }
+
+    /// @brief One step of HSCAN: call fn(std::string_view field, std::string_view value) for some
+    /// fields. A listpack is small enough to be walked in a single step, like redis does.
+    /// @return the next cursor, 0 once the walk is complete.
+    template <typename F>
+    size_t scan(const RedisObject &hash, size_t cursor, F &&fn)
+    {
+        if (hash.encoding() == ObjEncoding::Listpack)
+        {
+            forEach(hash, fn);
+            return 0;
+        }
+        return hash.as<HashDict>().scan(cursor, fn);
+    }
+
+    /// @brief Move a listpack encoded hash into a HashDict.
+    inline void convert(RedisObject &hash)
+    {
+        RedisObject converted = RedisObject::create<HashDict>(ObjType::Hash, ObjEncoding::Hashtable);
+        HashDict &dict = converted.as<HashDict>();
+        forEach(hash, [&](std::string_view field, std::string_view value)
+                { dict.set(field, value); });
+        hash = std::move(converted);
+    }
+
+    /// @brief Set a field, converting the hash first if the field or value is too long for a
+    /// listpack, or afterwards if it now has too many fields.
+    /// @return true if the field is new.
+    inline bool set(RedisObject &hash, std::string_view field, std::string_view value, const HashLimits &limits)
+    {
+        if (hash.encoding() == ObjEncoding::Listpack && (field.size() > limits.max_listpack_value || value.size() > limits.max_listpack_value))
+            convert(hash);
+        if (hash.encoding() == ObjEncoding::Hashtable)
+            return hash.as<HashDict>().set(field, value);
+        Listpack &lp = hash.as<Listpack>();
+        size_t pos = lp.find(field, 1);
+        if (pos != lp.end())
+        {
+            lp.replace(lp.next(pos), value);
+            return false;
+        }
+        lp.append(field);
+        lp.append(value);
+        if (lp.size() / 2 > limits.max_listpack_entries)
+            convert(hash);
+        return true;
+    }
+
+    /// @return true if the field existed.
+    inline bool remove(RedisObject &hash, std::string_view field)
+    {
+        if (hash.encoding() == ObjEncoding::Hashtable)
+            return hash.as<HashDict>().erase(field);
+        Listpack &lp = hash.as<Listpack>();
+        size_t pos = lp.find(field, 1);
+        if (pos == lp.end())
+            return false;
+        lp.erase(pos, 2);
+        return true;
+    }
+}
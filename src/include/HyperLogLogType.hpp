@@ -0,0 +1,87 @@
+#pragma once
+
+#include <string_view>
+#include "RedisObject.hpp"
+
+/// @brief Largest HyperLogLog kept in the sparse encoding, like redis' hll-sparse-max-bytes.
+struct HllLimits
+{
+    size_t sparse_max_bytes = 3000; // Bytes of sparse registers (hll-sparse-max-bytes).
+};
+
+/// @brief Operations on a HyperLogLog object whatever its encoding, like redis' hyperloglog.c.
+/// An HLL starts as an HllSparse and is converted to an HllDense, for good, once it grows past
+/// the HllLimits.
+namespace HyperLogLogType
+{
+    inline RedisObject create()
+    {
+        return RedisObject::create<HllSparse>(ObjType::HyperLogLog, ObjEncoding::HllSparse);
+    }
+
+    /// @brief Move a sparse HLL into an HllDense.
+    inline void convert(RedisObject &hll)
+    {
+        RedisObject converted = RedisObject::create<HllDense>(ObjType::HyperLogLog, ObjEncoding::HllDense);
+        HllDense &dense = converted.as<HllDense>();
+        hll.as<HllSparse>().forEach([&](size_t index, uint8_t value)
+                                    { dense.update(index, value); });
+        hll = std::move(converted);
+    }
+
+    /// @brief Add an element, converting the HLL when it outgrows the sparse encoding.
+    /// @return true if a register changed, i.e. the estimate may have changed.
+    inline bool add(RedisObject &hll, std::string_view element, const HllLimits &limits)
+    {
+        size_t index;
+        uint8_t value = Hll::registerFor(element, index);
+        if (hll.encoding() == ObjEncoding::HllDense)
+            return hll.as<HllDense>().update(index, value);
+        HllSparse &sparse = hll.as<HllSparse>();
+        if (!sparse.update(index, value))
+            return false;
+        if (sparse.bytes() > limits.sparse_max_bytes)
+            convert(hll);
+        return true;
+    }
+
+    /// @return the estimated number of distinct elements added.
+    inline uint64_t count(const RedisObject &hll)
+    {
+        if (hll.encoding() == ObjEncoding::HllDense)
+            return hll.as<HllDense>().count();
+        return hll.as<HllSparse>().count();
+    }
+
+    /// @brief registers[i] = max(registers[i], register i of the HLL), for one byte per register:
+    /// merging into zeroed registers unpacks the HLL, merging several gives their union.
+    inline void mergeInto(const RedisObject &hll, uint8_t *registers)
+    {
+        if (hll.encoding() == ObjEncoding::HllDense)
+            hll.as<HllDense>().mergeInto(registers);
+        else
+            hll.as<HllSparse>().mergeInto(registers);
+    }
+
+    /// @brief Replace the registers of an HLL with one byte per register, keeping it sparse while it fits.
+    inline void assign(RedisObject &hll, const uint8_t *registers, const HllLimits &limits)
+    {
+        size_t used = 0;
+        for (size_t i = 0; i < Hll::REGISTERS; ++i)
+            used += registers[i] != 0;
+        if (hll.encoding() == ObjEncoding::HllSparse && used * sizeof(uint32_t) <= limits.sparse_max_bytes)
+        {
+            RedisObject sparse = create();
+            for (size_t i = 0; i < Hll::REGISTERS; ++i)
+            {
+                if (registers[i] != 0)
+                    sparse.as<HllSparse>().update(i, registers[i]);
+            }
+            hll = std::move(sparse);
+            return;
+        }
+        if (hll.encoding() == ObjEncoding::HllSparse)
+            hll = RedisObject::create<HllDense>(ObjType::HyperLogLog, ObjEncoding::HllDense);
+        hll.as<HllDense>().assign(registers);
+    }
+}
@@ -0,0 +1,396 @@
+#pragma once
+
+#include <algorithm>
+#include <bit>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <new>
+#include <utility>
+#include <vector>
+#include "CpuFeatures.hpp"
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+/// @brief Sorted array of distinct integers in one exactly sized allocation, like redis' intset.
+/// All elements share the narrowest width (16, 32 or 64 bits) that fits every one of them; adding a
+/// wider value upgrades the whole array. Membership is a binary search, and two sets intersect with a
+/// linear merge that compares whole SIMD registers of elements at a time.
+class IntSet
+{
+public:
+    /// Intersect by galloping through the larger set once it is this many times larger than the smaller one.
+    static constexpr size_t GALLOP_RATIO = 32;
+
+    IntSet() = default;
+    IntSet(const IntSet &) = delete;
+    IntSet &operator=(const IntSet &) = delete;
+
+    ~IntSet()
+    {
+        std::free(data_);
+    }
+
+    size_t size() const
+    {
+        return count_;
+    }
+
+    /// @return bytes of one element: 2, 4 or 8.
+    size_t width() const
+    {
+        return width_;
+    }
+
+    size_t memoryUsage() const
+    {
+        return sizeof(*this) + count_ * width_;
+    }
+
+    int64_t at(size_t i) const
+    {
+        switch (width_)
+        {
+        case 2:
+            return elements<int16_t>()[i];
+        case 4:
+            return elements<int32_t>()[i];
+        default:
+            return elements<int64_t>()[i];
+        }
+    }
+
+    bool contains(int64_t value) const
+    {
+        return widthFor(value) <= width_ && search(value).second;
+    }
+
+    /// @return true if the value was added.
+    bool insert(int64_t value)
+    {
+        if (widthFor(value) > width_)
+        {
+            upgrade(widthFor(value));
+            // A value too wide for the old elements is either below or above all of them.
+            insertAt(value < 0 ? 0 : count_, value);
+            return true;
+        }
+        auto [pos, found] = search(value);
+        if (found)
+            return false;
+        insertAt(pos, value);
+        return true;
+    }
+
+    /// @return true if the value was there.
+    bool erase(int64_t value)
+    {
+        if (widthFor(value) > width_)
+            return false;
+        auto [pos, found] = search(value);
+        if (!found)
+            return false;
+        std::memmove(data_ + pos * width_, data_ + (pos + 1) * width_, (count_ - pos - 1) * width_);
+        resize(count_ - 1);
+        return true;
+    }
+
+    /// @brief Append the elements present in both `a` and `b`, in ascending order, to `out`.
+    static void intersect(const IntSet &a, const IntSet &b, std::vector<int64_t> &out)
+    {
+        const IntSet &wide = a.width_ >= b.width_ ? a : b;
+        const IntSet &narrow = a.width_ >= b.width_ ? b : a;
+        switch (wide.width_)
+        {
+        case 2:
+            intersectAs<int16_t>(wide, narrow, out);
+            break;
+        case 4:
+            intersectAs<int32_t>(wide, narrow, out);
+            break;
+        default:
+            intersectAs<int64_t>(wide, narrow, out);
+            break;
+        }
+    }
+
+    /// @brief Intersect two sorted arrays of distinct values into `out`, which must have room for
+    /// min(na, nb) values. Uses the widest SIMD instructions the CPU has, or gallops through the
+    /// larger array when the other one is much smaller.
+    /// @return number of values written.
+    template <typename T>
+    static size_t intersectSorted(const T *a, size_t na, const T *b, size_t nb, T *out)
+    {
+        if (na > nb)
+        {
+            std::swap(a, b);
+            std::swap(na, nb);
+        }
+        if (na * GALLOP_RATIO < nb)
+            return intersectGallop(a, na, b, nb, out);
+#if defined(__x86_64__)
+        if constexpr (sizeof(T) >= 4)
+        {
+            if (CpuFeatures::get().avx2)
+                return intersectAvx2(a, na, b, nb, out);
+        }
+        if (CpuFeatures::get().sse41)
+            return intersectSse41(a, na, b, nb, out);
+#endif
+        return intersectScalar(a, na, b, nb, out, 0, 0, 0);
+    }
+
+    /// @brief Plain merge intersection, continuing from a[i] and b[j] with k values already in `out`.
+    template <typename T>
+    static size_t intersectScalar(const T *a, size_t na, const T *b, size_t nb, T *out, size_t i, size_t j, size_t k)
+    {
+        while (i < na && j < nb)
+        {
+            if (a[i] < b[j])
+                ++i;
+            else if (b[j] < a[i])
+                ++j;
+            else
+            {
+                out[k++] = a[i];
+                ++i;
+                ++j;
+            }
+        }
+        return k;
+    }
+
+private:
+    unsigned char *data_ = nullptr;
+    size_t count_ = 0;
+    uint8_t width_ = sizeof(int16_t);
+
+    template <typename T>
+    const T *elements() const
+    {
+        return reinterpret_cast<const T *>(data_);
+    }
+
+    template <typename T>
+    T *elements()
+    {
+        return reinterpret_cast<T *>(data_);
+    }
+
+    static uint8_t widthFor(int64_t value)
+    {
+        if (value >= std::numeric_limits<int16_t>::min() && value <= std::numeric_limits<int16_t>::max())
+            return sizeof(int16_t);
+        if (value >= std::numeric_limits<int32_t>::min() && value <= std::numeric_limits<int32_t>::max())
+            return sizeof(int32_t);
+        return sizeof(int64_t);
+    }
+
+    void set(size_t i, int64_t value)
+    {
+        switch (width_)
+        {
+        case 2:
+            elements<int16_t>()[i] = static_cast<int16_t>(value);
+            break;
+        case 4:
+            elements<int32_t>()[i] = static_cast<int32_t>(value);
+            break;
+        default:
+            elements<int64_t>()[i] = value;
+            break;
+        }
+    }
+
+    /// @return the position of `value`, or where it would be inserted, and whether it is there.
+    std::pair<size_t, bool> search(int64_t value) const
+    {
+        size_t lo = 0, hi = count_;
+        while (lo < hi)
+        {
+            size_t mid = (lo + hi) / 2;
+            int64_t v = at(mid);
+            if (v == value)
+                return {mid, true};
+            if (v < value)
+                lo = mid + 1;
+            else
+                hi = mid;
+        }
+        return {lo, false};
+    }
+
+    void resize(size_t count)
+    {
+        if (count == 0)
+        {
+            std::free(data_);
+            data_ = nullptr;
+        }
+        else
+        {
+            void *p = std::realloc(data_, count * width_);
+            if (p == nullptr)
+                throw std::bad_alloc();
+            data_ = static_cast<unsigned char *>(p);
+        }
+        count_ = count;
+    }
+
+    void insertAt(size_t pos, int64_t value)
+    {
+        resize(count_ + 1);
+        std::memmove(data_ + (pos + 1) * width_, data_ + pos * width_, (count_ - 1 - pos) * width_);
+        set(pos, value);
+    }
+
+    /// @brief Widen every element, back to front so the array can grow in place.
+    void upgrade(uint8_t width)
+    {
+        uint8_t old_width = width_;
+        size_t count = count_;
+        width_ = width;
+        if (count == 0)
+            return;
+        void *p = std::realloc(data_, count * width_);
+        if (p == nullptr)
+            throw std::bad_alloc();
+        data_ = static_cast<unsigned char *>(p);
+        for (size_t i = count; i-- > 0;)
+        {
+            int64_t v;
+            if (old_width == sizeof(int16_t))
+                v = reinterpret_cast<int16_t *>(data_)[i];
+            else
+                v = reinterpret_cast<int32_t *>(data_)[i];
+            set(i, v);
+        }
+    }
+
+    /// @brief Intersect with both sets as arrays of T, widening a copy of the narrower one if needed.
+    template <typename T>
+    static void intersectAs(const IntSet &wide, const IntSet &narrow, std::vector<int64_t> &out)
+    {
+        std::vector<T> widened;
+        const T *b = narrow.elements<T>();
+        if (narrow.width_ != sizeof(T))
+        {
+            widened.resize(narrow.count_);
+            for (size_t i = 0; i < narrow.count_; ++i)
+                widened[i] = static_cast<T>(narrow.at(i));
+            b = widened.data();
+        }
+        std::vector<T> result(std::min(wide.count_, narrow.count_));
+        size_t n = intersectSorted(wide.elements<T>(), wide.count_, b, narrow.count_, result.data());
+        out.insert(out.end(), result.begin(), result.begin() + n);
+    }
+
+    /// @brief Look every element of the small array up in the large one, by exponential then binary search.
+    template <typename T>
+    static size_t intersectGallop(const T *a, size_t na, const T *b, size_t nb, T *out)
+    {
+        size_t k = 0, lo = 0;
+        for (size_t i = 0; i < na && lo < nb; ++i)
+        {
+            size_t step = 1, hi = lo;
+            while (hi < nb && b[hi] < a[i])
+            {
+                lo = hi + 1;
+                hi += step;
+                step *= 2;
+            }
+            const T *p = std::lower_bound(b + lo, b + std::min(hi + 1, nb), a[i]);
+            lo = p - b;
+            if (lo < nb && *p == a[i])
+                out[k++] = a[i];
+        }
+        return k;
+    }
+
+#if defined(__x86_64__)
+    /// @brief Mask keeping the bit of each element's lowest byte in a byte movemask, one bit per element.
+    template <typename T>
+    static constexpr uint32_t laneBits()
+    {
+        uint32_t bits = 0;
+        for (size_t i = 0; i < 32; i += sizeof(T))
+            bits |= 1u << i;
+        return bits;
+    }
+
+    template <typename T>
+    __attribute__((target("sse4.1"))) static __m128i equalLanes(__m128i a, __m128i b)
+    {
+        if constexpr (sizeof(T) == 2)
+            return _mm_cmpeq_epi16(a, b);
+        else if constexpr (sizeof(T) == 4)
+            return _mm_cmpeq_epi32(a, b);
+        else
+            return _mm_cmpeq_epi64(a, b);
+    }
+
+    /// @brief Lanes of `a` equal to any lane of `b`: compare against every rotation of `b`.
+    template <typename T, size_t... R>
+    __attribute__((target("sse4.1"))) static __m128i matchAnySse41(__m128i a, __m128i b, std::index_sequence<R...>)
+    {
+        return (equalLanes<T>(a, b) | ... | equalLanes<T>(a, _mm_alignr_epi8(b, b, (R + 1) * sizeof(T))));
+    }
+
+    /// @brief Merge intersection over blocks of 16 bytes: every block of `a` is compared with a
+    /// block of `b` all-against-all, then whichever block ends lower is replaced by the next one.
+    template <typename T>
+    __attribute__((target("sse4.1"))) static size_t intersectSse41(const T *a, size_t na, const T *b, size_t nb, T *out)
+    {
+        constexpr size_t LANES = 16 / sizeof(T);
+        size_t i = 0, j = 0, k = 0;
+        while (i + LANES <= na && j + LANES <= nb)
+        {
+            __m128i va = _mm_loadu_si128(reinterpret_cast<const __m128i *>(a + i));
+            __m128i vb = _mm_loadu_si128(reinterpret_cast<const __m128i *>(b + j));
+            uint32_t mask = _mm_movemask_epi8(matchAnySse41<T>(va, vb, std::make_index_sequence<LANES - 1>{})) & laneBits<T>();
+            for (; mask != 0; mask &= mask - 1)
+                out[k++] = a[i + std::countr_zero(mask) / sizeof(T)];
+            T a_last = a[i + LANES - 1], b_last = b[j + LANES - 1];
+            i += a_last <= b_last ? LANES : 0;
+            j += b_last <= a_last ? LANES : 0;
+        }
+        return intersectScalar(a, na, b, nb, out, i, j, k);
+    }
+
+    /// @brief The AVX2 version of intersectSse41(), for 32- and 64-bit elements (AVX2 has no
+    /// cross-lane rotation of 16-bit elements).
+    template <typename T>
+    __attribute__((target("avx2"))) static size_t intersectAvx2(const T *a, size_t na, const T *b, size_t nb, T *out)
+    {
+        constexpr size_t LANES = 32 / sizeof(T);
+        // Rotating by one element is a rotation by one or two 32-bit lanes.
+        constexpr int STEP = sizeof(T) / 4;
+        const __m256i rotate = _mm256_setr_epi32(STEP % 8, (1 + STEP) % 8, (2 + STEP) % 8, (3 + STEP) % 8,
+                                                 (4 + STEP) % 8, (5 + STEP) % 8, (6 + STEP) % 8, (7 + STEP) % 8);
+        size_t i = 0, j = 0, k = 0;
+        while (i + LANES <= na && j + LANES <= nb)
+        {
+            __m256i va = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(a + i));
+            __m256i vb = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(b + j));
+            __m256i match = _mm256_setzero_si256();
+            for (size_t r = 0; r < LANES; ++r)
+            {
+                if constexpr (sizeof(T) == 4)
+                    match = _mm256_or_si256(match, _mm256_cmpeq_epi32(va, vb));
+                else
+                    match = _mm256_or_si256(match, _mm256_cmpeq_epi64(va, vb));
+                vb = _mm256_permutevar8x32_epi32(vb, rotate);
+            }
+            uint32_t mask = _mm256_movemask_epi8(match) & laneBits<T>();
+            for (; mask != 0; mask &= mask - 1)
+                out[k++] = a[i + std::countr_zero(mask) / sizeof(T)];
+            T a_last = a[i + LANES - 1], b_last = b[j + LANES - 1];
+            i += a_last <= b_last ? LANES : 0;
+            j += b_last <= a_last ? LANES : 0;
+        }
+        return intersectScalar(a, na, b, nb, out, i, j, k);
+    }
+#endif
+};
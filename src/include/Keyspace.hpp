@@ -0,0 +1,774 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "Dict.hpp"
+#include "Eviction.hpp"
+#include "RedisObject.hpp"
+
+/// @brief Thread-safe key/value store split into independently locked shards.
+/// A key's hash picks its shard, so commands on different keys rarely contend for the same lock,
+/// and readers of one shard share its lock.
+///
+/// Like redis, every shard keeps the expiry times in a second dict that only holds the keys with a
+/// TTL, as absolute unix times in milliseconds. Keys without a TTL pay nothing for the feature. An
+/// expired key is deleted when it is accessed, and activeExpireCycle() finds the ones nobody touches.
+///
+/// Every access also refreshes the value's eviction bits (see Eviction.hpp), and usedMemory() tracks
+/// the bytes held by the entries, so the server can enforce maxmemory with evictOne().
+class Keyspace
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    static constexpr size_t DEFAULT_SHARDS = 64;
+    static constexpr size_t REHASH_BATCH_GROUPS = 64; // Dict groups migrated per lock acquisition by rehashStep().
+
+    // getExpire() results that are not a time, the same values TTL replies with.
+    static constexpr long long KEY_MISSING = -2;
+    static constexpr long long NO_EXPIRE = -1;
+
+    static constexpr size_t ACTIVE_EXPIRE_KEYS_PER_LOOP = 20;    // Keys with a TTL sampled per lock acquisition.
+    static constexpr size_t ACTIVE_EXPIRE_GROUPS_PER_LOOP = 32;  // Bounds the walk over a sparse expires dict.
+    static constexpr size_t ACTIVE_EXPIRE_ACCEPTABLE_STALE = 10; // % of expired keys in a sample that moves on to the next shard.
+
+    static constexpr size_t MAXMEMORY_SAMPLES = 5; // Keys sampled into the eviction pool per eviction, like redis' maxmemory-samples.
+
+    static constexpr size_t DEFAULT_PREFETCH_BATCH = 16; // Keys whose lookups overlap in multi-key commands, like redis' prefetch-batch-max-size.
+
+    /// @brief Outcome of one activeExpireCycle().
+    struct ExpireCycleResult
+    {
+        size_t expired = 0;
+        bool time_limit_reached = false;
+    };
+
+    /// @param shards number of shards, rounded up to a power of two.
+    explicit Keyspace(size_t shards = DEFAULT_SHARDS)
+    {
+        size_t n = 1;
+        while (n < shards)
+            n <<= 1;
+        shards_ = std::make_unique<Shard[]>(n);
+        mask_ = n - 1;
+    }
+
+    Keyspace(const Keyspace &) = delete;
+    Keyspace &operator=(const Keyspace &) = delete;
+
+    /// @return the current unix time in milliseconds, the clock of every expiry time.
+    static long long nowMs()
+    {
+        return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+    }
+
+    /// @brief Choose what the eviction bits of the values track and which keys evictOne() removes.
+    void setEvictionPolicy(EvictionPolicy policy)
+    {
+        policy_.store(policy, std::memory_order_relaxed);
+    }
+
+    /// @brief How many lookups of a multi-key command prefetch their dict slots together, see
+    /// prefetchBatch(); 0 or 1 turns prefetching off.
+    void setPrefetchBatch(size_t keys)
+    {
+        prefetch_batch_.store(keys, std::memory_order_relaxed);
+    }
+
+    /// @brief Refresh the clock the eviction bits are stamped with; the server calls this from its cron.
+    void updateClock()
+    {
+        updateClock(nowMs());
+    }
+
+    /// @brief Set that clock to `now_ms`, e.g. to replay a workload faster than real time.
+    void updateClock(long long now_ms)
+    {
+        clock_ms_.store(now_ms, std::memory_order_relaxed);
+    }
+
+    /// @brief Make the exclusive locks the calling thread releases from now on append their place in
+    /// the order of writes to `order`, or stop that with nullptr. Every such release draws the next
+    /// number of one keyspace-wide sequence while the shard is still locked, so two writes to the same
+    /// shard get numbers in the order they were applied; the server replicates commands in that order.
+    static void recordWriteOrder(std::vector<uint64_t> *order)
+    {
+        write_order_ = order;
+    }
+
+    /// @return a number after every one recordWriteOrder() has handed out so far.
+    uint64_t nextWriteOrder()
+    {
+        return write_seq_.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    /// @return a copy of the value of a key that exists and has not expired. Copies are cheap:
+    /// at most 24 bytes and a reference count, see RedisObject.
+    std::optional<RedisObject> get(std::string_view key)
+    {
+        size_t hash = Dict<RedisObject>::hashKey(key);
+        Shard &shard = shardFor(hash);
+        {
+            std::shared_lock lock(shard.mutex);
+            RedisObject *value = shard.map.find(key, hash);
+            if (value == nullptr)
+                return std::nullopt;
+            if (!isExpired(shard, key, hash))
+            {
+                touch(*value);
+                return *value;
+            }
+        }
+        // Deleting the expired key needs the exclusive lock; another client may have beaten us to it.
+        WriteLock lock(*this, shard);
+        expireIfNeeded(shard, key, hash);
+        return std::nullopt;
+    }
+
+    /// @brief Read a key in place under its shard's shared lock, for values too big to copy out
+    /// such as lists. Calls fn(const RedisObject *value), with nullptr for a missing or expired key;
+    /// the expired key is left for the next write or activeExpireCycle() to delete.
+    /// @return whatever fn returns.
+    template <typename F>
+    auto read(std::string_view key, F &&fn)
+    {
+        size_t hash = Dict<RedisObject>::hashKey(key);
+        Shard &shard = shardFor(hash);
+        std::shared_lock lock(shard.mutex);
+        RedisObject *value = shard.map.find(key, hash);
+        if (value == nullptr || isExpired(shard, key, hash))
+            return fn(static_cast<const RedisObject *>(nullptr));
+        touch(*value);
+        return fn(static_cast<const RedisObject *>(value));
+    }
+
+    /// @brief read() for several keys at once, for MGET and commands such as SINTER that combine values.
+    /// The shared locks of all their shards are held together, taken in shard order so that two
+    /// such readers cannot deadlock with each other. Calls fn(const std::vector<const RedisObject *> &),
+    /// one value per key, with nullptr for the missing and expired ones.
+    /// @return whatever fn returns.
+    template <typename F>
+    auto readMany(const std::vector<std::string_view> &keys, F &&fn)
+    {
+        std::vector<size_t> hashes = hashKeys(keys);
+        std::vector<std::shared_lock<std::shared_mutex>> locks;
+        for (size_t i : shardOrder(hashes))
+            locks.emplace_back(shards_[i].mutex);
+        std::vector<const RedisObject *> values(keys.size());
+        for (size_t i = 0; i < keys.size(); ++i)
+        {
+            prefetchBatch(hashes, i);
+            Shard &shard = shardFor(hashes[i]);
+            RedisObject *value = shard.map.find(keys[i], hashes[i]);
+            if (value == nullptr || isExpired(shard, keys[i], hashes[i]))
+                continue;
+            touch(*value);
+            values[i] = value;
+        }
+        return fn(values);
+    }
+
+    /// @brief One step of SCAN: call fn(std::string_view key, const RedisObject &value) for the keys
+    /// of one Dict::stableScan() step of one shard, under that shard's shared lock, skipping expired
+    /// keys. Shards are walked one after the other; the shard sits in the low bits of the cursor and
+    /// the shard's dict cursor above them, so every key present for the whole walk is seen at least
+    /// once however the shards resize in between.
+    /// @param cursor 0 to start a walk, otherwise the value returned by the previous call.
+    /// @return the cursor of the next step, 0 once the walk is complete.
+    template <typename F>
+    unsigned long long scan(unsigned long long cursor, F &&fn)
+    {
+        int shard_bits = std::countr_zero(mask_ + 1);
+        size_t index = cursor & mask_;
+        const Shard &shard = shards_[index];
+        size_t dict_cursor;
+        {
+            std::shared_lock lock(shard.mutex);
+            long long now = nowMs();
+            dict_cursor = shard.map.stableScan(cursor >> shard_bits, [&](std::string_view key, const RedisObject &value)
+                                               {
+                                                   if (shard.expires.size() != 0)
+                                                   {
+                                                       const long long *when = shard.expires.find(key);
+                                                       if (when != nullptr && *when <= now)
+                                                           return;
+                                                   }
+                                                   fn(key, value); });
+        }
+        if (dict_cursor != 0)
+            return (static_cast<unsigned long long>(dict_cursor) << shard_bits) | index;
+        return index == mask_ ? 0 : index + 1;
+    }
+
+    /// @brief Call fn(std::string_view key, const RedisObject &value) for every key that has not
+    /// expired, for KEYS. Each shard is walked whole under its shared lock, one shard at a time.
+    template <typename F>
+    void forEachKey(F &&fn) const
+    {
+        long long now = nowMs();
+        for (size_t i = 0; i <= mask_; ++i)
+        {
+            const Shard &shard = shards_[i];
+            std::shared_lock lock(shard.mutex);
+            shard.map.forEach([&](std::string_view key, const RedisObject &value)
+                              {
+                                  if (shard.expires.size() != 0)
+                                  {
+                                      const long long *when = shard.expires.find(key);
+                                      if (when != nullptr && *when <= now)
+                                          return;
+                                  }
+                                  fn(key, value); });
+        }
+    }
+
+    /// @brief Insert or overwrite a key; like SET, this drops any previous TTL.
+    /// @param expire_ms absolute unix time in milliseconds at which the key expires, or NO_EXPIRE.
+    void set(std::string_view key, RedisObject value, long long expire_ms = NO_EXPIRE)
+    {
+        size_t hash = Dict<RedisObject>::hashKey(key);
+        Shard &shard = shardFor(hash);
+        WriteLock lock(*this, shard);
+        setLocked(shard, key, hash, std::move(value), expire_ms);
+    }
+
+    /// @brief set() for SET's NX, XX, GET and KEEPTTL options, under the shard's exclusive lock.
+    /// Calls fn(const RedisObject *current), with nullptr for a missing or expired key, and stores
+    /// `value` only if fn returns true.
+    /// @param keep_ttl keep the key's current TTL instead of expire_ms.
+    /// @return whatever fn returns.
+    template <typename F>
+    bool setIf(std::string_view key, RedisObject value, long long expire_ms, bool keep_ttl, F &&fn)
+    {
+        size_t hash = Dict<RedisObject>::hashKey(key);
+        Shard &shard = shardFor(hash);
+        WriteLock lock(*this, shard);
+        expireIfNeeded(shard, key, hash);
+        const RedisObject *current = shard.map.find(key, hash);
+        if (!fn(current))
+            return false;
+        if (keep_ttl)
+        {
+            const long long *when = shard.expires.size() != 0 ? shard.expires.find(key, hash) : nullptr;
+            expire_ms = when != nullptr ? *when : NO_EXPIRE;
+        }
+        setLocked(shard, key, hash, std::move(value), expire_ms);
+        return true;
+    }
+
+    /// @brief set() for several keys at once, atomically, like MSET: the exclusive locks of all their
+    /// shards are held together, taken in shard order. A key given twice ends up with its last value.
+    /// @param nx set nothing unless none of the keys exists, like MSETNX.
+    /// @return false if nx stopped it.
+    bool setMany(const std::vector<std::string_view> &keys, std::vector<RedisObject> values, bool nx = false)
+    {
+        std::vector<size_t> hashes = hashKeys(keys);
+        std::vector<std::unique_ptr<WriteLock>> locks;
+        for (size_t i : shardOrder(hashes))
+            locks.push_back(std::make_unique<WriteLock>(*this, shards_[i]));
+        for (size_t i = 0; nx && i < keys.size(); ++i)
+        {
+            prefetchBatch(hashes, i);
+            Shard &shard = shardFor(hashes[i]);
+            if (!expireIfNeeded(shard, keys[i], hashes[i]) && shard.map.find(keys[i], hashes[i]) != nullptr)
+                return false;
+        }
+        for (size_t i = 0; i < keys.size(); ++i)
+        {
+            prefetchBatch(hashes, i);
+            setLocked(shardFor(hashes[i]), keys[i], hashes[i], std::move(values[i]), NO_EXPIRE);
+        }
+        return true;
+    }
+
+    /// @brief Delete keys, atomically like DEL: the exclusive locks of all their shards are held together.
+    /// @param unlinked if not null, receives the deleted values instead of destroying them under the
+    /// locks, so UNLINK can free big values without holding up the other clients of their shards.
+    /// @return number of keys deleted; a key given twice counts once, an expired key not at all.
+    size_t eraseMany(const std::vector<std::string_view> &keys, std::vector<RedisObject> *unlinked = nullptr)
+    {
+        std::vector<size_t> hashes = hashKeys(keys);
+        std::vector<std::unique_ptr<WriteLock>> locks;
+        for (size_t i : shardOrder(hashes))
+            locks.push_back(std::make_unique<WriteLock>(*this, shards_[i]));
+        size_t deleted = 0;
+        for (size_t i = 0; i < keys.size(); ++i)
+        {
+            prefetchBatch(hashes, i);
+            Shard &shard = shardFor(hashes[i]);
+            if (!expireIfNeeded(shard, keys[i], hashes[i]) && shard.map.find(keys[i], hashes[i]) != nullptr)
+            {
+                deleteKey(shard, keys[i], hashes[i], unlinked);
+                ++deleted;
+            }
+        }
+        return deleted;
+    }
+
+    /// @brief Read-modify-write a key under its shard's exclusive lock.
+    /// Calls fn(RedisObject &value, bool &exists), where `exists` tells whether the key is present
+    /// (an expired key is not). fn creates the key by setting `exists`, or deletes it by clearing it;
+    /// a created key has no expiry, an existing one keeps its expiry.
+    /// @return whatever fn returns.
+    template <typename F>
+    auto modify(std::string_view key, F &&fn)
+    {
+        size_t hash = Dict<RedisObject>::hashKey(key);
+        Shard &shard = shardFor(hash);
+        WriteLock lock(*this, shard);
+        expireIfNeeded(shard, key, hash);
+        auto [value, inserted] = shard.map.tryEmplace(key, hash);
+        bool exists = !inserted;
+        size_t heap_before = value->heapBytes();
+        uint32_t bits = value->accessBits(); // fn may replace the object.
+        auto result = fn(*value, exists);
+        shard.value_bytes += value->heapBytes() - heap_before;
+        if (!exists)
+        {
+            deleteKey(shard, key, hash);
+        }
+        else
+        {
+            value->setAccessBits(inserted ? Eviction::initialBits(isLfu(), clock_ms_.load(std::memory_order_relaxed)) : bits);
+            if (!inserted)
+                touch(*value);
+        }
+        return result;
+    }
+
+    /// @return the absolute unix time in milliseconds at which the key expires, NO_EXPIRE for a key
+    /// without a TTL, or KEY_MISSING.
+    long long getExpire(std::string_view key)
+    {
+        size_t hash = Dict<RedisObject>::hashKey(key);
+        Shard &shard = shardFor(hash);
+        {
+            std::shared_lock lock(shard.mutex);
+            if (shard.map.find(key, hash) == nullptr)
+                return KEY_MISSING;
+            const long long *when = shard.expires.size() != 0 ? shard.expires.find(key, hash) : nullptr;
+            if (when == nullptr)
+                return NO_EXPIRE;
+            if (*when > nowMs())
+                return *when;
+        }
+        WriteLock lock(*this, shard);
+        expireIfNeeded(shard, key, hash);
+        return KEY_MISSING;
+    }
+
+    /// @brief Change the TTL of an existing key under its shard's exclusive lock.
+    /// Calls fn(long long current) with the key's getExpire() value; fn returns the new expiry time,
+    /// NO_EXPIRE to remove the TTL, or std::nullopt to leave the key alone. A time that already
+    /// passed deletes the key.
+    /// @return true if the key exists and fn changed it.
+    template <typename F>
+    bool updateExpire(std::string_view key, F &&fn)
+    {
+        size_t hash = Dict<RedisObject>::hashKey(key);
+        Shard &shard = shardFor(hash);
+        WriteLock lock(*this, shard);
+        if (expireIfNeeded(shard, key, hash) || shard.map.find(key, hash) == nullptr)
+            return false;
+        const long long *current = shard.expires.size() != 0 ? shard.expires.find(key, hash) : nullptr;
+        std::optional<long long> when = fn(current != nullptr ? *current : NO_EXPIRE);
+        if (!when)
+            return false;
+        if (*when == NO_EXPIRE)
+            shard.expires.erase(key, hash);
+        else if (*when <= nowMs())
+            deleteKey(shard, key, hash);
+        else
+            *shard.expires.tryEmplace(key, hash).first = *when;
+        return true;
+    }
+
+    /// @brief Delete keys whose TTL passed, for about `budget`, resuming where the previous call stopped.
+    /// Every shard's expires dict is walked a sample at a time. A shard is left for the next one once a
+    /// sample is mostly alive, so the effort adapts to how many keys are actually expiring.
+    ExpireCycleResult activeExpireCycle(std::chrono::microseconds budget)
+    {
+        ExpireCycleResult result;
+        auto deadline = Clock::now() + budget;
+        std::vector<std::string> expired;
+        for (size_t visited = 0; visited <= mask_; ++visited)
+        {
+            Shard &shard = shards_[expire_shard_];
+            while (true)
+            {
+                size_t sampled = 0;
+                expired.clear();
+                {
+                    WriteLock lock(*this, shard);
+                    if (shard.expires.size() == 0)
+                        break;
+                    long long now = nowMs();
+                    for (size_t groups = 0; groups < ACTIVE_EXPIRE_GROUPS_PER_LOOP && sampled < ACTIVE_EXPIRE_KEYS_PER_LOOP; ++groups)
+                    {
+                        shard.expire_cursor = shard.expires.scan(shard.expire_cursor, [&](std::string_view key, long long when)
+                                                                 {
+                                                                     ++sampled;
+                                                                     if (when <= now)
+                                                                         expired.emplace_back(key); });
+                        if (shard.expire_cursor == 0)
+                            break;
+                    }
+                    for (const std::string &key : expired)
+                    {
+                        reclaim(shard, key, Dict<RedisObject>::hashKey(key));
+                    }
+                }
+                result.expired += expired.size();
+                if (Clock::now() >= deadline)
+                {
+                    result.time_limit_reached = true;
+                    return result;
+                }
+                if (expired.size() * 100 <= sampled * ACTIVE_EXPIRE_ACCEPTABLE_STALE)
+                    break;
+            }
+            expire_shard_ = (expire_shard_ + 1) & mask_;
+        }
+        return result;
+    }
+
+    /// @brief Delete one key chosen by the eviction policy: sample a shard into the eviction pool and
+    /// take the pool's best candidate. Thread-safe; concurrent evictions take turns on the pool.
+    /// @param evicted if not null, receives the deleted key, e.g. to tell replicas.
+    /// @return bytes freed, 0 when there is nothing the policy may evict.
+    size_t evictOne(std::string *evicted = nullptr)
+    {
+        EvictionPolicy policy = policy_.load(std::memory_order_relaxed);
+        if (policy == EvictionPolicy::NoEviction)
+            return 0;
+        std::lock_guard pool_lock(eviction_mutex_);
+        EvictionPool::Candidate candidate;
+        for (size_t attempts = 0; attempts <= mask_; ++attempts)
+        {
+            populateEvictionPool(policy, evict_shard_);
+            evict_shard_ = (evict_shard_ + 1) & mask_;
+            while (eviction_pool_.pop(candidate))
+            {
+                Shard &shard = shards_[candidate.shard];
+                size_t hash = Dict<RedisObject>::hashKey(candidate.key);
+                WriteLock lock(*this, shard);
+                // The pool may hold keys deleted (or made persistent) since they were sampled.
+                if (shard.map.find(candidate.key, hash) == nullptr)
+                    continue;
+                if (isVolatile(policy) && (shard.expires.size() == 0 || shard.expires.find(candidate.key, hash) == nullptr))
+                    continue;
+                if (evicted != nullptr)
+                    *evicted = candidate.key;
+                size_t bytes = deleteKey(shard, candidate.key, hash);
+                evicted_keys_.fetch_add(1, std::memory_order_relaxed);
+                return bytes;
+            }
+        }
+        return 0;
+    }
+
+    /// @brief Advance the incremental rehash of growing shards for about `budget`.
+    /// The shard lock is taken for one small batch at a time, so clients wait at most for one batch.
+    void rehashStep(std::chrono::microseconds budget)
+    {
+        auto deadline = Clock::now() + budget;
+        for (size_t i = 0; i <= mask_; ++i)
+        {
+            Shard &shard = shards_[i];
+            bool rehashing = true;
+            while (rehashing)
+            {
+                {
+                    std::unique_lock lock(shard.mutex);
+                    rehashing = shard.map.rehashStep(REHASH_BATCH_GROUPS) | shard.expires.rehashStep(REHASH_BATCH_GROUPS);
+                }
+                if (Clock::now() >= deadline)
+                    return;
+            }
+        }
+    }
+
+    /// @return number of keys, including expired ones not removed yet.
+    size_t size() const
+    {
+        size_t n = 0;
+        for (size_t i = 0; i <= mask_; ++i)
+        {
+            std::shared_lock lock(shards_[i].mutex);
+            n += shards_[i].map.size();
+        }
+        return n;
+    }
+
+    /// @return number of keys with a TTL.
+    size_t expiresSize() const
+    {
+        size_t n = 0;
+        for (size_t i = 0; i <= mask_; ++i)
+        {
+            std::shared_lock lock(shards_[i].mutex);
+            n += shards_[i].expires.size();
+        }
+        return n;
+    }
+
+    /// @return bytes held by the keys, values and TTLs: their dict slots and heap payloads. Free dict
+    /// slots are not counted, so deleting a key always lowers it.
+    size_t usedMemory() const
+    {
+        return static_cast<size_t>(std::max<int64_t>(0, used_memory_.load(std::memory_order_relaxed)));
+    }
+
+    /// @return keys deleted because their TTL passed, on access or by activeExpireCycle().
+    uint64_t expiredKeys() const
+    {
+        return expired_keys_.load(std::memory_order_relaxed);
+    }
+
+    /// @return bytes of keys and values freed by those deletions.
+    uint64_t expiredBytes() const
+    {
+        return expired_bytes_.load(std::memory_order_relaxed);
+    }
+
+    /// @return keys deleted by evictOne().
+    uint64_t evictedKeys() const
+    {
+        return evicted_keys_.load(std::memory_order_relaxed);
+    }
+
+private:
+    // Own cache line per shard, so locking one shard does not slow down its neighbours.
+    struct alignas(64) Shard
+    {
+        mutable std::shared_mutex mutex;
+        Dict<RedisObject> map;
+        Dict<long long> expires;  // Keys of `map` that have a TTL, to their expiry time in unix milliseconds.
+        size_t expire_cursor = 0; // Where activeExpireCycle() continues its walk over `expires`.
+        size_t value_bytes = 0;   // Heap bytes of the values in `map`.
+        size_t used_bytes = 0;    // This shard's share of used_memory_.
+    };
+
+    /// @brief Exclusive lock on a shard that folds the shard's memory change into used_memory_ on release.
+    class WriteLock
+    {
+    public:
+        WriteLock(Keyspace &keyspace, Shard &shard) : keyspace_(keyspace), shard_(shard), lock_(shard.mutex) {}
+
+        ~WriteLock()
+        {
+            size_t bytes = shard_.map.entryMemoryUsage() + shard_.expires.entryMemoryUsage() + shard_.value_bytes;
+            if (bytes != shard_.used_bytes)
+            {
+                keyspace_.used_memory_.fetch_add(static_cast<int64_t>(bytes) - static_cast<int64_t>(shard_.used_bytes), std::memory_order_relaxed);
+                shard_.used_bytes = bytes;
+            }
+            if (write_order_ != nullptr)
+                write_order_->push_back(keyspace_.nextWriteOrder());
+        }
+
+    private:
+        Keyspace &keyspace_;
+        Shard &shard_;
+        std::unique_lock<std::shared_mutex> lock_;
+    };
+
+    std::unique_ptr<Shard[]> shards_;
+    size_t mask_ = 0;
+    size_t expire_shard_ = 0; // Shard activeExpireCycle() continues with; only touched by the cron thread.
+    std::atomic<uint64_t> expired_keys_{0};
+    std::atomic<uint64_t> expired_bytes_{0};
+
+    std::atomic<EvictionPolicy> policy_{EvictionPolicy::NoEviction};
+    std::atomic<long long> clock_ms_{nowMs()}; // Time the eviction bits are stamped with, see updateClock().
+    std::atomic<int64_t> used_memory_{0};
+    std::atomic<uint64_t> evicted_keys_{0};
+    std::atomic<uint64_t> write_seq_{0}; // See recordWriteOrder().
+    static inline thread_local std::vector<uint64_t> *write_order_ = nullptr; // See recordWriteOrder().
+    std::atomic<size_t> prefetch_batch_{DEFAULT_PREFETCH_BATCH};
+    std::mutex eviction_mutex_; // Guards the pool and evict_shard_.
+    EvictionPool eviction_pool_;
+    size_t evict_shard_ = 0; // Next shard sampled into the pool.
+
+    // The low bits of the hash pick the group inside a shard's map, so use the high bits for the shard.
+    size_t shardIndex(size_t hash) const
+    {
+        return (hash >> 48) & mask_;
+    }
+
+    Shard &shardFor(size_t hash)
+    {
+        return shards_[shardIndex(hash)];
+    }
+
+    const Shard &shardFor(size_t hash) const
+    {
+        return shards_[shardIndex(hash)];
+    }
+
+    static std::vector<size_t> hashKeys(const std::vector<std::string_view> &keys)
+    {
+        std::vector<size_t> hashes(keys.size());
+        for (size_t i = 0; i < keys.size(); ++i)
+            hashes[i] = Dict<RedisObject>::hashKey(keys[i]);
+        return hashes;
+    }
+
+    /// @return the distinct shards of the hashes, sorted: the order in which multi-key operations
+    /// lock shards, so that they cannot deadlock with each other.
+    std::vector<size_t> shardOrder(const std::vector<size_t> &hashes) const
+    {
+        std::vector<size_t> order;
+        order.reserve(hashes.size());
+        for (size_t hash : hashes)
+            order.push_back(shardIndex(hash));
+        std::sort(order.begin(), order.end());
+        order.erase(std::unique(order.begin(), order.end()), order.end());
+        return order;
+    }
+
+    /// @brief The batched lookup path of multi-key operations, called before looking up key i.
+    /// At the start of every batch, first the control bytes of all the batch's keys are requested, then
+    /// the slots they point to, so a large keyspace costs about one round of cache misses per batch
+    /// instead of one per key. Callers hold the shard locks.
+    void prefetchBatch(const std::vector<size_t> &hashes, size_t i) const
+    {
+        size_t batch = prefetch_batch_.load(std::memory_order_relaxed);
+        if (batch <= 1 || i % batch != 0)
+            return;
+        size_t end = std::min(hashes.size(), i + batch);
+        for (size_t j = i; j < end; ++j)
+        {
+            const Shard &shard = shardFor(hashes[j]);
+            shard.map.prefetch(hashes[j]);
+            if (shard.expires.size() != 0)
+                shard.expires.prefetch(hashes[j]);
+        }
+        for (size_t j = i; j < end; ++j)
+            shardFor(hashes[j]).map.prefetchSlots(hashes[j]);
+    }
+
+    /// @brief set() with the shard locked exclusively.
+    void setLocked(Shard &shard, std::string_view key, size_t hash, RedisObject &&value, long long expire_ms)
+    {
+        RedisObject *slot = shard.map.tryEmplace(key, hash).first;
+        shard.value_bytes += value.heapBytes() - slot->heapBytes();
+        value.setAccessBits(Eviction::initialBits(isLfu(), clock_ms_.load(std::memory_order_relaxed)));
+        *slot = std::move(value);
+        if (expire_ms != NO_EXPIRE)
+            *shard.expires.tryEmplace(key, hash).first = expire_ms;
+        else if (shard.expires.size() != 0)
+            shard.expires.erase(key, hash);
+    }
+
+    bool isLfu() const
+    {
+        return policy_.load(std::memory_order_relaxed) == EvictionPolicy::AllKeysLfu;
+    }
+
+    static bool isVolatile(EvictionPolicy policy)
+    {
+        return policy == EvictionPolicy::VolatileLru || policy == EvictionPolicy::VolatileTtl;
+    }
+
+    /// @brief Record an access in the value's eviction bits. Callers hold the shard lock, shared or exclusive.
+    void touch(RedisObject &value)
+    {
+        uint32_t bits = value.accessBits();
+        uint32_t touched = Eviction::touchedBits(isLfu(), bits, clock_ms_.load(std::memory_order_relaxed));
+        // Skipping unchanged bits keeps readers of a hot key from bouncing its cache line between cores.
+        if (touched != bits)
+            value.setAccessBits(touched);
+    }
+
+    /// @brief Offer up to MAXMEMORY_SAMPLES keys of one shard to the eviction pool, scored by the policy.
+    /// Callers hold eviction_mutex_.
+    void populateEvictionPool(EvictionPolicy policy, size_t index)
+    {
+        Shard &shard = shards_[index];
+        std::shared_lock lock(shard.mutex);
+        long long now_ms = clock_ms_.load(std::memory_order_relaxed);
+        uint32_t lru_clock = Eviction::lruClock(now_ms);
+        uint32_t minutes = Eviction::lfuTimeInMinutes(now_ms);
+        size_t random = static_cast<size_t>(Clock::now().time_since_epoch().count()) * 0x9E3779B97F4A7C15ULL;
+        auto idleOf = [&](const RedisObject &value) -> unsigned long long
+        {
+            if (policy == EvictionPolicy::AllKeysRandom)
+                return random = random * 6364136223846793005ULL + 1442695040888963407ULL; // Any score will do.
+            if (policy == EvictionPolicy::AllKeysLfu)
+                return 255 - Eviction::lfuDecrAndReturn(value.accessBits(), minutes);
+            return Eviction::lruIdleTime(value.accessBits(), lru_clock);
+        };
+        if (!isVolatile(policy))
+        {
+            shard.map.sample(MAXMEMORY_SAMPLES, random, [&](std::string_view key, RedisObject &value)
+                             { eviction_pool_.offer(idleOf(value), key, index); });
+            return;
+        }
+        shard.expires.sample(MAXMEMORY_SAMPLES, random, [&](std::string_view key, long long when)
+                             {
+                                 if (policy == EvictionPolicy::VolatileTtl)
+                                 {
+                                     // Sooner is better: invert the expiry time.
+                                     eviction_pool_.offer(~static_cast<unsigned long long>(when), key, index);
+                                     return;
+                                 }
+                                 if (const RedisObject *value = shard.map.find(key))
+                                     eviction_pool_.offer(idleOf(*value), key, index); });
+    }
+
+    /// Callers hold the shard lock, shared or exclusive.
+    static bool isExpired(const Shard &shard, std::string_view key, size_t hash)
+    {
+        if (shard.expires.size() == 0)
+            return false;
+        const long long *when = shard.expires.find(key, hash);
+        return when != nullptr && *when <= nowMs();
+    }
+
+    /// @brief Delete a key and its TTL. Callers hold the shard lock exclusively.
+    /// @param unlinked if not null, receives the value instead of destroying it.
+    /// @return bytes of the key and value freed.
+    static size_t deleteKey(Shard &shard, std::string_view key, size_t hash, std::vector<RedisObject> *unlinked = nullptr)
+    {
+        size_t bytes = 0;
+        if (RedisObject *value = shard.map.find(key, hash))
+        {
+            bytes = key.size() + value->memoryUsage();
+            shard.value_bytes -= value->heapBytes();
+            if (unlinked != nullptr)
+                unlinked->push_back(std::move(*value));
+            shard.map.erase(key, hash);
+        }
+        if (shard.expires.size() != 0)
+            shard.expires.erase(key, hash);
+        return bytes;
+    }
+
+    /// @brief Delete an expired key and account for it. Callers hold the shard lock exclusively.
+    void reclaim(Shard &shard, std::string_view key, size_t hash)
+    {
+        size_t bytes = deleteKey(shard, key, hash);
+        expired_keys_.fetch_add(1, std::memory_order_relaxed);
+        expired_bytes_.fetch_add(bytes, std::memory_order_relaxed);
+    }
+
+    /// @return true if the key had expired and was deleted. Callers hold the shard lock exclusively.
+    bool expireIfNeeded(Shard &shard, std::string_view key, size_t hash)
+    {
+        if (!isExpired(shard, key, hash))
+            return false;
+        reclaim(shard, key, hash);
+        return true;
+    }
+};
@@ -0,0 +1,184 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <string_view>
+
+/// @brief Strings packed back to back in one exactly sized allocation, like redis' listpack.
+/// Small hashes and sorted sets keep their fields and values (members and scores) here as
+/// alternating entries: a few bytes of framing per string instead of a node, a hash slot and two
+/// allocations. Lookups are linear scans, which for a few dozen entries in one or two cache lines
+/// beat hashing.
+///
+/// An entry is [length][bytes], the length as a LEB128 varint. Entries are addressed by their byte
+/// offset; begin() is the first entry and end() is one past the last one.
+class Listpack
+{
+public:
+    Listpack() = default;
+    Listpack(const Listpack &) = delete;
+    Listpack &operator=(const Listpack &) = delete;
+
+    ~Listpack()
+    {
+        std::free(data_);
+    }
+
+    /// @return number of entries.
+    size_t size() const
+    {
+        return count_;
+    }
+
+    /// @return bytes allocated by the listpack.
+    size_t memoryUsage() const
+    {
+        return sizeof(*this) + bytes_;
+    }
+
+    size_t begin() const
+    {
+        return 0;
+    }
+
+    size_t end() const
+    {
+        return bytes_;
+    }
+
+    /// @brief The entry at offset `pos`.
+    /// @param next if not null, receives the offset of the following entry.
+    std::string_view get(size_t pos, size_t *next = nullptr) const
+    {
+        size_t len = 0;
+        for (size_t shift = 0;; shift += 7)
+        {
+            unsigned char b = data_[pos++];
+            len |= static_cast<size_t>(b & 127) << shift;
+            if ((b & 128) == 0)
+                break;
+        }
+        if (next != nullptr)
+            *next = pos + len;
+        return std::string_view(reinterpret_cast<const char *>(data_ + pos), len);
+    }
+
+    /// @return the offset of the entry after the one at `pos`.
+    size_t next(size_t pos) const
+    {
+        get(pos, &pos);
+        return pos;
+    }
+
+    /// @brief Find the first entry equal to `value` from `pos` on, comparing only every (skip + 1)th
+    /// entry, e.g. skip 1 to look at the fields of a field/value list and not at the values.
+    /// @return its offset, or end().
+    size_t find(std::string_view value, size_t skip, size_t pos = 0) const
+    {
+        while (pos < bytes_)
+        {
+            if (get(pos, &pos) == value)
+                return pos - value.size() - varintSize(value.size());
+            for (size_t i = 0; i < skip && pos < bytes_; ++i)
+                pos = next(pos);
+        }
+        return bytes_;
+    }
+
+    void append(std::string_view value)
+    {
+        size_t pos = bytes_;
+        resize(bytes_ + entrySize(value.size()));
+        writeEntry(data_ + pos, value);
+        ++count_;
+    }
+
+    /// @brief Insert an entry before the one at `pos` (at the end for end()).
+    void insert(size_t pos, std::string_view value)
+    {
+        size_t size = entrySize(value.size());
+        size_t tail = bytes_ - pos;
+        resize(bytes_ + size);
+        std::memmove(data_ + pos + size, data_ + pos, tail);
+        writeEntry(data_ + pos, value);
+        ++count_;
+    }
+
+    /// @brief Overwrite the entry at `pos`, moving the entries after it when the size changes.
+    void replace(size_t pos, std::string_view value)
+    {
+        size_t old_end = next(pos);
+        size_t new_end = pos + entrySize(value.size());
+        size_t tail = bytes_ - old_end;
+        if (new_end > old_end)
+        {
+            resize(bytes_ + (new_end - old_end));
+            std::memmove(data_ + new_end, data_ + old_end, tail);
+        }
+        else if (new_end < old_end)
+        {
+            std::memmove(data_ + new_end, data_ + old_end, tail);
+            resize(bytes_ - (old_end - new_end));
+        }
+        writeEntry(data_ + pos, value);
+    }
+
+    /// @brief Remove `count` entries starting with the one at `pos`.
+    void erase(size_t pos, size_t count)
+    {
+        size_t end = pos;
+        for (size_t i = 0; i < count; ++i)
+            end = next(end);
+        std::memmove(data_ + pos, data_ + end, bytes_ - end);
+        resize(bytes_ - (end - pos));
+        count_ -= count;
+    }
+
+    static size_t entrySize(size_t len)
+    {
+        return varintSize(len) + len;
+    }
+
+private:
+    unsigned char *data_ = nullptr;
+    size_t bytes_ = 0;
+    size_t count_ = 0;
+
+    static size_t varintSize(size_t value)
+    {
+        size_t n = 1;
+        for (; value >= 128; value >>= 7)
+            ++n;
+        return n;
+    }
+
+    static void writeEntry(unsigned char *p, std::string_view value)
+    {
+        size_t len = value.size();
+        for (; len >= 128; len >>= 7)
+            *p++ = static_cast<unsigned char>((len & 127) | 128);
+        *p++ = static_cast<unsigned char>(len);
+        std::memcpy(p, value.data(), value.size());
+    }
+
+    /// @brief Reallocate to exactly `bytes`, like redis does on every listpack change: the lists are
+    /// small, and no slack is what makes them compact.
+    void resize(size_t bytes)
+    {
+        if (bytes == 0)
+        {
+            std::free(data_);
+            data_ = nullptr;
+        }
+        else
+        {
+            void *p = std::realloc(data_, bytes);
+            if (p == nullptr)
+                throw std::bad_alloc();
+            data_ = static_cast<unsigned char *>(p);
+        }
+        bytes_ = bytes;
+    }
+};
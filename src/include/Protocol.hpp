@@ -0,0 +1,169 @@
+#pragma once
+
+#include <cstddef>
+#include <cstring>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+/// @brief Upper bounds on a request frame. A client exceeding them gets an error reply and is disconnected.
+struct ProtocolLimits
+{
+    size_t max_bulk_len = 512 * 1024 * 1024; // Largest single argument (proto-max-bulk-len).
+    size_t max_multibulk_len = 1024 * 1024;  // Most arguments in one command.
+};
+
+/// @brief Outcome of looking for one request frame at the front of a query buffer.
+struct FrameScan
+{
+    enum Status
+    {
+        Complete,   // `length` is the size of the whole frame.
+        Incomplete, // `length` is how many bytes the frame needs at least; nothing needs scanning before then.
+        Error,      // `error` describes the violation.
+    };
+
+    Status status = Incomplete;
+    size_t length = 0;
+    const char *error = nullptr;
+};
+
+/// @brief How far scanRequestFrame() got in a frame that is not complete yet, like redis' multibulklen
+/// and bulklen: the next call resumes there instead of scanning the frame from its start again, so a
+/// frame with many arguments that arrives in many reads is scanned once. Positions are offsets from
+/// the start of the frame, because the buffer may move between calls.
+struct FrameState
+{
+    size_t pos = 0;                              // End of the header lines and arguments scanned so far.
+    long long remaining = -1;                    // Arguments left to scan; -1 until the "*<count>" line is read.
+    std::vector<std::pair<size_t, size_t>> args; // Offset and length of every argument scanned.
+
+    void reset()
+    {
+        pos = 0;
+        remaining = -1;
+        args.clear();
+        if (args.capacity() > 1024)
+            args.shrink_to_fit(); // Don't keep the offsets of a huge command around.
+    }
+};
+
+/// Longest header line ("*<count>" or "$<len>") accepted before its CRLF shows up.
+inline constexpr size_t PROTO_MAX_LINE = 64 * 1024;
+
+/// @brief Parse a "<prefix><integer>\r\n" header line starting at `pos`.
+/// @return false when the line is not complete yet; `error` is set when it is malformed.
+inline bool scanHeaderLine(const char *p, size_t len, size_t &pos, char prefix, long long &value, const char *&error)
+{
+    const char *start = p + pos;
+    size_t avail = len - pos;
+    if (*start != prefix)
+    {
+        error = prefix == '*' ? "expected '*'" : "expected '$'";
+        return false;
+    }
+    const char *cr = static_cast<const char *>(std::memchr(start, '\r', avail < PROTO_MAX_LINE ? avail : PROTO_MAX_LINE));
+    if (cr == nullptr || cr + 1 == p + len)
+    {
+        if (avail >= PROTO_MAX_LINE)
+            error = prefix == '*' ? "too big mbulk count string" : "too big bulk count string";
+        return false;
+    }
+    if (cr[1] != '\n')
+    {
+        error = "header not terminated by CRLF";
+        return false;
+    }
+    const char *digit = start + 1;
+    bool negative = digit < cr && *digit == '-';
+    if (negative)
+        ++digit;
+    if (digit == cr || cr - digit > 18)
+    {
+        error = prefix == '*' ? "invalid multibulk length" : "invalid bulk length";
+        return false;
+    }
+    value = 0;
+    for (; digit < cr; ++digit)
+    {
+        if (*digit < '0' || *digit > '9')
+        {
+            error = prefix == '*' ? "invalid multibulk length" : "invalid bulk length";
+            return false;
+        }
+        value = value * 10 + (*digit - '0');
+    }
+    if (negative)
+        value = -value;
+    pos = (cr - p) + 2;
+    return true;
+}
+
+/// @brief Find the extent of the request frame (an array of bulk strings) at the front of `p`.
+/// Only header lines are looked at; argument bytes are skipped by their declared length,
+/// so the cost does not depend on how large the arguments are.
+/// @param state where the previous call stopped in this frame; reset once the frame is complete or invalid.
+/// @param argv when given, receives a view of every argument of a complete frame (nothing is copied).
+inline FrameScan scanRequestFrame(const char *p, size_t len, const ProtocolLimits &limits, FrameState &state, std::vector<std::string_view> *argv = nullptr)
+{
+    FrameScan scan;
+    size_t pos = state.pos;
+    auto stop = [&](FrameScan::Status status, size_t need)
+    {
+        scan.status = status;
+        scan.length = need;
+        if (status == FrameScan::Incomplete)
+            state.pos = pos;
+        else
+            state.reset();
+        return scan;
+    };
+    if (state.remaining < 0)
+    {
+        long long count = 0;
+        if (!scanHeaderLine(p, len, pos, '*', count, scan.error))
+            return stop(scan.error ? FrameScan::Error : FrameScan::Incomplete, len + 1);
+        if (count > static_cast<long long>(limits.max_multibulk_len))
+        {
+            scan.error = "invalid multibulk length";
+            return stop(FrameScan::Error, 0);
+        }
+        state.remaining = count > 0 ? count : 0;
+        // Like redis, trust a huge count only as far as the arguments that actually arrive.
+        state.args.reserve(static_cast<size_t>(state.remaining < 1024 ? state.remaining : 1024));
+    }
+    while (state.remaining > 0)
+    {
+        size_t header = pos;
+        long long bulk_len = 0;
+        if (pos == len || !scanHeaderLine(p, len, pos, '$', bulk_len, scan.error))
+            return stop(scan.error ? FrameScan::Error : FrameScan::Incomplete, len + 1);
+        if (bulk_len < 0 || bulk_len > static_cast<long long>(limits.max_bulk_len))
+        {
+            scan.error = "invalid bulk length";
+            return stop(FrameScan::Error, 0);
+        }
+        size_t end = pos + static_cast<size_t>(bulk_len) + 2;
+        if (end > len)
+        {
+            // The argument is still arriving; its size tells how much to wait for. Its header is read again then.
+            pos = header;
+            return stop(FrameScan::Incomplete, end);
+        }
+        if (p[end - 2] != '\r' || p[end - 1] != '\n')
+        {
+            scan.error = "bulk string not terminated by CRLF";
+            return stop(FrameScan::Error, 0);
+        }
+        state.args.emplace_back(pos, static_cast<size_t>(bulk_len));
+        pos = end;
+        --state.remaining;
+    }
+    if (argv != nullptr)
+    {
+        argv->clear();
+        for (auto [offset, length] : state.args)
+            argv->emplace_back(p + offset, length);
+    }
+    return stop(FrameScan::Complete, pos);
+}
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <algorithm>
+#include <cstring>
+#include <memory>
+
+/// @brief Growable, binary-safe input buffer of a client.
+/// Sockets are read straight into its free tail, so no scratch buffer and no memset are needed;
+/// consumed bytes are dropped from the front and the memory is reused by later reads.
+class QueryBuffer
+{
+public:
+    /// Idle buffers above this capacity are released instead of being kept for reuse.
+    static constexpr size_t IDLE_MAX_CAPACITY = 64 * 1024;
+
+    QueryBuffer() = default;
+    QueryBuffer(const QueryBuffer &) = delete;
+    QueryBuffer &operator=(const QueryBuffer &) = delete;
+
+    const char *data() const
+    {
+        return data_.get() + start_;
+    }
+
+    size_t size() const
+    {
+        return end_ - start_;
+    }
+
+    bool empty() const
+    {
+        return start_ == end_;
+    }
+
+    /// @brief Make room for at least `n` more bytes.
+    /// @return pointer where up to `n` bytes may be written, followed by commit().
+    char *prepare(size_t n)
+    {
+        if (cap_ - end_ < n)
+        {
+            size_t used = size();
+            if (cap_ - used >= n && start_ > 0)
+            {
+                std::memmove(data_.get(), data_.get() + start_, used);
+            }
+            else
+            {
+                size_t cap = std::max(cap_ * 2, used + n);
+                auto grown = std::make_unique_for_overwrite<char[]>(cap);
+                if (used > 0)
+                    std::memcpy(grown.get(), data_.get() + start_, used);
+                data_ = std::move(grown);
+                cap_ = cap;
+            }
+            start_ = 0;
+            end_ = used;
+        }
+        return data_.get() + end_;
+    }
+
+    /// @brief Mark `n` bytes written after prepare() as received.
+    void commit(size_t n)
+    {
+        end_ += n;
+    }
+
+    void append(const char *p, size_t n)
+    {
+        std::memcpy(prepare(n), p, n);
+        commit(n);
+    }
+
+    /// @brief Drop `n` processed bytes from the front.
+    void consume(size_t n)
+    {
+        start_ += n;
+        if (start_ == end_)
+        {
+            start_ = end_ = 0;
+            if (cap_ > IDLE_MAX_CAPACITY)
+            {
+                // A big frame is done; don't keep its memory around for an idle connection.
+                data_.reset();
+                cap_ = 0;
+            }
+        }
+    }
+
+private:
+    std::unique_ptr<char[]> data_;
+    size_t cap_ = 0;
+    size_t start_ = 0;
+    size_t end_ = 0;
+};
@@ -0,0 +1,345 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <new>
+#include <string>
+#include <string_view>
+
+/// @brief List of strings stored as a doubly linked list of packed nodes, like redis' quicklist of listpacks.
+/// A node is a single allocation holding up to NODE_MAX_BYTES of consecutive entries, so a short element
+/// costs a few bytes of framing instead of a heap allocation of its own. Nodes keep their free room at the
+/// end that is being pushed to and grow geometrically, so pushes and pops at both ends of the list are
+/// O(1) amortized and never touch the bytes of other nodes.
+///
+/// An entry is [length][bytes][backlen]: the length as a LEB128 varint, then the bytes, then the size of
+/// the first two parts as a varint written to be read backwards, so a node can be walked in both directions.
+class Quicklist
+{
+public:
+    static constexpr size_t NODE_MAX_BYTES = 8 * 1024; // Same default node size as redis' list-max-listpack-size -2.
+    static constexpr size_t NODE_MIN_BYTES = 64;       // First allocation of a node; it doubles up to NODE_MAX_BYTES.
+
+    Quicklist() = default;
+    Quicklist(const Quicklist &) = delete;
+    Quicklist &operator=(const Quicklist &) = delete;
+
+    ~Quicklist()
+    {
+        clear();
+    }
+
+    size_t size() const
+    {
+        return count_;
+    }
+
+    /// @return bytes allocated by the list, node headers and free room included.
+    size_t memoryUsage() const
+    {
+        return sizeof(*this) + bytes_;
+    }
+
+    void pushFront(std::string_view value)
+    {
+        size_t need = entrySize(value.size());
+        if (head_ == nullptr || head_->used() + need > NODE_MAX_BYTES)
+        {
+            linkBefore(head_, allocNode(std::max(need, NODE_MIN_BYTES), true));
+        }
+        Node *node = makeRoom(head_, need, true);
+        node->begin -= static_cast<uint32_t>(need);
+        writeEntry(node->data() + node->begin, value);
+        ++node->count;
+        ++count_;
+    }
+
+    void pushBack(std::string_view value)
+    {
+        size_t need = entrySize(value.size());
+        if (tail_ == nullptr || tail_->used() + need > NODE_MAX_BYTES)
+        {
+            linkBefore(nullptr, allocNode(std::max(need, NODE_MIN_BYTES), false));
+        }
+        Node *node = makeRoom(tail_, need, false);
+        writeEntry(node->data() + node->end, value);
+        node->end += static_cast<uint32_t>(need);
+        ++node->count;
+        ++count_;
+    }
+
+    bool popFront(std::string &out)
+    {
+        if (head_ == nullptr)
+            return false;
+        out = readEntry(head_->data() + head_->begin, nullptr);
+        removeFront(1);
+        return true;
+    }
+
+    bool popBack(std::string &out)
+    {
+        if (tail_ == nullptr)
+            return false;
+        out = readEntry(entryBefore(tail_->data() + tail_->end), nullptr);
+        removeBack(1);
+        return true;
+    }
+
+    /// @brief The element at position `index` from the head, found from whichever end is closer.
+    bool index(size_t index, std::string_view &out) const
+    {
+        if (index >= count_)
+            return false;
+        if (index < count_ / 2)
+        {
+            const Node *node = head_;
+            while (index >= node->count)
+            {
+                index -= node->count;
+                node = node->next;
+            }
+            const unsigned char *p = node->data() + node->begin;
+            for (; index > 0; --index)
+                readEntry(p, &p);
+            out = readEntry(p, nullptr);
+            return true;
+        }
+        size_t from_tail = count_ - 1 - index;
+        const Node *node = tail_;
+        while (from_tail >= node->count)
+        {
+            from_tail -= node->count;
+            node = node->prev;
+        }
+        const unsigned char *p = entryBefore(node->data() + node->end);
+        for (; from_tail > 0; --from_tail)
+            p = entryBefore(p);
+        out = readEntry(p, nullptr);
+        return true;
+    }
+
+    /// @brief Call fn(std::string_view element) for `count` elements from position `start` on.
+    template <typename F>
+    void range(size_t start, size_t count, F &&fn) const
+    {
+        if (start >= count_)
+            return;
+        count = std::min(count, count_ - start);
+        const Node *node = head_;
+        while (start >= node->count)
+        {
+            start -= node->count;
+            node = node->next;
+        }
+        const unsigned char *p = node->data() + node->begin;
+        for (; start > 0; --start)
+            readEntry(p, &p);
+        while (count > 0)
+        {
+            if (p == node->data() + node->end)
+            {
+                node = node->next;
+                p = node->data() + node->begin;
+            }
+            fn(readEntry(p, &p));
+            --count;
+        }
+    }
+
+    /// @brief Remove the first `n` elements. Whole nodes are freed without looking at their entries.
+    void removeFront(size_t n)
+    {
+        n = std::min(n, count_);
+        count_ -= n;
+        while (n > 0 && n >= head_->count)
+        {
+            n -= head_->count;
+            unlinkAndFree(head_);
+        }
+        if (n == 0)
+            return;
+        const unsigned char *p = head_->data() + head_->begin;
+        for (size_t i = 0; i < n; ++i)
+            readEntry(p, &p);
+        head_->begin = static_cast<uint32_t>(p - head_->data());
+        head_->count -= static_cast<uint32_t>(n);
+    }
+
+    /// @brief Remove the last `n` elements.
+    void removeBack(size_t n)
+    {
+        n = std::min(n, count_);
+        count_ -= n;
+        while (n > 0 && n >= tail_->count)
+        {
+            n -= tail_->count;
+            unlinkAndFree(tail_);
+        }
+        if (n == 0)
+            return;
+        const unsigned char *p = tail_->data() + tail_->end;
+        for (size_t i = 0; i < n; ++i)
+            p = entryBefore(p);
+        tail_->end = static_cast<uint32_t>(p - tail_->data());
+        tail_->count -= static_cast<uint32_t>(n);
+    }
+
+    void clear()
+    {
+        while (head_ != nullptr)
+            unlinkAndFree(head_);
+        count_ = 0;
+    }
+
+private:
+    struct Node
+    {
+        Node *prev = nullptr;
+        Node *next = nullptr;
+        uint32_t count = 0;    // Entries in the node.
+        uint32_t begin = 0;    // Offset of the first entry in data().
+        uint32_t end = 0;      // Offset one past the last entry.
+        uint32_t capacity = 0; // Bytes of data().
+
+        unsigned char *data()
+        {
+            return reinterpret_cast<unsigned char *>(this + 1);
+        }
+
+        const unsigned char *data() const
+        {
+            return reinterpret_cast<const unsigned char *>(this + 1);
+        }
+
+        size_t used() const
+        {
+            return end - begin;
+        }
+    };
+
+    Node *head_ = nullptr;
+    Node *tail_ = nullptr;
+    size_t count_ = 0;
+    size_t bytes_ = 0; // Node headers and data, for memoryUsage().
+
+    static size_t varintSize(size_t value)
+    {
+        size_t n = 1;
+        for (; value >= 128; value >>= 7)
+            ++n;
+        return n;
+    }
+
+    static size_t entrySize(size_t len)
+    {
+        size_t body = varintSize(len) + len;
+        return body + varintSize(body);
+    }
+
+    static void writeEntry(unsigned char *p, std::string_view value)
+    {
+        unsigned char *start = p;
+        size_t len = value.size();
+        for (; len >= 128; len >>= 7)
+            *p++ = static_cast<unsigned char>((len & 127) | 128);
+        *p++ = static_cast<unsigned char>(len);
+        std::memcpy(p, value.data(), value.size());
+        p += value.size();
+        // The last byte holds the lowest 7 bits, and the high bit of a byte says another one precedes it.
+        size_t body = p - start;
+        size_t n = varintSize(body);
+        for (size_t i = 0; i < n; ++i)
+            p[n - 1 - i] = static_cast<unsigned char>(((body >> (7 * i)) & 127) | (i + 1 < n ? 128 : 0));
+    }
+
+    /// @param next if not null, receives the start of the following entry.
+    static std::string_view readEntry(const unsigned char *p, const unsigned char **next)
+    {
+        const unsigned char *start = p;
+        size_t len = 0;
+        for (size_t shift = 0;; shift += 7)
+        {
+            unsigned char b = *p++;
+            len |= static_cast<size_t>(b & 127) << shift;
+            if ((b & 128) == 0)
+                break;
+        }
+        std::string_view value(reinterpret_cast<const char *>(p), len);
+        if (next != nullptr)
+            *next = p + len + varintSize(p + len - start);
+        return value;
+    }
+
+    /// @return the start of the entry that ends at `end`.
+    static const unsigned char *entryBefore(const unsigned char *end)
+    {
+        size_t body = 0;
+        size_t i = 0;
+        unsigned char b;
+        do
+        {
+            b = *(end - 1 - i);
+            body |= static_cast<size_t>(b & 127) << (7 * i);
+            ++i;
+        } while (b & 128);
+        return end - i - body;
+    }
+
+    /// @param front whether the node starts with its room in front, for pushes at the head.
+    Node *allocNode(size_t capacity, bool front)
+    {
+        Node *node = new (::operator new(sizeof(Node) + capacity)) Node;
+        node->capacity = static_cast<uint32_t>(capacity);
+        node->begin = node->end = front ? node->capacity : 0;
+        bytes_ += sizeof(Node) + capacity;
+        return node;
+    }
+
+    /// @brief Insert `node` before `next`, or at the tail when `next` is null.
+    void linkBefore(Node *next, Node *node)
+    {
+        node->next = next;
+        node->prev = next != nullptr ? next->prev : tail_;
+        (node->prev != nullptr ? node->prev->next : head_) = node;
+        (next != nullptr ? next->prev : tail_) = node;
+    }
+
+    void unlinkAndFree(Node *node)
+    {
+        (node->prev != nullptr ? node->prev->next : head_) = node->next;
+        (node->next != nullptr ? node->next->prev : tail_) = node->prev;
+        bytes_ -= sizeof(Node) + node->capacity;
+        node->~Node();
+        ::operator delete(node);
+    }
+
+    /// @brief Make `need` free bytes at one end of a node, growing it (which moves it) or sliding its entries.
+    /// @return the node, at its new address if it moved.
+    Node *makeRoom(Node *node, size_t need, bool front)
+    {
+        size_t room = front ? node->begin : node->capacity - node->end;
+        if (room >= need)
+            return node;
+        size_t used = node->used();
+        if (node->capacity >= used + need)
+        {
+            // Enough room, but at the other end: slide the entries over.
+            size_t begin = front ? node->capacity - used : 0;
+            std::memmove(node->data() + begin, node->data() + node->begin, used);
+            node->begin = static_cast<uint32_t>(begin);
+            node->end = static_cast<uint32_t>(begin + used);
+            return node;
+        }
+        size_t capacity = std::max(used + need, std::min(std::max<size_t>(node->capacity * 2, NODE_MIN_BYTES), NODE_MAX_BYTES));
+        Node *grown = allocNode(capacity, front);
+        grown->begin = static_cast<uint32_t>(front ? capacity - used : 0);
+        grown->end = static_cast<uint32_t>(grown->begin + used);
+        grown->count = node->count;
+        std::memcpy(grown->data() + grown->begin, node->data() + node->begin, used);
+        linkBefore(node, grown);
+        unlinkAndFree(node);
+        return grown;
+    }
+};
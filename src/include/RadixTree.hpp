@@ -0,0 +1,259 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <utility>
+#include <vector>
+
+/// @brief Ordered map from fixed size byte-string keys to V, as a radix tree with path compression,
+/// like redis' rax. Every inner node consumes a run of key bytes shared by all the keys below it and
+/// branches on the next byte; leaves sit at depth KEY_BYTES. Keys that share long prefixes, such as
+/// big-endian timestamps, cost a few nodes in total, and the tree keeps them sorted for seeks.
+template <typename V, size_t KEY_BYTES = 16>
+class RadixTree
+{
+public:
+    using Key = std::array<uint8_t, KEY_BYTES>;
+
+    RadixTree() = default;
+    RadixTree(const RadixTree &) = delete;
+    RadixTree &operator=(const RadixTree &) = delete;
+
+    size_t size() const
+    {
+        return size_;
+    }
+
+    /// @return bytes held by the nodes (not what the values point to).
+    size_t memoryUsage() const
+    {
+        return node_bytes_;
+    }
+
+    /// @brief Insert a key, or overwrite its value.
+    /// @return the value's slot, which stays put until the key is erased.
+    V &insert(const Key &key, V value)
+    {
+        if (root_ == nullptr)
+        {
+            root_ = makeNode(key.data(), KEY_BYTES);
+            root_->value = std::move(value);
+            ++size_;
+            return root_->value;
+        }
+        std::unique_ptr<Node> *slot = &root_;
+        size_t depth = 0;
+        while (true)
+        {
+            Node *node = slot->get();
+            size_t common = commonPrefix(*node, key.data() + depth);
+            if (common < node->prefix_len)
+            {
+                // Split: a new inner node takes the common part and branches to both.
+                std::unique_ptr<Node> inner = makeNode(node->prefix, common);
+                uint8_t old_label = node->prefix[common];
+                size_t rest = node->prefix_len - common - 1;
+                std::memmove(node->prefix, node->prefix + common + 1, rest);
+                node->prefix_len = static_cast<uint8_t>(rest);
+                addChild(*inner, old_label, std::move(*slot));
+                *slot = std::move(inner);
+                return addLeaf(**slot, key, depth + common, std::move(value));
+            }
+            depth += node->prefix_len;
+            if (depth == KEY_BYTES)
+            {
+                node->value = std::move(value);
+                return node->value;
+            }
+            auto it = findChild(*node, key[depth]);
+            if (it == node->children.end() || it->first != key[depth])
+                return addLeaf(*node, key, depth, std::move(value));
+            slot = &it->second;
+            ++depth;
+        }
+    }
+
+    /// @return the value of `key`, or nullptr.
+    V *find(const Key &key)
+    {
+        Node *node = root_.get();
+        size_t depth = 0;
+        while (node != nullptr)
+        {
+            if (commonPrefix(*node, key.data() + depth) < node->prefix_len)
+                return nullptr;
+            depth += node->prefix_len;
+            if (depth == KEY_BYTES)
+                return &node->value;
+            auto it = findChild(*node, key[depth]);
+            if (it == node->children.end() || it->first != key[depth])
+                return nullptr;
+            node = it->second.get();
+            ++depth;
+        }
+        return nullptr;
+    }
+
+    /// @return the value of the greatest key not above `key`, or nullptr.
+    const V *floor(const Key &key) const
+    {
+        return root_ == nullptr ? nullptr : floor(*root_, key, 0);
+    }
+
+    V *floor(const Key &key)
+    {
+        return const_cast<V *>(std::as_const(*this).floor(key));
+    }
+
+    /// @return true if the key was there.
+    bool erase(const Key &key)
+    {
+        // The path down, as the slots holding each node.
+        std::unique_ptr<Node> *path[KEY_BYTES + 1];
+        size_t levels = 0;
+        std::unique_ptr<Node> *slot = &root_;
+        size_t depth = 0;
+        while (true)
+        {
+            Node *node = slot->get();
+            if (node == nullptr || commonPrefix(*node, key.data() + depth) < node->prefix_len)
+                return false;
+            path[levels++] = slot;
+            depth += node->prefix_len;
+            if (depth == KEY_BYTES)
+                break;
+            auto it = findChild(*node, key[depth]);
+            if (it == node->children.end() || it->first != key[depth])
+                return false;
+            slot = &it->second;
+            ++depth;
+        }
+        std::unique_ptr<Node> &leaf = *path[levels - 1];
+        freeNode(leaf);
+        --size_;
+        if (levels == 1)
+        {
+            leaf.reset();
+            return true;
+        }
+        Node &parent = *path[levels - 2]->get();
+        parent.children.erase(findChild(parent, key[KEY_BYTES - leaf->prefix_len - 1]));
+        if (parent.children.size() == 1)
+        {
+            // Merge the parent with its only child: prefix, label and the child's prefix in one node.
+            std::unique_ptr<Node> &parent_slot = *path[levels - 2];
+            auto [label, child] = std::move(parent.children.front());
+            uint8_t prefix[KEY_BYTES];
+            size_t len = parent.prefix_len;
+            std::memcpy(prefix, parent.prefix, len);
+            prefix[len++] = label;
+            std::memcpy(prefix + len, child->prefix, child->prefix_len);
+            len += child->prefix_len;
+            std::memcpy(child->prefix, prefix, len);
+            child->prefix_len = static_cast<uint8_t>(len);
+            parent.children.clear();
+            freeNode(parent_slot);
+            parent_slot = std::move(child);
+        }
+        return true;
+    }
+
+private:
+    struct Node
+    {
+        uint8_t prefix_len = 0;
+        uint8_t prefix[KEY_BYTES]; // Key bytes consumed by this node, after its parent's label.
+        std::vector<std::pair<uint8_t, std::unique_ptr<Node>>> children; // Sorted by label.
+        V value{};                                                        // Set on leaves only.
+    };
+
+    std::unique_ptr<Node> root_;
+    size_t size_ = 0;
+    size_t node_bytes_ = 0;
+
+    std::unique_ptr<Node> makeNode(const uint8_t *prefix, size_t len)
+    {
+        auto node = std::make_unique<Node>();
+        std::memcpy(node->prefix, prefix, len);
+        node->prefix_len = static_cast<uint8_t>(len);
+        node_bytes_ += sizeof(Node);
+        return node;
+    }
+
+    /// @brief Account for a node about to be destroyed, with its children array.
+    void freeNode(std::unique_ptr<Node> &node)
+    {
+        node_bytes_ -= sizeof(Node) + node->children.capacity() * sizeof(node->children[0]);
+    }
+
+    static size_t commonPrefix(const Node &node, const uint8_t *key)
+    {
+        size_t i = 0;
+        while (i < node.prefix_len && node.prefix[i] == key[i])
+            ++i;
+        return i;
+    }
+
+    /// @return the first child whose label is not below `label`.
+    static auto findChild(Node &node, uint8_t label)
+    {
+        auto it = node.children.begin();
+        while (it != node.children.end() && it->first < label)
+            ++it;
+        return it;
+    }
+
+    /// @brief Hang a leaf for `key` under `node`, which has consumed key bytes up to `depth`.
+    V &addLeaf(Node &node, const Key &key, size_t depth, V value)
+    {
+        std::unique_ptr<Node> leaf = makeNode(key.data() + depth + 1, KEY_BYTES - depth - 1);
+        leaf->value = std::move(value);
+        V &slot = leaf->value;
+        addChild(node, key[depth], std::move(leaf));
+        ++size_;
+        return slot;
+    }
+
+    void addChild(Node &node, uint8_t label, std::unique_ptr<Node> child)
+    {
+        size_t capacity = node.children.capacity();
+        node.children.emplace(findChild(node, label), label, std::move(child));
+        node_bytes_ += (node.children.capacity() - capacity) * sizeof(node.children[0]);
+    }
+
+    static const V *last(const Node &node)
+    {
+        const Node *n = &node;
+        while (!n->children.empty())
+            n = n->children.back().second.get();
+        return &n->value;
+    }
+
+    static const V *floor(const Node &node, const Key &key, size_t depth)
+    {
+        for (size_t i = 0; i < node.prefix_len; ++i)
+        {
+            if (node.prefix[i] < key[depth + i])
+                return last(node); // Every key below is smaller.
+            if (node.prefix[i] > key[depth + i])
+                return nullptr;
+        }
+        depth += node.prefix_len;
+        if (depth == KEY_BYTES)
+            return &node.value;
+        for (size_t i = node.children.size(); i-- > 0;)
+        {
+            auto &[label, child] = node.children[i];
+            if (label < key[depth])
+                return last(*child);
+            if (label == key[depth])
+            {
+                if (const V *found = floor(*child, key, depth + 1))
+                    return found;
+            }
+        }
+        return nullptr;
+    }
+};
@@ -0,0 +1,514 @@
+#pragma once
+
+#include <atomic>
+#include <cctype>
+#include <cerrno>
+#include <charconv>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <new>
+#include <string>
+#include <string_view>
+#include "HashDict.hpp"
+#include "IntSet.hpp"
+#include "Listpack.hpp"
+#include "HyperLogLog.hpp"
+#include "Quicklist.hpp"
+#include "ReplyBuffer.hpp"
+#include "SortedSet.hpp"
+#include "Stream.hpp"
+#include "StringSet.hpp"
+
+/// @brief Data type of a value, as reported by TYPE.
+enum class ObjType : uint8_t
+{
+    String,
+    List,
+    Hash,
+    Set,
+    ZSet,
+    Stream,
+    HyperLogLog,
+};
+
+/// @brief How a value is stored, as reported by OBJECT ENCODING.
+enum class ObjEncoding : uint8_t
+{
+    Int,    // String that is a canonical 64-bit integer, kept as the number itself.
+    Embstr, // Short string stored inside the object.
+    Raw,    // Heap string, shared with replies that are still being written.
+    // Encodings from here on keep a container on the heap, see RedisObject::create().
+    Quicklist, // List as a linked list of packed nodes.
+    Listpack,  // Small hash or sorted set as one packed array of alternating fields and values.
+    Hashtable, // Hash as a HashDict, set as a StringSet.
+    Skiplist,  // Sorted set as a SortedSet.
+    Intset,    // Set of integers as a sorted IntSet.
+    Stream,    // Stream as a Stream.
+    HllSparse, // HyperLogLog as an HllSparse.
+    HllDense,  // HyperLogLog as an HllDense.
+};
+
+/// @brief Parse a canonical decimal integer ("-12", not "+12", "012" or " 12"), like redis' string2ll.
+inline bool parseLongLong(std::string_view s, long long &value)
+{
+    if (s.empty() || s.size() > 20)
+        return false;
+    const char *end = s.data() + s.size();
+    auto [ptr, ec] = std::from_chars(s.data(), end, value);
+    if (ec != std::errc() || ptr != end)
+        return false;
+    // Leading zeros (and "-0") would not survive a round trip through the integer encoding.
+    size_t first = s[0] == '-' ? 1 : 0;
+    return !(s[first] == '0' && (s.size() > 1));
+}
+
+/// Longest textual form of a long double accepted or produced by INCRBYFLOAT.
+inline constexpr size_t MAX_LONG_DOUBLE_CHARS = 5 * 1024;
+
+/// @brief Parse a decimal floating point number, rejecting blanks, NaN and trailing garbage.
+inline bool parseLongDouble(std::string_view s, long double &value)
+{
+    if (s.empty() || s.size() >= MAX_LONG_DOUBLE_CHARS || std::isspace(static_cast<unsigned char>(s[0])))
+        return false;
+    char buf[MAX_LONG_DOUBLE_CHARS];
+    std::memcpy(buf, s.data(), s.size());
+    buf[s.size()] = '\0';
+    char *end;
+    errno = 0;
+    value = std::strtold(buf, &end);
+    return end == buf + s.size() && errno != ERANGE && !std::isnan(value);
+}
+
+/// @brief Format a long double the way INCRBYFLOAT replies: fixed notation, no trailing zeros.
+inline std::string formatLongDouble(long double value)
+{
+    char buf[MAX_LONG_DOUBLE_CHARS];
+    int len = std::snprintf(buf, sizeof(buf), "%.17Lf", value);
+    if (len <= 0 || static_cast<size_t>(len) >= sizeof(buf))
+        return {};
+    std::string_view out(buf, len);
+    if (out.find('.') != std::string_view::npos)
+    {
+        out.remove_suffix(out.size() - out.find_last_not_of('0') - 1);
+        if (out.back() == '.')
+            out.remove_suffix(1);
+    }
+    if (out == "-0")
+        out = "0";
+    return std::string(out);
+}
+
+/// @brief Parse a sorted set score: a double, "inf" or "-inf", but not NaN, like redis' string2d.
+inline bool parseDouble(std::string_view s, double &value)
+{
+    if (s.empty() || s.size() >= MAX_LONG_DOUBLE_CHARS || std::isspace(static_cast<unsigned char>(s[0])))
+        return false;
+    char buf[MAX_LONG_DOUBLE_CHARS];
+    std::memcpy(buf, s.data(), s.size());
+    buf[s.size()] = '\0';
+    char *end;
+    errno = 0;
+    value = std::strtod(buf, &end);
+    if (end != buf + s.size() || std::isnan(value))
+        return false;
+    // Overflow and underflow are errors, a written out "inf" is not.
+    return errno != ERANGE || (!std::isinf(value) && value != 0);
+}
+
+/// Longest output of formatDouble().
+inline constexpr size_t MAX_DOUBLE_CHARS = 32;
+
+/// @brief Format a score as the shortest text that parses back to the same double ("1.5", "inf").
+inline std::string_view formatDouble(double value, char (&buf)[MAX_DOUBLE_CHARS])
+{
+    auto [ptr, ec] = std::to_chars(buf, buf + sizeof(buf), value);
+    return std::string_view(buf, ptr - buf);
+}
+
+/// @brief A keyspace value: a type tag, an encoding, the payload and the access bits used by
+/// eviction (an LRU clock or an LFU counter, see Eviction.hpp), in 24 bytes.
+/// Numbers and short strings need no allocation at all; only long strings live on the heap,
+/// as a SharedString so GET can hand them to a reply by reference. Lists and the other container
+/// types live on the heap behind a shared pointer, so copying an object never copies a container;
+/// containers are only changed under the keyspace's exclusive lock.
+class RedisObject
+{
+public:
+    static constexpr size_t EMBSTR_MAX = 18;
+
+    /// Room to format an integer-encoded value, see stringView().
+    using IntBuffer = char[24];
+
+    RedisObject()
+    {
+        meta_.len = 0;
+        meta_.type = static_cast<uint8_t>(ObjType::String);
+        meta_.encoding = static_cast<uint8_t>(ObjEncoding::Embstr);
+    }
+
+    /// @brief Store a string in its most compact encoding.
+    static RedisObject fromString(std::string_view s)
+    {
+        long long value;
+        if (parseLongLong(s, value))
+            return fromInt(value);
+        RedisObject o;
+        if (s.size() <= EMBSTR_MAX)
+        {
+            std::memcpy(o.data_, s.data(), s.size());
+            o.meta_.len = static_cast<uint8_t>(s.size());
+            return o;
+        }
+        return fromHeapString(std::string(s));
+    }
+
+    /// @brief fromString() for a string built by the caller: a long one is moved to the heap, not copied.
+    static RedisObject adoptString(std::string &&s)
+    {
+        long long value;
+        if (s.size() <= EMBSTR_MAX || parseLongLong(s, value))
+            return fromString(s);
+        return fromHeapString(std::move(s));
+    }
+
+    static RedisObject fromInt(long long value)
+    {
+        RedisObject o;
+        o.meta_.encoding = static_cast<uint8_t>(ObjEncoding::Int);
+        std::memcpy(o.data_, &value, sizeof(value));
+        return o;
+    }
+
+    /// @brief A new, empty container object.
+    /// @tparam T the class the encoding keeps on the heap, e.g. Quicklist for ObjEncoding::Quicklist.
+    template <typename T>
+    static RedisObject create(ObjType type, ObjEncoding encoding)
+    {
+        RedisObject o;
+        o.meta_.type = static_cast<uint8_t>(type);
+        o.meta_.encoding = static_cast<uint8_t>(encoding);
+        new (o.data_) ContainerPtr(std::make_shared<T>());
+        return o;
+    }
+
+    RedisObject(const RedisObject &other)
+    {
+        copyFrom(other);
+    }
+
+    RedisObject(RedisObject &&other) noexcept
+    {
+        moveFrom(other);
+    }
+
+    RedisObject &operator=(const RedisObject &other)
+    {
+        if (this != &other)
+        {
+            release();
+            copyFrom(other);
+        }
+        return *this;
+    }
+
+    RedisObject &operator=(RedisObject &&other) noexcept
+    {
+        if (this != &other)
+        {
+            release();
+            moveFrom(other);
+        }
+        return *this;
+    }
+
+    ~RedisObject()
+    {
+        release();
+    }
+
+    ObjType type() const
+    {
+        return static_cast<ObjType>(meta_.type);
+    }
+
+    ObjEncoding encoding() const
+    {
+        return static_cast<ObjEncoding>(meta_.encoding);
+    }
+
+    /// @brief The eviction bits. Readers holding a shared lock update them concurrently, hence atomic.
+    uint32_t accessBits() const
+    {
+        return std::atomic_ref<uint32_t>(access_).load(std::memory_order_relaxed);
+    }
+
+    void setAccessBits(uint32_t bits)
+    {
+        std::atomic_ref<uint32_t>(access_).store(bits, std::memory_order_relaxed);
+    }
+
+    /// @brief The container of an object made by create<T>().
+    template <typename T>
+    T &as()
+    {
+        return *static_cast<T *>(container().get());
+    }
+
+    template <typename T>
+    const T &as() const
+    {
+        return *static_cast<const T *>(container().get());
+    }
+
+    /// @brief Name of the type, as TYPE and SCAN's TYPE option know it. A HyperLogLog is a string in
+    /// redis, but here it is a type of its own that GET and the other string commands reject, so it
+    /// reports "hyperloglog" to agree with them.
+    const char *typeName() const
+    {
+        switch (type())
+        {
+        case ObjType::String:
+            return "string";
+        case ObjType::HyperLogLog:
+            return "hyperloglog";
+        case ObjType::List:
+            return "list";
+        case ObjType::Hash:
+            return "hash";
+        case ObjType::Set:
+            return "set";
+        case ObjType::ZSet:
+            return "zset";
+        case ObjType::Stream:
+            return "stream";
+        }
+        return "unknown";
+    }
+
+    /// @brief Name of the encoding, as OBJECT ENCODING reports it.
+    const char *encodingName() const
+    {
+        switch (encoding())
+        {
+        case ObjEncoding::Int:
+            return "int";
+        case ObjEncoding::Embstr:
+            return "embstr";
+        case ObjEncoding::Raw:
+            return "raw";
+        case ObjEncoding::Quicklist:
+            return "quicklist";
+        case ObjEncoding::Listpack:
+            return "listpack";
+        case ObjEncoding::Hashtable:
+            return "hashtable";
+        case ObjEncoding::Skiplist:
+            return "skiplist";
+        case ObjEncoding::Intset:
+            return "intset";
+        case ObjEncoding::Stream:
+            return "stream";
+        case ObjEncoding::HllSparse:
+            return "sparse";
+        case ObjEncoding::HllDense:
+            return "dense";
+        }
+        return "unknown";
+    }
+
+    /// @return bytes allocated outside the object.
+    size_t heapBytes() const
+    {
+        // make_shared puts the control block and the object in one allocation.
+        switch (encoding())
+        {
+        case ObjEncoding::Raw:
+            return 16 + sizeof(std::string) + raw()->capacity() + 1;
+        case ObjEncoding::Quicklist:
+            return 16 + as<Quicklist>().memoryUsage();
+        case ObjEncoding::Listpack:
+            return 16 + as<Listpack>().memoryUsage();
+        case ObjEncoding::Hashtable:
+            return 16 + (type() == ObjType::Set ? as<StringSet>().memoryUsage() : as<HashDict>().memoryUsage());
+        case ObjEncoding::Skiplist:
+            return 16 + as<SortedSet>().memoryUsage();
+        case ObjEncoding::Intset:
+            return 16 + as<IntSet>().memoryUsage();
+        case ObjEncoding::Stream:
+            return 16 + as<Stream>().memoryUsage();
+        case ObjEncoding::HllSparse:
+            return 16 + as<HllSparse>().memoryUsage();
+        case ObjEncoding::HllDense:
+            return 16 + as<HllDense>().memoryUsage();
+        default:
+            return 0;
+        }
+    }
+
+    /// @return bytes used by the object, including its heap payload.
+    size_t memoryUsage() const
+    {
+        return sizeof(*this) + heapBytes();
+    }
+
+    /// @brief The value of a string object; an integer is formatted into `buf`.
+    std::string_view stringView(IntBuffer &buf) const
+    {
+        switch (encoding())
+        {
+        case ObjEncoding::Int:
+            return std::string_view(buf, std::to_chars(buf, buf + sizeof(buf), intValue()).ptr - buf);
+        case ObjEncoding::Embstr:
+            return std::string_view(reinterpret_cast<const char *>(data_), meta_.len);
+        case ObjEncoding::Raw:
+            return *raw();
+        default:
+            return {};
+        }
+    }
+
+    /// @return the heap string of a Raw object, null for the other encodings.
+    SharedString sharedString() const
+    {
+        return encoding() == ObjEncoding::Raw ? raw() : nullptr;
+    }
+
+    /// @brief The value of a string object as a heap string only this object owns, to change it in
+    /// place (SETBIT, BITFIELD) under the keyspace's exclusive lock, like redis' dbUnshareStringValue().
+    /// An integer or embedded string moves to the heap first; a heap string still shared with a reply
+    /// or a copy of the object is copied, so readers never see it change.
+    std::string &mutableString()
+    {
+        if (encoding() != ObjEncoding::Raw)
+        {
+            IntBuffer buf;
+            *this = fromHeapString(std::string(stringView(buf)));
+        }
+#if defined(__SANITIZE_THREAD__)
+        // ThreadSanitizer does not model the fence below, so sanitized builds always copy.
+        else
+        {
+            *this = fromHeapString(std::string(*raw()));
+        }
+#else
+        else if (raw().use_count() != 1)
+        {
+            *this = fromHeapString(std::string(*raw()));
+        }
+        else
+        {
+            // Pairs with the release of the last other owner, whose reads then happen before our writes.
+            std::atomic_thread_fence(std::memory_order_acquire);
+        }
+#endif
+        // Heap strings are created non-const by fromHeapString(), so writing through this is fine.
+        return const_cast<std::string &>(*raw());
+    }
+
+    /// @brief Read the value as an integer, for INCR and friends.
+    /// @return false when the string is not a canonical 64-bit integer.
+    bool getLongLong(long long &value) const
+    {
+        if (encoding() == ObjEncoding::Int)
+        {
+            value = intValue();
+            return true;
+        }
+        IntBuffer buf;
+        return parseLongLong(stringView(buf), value);
+    }
+
+    /// @brief Overwrite the value with an integer, in place when it already is integer encoded.
+    void setLongLong(long long value)
+    {
+        if (encoding() != ObjEncoding::Int)
+        {
+            release();
+            meta_.encoding = static_cast<uint8_t>(ObjEncoding::Int);
+        }
+        std::memcpy(data_, &value, sizeof(value));
+    }
+
+private:
+    using ContainerPtr = std::shared_ptr<void>; // Deletes the container with its real type.
+
+    // Int: the value in [0, 8). Embstr: the bytes in [0, len). Raw: a SharedString in [0, 16).
+    // Containers: a ContainerPtr in [0, 16).
+    alignas(8) unsigned char data_[EMBSTR_MAX];
+    struct
+    {
+        uint8_t len;          // Embstr length.
+        uint8_t type : 4;     // ObjType.
+        uint8_t encoding : 4; // ObjEncoding.
+    } meta_;
+    alignas(4) mutable uint32_t access_ = 0; // LRU clock or LFU counter, see Eviction.hpp.
+
+    static RedisObject fromHeapString(std::string &&s)
+    {
+        RedisObject o;
+        o.meta_.encoding = static_cast<uint8_t>(ObjEncoding::Raw);
+        new (o.data_) SharedString(std::make_shared<std::string>(std::move(s)));
+        return o;
+    }
+
+    long long intValue() const
+    {
+        long long value;
+        std::memcpy(&value, data_, sizeof(value));
+        return value;
+    }
+
+    const SharedString &raw() const
+    {
+        return *std::launder(reinterpret_cast<const SharedString *>(data_));
+    }
+
+    bool isContainer() const
+    {
+        return encoding() >= ObjEncoding::Quicklist;
+    }
+
+    const ContainerPtr &container() const
+    {
+        return *std::launder(reinterpret_cast<const ContainerPtr *>(data_));
+    }
+
+    void copyFrom(const RedisObject &other)
+    {
+        std::memcpy(data_, other.data_, sizeof(data_));
+        meta_ = other.meta_;
+        access_ = other.accessBits();
+        if (other.encoding() == ObjEncoding::Raw)
+            new (data_) SharedString(other.raw());
+        else if (other.isContainer())
+            new (data_) ContainerPtr(other.container());
+    }
+
+    /// Ownership of a heap payload moves with the bytes.
+    void moveFrom(RedisObject &other)
+    {
+        std::memcpy(data_, other.data_, sizeof(data_));
+        meta_ = other.meta_;
+        access_ = other.accessBits();
+        other.meta_.type = static_cast<uint8_t>(ObjType::String);
+        other.meta_.encoding = static_cast<uint8_t>(ObjEncoding::Embstr);
+        other.meta_.len = 0;
+    }
+
+    void release()
+    {
+        if (encoding() == ObjEncoding::Raw)
+            std::launder(reinterpret_cast<SharedString *>(data_))->~SharedString();
+        else if (isContainer())
+            std::launder(reinterpret_cast<ContainerPtr *>(data_))->~ContainerPtr();
+        meta_.type = static_cast<uint8_t>(ObjType::String);
+        meta_.encoding = static_cast<uint8_t>(ObjEncoding::Embstr);
+        meta_.len = 0;
+    }
+};
+
+static_assert(sizeof(RedisObject) == 24);
@@ -6,18 +6,61 @@
 #include <sys/socket.h>
 #include <arpa/inet.h>
 #include <netdb.h>
+#include <poll.h>
 #include <cstring>
 #include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <shared_mutex>
+#include <pthread.h>
 #include <bits/stdc++.h>
 #include <chrono>
 #include <cassert>
+#include <asio.hpp>
 #include "resp/all.hpp" // Repo Link : https://github.com/nousxiong/resp
+#include "Bitmap.hpp"
+#include "Blocking.hpp"
+#include "Client.hpp"
+#include "CommandArgs.hpp"
+#include "CommandTable.hpp"
+#include "Eviction.hpp"
+#include "Glob.hpp"
+#include "HashType.hpp"
+#include "HyperLogLogType.hpp"
+#include "Keyspace.hpp"
+#include "SetType.hpp"
+#include "Stream.hpp"
+#include "ZSetType.hpp"
+#include "Protocol.hpp"
+#include "EventLoop.hpp"
+#include "UringLoop.hpp"
+
+/// @brief How client connections are served.
+enum class IOMode
+{
+    Threads, // One detached thread per accepted connection.
+    Epoll,   // Single edge-triggered epoll reactor owning every connection.
+    Uring,   // io_uring reactor with multishot accept/recv; falls back to Epoll on kernels without support.
+    Asio,    // C++20 coroutines on a pool of asio::io_context, one per thread.
+};
 
 struct server_metadata
 {
     int port = 6379;
     bool is_replica = false;
     std::string master;
+    IOMode io_mode = IOMode::Epoll;
+    int io_threads = 1;               // Number of reactors (each with its own SO_REUSEPORT listener), or asio io_context threads.
+    bool io_cpu_affinity = false;     // Pin reactor N to CPU N.
+    ProtocolLimits proto_limits;      // Largest request frame accepted from a client.
+    unsigned long long maxmemory = 0; // Bytes the keyspace may use before keys are evicted; 0 for no limit.
+    EvictionPolicy maxmemory_policy = EvictionPolicy::NoEviction;
+    HashLimits hash_limits;           // When a hash leaves the listpack encoding.
+    SetLimits set_limits;             // When a set leaves the intset encoding.
+    ZSetLimits zset_limits;           // When a sorted set leaves the listpack encoding.
+    StreamLimits stream_limits;       // When a stream starts a new block of entries.
+    HllLimits hll_limits;             // When a HyperLogLog leaves the sparse encoding.
+    size_t prefetch_batch = Keyspace::DEFAULT_PREFETCH_BATCH; // Lookups of a multi-key command prefetched together; 0 or 1 for none.
 
     server_metadata() = default;
     server_metadata(int port, bool is_replica, std::string master) : port(port), is_replica(is_replica), master(master) {}
@@ -38,6 +81,29 @@ struct redisServerConfig
     redisServerConfig() = default;
 };
 
+/// @brief Counters kept by the cron thread for INFO stats; read from any connection.
+struct redisServerStats
+{
+    std::atomic<long long> instantaneous_expired_keys_per_sec{0};
+    std::atomic<long long> expire_cycle_time_us{0}; // Time spent in the active expire cycle.
+    std::atomic<long long> expired_time_cap_reached_count{0};
+    std::atomic<long long> eviction_time_cap_reached_count{0};
+};
+
+class RedisServer;
+
+/// @brief Entry of the command table.
+struct RedisCommand
+{
+    std::string_view name;
+    void (RedisServer::*proc)(Client &, const CommandArgs &) = nullptr;
+    int arity = 0;      // Number of arguments including the name; -N means at least N.
+    uint32_t flags = 0; // CommandFlags.
+    int first_key = 0;  // Position of the first key argument, 0 when there are no keys.
+    int last_key = 0;   // Position of the last key argument, -1 for the last argument.
+    int key_step = 0;   // Distance between key arguments.
+};
+
 /// @brief Initialize and start a Redis Server
 class RedisServer
 {
@@ -48,287 +114,3282 @@ public:
         PORT = server_meta.port;
         if (server_meta.is_replica)
             server_config.role = "slave";
+        keyspace.setEvictionPolicy(server_meta.maxmemory_policy);
+        keyspace.setPrefetchBatch(server_meta.prefetch_batch);
         initServer();
     }
 
     ~RedisServer()
     {
-        if (server_fd_ != -1)
+        for (int server_fd : server_fds_)
         {
-            close(server_fd_);
+            close(server_fd);
         }
     }
 
 private:
     redisServerConfig server_config;
+    redisServerStats stats;
     server_metadata server_meta;
     int BUFFER_SIZE = 4096;
     int PORT;
-    int CONNECTION_BACKLOG = 5;
-    int server_fd_ = -1;
-    std::unordered_map<std::string, std::pair<std::string, std::chrono::steady_clock::time_point>> umap;
-    std::unordered_set<int> connectedReplicas;
+    int CONNECTION_BACKLOG = 511;                       // Same default as redis tcp-backlog; a tiny queue drops SYNs under connection bursts.
+    int CRON_HZ = 10;                                   // serverCron() runs per second.
+    int ACTIVE_EXPIRE_CYCLE_PERC = 25;                  // Share of every cron period the active expire cycle may use.
+    std::chrono::microseconds EVICTION_TIME_LIMIT{500}; // Longest a single command spends evicting keys.
+    static constexpr const char *WRONGTYPE_ERR = "-WRONGTYPE Operation against a key holding the wrong kind of value\r\n";
+    std::vector<int> server_fds_; // One listener per reactor.
+    // Connections are served from several threads: the keyspace locks per shard and the replica list has its own lock.
+    // Values are shared so GET can queue a large value by reference after releasing the lock.
+    Keyspace keyspace;
+    BlockingKeys blocking_keys; // Clients waiting in XREAD BLOCK, by key.
+    std::unordered_set<Client *> connectedReplicas; // Removed by onClientClose() before the client goes away.
+    std::mutex replicas_mutex;                      // Guards connectedReplicas and the two below.
+    std::map<uint64_t, std::string> repl_waiting;   // Commands propagated ahead of an earlier write, by write order.
+    uint64_t repl_next_order = 0;                   // Write order the replication stream continues with.
+
+    /// @brief Encode a command as a RESP array of bulk strings, e.g. for propagation to replicas.
+    static std::string encodeCommand(const CommandArgs &args)
+    {
+        std::string out = "*" + std::to_string(args.size()) + "\r\n";
+        for (std::string_view arg : args)
+        {
+            out += "$" + std::to_string(arg.size()) + "\r\n";
+            out += arg;
+            out += "\r\n";
+        }
+        return out;
+    }
 
-    void psync(int fd, resp::unique_value &rep)
+    void psync(Client &c, const CommandArgs &)
     {
-        std::string fullresync_response = "+FULLRESYNC " + server_config.master_replid + " 0\r\n";
-        send(fd, fullresync_response.c_str(), fullresync_response.length(), 0);
-        std::string hex_bytes = "524544495330303131fa0972656469732d76657205372e322e30fa0a72656469732d62697473c040fa056374696d65c26d08bc65fa08757365642d6d656dc2b0c41000fa08616f662d62617365c000fff06e3bfec0ff5aa2";
+        c.addReply("+FULLRESYNC " + server_config.master_replid + " 0\r\n");
         // RDB File Info : https://rdb.fnordig.de/file_format.html
-        std::string empty_rdb = "";
-        for (int i = 0; i < hex_bytes.length(); i += 2)
+        static const std::string empty_rdb = []
+        {
+            std::string hex_bytes = "524544495330303131fa0972656469732d76657205372e322e30fa0a72656469732d62697473c040fa056374696d65c26d08bc65fa08757365642d6d656dc2b0c41000fa08616f662d62617365c000fff06e3bfec0ff5aa2";
+            std::string rdb = "";
+            for (size_t i = 0; i < hex_bytes.length(); i += 2)
+            {
+                rdb += static_cast<char>(std::stoi(hex_bytes.substr(i, 2), nullptr, 16));
+            }
+            return rdb;
+        }();
+        // The RDB transfer is a bulk string without the trailing CRLF.
+        c.addReply("$" + std::to_string(empty_rdb.length()) + "\r\n");
+        c.addReply(empty_rdb);
+
+        // Propagated commands are queued behind FULLRESYNC and the RDB on the same reply buffer, so they cannot overtake them.
+        std::lock_guard lock(replicas_mutex);
+        connectedReplicas.insert(&c);
+    }
+
+    std::string infoReplication()
+    {
+        return "# Replication\r\n"
+               "role:" +
+               server_config.role + "\r\n" +
+               "connected_slaves:" + std::to_string(server_config.connected_slaves) + "\r\n" +
+               "master_replid:" + server_config.master_replid + "\r\n" +
+               "master_repl_offset:" + std::to_string(server_config.master_repl_offset) + "\r\n" +
+               "second_repl_offset:" + std::to_string(server_config.second_repl_offset) + "\r\n" +
+               "repl_backlog_active:" + std::to_string(server_config.repl_backlog_active) + "\r\n" +
+               "repl_backlog_size:" + std::to_string(server_config.repl_backlog_size) + "\r\n" +
+               "repl_backlog_first_byte_offset:" + std::to_string(server_config.repl_backlog_first_byte_offset) + "\r\n" +
+               "repl_backlog_histlen:" + std::to_string(server_config.repl_backlog_histlen) + "\r\n";
+    }
+
+    std::string infoStats()
+    {
+        return "# Stats\r\n"
+               "expired_keys:" +
+               std::to_string(keyspace.expiredKeys()) + "\r\n" +
+               "instantaneous_expired_keys_per_sec:" + std::to_string(stats.instantaneous_expired_keys_per_sec.load()) + "\r\n" +
+               "expired_reclaimed_bytes:" + std::to_string(keyspace.expiredBytes()) + "\r\n" +
+               "expired_time_cap_reached_count:" + std::to_string(stats.expired_time_cap_reached_count.load()) + "\r\n" +
+               "expire_cycle_cpu_milliseconds:" + std::to_string(stats.expire_cycle_time_us.load() / 1000) + "\r\n" +
+               "evicted_keys:" + std::to_string(keyspace.evictedKeys()) + "\r\n" +
+               "eviction_time_cap_reached_count:" + std::to_string(stats.eviction_time_cap_reached_count.load()) + "\r\n";
+    }
+
+    std::string infoMemory()
+    {
+        return "# Memory\r\n"
+               "used_memory:" +
+               std::to_string(keyspace.usedMemory()) + "\r\n" +
+               "maxmemory:" + std::to_string(server_meta.maxmemory) + "\r\n" +
+               "maxmemory_policy:" + std::string(evictionPolicyName(server_meta.maxmemory_policy)) + "\r\n";
+    }
+
+    std::string infoKeyspace()
+    {
+        size_t keys = keyspace.size();
+        if (keys == 0)
+            return "# Keyspace\r\n";
+        return "# Keyspace\r\ndb0:keys=" + std::to_string(keys) + ",expires=" + std::to_string(keyspace.expiresSize()) + "\r\n";
+    }
+
+    /// @brief INFO [section ...]: every section when none is named.
+    void info(Client &c, const CommandArgs &args)
+    {
+        const std::pair<std::string_view, std::string (RedisServer::*)()> sections[] = {
+            {"memory", &RedisServer::infoMemory},
+            {"replication", &RedisServer::infoReplication},
+            {"stats", &RedisServer::infoStats},
+            {"keyspace", &RedisServer::infoKeyspace},
+        };
+        std::string response;
+        auto add = [&](std::string (RedisServer::*section)())
+        {
+            if (!response.empty())
+                response += "\r\n";
+            response += (this->*section)();
+        };
+        if (args.size() == 1 || args.equalsIgnoreCase(1, "all") || args.equalsIgnoreCase(1, "default") || args.equalsIgnoreCase(1, "everything"))
+        {
+            for (const auto &[name, section] : sections)
+                add(section);
+            c.addReplyBulk(response);
+            return;
+        }
+        for (size_t i = 1; i < args.size(); ++i)
+        {
+            auto it = std::find_if(std::begin(sections), std::end(sections), [&](const auto &entry)
+                                   { return args.equalsIgnoreCase(i, entry.first); });
+            if (it == std::end(sections))
+            {
+                // Default error response if the section is not supported
+                c.addReply("-ERR unsupported INFO section\r\n");
+                return;
+            }
+            add(it->second);
+        }
+        c.addReplyBulk(response);
+    }
+
+    void ping(Client &c, const CommandArgs &args)
+    {
+        if (args.size() > 1)
+        {
+            c.addReplyBulk(args[1]);
+            return;
+        }
+        // Simple String in RESP : https://redis.io/docs/latest/develop/reference/protocol-spec/#simple-strings
+        c.addReply("+PONG\r\n");
+    }
+
+    void echo(Client &c, const CommandArgs &args)
+    {
+        c.addReplyBulk(args[1]);
+    }
+
+    /// @brief SET key value [NX|XX] [GET] [EX seconds|PX milliseconds|EXAT unix-time-seconds|PXAT unix-time-milliseconds|KEEPTTL].
+    void setValue(Client &c, const CommandArgs &args)
+    {
+        bool nx = false, xx = false, get = false, keep_ttl = false, expire = false;
+        long long expire_ms = Keyspace::NO_EXPIRE;
+        for (size_t i = 3; i < args.size(); ++i)
+        {
+            if (args.equalsIgnoreCase(i, "NX") && !xx)
+                nx = true;
+            else if (args.equalsIgnoreCase(i, "XX") && !nx)
+                xx = true;
+            else if (args.equalsIgnoreCase(i, "GET"))
+                get = true;
+            else if (args.equalsIgnoreCase(i, "KEEPTTL") && !expire)
+                keep_ttl = true;
+            else if (!expire && !keep_ttl && i + 1 < args.size() &&
+                     (args.equalsIgnoreCase(i, "EX") || args.equalsIgnoreCase(i, "PX") || args.equalsIgnoreCase(i, "EXAT") || args.equalsIgnoreCase(i, "PXAT")))
+            {
+                long long unit_ms = args.equalsIgnoreCase(i, "EX") || args.equalsIgnoreCase(i, "EXAT") ? 1000 : 1;
+                bool relative = args[i].size() == 2;
+                if (!parseLongLong(args[++i], expire_ms))
+                {
+                    c.addReply("-ERR value is not an integer or out of range\r\n");
+                    return;
+                }
+                if (expire_ms <= 0 || __builtin_mul_overflow(expire_ms, unit_ms, &expire_ms) ||
+                    (relative && __builtin_add_overflow(expire_ms, Keyspace::nowMs(), &expire_ms)))
+                {
+                    c.addReply("-ERR invalid expire time in 'set' command\r\n");
+                    return;
+                }
+                expire = true;
+            }
+            else
+            {
+                c.addReply("-ERR syntax error\r\n");
+                return;
+            }
+        }
+
+        std::optional<RedisObject> old;
+        bool wrong_type = false;
+        // The only copy of the value: from the query buffer into the keyspace.
+        bool stored = keyspace.setIf(args[1], RedisObject::fromString(args[2]), expire_ms, keep_ttl, [&](const RedisObject *current)
+                                     {
+                                         if (get && current != nullptr)
+                                         {
+                                             if (current->type() != ObjType::String)
+                                             {
+                                                 wrong_type = true;
+                                                 return false;
+                                             }
+                                             old = *current;
+                                         }
+                                         return current != nullptr ? !nx : !xx; });
+        if (wrong_type)
+        {
+            c.addReply(WRONGTYPE_ERR);
+            return;
+        }
+        if (stored)
+        {
+            ++c.dirty;
+            // Replicas get the outcome: an absolute expiry time, and neither the conditions nor GET.
+            if (args.size() > 3)
+            {
+                c.propagate_argv = {"SET", args.str(1), args.str(2)};
+                if (expire)
+                    c.propagate_argv.insert(c.propagate_argv.end(), {"PXAT", std::to_string(expire_ms)});
+                else if (keep_ttl)
+                    c.propagate_argv.emplace_back("KEEPTTL");
+            }
+        }
+        if (get)
+        {
+            if (old)
+                addReplyStringObject(c, *old);
+            else
+                c.addReplyNull();
+        }
+        else if (!stored)
+        {
+            c.addReplyNull();
+        }
+        else if (server_config.role == "master")
+        {
+            c.addReply("+OK\r\n");
+        }
+    }
+
+    void getValue(Client &c, const CommandArgs &args)
+    {
+        std::optional<RedisObject> value = keyspace.get(args[1]);
+        if (!value)
+        {
+            c.addReplyNull();
+        }
+        else if (value->type() != ObjType::String)
+        {
+            c.addReply(WRONGTYPE_ERR);
+        }
+        else
+        {
+            addReplyStringObject(c, *value);
+        }
+    }
+
+    /// @brief MGET key [key ...]: the values of the keys, null for a missing key or one that is not a string.
+    void mget(Client &c, const CommandArgs &args)
+    {
+        keyspace.readMany(std::vector<std::string_view>(args.begin() + 1, args.end()),
+                          [&](const std::vector<const RedisObject *> &values)
+                          {
+                              c.addReplyArrayLen(static_cast<long long>(values.size()));
+                              for (const RedisObject *value : values)
+                              {
+                                  if (value == nullptr || value->type() != ObjType::String)
+                                      c.addReplyNull();
+                                  else
+                                      addReplyStringObject(c, *value);
+                              } });
+    }
+
+    /// @brief Set the key/value pairs of MSET or MSETNX, all at once.
+    /// @return false if `nx` and one of the keys exists.
+    bool msetGeneric(Client &c, const CommandArgs &args, bool nx)
+    {
+        std::vector<std::string_view> keys;
+        std::vector<RedisObject> values;
+        keys.reserve(args.size() / 2);
+        values.reserve(args.size() / 2);
+        for (size_t i = 1; i + 1 < args.size(); i += 2)
+        {
+            keys.push_back(args[i]);
+            values.push_back(RedisObject::fromString(args[i + 1]));
+        }
+        if (!keyspace.setMany(keys, std::move(values), nx))
+            return false;
+        ++c.dirty;
+        return true;
+    }
+
+    /// @brief MSET key value [key value ...]: set every key, dropping their TTLs, in one step.
+    void mset(Client &c, const CommandArgs &args)
+    {
+        if (args.size() % 2 == 0)
+        {
+            c.addReply("-ERR wrong number of arguments for 'mset' command\r\n");
+            return;
+        }
+        msetGeneric(c, args, false);
+        c.addReply("+OK\r\n");
+    }
+
+    /// @brief MSETNX key value [key value ...]: MSET, unless any of the keys exists; replies 1 if it set them.
+    void msetnx(Client &c, const CommandArgs &args)
+    {
+        if (args.size() % 2 == 0)
+        {
+            c.addReply("-ERR wrong number of arguments for 'msetnx' command\r\n");
+            return;
+        }
+        c.addReplyInteger(msetGeneric(c, args, true) ? 1 : 0);
+    }
+
+    /// @brief DEL key [key ...]: replies with the number of keys deleted.
+    void del(Client &c, const CommandArgs &args)
+    {
+        size_t deleted = keyspace.eraseMany(std::vector<std::string_view>(args.begin() + 1, args.end()));
+        if (deleted != 0)
+            ++c.dirty;
+        c.addReplyInteger(static_cast<long long>(deleted));
+    }
+
+    /// @brief UNLINK key [key ...]: DEL that frees the values after releasing the shard locks, so
+    /// deleting a big list or bitmap does not stall the other clients of its shard. The memory goes
+    /// back before the reply, unlike redis' background thread, but nobody waits on it but the caller.
+    void unlink(Client &c, const CommandArgs &args)
+    {
+        std::vector<RedisObject> unlinked;
+        size_t deleted = keyspace.eraseMany(std::vector<std::string_view>(args.begin() + 1, args.end()), &unlinked);
+        unlinked.clear();
+        if (deleted != 0)
+            ++c.dirty;
+        c.addReplyInteger(static_cast<long long>(deleted));
+    }
+
+    /// @brief EXISTS key [key ...]: how many of the keys exist; a key given twice counts twice.
+    void exists(Client &c, const CommandArgs &args)
+    {
+        long long count = keyspace.readMany(std::vector<std::string_view>(args.begin() + 1, args.end()),
+                                            [](const std::vector<const RedisObject *> &values)
+                                            { return std::count_if(values.begin(), values.end(), [](const RedisObject *value)
+                                                                   { return value != nullptr; }); });
+        c.addReplyInteger(count);
+    }
+
+    /// @brief Reply with the value of a string object; heap strings are passed by reference.
+    static void addReplyStringObject(Client &c, const RedisObject &value)
+    {
+        if (SharedString shared = value.sharedString())
+        {
+            c.addReplyBulk(shared);
+            return;
+        }
+        RedisObject::IntBuffer buf;
+        c.addReplyBulk(value.stringView(buf));
+    }
+
+    /// @brief Add `delta` to the integer value of a key, in place when it is integer encoded.
+    void incrDecr(Client &c, std::string_view key, long long delta)
+    {
+        const char *error = nullptr;
+        long long result = 0;
+        keyspace.modify(key, [&](RedisObject &value, bool &exists)
+                        {
+                            long long current = 0;
+                            if (exists && value.type() != ObjType::String)
+                                error = WRONGTYPE_ERR;
+                            else if (exists && !value.getLongLong(current))
+                                error = "-ERR value is not an integer or out of range\r\n";
+                            else if (__builtin_add_overflow(current, delta, &result))
+                                error = "-ERR increment or decrement would overflow\r\n";
+                            else
+                            {
+                                value.setLongLong(result);
+                                exists = true;
+                            }
+                            return error == nullptr; });
+        if (error != nullptr)
+        {
+            c.addReply(error);
+            return;
+        }
+        ++c.dirty;
+        c.addReplyInteger(result);
+    }
+
+    void incr(Client &c, const CommandArgs &args)
+    {
+        incrDecr(c, args[1], 1);
+    }
+
+    void decr(Client &c, const CommandArgs &args)
+    {
+        incrDecr(c, args[1], -1);
+    }
+
+    void incrBy(Client &c, const CommandArgs &args)
+    {
+        long long delta;
+        if (!parseLongLong(args[2], delta))
+        {
+            c.addReply("-ERR value is not an integer or out of range\r\n");
+            return;
+        }
+        incrDecr(c, args[1], delta);
+    }
+
+    void decrBy(Client &c, const CommandArgs &args)
+    {
+        long long delta;
+        if (!parseLongLong(args[2], delta) || delta == LLONG_MIN)
+        {
+            c.addReply("-ERR value is not an integer or out of range\r\n");
+            return;
+        }
+        incrDecr(c, args[1], -delta);
+    }
+
+    void incrByFloat(Client &c, const CommandArgs &args)
+    {
+        long double delta;
+        if (!parseLongDouble(args[2], delta))
+        {
+            c.addReply("-ERR value is not a valid float\r\n");
+            return;
+        }
+        const char *error = nullptr;
+        std::string result;
+        keyspace.modify(args[1], [&](RedisObject &value, bool &exists)
+                        {
+                            long double current = 0;
+                            RedisObject::IntBuffer buf;
+                            if (exists && value.type() != ObjType::String)
+                                error = WRONGTYPE_ERR;
+                            else if (exists && !parseLongDouble(value.stringView(buf), current))
+                                error = "-ERR value is not a valid float\r\n";
+                            else if (std::isnan(current + delta) || std::isinf(current + delta))
+                                error = "-ERR increment would produce NaN or Infinity\r\n";
+                            else
+                            {
+                                result = formatLongDouble(current + delta);
+                                value = RedisObject::fromString(result);
+                                exists = true;
+                            }
+                            return error == nullptr; });
+        if (error != nullptr)
+        {
+            c.addReply(error);
+            return;
+        }
+        ++c.dirty;
+        c.addReplyBulk(result);
+    }
+
+    /// @brief EXPIRE, PEXPIRE, EXPIREAT and PEXPIREAT key time [NX|XX|GT|LT].
+    /// @param unit_ms milliseconds per unit of time: 1000 for seconds, 1 for milliseconds.
+    /// @param relative whether time counts from now rather than from the unix epoch.
+    void expireGeneric(Client &c, const CommandArgs &args, long long unit_ms, bool relative)
+    {
+        long long when;
+        if (!parseLongLong(args[2], when))
+        {
+            c.addReply("-ERR value is not an integer or out of range\r\n");
+            return;
+        }
+        bool nx = false, xx = false, gt = false, lt = false;
+        for (size_t i = 3; i < args.size(); ++i)
+        {
+            if (args.equalsIgnoreCase(i, "NX"))
+                nx = true;
+            else if (args.equalsIgnoreCase(i, "XX"))
+                xx = true;
+            else if (args.equalsIgnoreCase(i, "GT"))
+                gt = true;
+            else if (args.equalsIgnoreCase(i, "LT"))
+                lt = true;
+            else
+            {
+                c.addReply("-ERR Unsupported option " + args.str(i) + "\r\n");
+                return;
+            }
+        }
+        if (nx && (xx || gt || lt))
+        {
+            c.addReply("-ERR NX and XX, GT or LT options at the same time are not compatible\r\n");
+            return;
+        }
+        if (gt && lt)
+        {
+            c.addReply("-ERR GT and LT options at the same time are not compatible\r\n");
+            return;
+        }
+        if (__builtin_mul_overflow(when, unit_ms, &when) || (relative && __builtin_add_overflow(when, Keyspace::nowMs(), &when)))
+        {
+            std::string name = args.str(0);
+            std::transform(name.begin(), name.end(), name.begin(), [](unsigned char ch)
+                           { return std::tolower(ch); });
+            c.addReply("-ERR invalid expire time in '" + name + "' command\r\n");
+            return;
+        }
+        // Any time in the past deletes the key; keep it clear of the NO_EXPIRE marker.
+        when = std::max(when, 0LL);
+
+        bool changed = keyspace.updateExpire(args[1], [&](long long current) -> std::optional<long long>
+                                             {
+                                                 // A key without a TTL counts as one that never expires for GT and LT.
+                                                 bool persistent = current == Keyspace::NO_EXPIRE;
+                                                 if ((nx && !persistent) || (xx && persistent) ||
+                                                     (gt && (persistent || when <= current)) || (lt && !persistent && when >= current))
+                                                     return std::nullopt;
+                                                 return when; });
+        if (changed)
+            ++c.dirty;
+        c.addReplyInteger(changed ? 1 : 0);
+    }
+
+    void expire(Client &c, const CommandArgs &args)
+    {
+        expireGeneric(c, args, 1000, true);
+    }
+
+    void pexpire(Client &c, const CommandArgs &args)
+    {
+        expireGeneric(c, args, 1, true);
+    }
+
+    void expireAt(Client &c, const CommandArgs &args)
+    {
+        expireGeneric(c, args, 1000, false);
+    }
+
+    void pexpireAt(Client &c, const CommandArgs &args)
+    {
+        expireGeneric(c, args, 1, false);
+    }
+
+    /// @brief TTL and PTTL: the remaining time to live, -1 for a key without a TTL, -2 for a missing key.
+    void ttlGeneric(Client &c, const CommandArgs &args, bool output_ms)
+    {
+        long long when = keyspace.getExpire(args[1]);
+        if (when < 0)
+        {
+            c.addReplyInteger(when);
+            return;
+        }
+        long long ttl = std::max(0LL, when - Keyspace::nowMs());
+        c.addReplyInteger(output_ms ? ttl : (ttl + 500) / 1000);
+    }
+
+    void ttl(Client &c, const CommandArgs &args)
+    {
+        ttlGeneric(c, args, false);
+    }
+
+    void pttl(Client &c, const CommandArgs &args)
+    {
+        ttlGeneric(c, args, true);
+    }
+
+    void persist(Client &c, const CommandArgs &args)
+    {
+        bool changed = keyspace.updateExpire(args[1], [](long long current) -> std::optional<long long>
+                                             {
+                                                 if (current == Keyspace::NO_EXPIRE)
+                                                     return std::nullopt;
+                                                 return Keyspace::NO_EXPIRE; });
+        if (changed)
+            ++c.dirty;
+        c.addReplyInteger(changed ? 1 : 0);
+    }
+
+    /// @brief LPUSH and RPUSH key element [element ...]: push onto the head or the tail, creating the list.
+    void pushGeneric(Client &c, const CommandArgs &args, bool front)
+    {
+        size_t length = 0;
+        bool ok = keyspace.modify(args[1], [&](RedisObject &value, bool &exists)
+                                  {
+                                      if (exists && value.type() != ObjType::List)
+                                          return false;
+                                      if (!exists)
+                                      {
+                                          value = RedisObject::create<Quicklist>(ObjType::List, ObjEncoding::Quicklist);
+                                          exists = true;
+                                      }
+                                      Quicklist &list = value.as<Quicklist>();
+                                      for (size_t i = 2; i < args.size(); ++i)
+                                      {
+                                          if (front)
+                                              list.pushFront(args[i]);
+                                          else
+                                              list.pushBack(args[i]);
+                                      }
+                                      length = list.size();
+                                      return true; });
+        if (!ok)
+        {
+            c.addReply(WRONGTYPE_ERR);
+            return;
+        }
+        ++c.dirty;
+        c.addReplyInteger(length);
+    }
+
+    void lpush(Client &c, const CommandArgs &args)
+    {
+        pushGeneric(c, args, true);
+    }
+
+    void rpush(Client &c, const CommandArgs &args)
+    {
+        pushGeneric(c, args, false);
+    }
+
+    /// @brief LPOP and RPOP key [count]: one element as a bulk string, or with a count up to count
+    /// elements as an array. Popping the last element deletes the key.
+    void popGeneric(Client &c, const CommandArgs &args, bool front)
+    {
+        if (args.size() > 3)
+        {
+            c.addReply("-ERR syntax error\r\n");
+            return;
+        }
+        long long count = 1;
+        bool with_count = args.size() == 3;
+        if (with_count && (!parseLongLong(args[2], count) || count < 0))
+        {
+            c.addReply("-ERR value is out of range, must be positive\r\n");
+            return;
+        }
+        std::vector<std::string> popped;
+        bool ok = keyspace.modify(args[1], [&](RedisObject &value, bool &exists)
+                                  {
+                                      if (!exists)
+                                          return true;
+                                      if (value.type() != ObjType::List)
+                                          return false;
+                                      Quicklist &list = value.as<Quicklist>();
+                                      popped.resize(std::min<size_t>(count, list.size()));
+                                      for (std::string &element : popped)
+                                      {
+                                          if (front)
+                                              list.popFront(element);
+                                          else
+                                              list.popBack(element);
+                                      }
+                                      exists = list.size() != 0;
+                                      return true; });
+        if (!ok)
+        {
+            c.addReply(WRONGTYPE_ERR);
+            return;
+        }
+        if (!popped.empty())
+            ++c.dirty;
+        if (!with_count)
+        {
+            if (popped.empty())
+                c.addReplyNull();
+            else
+                c.addReplyBulk(popped[0]);
+            return;
+        }
+        if (popped.empty() && count != 0)
+        {
+            c.addReply("*-1\r\n");
+            return;
+        }
+        c.addReplyArrayLen(popped.size());
+        for (const std::string &element : popped)
+            c.addReplyBulk(element);
+    }
+
+    void lpop(Client &c, const CommandArgs &args)
+    {
+        popGeneric(c, args, true);
+    }
+
+    void rpop(Client &c, const CommandArgs &args)
+    {
+        popGeneric(c, args, false);
+    }
+
+    /// @brief Clamp a [start, stop] range with negative offsets from the end to a list of `length` elements.
+    /// @return false if the range is empty.
+    static bool listRange(long long start, long long stop, size_t length, size_t &first, size_t &count)
+    {
+        long long len = static_cast<long long>(length);
+        if (start < 0)
+            start = std::max(0LL, start + len);
+        if (stop < 0)
+            stop += len;
+        stop = std::min(stop, len - 1);
+        if (start > stop || start >= len)
+            return false;
+        first = static_cast<size_t>(start);
+        count = static_cast<size_t>(stop - start + 1);
+        return true;
+    }
+
+    void lrange(Client &c, const CommandArgs &args)
+    {
+        long long start, stop;
+        if (!parseLongLong(args[2], start) || !parseLongLong(args[3], stop))
+        {
+            c.addReply("-ERR value is not an integer or out of range\r\n");
+            return;
+        }
+        // Replies are built under the shared lock, straight from the list's nodes.
+        keyspace.read(args[1], [&](const RedisObject *value)
+                      {
+                          if (value == nullptr)
+                          {
+                              c.addReplyArrayLen(0);
+                              return;
+                          }
+                          if (value->type() != ObjType::List)
+                          {
+                              c.addReply(WRONGTYPE_ERR);
+                              return;
+                          }
+                          const Quicklist &list = value->as<Quicklist>();
+                          size_t first = 0, count = 0;
+                          if (!listRange(start, stop, list.size(), first, count))
+                          {
+                              c.addReplyArrayLen(0);
+                              return;
+                          }
+                          c.addReplyArrayLen(count);
+                          list.range(first, count, [&](std::string_view element)
+                                     { c.addReplyBulk(element); }); });
+    }
+
+    void llen(Client &c, const CommandArgs &args)
+    {
+        keyspace.read(args[1], [&](const RedisObject *value)
+                      {
+                          if (value == nullptr)
+                              c.addReplyInteger(0);
+                          else if (value->type() != ObjType::List)
+                              c.addReply(WRONGTYPE_ERR);
+                          else
+                              c.addReplyInteger(value->as<Quicklist>().size()); });
+    }
+
+    void lindex(Client &c, const CommandArgs &args)
+    {
+        long long index;
+        if (!parseLongLong(args[2], index))
+        {
+            c.addReply("-ERR value is not an integer or out of range\r\n");
+            return;
+        }
+        keyspace.read(args[1], [&](const RedisObject *value)
+                      {
+                          if (value == nullptr)
+                          {
+                              c.addReplyNull();
+                              return;
+                          }
+                          if (value->type() != ObjType::List)
+                          {
+                              c.addReply(WRONGTYPE_ERR);
+                              return;
+                          }
+                          const Quicklist &list = value->as<Quicklist>();
+                          long long position = index < 0 ? index + static_cast<long long>(list.size()) : index;
+                          std::string_view element;
+                          if (position < 0 || !list.index(static_cast<size_t>(position), element))
+                              c.addReplyNull();
+                          else
+                              c.addReplyBulk(element); });
+    }
+
+    /// @brief LTRIM key start stop: keep only the given range; an empty range deletes the key.
+    void ltrim(Client &c, const CommandArgs &args)
+    {
+        long long start, stop;
+        if (!parseLongLong(args[2], start) || !parseLongLong(args[3], stop))
+        {
+            c.addReply("-ERR value is not an integer or out of range\r\n");
+            return;
+        }
+        bool ok = keyspace.modify(args[1], [&](RedisObject &value, bool &exists)
+                                  {
+                                      if (!exists)
+                                          return true;
+                                      if (value.type() != ObjType::List)
+                                          return false;
+                                      Quicklist &list = value.as<Quicklist>();
+                                      size_t first = 0, count = 0;
+                                      if (!listRange(start, stop, list.size(), first, count))
+                                      {
+                                          exists = false;
+                                          return true;
+                                      }
+                                      list.removeBack(list.size() - first - count);
+                                      list.removeFront(first);
+                                      return true; });
+        if (!ok)
+        {
+            c.addReply(WRONGTYPE_ERR);
+            return;
+        }
+        ++c.dirty;
+        c.addReply("+OK\r\n");
+    }
+
+    /// @brief Run fn(const RedisObject &hash) on an existing hash under the shared lock; reply with
+    /// `missing` when the key does not exist and with WRONGTYPE when it is not a hash.
+    template <typename F>
+    void readHash(Client &c, std::string_view key, std::string_view missing, F &&fn)
+    {
+        keyspace.read(key, [&](const RedisObject *value)
+                      {
+                          if (value == nullptr)
+                              c.addReply(missing);
+                          else if (value->type() != ObjType::Hash)
+                              c.addReply(WRONGTYPE_ERR);
+                          else
+                              fn(*value); });
+    }
+
+    /// @brief HSET key field value [field value ...]: replies with the number of new fields.
+    void hset(Client &c, const CommandArgs &args)
+    {
+        if (args.size() % 2 != 0)
+        {
+            c.addReply("-ERR wrong number of arguments for 'hset' command\r\n");
+            return;
+        }
+        size_t created = 0;
+        bool ok = keyspace.modify(args[1], [&](RedisObject &value, bool &exists)
+                                  {
+                                      if (exists && value.type() != ObjType::Hash)
+                                          return false;
+                                      if (!exists)
+                                      {
+                                          value = HashType::create();
+                                          exists = true;
+                                      }
+                                      for (size_t i = 2; i < args.size(); i += 2)
+                                          created += HashType::set(value, args[i], args[i + 1], server_meta.hash_limits);
+                                      return true; });
+        if (!ok)
         {
-            empty_rdb += static_cast<char>(std::stoi(hex_bytes.substr(i, 2), nullptr, 16));
+            c.addReply(WRONGTYPE_ERR);
+            return;
         }
-        fullresync_response = "$" + std::to_string(empty_rdb.length()) + "\r\n" + empty_rdb;
-        send(fd, fullresync_response.c_str(), fullresync_response.length(), 0);
+        ++c.dirty;
+        c.addReplyInteger(created);
+    }
 
-        // Store fd for proporgation of commands
-        connectedReplicas.insert(fd);
+    void hget(Client &c, const CommandArgs &args)
+    {
+        readHash(c, args[1], "$-1\r\n", [&](const RedisObject &hash)
+                 {
+                     std::string_view value;
+                     if (HashType::get(hash, args[2], value))
+                         c.addReplyBulk(value);
+                     else
+                         c.addReplyNull(); });
+    }
+
+    void hmget(Client &c, const CommandArgs &args)
+    {
+        keyspace.read(args[1], [&](const RedisObject *hash)
+                      {
+                          if (hash != nullptr && hash->type() != ObjType::Hash)
+                          {
+                              c.addReply(WRONGTYPE_ERR);
+                              return;
+                          }
+                          c.addReplyArrayLen(args.size() - 2);
+                          for (size_t i = 2; i < args.size(); ++i)
+                          {
+                              std::string_view value;
+                              if (hash != nullptr && HashType::get(*hash, args[i], value))
+                                  c.addReplyBulk(value);
+                              else
+                                  c.addReplyNull();
+                          } });
+    }
+
+    /// @brief HDEL key field [field ...]: replies with the number of fields removed; removing the last one deletes the key.
+    void hdel(Client &c, const CommandArgs &args)
+    {
+        size_t removed = 0;
+        bool ok = keyspace.modify(args[1], [&](RedisObject &value, bool &exists)
+                                  {
+                                      if (!exists)
+                                          return true;
+                                      if (value.type() != ObjType::Hash)
+                                          return false;
+                                      for (size_t i = 2; i < args.size(); ++i)
+                                          removed += HashType::remove(value, args[i]);
+                                      exists = HashType::length(value) != 0;
+                                      return true; });
+        if (!ok)
+        {
+            c.addReply(WRONGTYPE_ERR);
+            return;
+        }
+        if (removed != 0)
+            ++c.dirty;
+        c.addReplyInteger(removed);
+    }
+
+    void hgetall(Client &c, const CommandArgs &args)
+    {
+        readHash(c, args[1], "*0\r\n", [&](const RedisObject &hash)
+                 {
+                     c.addReplyArrayLen(HashType::length(hash) * 2);
+                     HashType::forEach(hash, [&](std::string_view field, std::string_view value)
+                                       {
+                                           c.addReplyBulk(field);
+                                           c.addReplyBulk(value); }); });
+    }
+
+    void hlen(Client &c, const CommandArgs &args)
+    {
+        readHash(c, args[1], ":0\r\n", [&](const RedisObject &hash)
+                 { c.addReplyInteger(HashType::length(hash)); });
+    }
+
+    /// @brief HSCAN key cursor [MATCH pattern] [COUNT count]: field/value pairs, a few at a time.
+    void hscan(Client &c, const CommandArgs &args)
+    {
+        ScanOptions options;
+        if (!parseScanOptions(c, args, 2, false, options))
+            return;
+        readHash(c, args[1], EMPTY_SCAN_REPLY, [&](const RedisObject &hash)
+                 {
+                     std::vector<std::pair<std::string_view, std::string_view>> fields;
+                     size_t seen = 0;
+                     unsigned long long cursor = scanSteps(options, seen, [&](unsigned long long cursor)
+                                                           { return HashType::scan(hash, cursor, [&](std::string_view field, std::string_view value)
+                                                                                   {
+                                                                                       ++seen;
+                                                                                       if (scanMatches(options, field))
+                                                                                           fields.emplace_back(field, value); }); });
+                     addReplyScanHeader(c, cursor, fields.size() * 2);
+                     for (const auto &[field, value] : fields)
+                     {
+                         c.addReplyBulk(field);
+                         c.addReplyBulk(value);
+                     } });
+    }
+
+    void hincrby(Client &c, const CommandArgs &args)
+    {
+        long long delta;
+        if (!parseLongLong(args[3], delta))
+        {
+            c.addReply("-ERR value is not an integer or out of range\r\n");
+            return;
+        }
+        const char *error = nullptr;
+        long long result = 0;
+        keyspace.modify(args[1], [&](RedisObject &value, bool &exists)
+                        {
+                            long long current = 0;
+                            std::string_view old;
+                            if (exists && value.type() != ObjType::Hash)
+                                error = WRONGTYPE_ERR;
+                            else if (exists && HashType::get(value, args[2], old) && !parseLongLong(old, current))
+                                error = "-ERR hash value is not an integer\r\n";
+                            else if (__builtin_add_overflow(current, delta, &result))
+                                error = "-ERR increment or decrement would overflow\r\n";
+                            else
+                            {
+                                if (!exists)
+                                {
+                                    value = HashType::create();
+                                    exists = true;
+                                }
+                                HashType::set(value, args[2], std::to_string(result), server_meta.hash_limits);
+                            }
+                            return error == nullptr; });
+        if (error != nullptr)
+        {
+            c.addReply(error);
+            return;
+        }
+        ++c.dirty;
+        c.addReplyInteger(result);
+    }
+
+    // ZADD options.
+    static constexpr int ZADD_NX = 1 << 0;   // Only add new members.
+    static constexpr int ZADD_XX = 1 << 1;   // Only update existing members.
+    static constexpr int ZADD_GT = 1 << 2;   // Only update to a greater score.
+    static constexpr int ZADD_LT = 1 << 3;   // Only update to a lower score.
+    static constexpr int ZADD_CH = 1 << 4;   // Reply with added plus changed members.
+    static constexpr int ZADD_INCR = 1 << 5; // Add the score to the current one, like ZINCRBY.
+
+    static void addReplyScore(Client &c, double score)
+    {
+        char buf[MAX_DOUBLE_CHARS];
+        c.addReplyBulk(formatDouble(score, buf));
+    }
+
+    /// @brief Add or update the score/member pairs in args[first...], for ZADD and ZINCRBY.
+    void zaddGeneric(Client &c, const CommandArgs &args, size_t first, int flags)
+    {
+        size_t pairs = (args.size() - first) / 2;
+        std::vector<double> scores(pairs);
+        for (size_t i = 0; i < pairs; ++i)
+        {
+            if (!parseDouble(args[first + 2 * i], scores[i]))
+            {
+                c.addReply("-ERR value is not a valid float\r\n");
+                return;
+            }
+        }
+        const char *error = nullptr;
+        size_t added = 0, changed = 0;
+        std::optional<double> incr_result;
+        keyspace.modify(args[1], [&](RedisObject &value, bool &exists)
+                        {
+                            if (exists && value.type() != ObjType::ZSet)
+                            {
+                                error = WRONGTYPE_ERR;
+                                return false;
+                            }
+                            if (!exists)
+                            {
+                                if (flags & ZADD_XX)
+                                    return true;
+                                value = ZSetType::create();
+                            }
+                            for (size_t i = 0; i < pairs; ++i)
+                            {
+                                std::string_view member = args[first + 2 * i + 1];
+                                double current = 0, score = scores[i];
+                                bool found = ZSetType::score(value, member, current);
+                                if (found ? (flags & ZADD_NX) : (flags & ZADD_XX))
+                                    continue;
+                                if (flags & ZADD_INCR)
+                                {
+                                    score += current;
+                                    if (std::isnan(score))
+                                    {
+                                        error = "-ERR resulting score is not a number (NaN)\r\n";
+                                        break;
+                                    }
+                                }
+                                if (found && (((flags & ZADD_GT) && score <= current) || ((flags & ZADD_LT) && score >= current)))
+                                    continue;
+                                if (flags & ZADD_INCR)
+                                    incr_result = score;
+                                if (!found)
+                                    ++added;
+                                else if (score != current)
+                                    ++changed;
+                                ZSetType::set(value, member, score, server_meta.zset_limits);
+                            }
+                            exists = ZSetType::length(value) != 0;
+                            return error == nullptr; });
+        if (error != nullptr)
+        {
+            c.addReply(error);
+            return;
+        }
+        if (added + changed != 0)
+            ++c.dirty;
+        if (flags & ZADD_INCR)
+        {
+            if (incr_result)
+                addReplyScore(c, *incr_result);
+            else
+                c.addReplyNull();
+            return;
+        }
+        c.addReplyInteger((flags & ZADD_CH) ? added + changed : added);
+    }
+
+    /// @brief ZADD key [NX|XX] [GT|LT] [CH] [INCR] score member [score member ...].
+    void zadd(Client &c, const CommandArgs &args)
+    {
+        static constexpr std::pair<std::string_view, int> options[] = {
+            {"NX", ZADD_NX}, {"XX", ZADD_XX}, {"GT", ZADD_GT}, {"LT", ZADD_LT}, {"CH", ZADD_CH}, {"INCR", ZADD_INCR}};
+        int flags = 0;
+        size_t first = 2;
+        for (bool matched = true; matched && first < args.size(); first += matched)
+        {
+            matched = false;
+            for (const auto &[name, flag] : options)
+            {
+                if (args.equalsIgnoreCase(first, name))
+                {
+                    flags |= flag;
+                    matched = true;
+                }
+            }
+        }
+        size_t rest = args.size() - first;
+        if (rest == 0 || rest % 2 != 0)
+            c.addReply("-ERR syntax error\r\n");
+        else if ((flags & ZADD_NX) && (flags & ZADD_XX))
+            c.addReply("-ERR XX and NX options at the same time are not compatible\r\n");
+        else if (std::popcount(static_cast<unsigned>(flags & (ZADD_NX | ZADD_GT | ZADD_LT))) > 1)
+            c.addReply("-ERR GT, LT, and/or NX options at the same time are not compatible\r\n");
+        else if ((flags & ZADD_INCR) && rest != 2)
+            c.addReply("-ERR INCR option supports a single increment-element pair\r\n");
+        else
+            zaddGeneric(c, args, first, flags);
+    }
+
+    /// @brief ZINCRBY key increment member.
+    void zincrby(Client &c, const CommandArgs &args)
+    {
+        zaddGeneric(c, args, 2, ZADD_INCR);
+    }
+
+    void zrem(Client &c, const CommandArgs &args)
+    {
+        size_t removed = 0;
+        bool ok = keyspace.modify(args[1], [&](RedisObject &value, bool &exists)
+                                  {
+                                      if (!exists)
+                                          return true;
+                                      if (value.type() != ObjType::ZSet)
+                                          return false;
+                                      for (size_t i = 2; i < args.size(); ++i)
+                                          removed += ZSetType::remove(value, args[i]);
+                                      exists = ZSetType::length(value) != 0;
+                                      return true; });
+        if (!ok)
+        {
+            c.addReply(WRONGTYPE_ERR);
+            return;
+        }
+        if (removed != 0)
+            ++c.dirty;
+        c.addReplyInteger(removed);
+    }
+
+    /// @brief Run fn(const RedisObject &zset) on an existing sorted set under the shared lock; reply
+    /// with `missing` when the key does not exist and with WRONGTYPE when it is not a sorted set.
+    template <typename F>
+    void readZSet(Client &c, std::string_view key, std::string_view missing, F &&fn)
+    {
+        keyspace.read(key, [&](const RedisObject *value)
+                      {
+                          if (value == nullptr)
+                              c.addReply(missing);
+                          else if (value->type() != ObjType::ZSet)
+                              c.addReply(WRONGTYPE_ERR);
+                          else
+                              fn(*value); });
+    }
+
+    /// @brief ZSCAN key cursor [MATCH pattern] [COUNT count]: member/score pairs, a few at a time.
+    void zscan(Client &c, const CommandArgs &args)
+    {
+        ScanOptions options;
+        if (!parseScanOptions(c, args, 2, false, options))
+            return;
+        readZSet(c, args[1], EMPTY_SCAN_REPLY, [&](const RedisObject &zset)
+                 {
+                     std::vector<std::pair<std::string_view, double>> members;
+                     size_t seen = 0;
+                     unsigned long long cursor = scanSteps(options, seen, [&](unsigned long long cursor)
+                                                           { return ZSetType::scan(zset, cursor, [&](std::string_view member, double score)
+                                                                                   {
+                                                                                       ++seen;
+                                                                                       if (scanMatches(options, member))
+                                                                                           members.emplace_back(member, score); }); });
+                     addReplyScanHeader(c, cursor, members.size() * 2);
+                     for (const auto &[member, score] : members)
+                     {
+                         c.addReplyBulk(member);
+                         addReplyScore(c, score);
+                     } });
+    }
+
+    void zscore(Client &c, const CommandArgs &args)
+    {
+        readZSet(c, args[1], "$-1\r\n", [&](const RedisObject &zset)
+                 {
+                     double score;
+                     if (ZSetType::score(zset, args[2], score))
+                         addReplyScore(c, score);
+                     else
+                         c.addReplyNull(); });
+    }
+
+    void zcard(Client &c, const CommandArgs &args)
+    {
+        readZSet(c, args[1], ":0\r\n", [&](const RedisObject &zset)
+                 { c.addReplyInteger(ZSetType::length(zset)); });
+    }
+
+    /// @brief ZRANK key member [WITHSCORE].
+    void zrank(Client &c, const CommandArgs &args)
+    {
+        bool with_score = args.size() == 4 && args.equalsIgnoreCase(3, "WITHSCORE");
+        if (args.size() > 4 || (args.size() == 4 && !with_score))
+        {
+            c.addReply("-ERR syntax error\r\n");
+            return;
+        }
+        readZSet(c, args[1], with_score ? "*-1\r\n" : "$-1\r\n", [&](const RedisObject &zset)
+                 {
+                     size_t rank;
+                     double score = 0;
+                     if (!ZSetType::rank(zset, args[2], false, rank))
+                     {
+                         c.addReply(with_score ? "*-1\r\n" : "$-1\r\n");
+                         return;
+                     }
+                     if (!with_score)
+                     {
+                         c.addReplyInteger(rank);
+                         return;
+                     }
+                     ZSetType::score(zset, args[2], score);
+                     c.addReplyArrayLen(2);
+                     c.addReplyInteger(rank);
+                     addReplyScore(c, score); });
+    }
+
+    /// @brief ZRANGE and ZRANGEBYSCORE. args[first] and args[first + 1] are the range, options follow.
+    /// @param by_score whether the range is of scores rather than ranks.
+    void zrangeGeneric(Client &c, const CommandArgs &args, bool by_score)
+    {
+        bool reverse = false, with_scores = false, has_limit = false;
+        long long offset = 0, limit = -1;
+        for (size_t i = 4; i < args.size(); ++i)
+        {
+            if (args.equalsIgnoreCase(i, "WITHSCORES"))
+                with_scores = true;
+            else if (args.equalsIgnoreCase(i, "BYSCORE") && args.equalsIgnoreCase(0, "ZRANGE"))
+                by_score = true;
+            else if (args.equalsIgnoreCase(i, "REV") && args.equalsIgnoreCase(0, "ZRANGE"))
+                reverse = true;
+            else if (args.equalsIgnoreCase(i, "LIMIT") && i + 2 < args.size())
+            {
+                if (!parseLongLong(args[i + 1], offset) || !parseLongLong(args[i + 2], limit))
+                {
+                    c.addReply("-ERR value is not an integer or out of range\r\n");
+                    return;
+                }
+                has_limit = true;
+                i += 2;
+            }
+            else
+            {
+                c.addReply("-ERR syntax error\r\n");
+                return;
+            }
+        }
+        if (has_limit && !by_score)
+        {
+            c.addReply("-ERR syntax error, LIMIT is only supported in combination with either BYSCORE or BYLEX\r\n");
+            return;
+        }
+        long long start = 0, stop = 0;
+        ScoreRange range;
+        // With REV the range is given from the high end: ZRANGE key max min BYSCORE REV.
+        if (by_score && !ZSetType::parseScoreRange(args[reverse ? 3 : 2], args[reverse ? 2 : 3], range))
+        {
+            c.addReply("-ERR min or max is not a float\r\n");
+            return;
+        }
+        if (!by_score && (!parseLongLong(args[2], start) || !parseLongLong(args[3], stop)))
+        {
+            c.addReply("-ERR value is not an integer or out of range\r\n");
+            return;
+        }
+        readZSet(c, args[1], "*0\r\n", [&](const RedisObject &zset)
+                 {
+                     // Views into the set stay valid while the shared lock is held.
+                     std::vector<std::pair<std::string_view, double>> result;
+                     auto collect = [&](std::string_view member, double score)
+                     { result.emplace_back(member, score); };
+                     size_t first = 0, count = 0;
+                     if (by_score && offset >= 0)
+                         ZSetType::rangeByScore(zset, range, reverse, offset, limit, collect);
+                     else if (!by_score && listRange(start, stop, ZSetType::length(zset), first, count))
+                         ZSetType::rangeByRank(zset, first, count, reverse, collect);
+                     c.addReplyArrayLen(result.size() * (with_scores ? 2 : 1));
+                     for (const auto &[member, score] : result)
+                     {
+                         c.addReplyBulk(member);
+                         if (with_scores)
+                             addReplyScore(c, score);
+                     } });
+    }
+
+    /// @brief ZRANGE key start stop [BYSCORE] [REV] [LIMIT offset count] [WITHSCORES].
+    void zrange(Client &c, const CommandArgs &args)
+    {
+        zrangeGeneric(c, args, false);
+    }
+
+    /// @brief ZRANGEBYSCORE key min max [WITHSCORES] [LIMIT offset count].
+    void zrangebyscore(Client &c, const CommandArgs &args)
+    {
+        zrangeGeneric(c, args, true);
+    }
+
+    /// @brief SADD key member [member ...]: replies with the number of new members.
+    void sadd(Client &c, const CommandArgs &args)
+    {
+        size_t added = 0;
+        bool ok = keyspace.modify(args[1], [&](RedisObject &value, bool &exists)
+                                  {
+                                      if (exists && value.type() != ObjType::Set)
+                                          return false;
+                                      if (!exists)
+                                      {
+                                          value = SetType::create(args[2]);
+                                          exists = true;
+                                      }
+                                      for (size_t i = 2; i < args.size(); ++i)
+                                          added += SetType::add(value, args[i], server_meta.set_limits);
+                                      return true; });
+        if (!ok)
+        {
+            c.addReply(WRONGTYPE_ERR);
+            return;
+        }
+        if (added != 0)
+            ++c.dirty;
+        c.addReplyInteger(added);
+    }
+
+    /// @brief SREM key member [member ...]: replies with the number of members removed; removing the last one deletes the key.
+    void srem(Client &c, const CommandArgs &args)
+    {
+        size_t removed = 0;
+        bool ok = keyspace.modify(args[1], [&](RedisObject &value, bool &exists)
+                                  {
+                                      if (!exists)
+                                          return true;
+                                      if (value.type() != ObjType::Set)
+                                          return false;
+                                      for (size_t i = 2; i < args.size(); ++i)
+                                          removed += SetType::remove(value, args[i]);
+                                      exists = SetType::length(value) != 0;
+                                      return true; });
+        if (!ok)
+        {
+            c.addReply(WRONGTYPE_ERR);
+            return;
+        }
+        if (removed != 0)
+            ++c.dirty;
+        c.addReplyInteger(removed);
+    }
+
+    /// @brief Run fn(const RedisObject &set) on an existing set under the shared lock; reply with
+    /// `missing` when the key does not exist and with WRONGTYPE when it is not a set.
+    template <typename F>
+    void readSet(Client &c, std::string_view key, std::string_view missing, F &&fn)
+    {
+        keyspace.read(key, [&](const RedisObject *value)
+                      {
+                          if (value == nullptr)
+                              c.addReply(missing);
+                          else if (value->type() != ObjType::Set)
+                              c.addReply(WRONGTYPE_ERR);
+                          else
+                              fn(*value); });
+    }
+
+    /// @brief SSCAN key cursor [MATCH pattern] [COUNT count]: members, a few at a time.
+    void sscan(Client &c, const CommandArgs &args)
+    {
+        ScanOptions options;
+        if (!parseScanOptions(c, args, 2, false, options))
+            return;
+        readSet(c, args[1], EMPTY_SCAN_REPLY, [&](const RedisObject &set)
+                {
+                    std::vector<std::string> members; // Copies: an intset formats its members in a scratch buffer.
+                    size_t seen = 0;
+                    unsigned long long cursor = scanSteps(options, seen, [&](unsigned long long cursor)
+                                                          { return SetType::scan(set, cursor, [&](std::string_view member)
+                                                                                 {
+                                                                                     ++seen;
+                                                                                     if (scanMatches(options, member))
+                                                                                         members.emplace_back(member); }); });
+                    addReplyScanHeader(c, cursor, members.size());
+                    for (const std::string &member : members)
+                        c.addReplyBulk(member); });
+    }
+
+    void sismember(Client &c, const CommandArgs &args)
+    {
+        readSet(c, args[1], ":0\r\n", [&](const RedisObject &set)
+                { c.addReplyInteger(SetType::contains(set, args[2]) ? 1 : 0); });
+    }
+
+    void smembers(Client &c, const CommandArgs &args)
+    {
+        readSet(c, args[1], "*0\r\n", [&](const RedisObject &set)
+                {
+                    c.addReplyArrayLen(SetType::length(set));
+                    SetType::forEach(set, [&](std::string_view member)
+                                     { c.addReplyBulk(member); }); });
+    }
+
+    void scard(Client &c, const CommandArgs &args)
+    {
+        readSet(c, args[1], ":0\r\n", [&](const RedisObject &set)
+                { c.addReplyInteger(SetType::length(set)); });
+    }
+
+    /// @brief Run fn(const std::vector<const RedisObject *> &sets) on the keys args[first..last),
+    /// all under their shards' shared locks, with nullptr for the missing keys; reply with WRONGTYPE
+    /// instead when one of them is not a set.
+    template <typename F>
+    void readSets(Client &c, const CommandArgs &args, size_t first, size_t last, F &&fn)
+    {
+        std::vector<std::string_view> keys;
+        for (size_t i = first; i < last; ++i)
+            keys.push_back(args[i]);
+        keyspace.readMany(keys, [&](const std::vector<const RedisObject *> &sets)
+                          {
+                              for (const RedisObject *set : sets)
+                              {
+                                  if (set != nullptr && set->type() != ObjType::Set)
+                                  {
+                                      c.addReply(WRONGTYPE_ERR);
+                                      return;
+                                  }
+                              }
+                              fn(sets); });
+    }
+
+    /// @brief SINTER key [key ...]: the members of every set; a missing key is an empty set.
+    void sinter(Client &c, const CommandArgs &args)
+    {
+        readSets(c, args, 1, args.size(), [&](const std::vector<const RedisObject *> &sets)
+                 {
+                     std::vector<std::string> result;
+                     if (std::find(sets.begin(), sets.end(), nullptr) == sets.end())
+                         SetType::intersect(sets, 0, [&](std::string_view member)
+                                            { result.emplace_back(member); });
+                     c.addReplyArrayLen(result.size());
+                     for (const std::string &member : result)
+                         c.addReplyBulk(member); });
+    }
+
+    /// @brief SINTERCARD numkeys key [key ...] [LIMIT limit]: the size of the intersection,
+    /// counting no further than `limit` (0 for no limit).
+    void sintercard(Client &c, const CommandArgs &args)
+    {
+        long long numkeys, limit = 0;
+        if (!parseLongLong(args[1], numkeys))
+        {
+            c.addReply("-ERR value is not an integer or out of range\r\n");
+            return;
+        }
+        if (numkeys <= 0)
+        {
+            c.addReply("-ERR numkeys should be greater than 0\r\n");
+            return;
+        }
+        if (static_cast<size_t>(numkeys) > args.size() - 2)
+        {
+            c.addReply("-ERR Number of keys can't be greater than number of args\r\n");
+            return;
+        }
+        size_t last = 2 + numkeys;
+        if (last != args.size())
+        {
+            if (!args.equalsIgnoreCase(last, "LIMIT") || last + 2 != args.size())
+            {
+                c.addReply("-ERR syntax error\r\n");
+                return;
+            }
+            if (!parseLongLong(args[last + 1], limit) || limit < 0)
+            {
+                c.addReply("-ERR LIMIT can't be negative\r\n");
+                return;
+            }
+        }
+        readSets(c, args, 2, last, [&](const std::vector<const RedisObject *> &sets)
+                 {
+                     size_t count = 0;
+                     if (std::find(sets.begin(), sets.end(), nullptr) == sets.end())
+                         count = SetType::intersect(sets, limit, [](std::string_view) {});
+                     c.addReplyInteger(count); });
+    }
+
+    /// @brief SUNION key [key ...]: the members of any of the sets.
+    void sunion(Client &c, const CommandArgs &args)
+    {
+        readSets(c, args, 1, args.size(), [&](const std::vector<const RedisObject *> &sets)
+                 {
+                     // Gathered into a set of the usual encodings, like redis' setTypeCreate().
+                     RedisObject result = RedisObject::create<IntSet>(ObjType::Set, ObjEncoding::Intset);
+                     for (const RedisObject *set : sets)
+                     {
+                         if (set != nullptr)
+                             SetType::forEach(*set, [&](std::string_view member)
+                                              { SetType::add(result, member, server_meta.set_limits); });
+                     }
+                     c.addReplyArrayLen(SetType::length(result));
+                     SetType::forEach(result, [&](std::string_view member)
+                                      { c.addReplyBulk(member); }); });
+    }
+
+    /// @brief SDIFF key [key ...]: the members of the first set that are in none of the others.
+    void sdiff(Client &c, const CommandArgs &args)
+    {
+        readSets(c, args, 1, args.size(), [&](const std::vector<const RedisObject *> &sets)
+                 {
+                     std::vector<std::string> result;
+                     if (sets[0] != nullptr)
+                         SetType::forEach(*sets[0], [&](std::string_view member)
+                                          {
+                                              for (size_t i = 1; i < sets.size(); ++i)
+                                              {
+                                                  if (sets[i] != nullptr && SetType::contains(*sets[i], member))
+                                                      return;
+                                              }
+                                              result.emplace_back(member); });
+                     c.addReplyArrayLen(result.size());
+                     for (const std::string &member : result)
+                         c.addReplyBulk(member); });
+    }
+
+    static constexpr const char *INVALID_STREAM_ID_ERR = "-ERR Invalid stream ID specified as stream command argument\r\n";
+
+    /// @brief Run fn(const Stream &stream) on an existing stream under the shared lock; reply with
+    /// `missing` when the key does not exist and with WRONGTYPE when it is not a stream.
+    template <typename F>
+    void readStream(Client &c, std::string_view key, std::string_view missing, F &&fn)
+    {
+        keyspace.read(key, [&](const RedisObject *value)
+                      {
+                          if (value == nullptr)
+                              c.addReply(missing);
+                          else if (value->type() != ObjType::Stream)
+                              c.addReply(WRONGTYPE_ERR);
+                          else
+                              fn(value->as<Stream>()); });
+    }
+
+    static void addReplyStreamID(Client &c, StreamID id)
+    {
+        char buf[StreamID::MAX_CHARS];
+        c.addReplyBulk(id.format(buf));
+    }
+
+    /// @brief An entry as [id, [field, value, ...]].
+    static void addReplyStreamEntry(Client &c, const Stream::Entry &entry)
+    {
+        c.addReplyArrayLen(2);
+        addReplyStreamID(c, entry.id);
+        c.addReplyArrayLen(entry.fields.size() * 2);
+        for (const auto &[field, value] : entry.fields)
+        {
+            c.addReplyBulk(field);
+            c.addReplyBulk(value);
+        }
+    }
+
+    /// @brief Trimming requested by XADD and XTRIM: MAXLEN|MINID [=|~] threshold [LIMIT count].
+    struct StreamTrim
+    {
+        enum Strategy
+        {
+            None,
+            MaxLen,
+            MinId,
+        } strategy = None;
+        bool approx = false;
+        size_t max_length = 0;
+        StreamID min_id;
+        size_t limit = 0; // Entries removed at most, in approx mode; 0 for no limit.
+    };
+
+    /// @brief Parse trimming arguments starting at args[i], leaving `i` on the first argument after them.
+    /// @return false after replying with an error.
+    bool parseStreamTrim(Client &c, const CommandArgs &args, size_t &i, StreamTrim &trim)
+    {
+        trim.strategy = args.equalsIgnoreCase(i, "MAXLEN") ? StreamTrim::MaxLen : StreamTrim::MinId;
+        ++i;
+        if (i < args.size() && (args[i] == "~" || args[i] == "="))
+            trim.approx = args[i++] == "~";
+        if (i == args.size())
+        {
+            c.addReply("-ERR syntax error\r\n");
+            return false;
+        }
+        if (trim.strategy == StreamTrim::MaxLen)
+        {
+            long long max_length;
+            if (!parseLongLong(args[i], max_length))
+            {
+                c.addReply("-ERR value is not an integer or out of range\r\n");
+                return false;
+            }
+            if (max_length < 0)
+            {
+                c.addReply("-ERR The MAXLEN argument must be >= 0.\r\n");
+                return false;
+            }
+            trim.max_length = max_length;
+        }
+        else if (!StreamID::parse(args[i], trim.min_id, 0))
+        {
+            c.addReply(INVALID_STREAM_ID_ERR);
+            return false;
+        }
+        ++i;
+        // Approximate trimming stops after a bounded amount of work, like redis' 100 * stream-node-max-entries.
+        trim.limit = trim.approx ? 100 * server_meta.stream_limits.max_block_entries : 0;
+        if (i + 1 < args.size() && args.equalsIgnoreCase(i, "LIMIT"))
+        {
+            long long limit;
+            if (!parseLongLong(args[i + 1], limit) || limit < 0)
+            {
+                c.addReply("-ERR The LIMIT argument must be >= 0.\r\n");
+                return false;
+            }
+            if (!trim.approx)
+            {
+                c.addReply("-ERR syntax error, LIMIT cannot be used without the special ~ option\r\n");
+                return false;
+            }
+            trim.limit = limit;
+            i += 2;
+        }
+        return true;
+    }
+
+    /// @return number of entries removed.
+    static size_t applyStreamTrim(Stream &stream, const StreamTrim &trim)
+    {
+        if (trim.strategy == StreamTrim::MaxLen)
+            return stream.trimMaxLen(trim.max_length, trim.approx, trim.limit);
+        if (trim.strategy == StreamTrim::MinId)
+            return stream.trimMinId(trim.min_id, trim.approx, trim.limit);
+        return 0;
+    }
+
+    /// @brief XADD key [NOMKSTREAM] [MAXLEN|MINID [=|~] threshold [LIMIT count]] *|id field value [field value ...]:
+    /// replies with the ID of the new entry. "*" picks the current time in milliseconds, or the
+    /// last ID's plus a sequence number when the clock is behind; "<ms>-*" only picks the sequence number.
+    /// Replicas are sent the ID that was picked, and approximate trimming as the exact length it left.
+    void xadd(Client &c, const CommandArgs &args)
+    {
+        bool nomkstream = false;
+        StreamTrim trim;
+        size_t i = 2;
+        for (; i < args.size(); ++i)
+        {
+            if (args.equalsIgnoreCase(i, "NOMKSTREAM"))
+                nomkstream = true;
+            else if (args.equalsIgnoreCase(i, "MAXLEN") || args.equalsIgnoreCase(i, "MINID"))
+            {
+                if (!parseStreamTrim(c, args, i, trim))
+                    return;
+                --i;
+            }
+            else
+                break;
+        }
+        if (i == args.size() || (args.size() - i - 1) % 2 != 0 || args.size() - i - 1 == 0)
+        {
+            c.addReply("-ERR wrong number of arguments for 'xadd' command\r\n");
+            return;
+        }
+        // "*", "<ms>-*" or an explicit ID; a bare "<ms>" means "<ms>-0".
+        std::string_view id_arg = args[i];
+        bool auto_ms = id_arg == "*";
+        bool auto_seq = auto_ms || id_arg.ends_with("-*");
+        StreamID requested;
+        if (!auto_ms && !StreamID::parse(auto_seq ? id_arg.substr(0, id_arg.size() - 2) : id_arg, requested, 0))
+        {
+            c.addReply(INVALID_STREAM_ID_ERR);
+            return;
+        }
+        if (!auto_seq && requested == StreamID{})
+        {
+            c.addReply("-ERR The ID specified in XADD must be greater than 0-0\r\n");
+            return;
+        }
+        std::vector<std::string_view> fields(args.begin() + i + 1, args.end());
+        StreamID id;
+        size_t length = 0;
+        const char *error = nullptr;
+        bool added = false;
+        keyspace.modify(args[1], [&](RedisObject &value, bool &exists)
+                        {
+                            if (exists && value.type() != ObjType::Stream)
+                            {
+                                error = WRONGTYPE_ERR;
+                                return false;
+                            }
+                            if (!exists && nomkstream)
+                                return false;
+                            StreamID last = exists ? value.as<Stream>().lastId() : StreamID{};
+                            if (auto_ms)
+                            {
+                                id = {std::max<uint64_t>(Keyspace::nowMs(), last.ms), 0};
+                                if (id.ms == last.ms && !(id = last).increment())
+                                    error = "-ERR The stream has exhausted the last possible ID, unable to add more items\r\n";
+                            }
+                            else if (auto_seq)
+                            {
+                                id = {requested.ms, 0};
+                                if (id.ms < last.ms || (id.ms == last.ms && (last.seq == UINT64_MAX || !(id = last).increment())))
+                                    error = "-ERR The ID specified in XADD is equal or smaller than the target stream top item\r\n";
+                            }
+                            else
+                            {
+                                id = requested;
+                                if (id <= last)
+                                    error = "-ERR The ID specified in XADD is equal or smaller than the target stream top item\r\n";
+                            }
+                            if (error != nullptr)
+                                return false;
+                            if (!exists)
+                            {
+                                value = RedisObject::create<Stream>(ObjType::Stream, ObjEncoding::Stream);
+                                exists = true;
+                            }
+                            Stream &stream = value.as<Stream>();
+                            stream.append(id, fields, server_meta.stream_limits);
+                            applyStreamTrim(stream, trim);
+                            length = stream.size();
+                            added = true;
+                            return true; });
+        if (error != nullptr)
+        {
+            c.addReply(error);
+            return;
+        }
+        if (!added)
+        {
+            c.addReplyNull(); // NOMKSTREAM and no such key.
+            return;
+        }
+        ++c.dirty;
+        blocking_keys.signal(args[1]);
+        char buf[StreamID::MAX_CHARS];
+        std::string_view id_str = id.format(buf);
+        if (auto_seq || trim.approx)
+        {
+            c.propagate_argv = {args.str(0), args.str(1)};
+            if (trim.strategy != StreamTrim::None)
+                c.propagate_argv.insert(c.propagate_argv.end(), {"MAXLEN", "=", std::to_string(length)});
+            c.propagate_argv.emplace_back(id_str);
+            c.propagate_argv.insert(c.propagate_argv.end(), fields.begin(), fields.end());
+        }
+        c.addReplyBulk(id_str);
+    }
+
+    /// @brief Parse an XRANGE bound: "-", "+", an ID, or "(" and an ID to leave that ID out.
+    /// A bare "<ms>" covers the whole millisecond.
+    /// @param end the upper bound, whose missing sequence number is the largest.
+    /// @return false after replying with an error.
+    static bool parseStreamRangeID(Client &c, std::string_view s, bool end, StreamID &id)
+    {
+        if (s == "-" || s == "+")
+        {
+            id = s == "-" ? StreamID{} : StreamID::max();
+            return true;
+        }
+        bool exclusive = s.starts_with('(');
+        if (!StreamID::parse(exclusive ? s.substr(1) : s, id, end ? UINT64_MAX : 0))
+        {
+            c.addReply(INVALID_STREAM_ID_ERR);
+            return false;
+        }
+        if (exclusive && !(end ? id.decrement() : id.increment()))
+        {
+            c.addReply(end ? "-ERR invalid end ID for the interval\r\n" : "-ERR invalid start ID for the interval\r\n");
+            return false;
+        }
+        return true;
+    }
+
+    void xrangeGeneric(Client &c, const CommandArgs &args, bool reverse)
+    {
+        StreamID start, end;
+        if (!parseStreamRangeID(c, args[reverse ? 3 : 2], false, start) || !parseStreamRangeID(c, args[reverse ? 2 : 3], true, end))
+            return;
+        long long count = -1;
+        if (args.size() > 4)
+        {
+            if (args.size() != 6 || !args.equalsIgnoreCase(4, "COUNT"))
+            {
+                c.addReply("-ERR syntax error\r\n");
+                return;
+            }
+            if (!parseLongLong(args[5], count))
+            {
+                c.addReply("-ERR value is not an integer or out of range\r\n");
+                return;
+            }
+            if (count <= 0)
+            {
+                c.addReply("*0\r\n");
+                return;
+            }
+        }
+        readStream(c, args[1], "*0\r\n", [&](const Stream &stream)
+                   {
+                       // The array length comes first: collect the entries, whose views stay valid under the lock.
+                       std::vector<Stream::Entry> entries;
+                       stream.range(start, end, reverse, count > 0 ? count : 0, [&](const Stream::Entry &entry)
+                                    { entries.push_back(entry); });
+                       c.addReplyArrayLen(entries.size());
+                       for (const Stream::Entry &entry : entries)
+                           addReplyStreamEntry(c, entry); });
+    }
+
+    /// @brief XRANGE key start end [COUNT count]: the entries with IDs in [start, end].
+    void xrange(Client &c, const CommandArgs &args)
+    {
+        xrangeGeneric(c, args, false);
+    }
+
+    /// @brief XREVRANGE key end start [COUNT count]: XRANGE from the end.
+    void xrevrange(Client &c, const CommandArgs &args)
+    {
+        xrangeGeneric(c, args, true);
+    }
+
+    void xlen(Client &c, const CommandArgs &args)
+    {
+        readStream(c, args[1], ":0\r\n", [&](const Stream &stream)
+                   { c.addReplyInteger(stream.size()); });
+    }
+
+    /// @brief XTRIM key MAXLEN|MINID [=|~] threshold [LIMIT count]: replies with the number of entries removed.
+    void xtrim(Client &c, const CommandArgs &args)
+    {
+        size_t i = 2;
+        StreamTrim trim;
+        if (!args.equalsIgnoreCase(i, "MAXLEN") && !args.equalsIgnoreCase(i, "MINID"))
+        {
+            c.addReply("-ERR syntax error\r\n");
+            return;
+        }
+        if (!parseStreamTrim(c, args, i, trim))
+            return;
+        if (i != args.size())
+        {
+            c.addReply("-ERR syntax error\r\n");
+            return;
+        }
+        size_t removed = 0, length = 0;
+        bool ok = keyspace.modify(args[1], [&](RedisObject &value, bool &exists)
+                                  {
+                                      if (!exists)
+                                          return true;
+                                      if (value.type() != ObjType::Stream)
+                                          return false;
+                                      removed = applyStreamTrim(value.as<Stream>(), trim);
+                                      length = value.as<Stream>().size();
+                                      return true; });
+        if (!ok)
+        {
+            c.addReply(WRONGTYPE_ERR);
+            return;
+        }
+        if (removed != 0)
+        {
+            ++c.dirty;
+            if (trim.approx)
+                c.propagate_argv = {args.str(0), args.str(1), "MAXLEN", "=", std::to_string(length)};
+        }
+        c.addReplyInteger(removed);
+    }
+
+    /// @brief XREAD [COUNT count] [BLOCK milliseconds] STREAMS key [key ...] id [id ...]: the entries
+    /// after each ID, as [[key, [entry, ...]], ...] for the streams that have any. "$" stands for the
+    /// stream's last ID. With BLOCK and nothing to return, the client waits for an XADD to one of the
+    /// keys (0 for no timeout) and gets a null reply if none comes.
+    void xread(Client &c, const CommandArgs &args)
+    {
+        long long count = 0, timeout_ms = -1;
+        size_t i = 1;
+        for (; i < args.size() && !args.equalsIgnoreCase(i, "STREAMS"); i += 2)
+        {
+            bool is_count = args.equalsIgnoreCase(i, "COUNT");
+            if ((!is_count && !args.equalsIgnoreCase(i, "BLOCK")) || i + 1 == args.size())
+            {
+                c.addReply("-ERR syntax error\r\n");
+                return;
+            }
+            if (is_count)
+            {
+                if (!parseLongLong(args[i + 1], count))
+                {
+                    c.addReply("-ERR value is not an integer or out of range\r\n");
+                    return;
+                }
+                count = std::max(count, 0LL);
+            }
+            else if (!parseLongLong(args[i + 1], timeout_ms))
+            {
+                c.addReply("-ERR timeout is not an integer or out of range\r\n");
+                return;
+            }
+            else if (timeout_ms < 0)
+            {
+                c.addReply("-ERR timeout is negative\r\n");
+                return;
+            }
+        }
+        size_t first = i + 1;
+        if (first >= args.size() || (args.size() - first) % 2 != 0)
+        {
+            c.addReply(i == args.size() ? "-ERR syntax error\r\n" : "-ERR Unbalanced 'xread' list of streams: for each stream key an ID or '$' must be specified.\r\n");
+            return;
+        }
+        size_t streams = (args.size() - first) / 2;
+        std::vector<std::string_view> keys(args.begin() + first, args.begin() + first + streams);
+        std::vector<StreamID> after(streams);
+        std::vector<bool> last_id(streams);
+        for (size_t k = 0; k < streams; ++k)
+        {
+            last_id[k] = args[first + streams + k] == "$";
+            if (!last_id[k] && !StreamID::parse(args[first + streams + k], after[k], 0))
+            {
+                c.addReply(INVALID_STREAM_ID_ERR);
+                return;
+            }
+        }
+
+        // Look the streams up; the first look also resolves "$".
+        bool resolve = true;
+        auto serve = [&]
+        {
+            return keyspace.readMany(keys, [&](const std::vector<const RedisObject *> &values)
+                                     {
+                                         for (const RedisObject *value : values)
+                                         {
+                                             if (value != nullptr && value->type() != ObjType::Stream)
+                                             {
+                                                 c.addReply(WRONGTYPE_ERR);
+                                                 return true;
+                                             }
+                                         }
+                                         std::vector<std::vector<Stream::Entry>> found(streams);
+                                         size_t with_entries = 0;
+                                         for (size_t k = 0; k < streams; ++k)
+                                         {
+                                             const Stream *stream = values[k] != nullptr ? &values[k]->as<Stream>() : nullptr;
+                                             if (last_id[k] && resolve)
+                                                 after[k] = stream != nullptr ? stream->lastId() : StreamID{};
+                                             StreamID start = after[k];
+                                             if (stream == nullptr || !start.increment())
+                                                 continue;
+                                             stream->range(start, StreamID::max(), false, count, [&](const Stream::Entry &entry)
+                                                           { found[k].push_back(entry); });
+                                             with_entries += !found[k].empty();
+                                         }
+                                         resolve = false;
+                                         if (with_entries == 0)
+                                             return false;
+                                         c.addReplyArrayLen(with_entries);
+                                         for (size_t k = 0; k < streams; ++k)
+                                         {
+                                             if (found[k].empty())
+                                                 continue;
+                                             c.addReplyArrayLen(2);
+                                             c.addReplyBulk(keys[k]);
+                                             c.addReplyArrayLen(found[k].size());
+                                             for (const Stream::Entry &entry : found[k])
+                                                 addReplyStreamEntry(c, entry);
+                                         }
+                                         return true; });
+        };
+        if (serve())
+            return;
+        if (timeout_ms < 0)
+        {
+            c.addReply("*-1\r\n");
+            return;
+        }
+        // Run again as the same command with "$" replaced by the IDs it stood for.
+        std::vector<std::string> argv(args.begin(), args.end());
+        char buf[StreamID::MAX_CHARS];
+        for (size_t k = 0; k < streams; ++k)
+        {
+            if (last_id[k])
+                argv[first + streams + k] = after[k].format(buf);
+        }
+        blockClient(c, std::vector<std::string>(keys.begin(), keys.end()), std::move(argv), timeout_ms, "*-1\r\n");
+        if (c.blocked.active && serve())
+            unblockClient(c);
+    }
+
+    /// @brief Run fn(const RedisObject &hll) on an existing HyperLogLog under the shared lock; reply
+    /// with `missing` when the key does not exist and with WRONGTYPE when it is not a HyperLogLog.
+    template <typename F>
+    void readHll(Client &c, std::string_view key, std::string_view missing, F &&fn)
+    {
+        keyspace.read(key, [&](const RedisObject *value)
+                      {
+                          if (value == nullptr)
+                              c.addReply(missing);
+                          else if (value->type() != ObjType::HyperLogLog)
+                              c.addReply(WRONGTYPE_ERR);
+                          else
+                              fn(*value); });
+    }
+
+    /// @brief Merge the HyperLogLogs at `keys` into one byte per register, all under their shards' shared locks.
+    /// Missing keys count as empty.
+    /// @return false if one of them is not a HyperLogLog.
+    bool mergeHlls(const std::vector<std::string_view> &keys, uint8_t *registers)
+    {
+        return keyspace.readMany(keys, [&](const std::vector<const RedisObject *> &hlls)
+                                 {
+                                     for (const RedisObject *hll : hlls)
+                                     {
+                                         if (hll != nullptr && hll->type() != ObjType::HyperLogLog)
+                                             return false;
+                                     }
+                                     for (const RedisObject *hll : hlls)
+                                     {
+                                         if (hll != nullptr)
+                                             HyperLogLogType::mergeInto(*hll, registers);
+                                     }
+                                     return true; });
+    }
+
+    /// @brief PFADD key [element ...]: replies 1 when the estimate may have changed (or the key was created), else 0.
+    void pfadd(Client &c, const CommandArgs &args)
+    {
+        bool changed = false;
+        bool ok = keyspace.modify(args[1], [&](RedisObject &value, bool &exists)
+                                  {
+                                      if (exists && value.type() != ObjType::HyperLogLog)
+                                          return false;
+                                      if (!exists)
+                                      {
+                                          value = HyperLogLogType::create();
+                                          exists = changed = true;
+                                      }
+                                      for (size_t i = 2; i < args.size(); ++i)
+                                          changed |= HyperLogLogType::add(value, args[i], server_meta.hll_limits);
+                                      return true; });
+        if (!ok)
+        {
+            c.addReply(WRONGTYPE_ERR);
+            return;
+        }
+        if (changed)
+            ++c.dirty;
+        c.addReplyInteger(changed ? 1 : 0);
+    }
+
+    /// @brief PFCOUNT key [key ...]: the estimated number of distinct elements added to the keys.
+    /// Several keys are merged into their union first, which is not cached.
+    void pfcount(Client &c, const CommandArgs &args)
+    {
+        if (args.size() == 2)
+        {
+            readHll(c, args[1], ":0\r\n", [&](const RedisObject &hll)
+                    { c.addReplyInteger(HyperLogLogType::count(hll)); });
+            return;
+        }
+        alignas(32) uint8_t registers[Hll::REGISTERS] = {};
+        if (!mergeHlls(std::vector<std::string_view>(args.begin() + 1, args.end()), registers))
+        {
+            c.addReply(WRONGTYPE_ERR);
+            return;
+        }
+        c.addReplyInteger(Hll::estimate(registers));
+    }
+
+    /// @brief PFMERGE destkey [sourcekey ...]: store the union of the HyperLogLogs, destkey's own
+    /// registers included, in destkey. The sources are read before destkey is locked; taking the
+    /// maximum again under its lock keeps concurrent PFADDs to destkey.
+    void pfmerge(Client &c, const CommandArgs &args)
+    {
+        alignas(32) uint8_t registers[Hll::REGISTERS] = {};
+        std::vector<std::string_view> sources;
+        for (size_t i = 2; i < args.size(); ++i)
+        {
+            if (args[i] != args[1])
+                sources.push_back(args[i]);
+        }
+        bool ok = mergeHlls(sources, registers) &&
+                  keyspace.modify(args[1], [&](RedisObject &value, bool &exists)
+                                  {
+                                      if (exists && value.type() != ObjType::HyperLogLog)
+                                          return false;
+                                      if (!exists)
+                                      {
+                                          value = HyperLogLogType::create();
+                                          exists = true;
+                                      }
+                                      HyperLogLogType::mergeInto(value, registers);
+                                      HyperLogLogType::assign(value, registers, server_meta.hll_limits);
+                                      return true; });
+        if (!ok)
+        {
+            c.addReply(WRONGTYPE_ERR);
+            return;
+        }
+        ++c.dirty;
+        c.addReply("+OK\r\n");
+    }
+
+    /// @brief Run fn(std::string_view value) on an existing string under the shared lock; reply with
+    /// `missing` when the key does not exist and with WRONGTYPE when it is not a string.
+    template <typename F>
+    void readString(Client &c, std::string_view key, std::string_view missing, F &&fn)
+    {
+        keyspace.read(key, [&](const RedisObject *value)
+                      {
+                          RedisObject::IntBuffer buf;
+                          if (value == nullptr)
+                              c.addReply(missing);
+                          else if (value->type() != ObjType::String)
+                              c.addReply(WRONGTYPE_ERR);
+                          else
+                              fn(value->stringView(buf)); });
+    }
+
+    /// @brief Parse the bit offset of a bitmap command, like redis' getBitOffsetFromArgument(): with
+    /// `hash`, "#N" means the Nth field of `bits` bits. The field must end within proto-max-bulk-len bytes.
+    bool parseBitOffset(Client &c, std::string_view arg, bool hash, unsigned bits, uint64_t &offset)
+    {
+        bool fields = hash && !arg.empty() && arg[0] == '#';
+        if (fields)
+            arg.remove_prefix(1);
+        const uint64_t max = server_meta.proto_limits.max_bulk_len * 8 - std::max(bits, 1u);
+        long long value;
+        if (!parseLongLong(arg, value) || value < 0 || (fields && __builtin_mul_overflow(value, static_cast<long long>(bits), &value)) ||
+            static_cast<uint64_t>(value) > max)
+        {
+            c.addReply("-ERR bit offset is not an integer or out of range\r\n");
+            return false;
+        }
+        offset = static_cast<uint64_t>(value);
+        return true;
+    }
+
+    /// @brief The bytes [first, last] a BITCOUNT or BITPOS range covers, and the bits of the first and
+    /// last byte outside it when the range is in bits.
+    struct BitRange
+    {
+        bool empty = false;
+        size_t first = 0;
+        size_t last = 0;
+        uint8_t first_mask = 0;
+        uint8_t last_mask = 0;
+    };
+
+    /// @brief Clamp start and end, byte or (with `bits`) bit indexes that count from the end when
+    /// negative, to a string of `len` bytes.
+    static BitRange bitRange(long long start, long long end, bool bits, size_t len)
+    {
+        const long long total = bits ? static_cast<long long>(len) * 8 : static_cast<long long>(len);
+        if (start < 0)
+            start = std::max(start + total, 0LL);
+        if (end < 0)
+            end = std::max(end + total, 0LL);
+        end = std::min(end, total - 1);
+        BitRange range;
+        if (start > end)
+        {
+            range.empty = true;
+            return range;
+        }
+        if (bits)
+        {
+            range.first_mask = static_cast<uint8_t>(~((1u << (8 - (start & 7))) - 1));
+            range.last_mask = static_cast<uint8_t>((1u << (7 - (end & 7))) - 1);
+            start >>= 3;
+            end >>= 3;
+        }
+        range.first = static_cast<size_t>(start);
+        range.last = static_cast<size_t>(end);
+        return range;
+    }
+
+    /// @brief Parse BYTE or BIT, the unit of a BITCOUNT or BITPOS range.
+    static bool parseBitUnit(Client &c, const CommandArgs &args, size_t i, bool &bits)
+    {
+        if (args.equalsIgnoreCase(i, "byte"))
+            bits = false;
+        else if (args.equalsIgnoreCase(i, "bit"))
+            bits = true;
+        else
+        {
+            c.addReply("-ERR syntax error\r\n");
+            return false;
+        }
+        return true;
+    }
+
+    /// @brief SETBIT key offset value: replies with the previous bit. The string grows with zero bytes
+    /// to reach the offset, in place unless a reply still shares it.
+    void setbit(Client &c, const CommandArgs &args)
+    {
+        uint64_t offset;
+        if (!parseBitOffset(c, args[2], false, 0, offset))
+            return;
+        if (args[3] != "0" && args[3] != "1")
+        {
+            c.addReply("-ERR bit is not an integer or out of range\r\n");
+            return;
+        }
+        const bool on = args[3] == "1";
+        bool previous = false;
+        bool ok = keyspace.modify(args[1], [&](RedisObject &value, bool &exists)
+                                  {
+                                      if (exists && value.type() != ObjType::String)
+                                          return false;
+                                      if (!exists)
+                                          value = RedisObject();
+                                      exists = true;
+                                      std::string &bitmap = value.mutableString();
+                                      size_t byte = offset >> 3;
+                                      if (bitmap.size() <= byte)
+                                          bitmap.resize(byte + 1);
+                                      const uint8_t mask = static_cast<uint8_t>(0x80 >> (offset & 7));
+                                      uint8_t &slot = reinterpret_cast<uint8_t &>(bitmap[byte]);
+                                      previous = (slot & mask) != 0;
+                                      slot = static_cast<uint8_t>(on ? slot | mask : slot & ~mask);
+                                      return true; });
+        if (!ok)
+        {
+            c.addReply(WRONGTYPE_ERR);
+            return;
+        }
+        ++c.dirty;
+        c.addReplyInteger(previous ? 1 : 0);
+    }
+
+    /// @brief GETBIT key offset: bits past the end of the string are 0.
+    void getbit(Client &c, const CommandArgs &args)
+    {
+        uint64_t offset;
+        if (!parseBitOffset(c, args[2], false, 0, offset))
+            return;
+        readString(c, args[1], ":0\r\n", [&](std::string_view bitmap)
+                   {
+                       size_t byte = offset >> 3;
+                       bool set = byte < bitmap.size() && (static_cast<uint8_t>(bitmap[byte]) & (0x80 >> (offset & 7)));
+                       c.addReplyInteger(set ? 1 : 0); });
+    }
+
+    /// @brief BITCOUNT key [start end [BYTE|BIT]]: number of bits set in the string or in a range of it.
+    void bitcount(Client &c, const CommandArgs &args)
+    {
+        long long start = 0, end = -1;
+        bool bits = false;
+        if (args.size() == 3 || args.size() > 5)
+        {
+            c.addReply("-ERR syntax error\r\n");
+            return;
+        }
+        if (args.size() >= 4 && (!parseLongLong(args[2], start) || !parseLongLong(args[3], end)))
+        {
+            c.addReply("-ERR value is not an integer or out of range\r\n");
+            return;
+        }
+        if (args.size() == 5 && !parseBitUnit(c, args, 4, bits))
+            return;
+        readString(c, args[1], ":0\r\n", [&](std::string_view bitmap)
+                   {
+                       BitRange range = bitRange(start, end, bits, bitmap.size());
+                       if (range.empty)
+                       {
+                           c.addReplyInteger(0);
+                           return;
+                       }
+                       const uint8_t *p = reinterpret_cast<const uint8_t *>(bitmap.data());
+                       uint64_t count = Bitmap::popcount(p + range.first, range.last - range.first + 1);
+                       count -= Bitmap::popcountWord(p[range.first] & range.first_mask) + Bitmap::popcountWord(p[range.last] & range.last_mask);
+                       c.addReplyInteger(static_cast<long long>(count)); });
+    }
+
+    /// @brief BITPOS key bit [start [end [BYTE|BIT]]]: position of the first bit set to `bit`. Without
+    /// an end, the string reads as followed by zero bits, so looking for 0 in all ones finds the bit
+    /// just past it; with one, or when looking for 1, a miss replies -1.
+    void bitpos(Client &c, const CommandArgs &args)
+    {
+        if (args[2] != "0" && args[2] != "1")
+        {
+            c.addReply("-ERR The bit argument must be 1 or 0.\r\n");
+            return;
+        }
+        const bool bit = args[2] == "1";
+        long long start = 0, end = -1;
+        bool bits = false;
+        if (args.size() > 6)
+        {
+            c.addReply("-ERR syntax error\r\n");
+            return;
+        }
+        if ((args.size() >= 4 && !parseLongLong(args[3], start)) || (args.size() >= 5 && !parseLongLong(args[4], end)))
+        {
+            c.addReply("-ERR value is not an integer or out of range\r\n");
+            return;
+        }
+        if (args.size() == 6 && !parseBitUnit(c, args, 5, bits))
+            return;
+        const bool end_given = args.size() >= 5;
+        readString(c, args[1], bit ? ":-1\r\n" : ":0\r\n", [&](std::string_view bitmap)
+                   {
+                       BitRange range = bitRange(start, end, bits, bitmap.size());
+                       if (range.empty)
+                       {
+                           c.addReplyInteger(-1);
+                           return;
+                       }
+                       size_t bytes = range.last - range.first + 1;
+                       int64_t pos = Bitmap::findBit(reinterpret_cast<const uint8_t *>(bitmap.data()) + range.first, bytes, bit,
+                                                     range.first_mask, range.last_mask);
+                       if (pos == -1 && !bit && !end_given)
+                           pos = static_cast<int64_t>(bytes * 8);
+                       c.addReplyInteger(pos == -1 ? -1 : pos + static_cast<int64_t>(range.first * 8)); });
+    }
+
+    /// @brief BITOP AND|OR|XOR|NOT destkey key [key ...]: store the bitwise combination of the strings,
+    /// as long as the longest of them, in destkey; an empty result deletes destkey. Replies with its length.
+    void bitop(Client &c, const CommandArgs &args)
+    {
+        Bitmap::Op op;
+        if (args.equalsIgnoreCase(1, "and"))
+            op = Bitmap::Op::And;
+        else if (args.equalsIgnoreCase(1, "or"))
+            op = Bitmap::Op::Or;
+        else if (args.equalsIgnoreCase(1, "xor"))
+            op = Bitmap::Op::Xor;
+        else if (args.equalsIgnoreCase(1, "not"))
+            op = Bitmap::Op::Not;
+        else
+        {
+            c.addReply("-ERR syntax error\r\n");
+            return;
+        }
+        if (op == Bitmap::Op::Not && args.size() != 4)
+        {
+            c.addReply("-ERR BITOP NOT must be called with a single source key.\r\n");
+            return;
+        }
+        std::string result;
+        bool ok = keyspace.readMany(std::vector<std::string_view>(args.begin() + 3, args.end()),
+                                    [&](const std::vector<const RedisObject *> &values)
+                                    {
+                                        std::vector<std::string_view> sources;
+                                        std::vector<std::string> numbers; // Integer encoded sources, formatted.
+                                        numbers.reserve(values.size());
+                                        size_t len = 0;
+                                        for (const RedisObject *value : values)
+                                        {
+                                            RedisObject::IntBuffer buf;
+                                            if (value != nullptr && value->type() != ObjType::String)
+                                                return false;
+                                            if (value == nullptr)
+                                                sources.emplace_back();
+                                            else if (value->encoding() == ObjEncoding::Int)
+                                                sources.push_back(numbers.emplace_back(value->stringView(buf)));
+                                            else
+                                                sources.push_back(value->stringView(buf));
+                                            len = std::max(len, sources.back().size());
+                                        }
+                                        result.resize_and_overwrite(len, [&](char *out, size_t n)
+                                                                    {
+                                                                        Bitmap::bitop(op, reinterpret_cast<uint8_t *>(out), n, sources);
+                                                                        return n; });
+                                        return true;
+                                    });
+        if (!ok)
+        {
+            c.addReply(WRONGTYPE_ERR);
+            return;
+        }
+        const size_t len = result.size();
+        if (len != 0)
+            keyspace.set(args[2], RedisObject::adoptString(std::move(result)));
+        else
+            keyspace.modify(args[2], [](RedisObject &, bool &exists)
+                            { exists = false; return true; });
+        ++c.dirty;
+        c.addReplyInteger(static_cast<long long>(len));
+    }
+
+    /// @brief One GET, SET or INCRBY of a BITFIELD command.
+    struct BitfieldOp
+    {
+        enum Kind
+        {
+            Get,
+            Set,
+            IncrBy,
+        } kind;
+        uint64_t offset;
+        unsigned bits;
+        bool is_signed;
+        long long value; // SET value or INCRBY increment.
+        Bitmap::Overflow overflow;
+    };
+
+    /// @brief The value of a BITFIELD field, read as its signedness says.
+    static long long getBitfield(std::string_view bitmap, const BitfieldOp &op)
+    {
+        if (op.is_signed)
+            return Bitmap::getSignedField(bitmap, op.offset, op.bits);
+        return static_cast<long long>(Bitmap::getField(bitmap, op.offset, op.bits));
+    }
+
+    /// @brief Apply a SET or INCRBY to a bitmap long enough to hold its field.
+    /// @return the old value for SET, the new one for INCRBY, or nothing when OVERFLOW FAIL stopped it.
+    static std::optional<long long> writeBitfield(std::string &bitmap, const BitfieldOp &op)
+    {
+        long long old = getBitfield(bitmap, op);
+        uint64_t stored;
+        if (op.is_signed)
+        {
+            int64_t updated;
+            bool ok = op.kind == BitfieldOp::Set ? Bitmap::addSigned(op.value, 0, op.bits, op.overflow, updated)
+                                                 : Bitmap::addSigned(old, op.value, op.bits, op.overflow, updated);
+            if (!ok)
+                return std::nullopt;
+            stored = static_cast<uint64_t>(updated);
+        }
+        else
+        {
+            bool ok = op.kind == BitfieldOp::Set ? Bitmap::addUnsigned(static_cast<uint64_t>(op.value), 0, op.bits, op.overflow, stored)
+                                                 : Bitmap::addUnsigned(static_cast<uint64_t>(old), op.value, op.bits, op.overflow, stored);
+            if (!ok)
+                return std::nullopt;
+        }
+        Bitmap::setField(reinterpret_cast<uint8_t *>(bitmap.data()), op.offset, op.bits, stored);
+        if (op.kind == BitfieldOp::Set)
+            return old;
+        return getBitfield(bitmap, op);
+    }
+
+    /// @brief BITFIELD key [GET type offset] [SET type offset value] [INCRBY type offset increment]
+    /// [OVERFLOW WRAP|SAT|FAIL] ...: read and write integer fields of a bitmap. A type is i1 to i64
+    /// or u1 to u63, an offset "#N" means the Nth field of that type. OVERFLOW applies to the SET and
+    /// INCRBY after it. Replies with one value per GET, SET (old value) and INCRBY (new value).
+    void bitfield(Client &c, const CommandArgs &args)
+    {
+        std::vector<BitfieldOp> ops;
+        Bitmap::Overflow overflow = Bitmap::Overflow::Wrap;
+        bool writes = false;
+        uint64_t highest = 0; // Last bit a SET or INCRBY touches.
+        for (size_t i = 2; i < args.size(); ++i)
+        {
+            if (args.equalsIgnoreCase(i, "overflow") && i + 1 < args.size())
+            {
+                ++i;
+                if (args.equalsIgnoreCase(i, "wrap"))
+                    overflow = Bitmap::Overflow::Wrap;
+                else if (args.equalsIgnoreCase(i, "sat"))
+                    overflow = Bitmap::Overflow::Sat;
+                else if (args.equalsIgnoreCase(i, "fail"))
+                    overflow = Bitmap::Overflow::Fail;
+                else
+                {
+                    c.addReply("-ERR Invalid OVERFLOW type specified\r\n");
+                    return;
+                }
+                continue;
+            }
+            BitfieldOp op{};
+            if (args.equalsIgnoreCase(i, "get") && i + 2 < args.size())
+                op.kind = BitfieldOp::Get;
+            else if (args.equalsIgnoreCase(i, "set") && i + 3 < args.size())
+                op.kind = BitfieldOp::Set;
+            else if (args.equalsIgnoreCase(i, "incrby") && i + 3 < args.size())
+                op.kind = BitfieldOp::IncrBy;
+            else
+            {
+                c.addReply("-ERR syntax error\r\n");
+                return;
+            }
+            std::string_view type = args[i + 1];
+            long long bits = 0;
+            op.is_signed = !type.empty() && (type[0] == 'i' || type[0] == 'I');
+            if (type.empty() || (!op.is_signed && type[0] != 'u' && type[0] != 'U') || !parseLongLong(type.substr(1), bits) ||
+                bits < 1 || bits > (op.is_signed ? 64 : 63))
+            {
+                c.addReply("-ERR Invalid bitfield type. Use something like i16 u8. Note that u64 is not supported but i64 is.\r\n");
+                return;
+            }
+            op.bits = static_cast<unsigned>(bits);
+            if (!parseBitOffset(c, args[i + 2], true, op.bits, op.offset))
+                return;
+            if (op.kind != BitfieldOp::Get)
+            {
+                if (!parseLongLong(args[i + 3], op.value))
+                {
+                    c.addReply("-ERR value is not an integer or out of range\r\n");
+                    return;
+                }
+                writes = true;
+                highest = std::max(highest, op.offset + op.bits - 1);
+            }
+            op.overflow = overflow;
+            ops.push_back(op);
+            i += op.kind == BitfieldOp::Get ? 2 : 3;
+        }
+        if (!writes)
+        {
+            keyspace.read(args[1], [&](const RedisObject *value)
+                          {
+                              if (value != nullptr && value->type() != ObjType::String)
+                              {
+                                  c.addReply(WRONGTYPE_ERR);
+                                  return;
+                              }
+                              RedisObject::IntBuffer buf;
+                              std::string_view bitmap = value != nullptr ? value->stringView(buf) : std::string_view();
+                              c.addReplyArrayLen(static_cast<long long>(ops.size()));
+                              for (const BitfieldOp &op : ops)
+                                  c.addReplyInteger(getBitfield(bitmap, op)); });
+            return;
+        }
+        std::vector<std::optional<long long>> results;
+        results.reserve(ops.size());
+        bool ok = keyspace.modify(args[1], [&](RedisObject &value, bool &exists)
+                                  {
+                                      if (exists && value.type() != ObjType::String)
+                                          return false;
+                                      if (!exists)
+                                          value = RedisObject();
+                                      exists = true;
+                                      // Like redis, the string grows to the last field written even if OVERFLOW FAIL skips it.
+                                      std::string &bitmap = value.mutableString();
+                                      if (bitmap.size() <= highest >> 3)
+                                          bitmap.resize((highest >> 3) + 1);
+                                      for (const BitfieldOp &op : ops)
+                                      {
+                                          if (op.kind == BitfieldOp::Get)
+                                              results.emplace_back(getBitfield(bitmap, op));
+                                          else
+                                              results.push_back(writeBitfield(bitmap, op));
+                                      }
+                                      return true; });
+        if (!ok)
+        {
+            c.addReply(WRONGTYPE_ERR);
+            return;
+        }
+        ++c.dirty;
+        c.addReplyArrayLen(static_cast<long long>(results.size()));
+        for (const std::optional<long long> &result : results)
+        {
+            if (result)
+                c.addReplyInteger(*result);
+            else
+                c.addReplyNull();
+        }
+    }
+
+    /// @brief TYPE key: the type of a key's value, or none.
+    void type(Client &c, const CommandArgs &args)
+    {
+        keyspace.read(args[1], [&](const RedisObject *value)
+                      { c.addReply(value == nullptr ? std::string("+none\r\n") : "+" + std::string(value->typeName()) + "\r\n"); });
+    }
+
+    /// @brief The arguments of SCAN and its kin: cursor [MATCH pattern] [COUNT count] [TYPE type].
+    struct ScanOptions
+    {
+        unsigned long long cursor = 0;
+        std::optional<GlobPattern> match;
+        size_t count = 10;                     // Elements to look at, not to return.
+        std::optional<std::string_view> type;  // A typeName(), for SCAN only.
+    };
+
+    // Like redis, a call gives up after COUNT * this many steps, so a sparse table costs bounded work.
+    static constexpr size_t SCAN_MAX_STEPS_PER_COUNT = 10;
+    static constexpr const char *EMPTY_SCAN_REPLY = "*2\r\n$1\r\n0\r\n*0\r\n";
+
+    /// @brief Parse the cursor at args[first] and the options after it.
+    /// @param with_type accept the TYPE option, which only SCAN has.
+    /// @return false after replying with an error.
+    static bool parseScanOptions(Client &c, const CommandArgs &args, size_t first, bool with_type, ScanOptions &options)
+    {
+        std::string_view cursor = args[first];
+        auto [end, ec] = std::from_chars(cursor.data(), cursor.data() + cursor.size(), options.cursor);
+        if (ec != std::errc() || end != cursor.data() + cursor.size())
+        {
+            c.addReply("-ERR invalid cursor\r\n");
+            return false;
+        }
+        for (size_t i = first + 1; i < args.size(); i += 2)
+        {
+            if (i + 1 == args.size())
+            {
+                c.addReply("-ERR syntax error\r\n");
+                return false;
+            }
+            if (args.equalsIgnoreCase(i, "MATCH"))
+            {
+                options.match.emplace(args[i + 1]);
+            }
+            else if (args.equalsIgnoreCase(i, "COUNT"))
+            {
+                long long count;
+                if (!parseLongLong(args[i + 1], count))
+                {
+                    c.addReply("-ERR value is not an integer or out of range\r\n");
+                    return false;
+                }
+                if (count < 1)
+                {
+                    c.addReply("-ERR syntax error\r\n");
+                    return false;
+                }
+                options.count = static_cast<size_t>(count);
+            }
+            else if (with_type && args.equalsIgnoreCase(i, "TYPE"))
+            {
+                static constexpr std::string_view type_names[] = {"string", "list", "hash", "set", "zset", "stream", "hyperloglog"};
+                auto known = std::find_if(std::begin(type_names), std::end(type_names), [&](std::string_view name)
+                                          { return args.equalsIgnoreCase(i + 1, name); });
+                if (known == std::end(type_names))
+                {
+                    c.addReply("-ERR unknown type name '" + args.str(i + 1) + "'\r\n");
+                    return false;
+                }
+                options.type = *known;
+            }
+            else
+            {
+                c.addReply("-ERR syntax error\r\n");
+                return false;
+            }
+        }
+        return true;
+    }
+
+    /// @brief Call step(cursor), which returns the next cursor and adds the elements it looked at to
+    /// `seen`, until COUNT elements were seen, the walk is complete or the step budget is spent.
+    /// @return the cursor to reply with.
+    template <typename F>
+    static unsigned long long scanSteps(const ScanOptions &options, const size_t &seen, F &&step)
+    {
+        unsigned long long cursor = options.cursor;
+        size_t steps = std::min(options.count, SIZE_MAX / SCAN_MAX_STEPS_PER_COUNT) * SCAN_MAX_STEPS_PER_COUNT;
+        do
+        {
+            cursor = step(cursor);
+        } while (cursor != 0 && --steps != 0 && seen < options.count);
+        return cursor;
+    }
+
+    static bool scanMatches(const ScanOptions &options, std::string_view element)
+    {
+        return !options.match || options.match->matches(element);
+    }
+
+    /// @brief The header of a SCAN reply: the next cursor, then an array of `elements` to follow.
+    static void addReplyScanHeader(Client &c, unsigned long long cursor, size_t elements)
+    {
+        c.addReplyArrayLen(2);
+        c.addReplyBulk(std::to_string(cursor));
+        c.addReplyArrayLen(static_cast<long long>(elements));
+    }
+
+    /// @brief SCAN cursor [MATCH pattern] [COUNT count] [TYPE type]: walk the keyspace a few keys at a
+    /// time, see Keyspace::scan(). Each step holds one shard's shared lock, never the whole keyspace.
+    void scan(Client &c, const CommandArgs &args)
+    {
+        ScanOptions options;
+        if (!parseScanOptions(c, args, 1, true, options))
+            return;
+        std::vector<std::string> keys;
+        size_t seen = 0;
+        unsigned long long cursor = scanSteps(options, seen, [&](unsigned long long cursor)
+                                              { return keyspace.scan(cursor, [&](std::string_view key, const RedisObject &value)
+                                                                     {
+                                                                         ++seen;
+                                                                         if (options.type && value.typeName() != *options.type)
+                                                                             return;
+                                                                         if (scanMatches(options, key))
+                                                                             keys.emplace_back(key); }); });
+        addReplyScanHeader(c, cursor, keys.size());
+        for (const std::string &key : keys)
+            c.addReplyBulk(key);
+    }
+
+    /// @brief KEYS pattern: every key that matches, walking one shard at a time. A pattern without
+    /// wildcards is a single lookup.
+    void keys(Client &c, const CommandArgs &args)
+    {
+        GlobPattern pattern(args[1]);
+        if (pattern.isLiteral())
+        {
+            bool found = keyspace.read(pattern.literal(), [](const RedisObject *value)
+                                       { return value != nullptr; });
+            c.addReplyArrayLen(found ? 1 : 0);
+            if (found)
+                c.addReplyBulk(pattern.literal());
+            return;
+        }
+        std::vector<std::string> keys;
+        keyspace.forEachKey([&](std::string_view key, const RedisObject &)
+                            {
+                                if (pattern.matches(key))
+                                    keys.emplace_back(key); });
+        c.addReplyArrayLen(static_cast<long long>(keys.size()));
+        for (const std::string &key : keys)
+            c.addReplyBulk(key);
+    }
+
+    /// @brief OBJECT ENCODING key: how the value of a key is stored.
+    void object(Client &c, const CommandArgs &args)
+    {
+        if (!args.equalsIgnoreCase(1, "ENCODING") || args.size() != 3)
+        {
+            c.addReply("-ERR unknown subcommand '" + args.str(1) + "'. Try OBJECT HELP.\r\n");
+            return;
+        }
+        keyspace.read(args[2], [&](const RedisObject *value)
+                      {
+                          if (value == nullptr)
+                              c.addReplyNull();
+                          else
+                              c.addReplyBulk(value->encodingName()); });
+    }
+
+    void replconf(Client &c, const CommandArgs &args)
+    {
+        if (args.equalsIgnoreCase(1, "GETACK"))
+        {
+            c.addReply("*3\r\n$8\r\nREPLCONF\r\n$3\r\nACK\r\n$1\r\n0\r\n");
+        }
+        else
+        {
+            c.addReply("+OK\r\n");
+        }
+    }
+
+    /// @brief COMMAND, COMMAND COUNT, COMMAND INFO name... and COMMAND DOCS, served from the command table.
+    void command(Client &c, const CommandArgs &args)
+    {
+        if (args.size() == 1)
+        {
+            c.addReplyArrayLen(command_table.size());
+            for (const RedisCommand &cmd : command_table)
+            {
+                addReplyCommandInfo(c, cmd);
+            }
+        }
+        else if (args.equalsIgnoreCase(1, "COUNT") && args.size() == 2)
+        {
+            c.addReplyInteger(command_table.size());
+        }
+        else if (args.equalsIgnoreCase(1, "INFO"))
+        {
+            c.addReplyArrayLen(args.size() - 2);
+            for (size_t i = 2; i < args.size(); ++i)
+            {
+                const RedisCommand *cmd = command_table.find(args[i]);
+                if (cmd != nullptr)
+                    addReplyCommandInfo(c, *cmd);
+                else
+                    c.addReplyNull();
+            }
+        }
+        else if (args.equalsIgnoreCase(1, "DOCS"))
+        {
+            // No documentation is kept; clients such as redis-cli fall back to plain completion.
+            c.addReplyArrayLen(0);
+        }
+        else
+        {
+            c.addReply("-ERR unknown subcommand '" + args.str(1) + "'. Try COMMAND HELP.\r\n");
+        }
+    }
+
+    /// @brief One COMMAND INFO entry: name, arity, flags, first key, last key, key step and (empty) ACL categories.
+    static void addReplyCommandInfo(Client &c, const RedisCommand &cmd)
+    {
+        static constexpr std::pair<uint32_t, std::string_view> flag_names[] = {
+            {CMD_WRITE, "write"},
+            {CMD_READONLY, "readonly"},
+            {CMD_ADMIN, "admin"},
+            {CMD_FAST, "fast"},
+            {CMD_DENYOOM, "denyoom"},
+        };
+        c.addReplyArrayLen(7);
+        c.addReplyBulk(cmd.name);
+        c.addReplyInteger(cmd.arity);
+        c.addReplyArrayLen(std::popcount(cmd.flags));
+        for (const auto &[flag, name] : flag_names)
+        {
+            if (cmd.flags & flag)
+                c.addReply("+" + std::string(name) + "\r\n");
+        }
+        c.addReplyInteger(cmd.first_key);
+        c.addReplyInteger(cmd.last_key);
+        c.addReplyInteger(cmd.key_step);
+        c.addReplyArrayLen(0);
     }
 
-    void info(int fd, resp::unique_value &rep)
+    static constexpr RedisCommand command_list[] = {
+        {"ping", &RedisServer::ping, -1, CMD_FAST, 0, 0, 0},
+        {"echo", &RedisServer::echo, 2, CMD_FAST, 0, 0, 0},
+        {"set", &RedisServer::setValue, -3, CMD_WRITE | CMD_DENYOOM, 1, 1, 1},
+        {"get", &RedisServer::getValue, 2, CMD_READONLY | CMD_FAST, 1, 1, 1},
+        {"mget", &RedisServer::mget, -2, CMD_READONLY | CMD_FAST, 1, -1, 1},
+        {"mset", &RedisServer::mset, -3, CMD_WRITE | CMD_DENYOOM, 1, -1, 2},
+        {"msetnx", &RedisServer::msetnx, -3, CMD_WRITE | CMD_DENYOOM, 1, -1, 2},
+        {"del", &RedisServer::del, -2, CMD_WRITE, 1, -1, 1},
+        {"unlink", &RedisServer::unlink, -2, CMD_WRITE | CMD_FAST, 1, -1, 1},
+        {"exists", &RedisServer::exists, -2, CMD_READONLY | CMD_FAST, 1, -1, 1},
+        {"incr", &RedisServer::incr, 2, CMD_WRITE | CMD_DENYOOM | CMD_FAST, 1, 1, 1},
+        {"decr", &RedisServer::decr, 2, CMD_WRITE | CMD_DENYOOM | CMD_FAST, 1, 1, 1},
+        {"incrby", &RedisServer::incrBy, 3, CMD_WRITE | CMD_DENYOOM | CMD_FAST, 1, 1, 1},
+        {"decrby", &RedisServer::decrBy, 3, CMD_WRITE | CMD_DENYOOM | CMD_FAST, 1, 1, 1},
+        {"incrbyfloat", &RedisServer::incrByFloat, 3, CMD_WRITE | CMD_DENYOOM | CMD_FAST, 1, 1, 1},
+        {"expire", &RedisServer::expire, -3, CMD_WRITE | CMD_FAST, 1, 1, 1},
+        {"pexpire", &RedisServer::pexpire, -3, CMD_WRITE | CMD_FAST, 1, 1, 1},
+        {"expireat", &RedisServer::expireAt, -3, CMD_WRITE | CMD_FAST, 1, 1, 1},
+        {"pexpireat", &RedisServer::pexpireAt, -3, CMD_WRITE | CMD_FAST, 1, 1, 1},
+        {"ttl", &RedisServer::ttl, 2, CMD_READONLY | CMD_FAST, 1, 1, 1},
+        {"pttl", &RedisServer::pttl, 2, CMD_READONLY | CMD_FAST, 1, 1, 1},
+        {"persist", &RedisServer::persist, 2, CMD_WRITE | CMD_FAST, 1, 1, 1},
+        {"lpush", &RedisServer::lpush, -3, CMD_WRITE | CMD_DENYOOM | CMD_FAST, 1, 1, 1},
+        {"rpush", &RedisServer::rpush, -3, CMD_WRITE | CMD_DENYOOM | CMD_FAST, 1, 1, 1},
+        {"lpop", &RedisServer::lpop, -2, CMD_WRITE | CMD_FAST, 1, 1, 1},
+        {"rpop", &RedisServer::rpop, -2, CMD_WRITE | CMD_FAST, 1, 1, 1},
+        {"lrange", &RedisServer::lrange, 4, CMD_READONLY, 1, 1, 1},
+        {"llen", &RedisServer::llen, 2, CMD_READONLY | CMD_FAST, 1, 1, 1},
+        {"lindex", &RedisServer::lindex, 3, CMD_READONLY, 1, 1, 1},
+        {"ltrim", &RedisServer::ltrim, 4, CMD_WRITE, 1, 1, 1},
+        {"hset", &RedisServer::hset, -4, CMD_WRITE | CMD_DENYOOM | CMD_FAST, 1, 1, 1},
+        {"hget", &RedisServer::hget, 3, CMD_READONLY | CMD_FAST, 1, 1, 1},
+        {"hmget", &RedisServer::hmget, -3, CMD_READONLY | CMD_FAST, 1, 1, 1},
+        {"hdel", &RedisServer::hdel, -3, CMD_WRITE | CMD_FAST, 1, 1, 1},
+        {"hgetall", &RedisServer::hgetall, 2, CMD_READONLY, 1, 1, 1},
+        {"hlen", &RedisServer::hlen, 2, CMD_READONLY | CMD_FAST, 1, 1, 1},
+        {"hincrby", &RedisServer::hincrby, 4, CMD_WRITE | CMD_DENYOOM | CMD_FAST, 1, 1, 1},
+        {"hscan", &RedisServer::hscan, -3, CMD_READONLY, 1, 1, 1},
+        {"zadd", &RedisServer::zadd, -4, CMD_WRITE | CMD_DENYOOM | CMD_FAST, 1, 1, 1},
+        {"zincrby", &RedisServer::zincrby, 4, CMD_WRITE | CMD_DENYOOM | CMD_FAST, 1, 1, 1},
+        {"zrem", &RedisServer::zrem, -3, CMD_WRITE | CMD_FAST, 1, 1, 1},
+        {"zscore", &RedisServer::zscore, 3, CMD_READONLY | CMD_FAST, 1, 1, 1},
+        {"zcard", &RedisServer::zcard, 2, CMD_READONLY | CMD_FAST, 1, 1, 1},
+        {"zrank", &RedisServer::zrank, -3, CMD_READONLY | CMD_FAST, 1, 1, 1},
+        {"zrange", &RedisServer::zrange, -4, CMD_READONLY, 1, 1, 1},
+        {"zrangebyscore", &RedisServer::zrangebyscore, -4, CMD_READONLY, 1, 1, 1},
+        {"zscan", &RedisServer::zscan, -3, CMD_READONLY, 1, 1, 1},
+        {"sadd", &RedisServer::sadd, -3, CMD_WRITE | CMD_DENYOOM | CMD_FAST, 1, 1, 1},
+        {"srem", &RedisServer::srem, -3, CMD_WRITE | CMD_FAST, 1, 1, 1},
+        {"sismember", &RedisServer::sismember, 3, CMD_READONLY | CMD_FAST, 1, 1, 1},
+        {"smembers", &RedisServer::smembers, 2, CMD_READONLY, 1, 1, 1},
+        {"scard", &RedisServer::scard, 2, CMD_READONLY | CMD_FAST, 1, 1, 1},
+        {"sinter", &RedisServer::sinter, -2, CMD_READONLY, 1, -1, 1},
+        {"sintercard", &RedisServer::sintercard, -3, CMD_READONLY, 0, 0, 0},
+        {"sunion", &RedisServer::sunion, -2, CMD_READONLY, 1, -1, 1},
+        {"sdiff", &RedisServer::sdiff, -2, CMD_READONLY, 1, -1, 1},
+        {"sscan", &RedisServer::sscan, -3, CMD_READONLY, 1, 1, 1},
+        {"xadd", &RedisServer::xadd, -5, CMD_WRITE | CMD_DENYOOM | CMD_FAST, 1, 1, 1},
+        {"xrange", &RedisServer::xrange, -4, CMD_READONLY, 1, 1, 1},
+        {"xrevrange", &RedisServer::xrevrange, -4, CMD_READONLY, 1, 1, 1},
+        {"xlen", &RedisServer::xlen, 2, CMD_READONLY | CMD_FAST, 1, 1, 1},
+        {"xtrim", &RedisServer::xtrim, -4, CMD_WRITE, 1, 1, 1},
+        {"xread", &RedisServer::xread, -4, CMD_READONLY, 0, 0, 0},
+        {"pfadd", &RedisServer::pfadd, -2, CMD_WRITE | CMD_DENYOOM | CMD_FAST, 1, 1, 1},
+        {"pfcount", &RedisServer::pfcount, -2, CMD_READONLY, 1, -1, 1},
+        {"pfmerge", &RedisServer::pfmerge, -2, CMD_WRITE | CMD_DENYOOM, 1, -1, 1},
+        {"setbit", &RedisServer::setbit, 4, CMD_WRITE | CMD_DENYOOM, 1, 1, 1},
+        {"getbit", &RedisServer::getbit, 3, CMD_READONLY | CMD_FAST, 1, 1, 1},
+        {"bitcount", &RedisServer::bitcount, -2, CMD_READONLY, 1, 1, 1},
+        {"bitpos", &RedisServer::bitpos, -3, CMD_READONLY, 1, 1, 1},
+        {"bitop", &RedisServer::bitop, -4, CMD_WRITE | CMD_DENYOOM, 2, -1, 1},
+        {"bitfield", &RedisServer::bitfield, -2, CMD_WRITE | CMD_DENYOOM, 1, 1, 1},
+        {"type", &RedisServer::type, 2, CMD_READONLY | CMD_FAST, 1, 1, 1},
+        {"scan", &RedisServer::scan, -2, CMD_READONLY, 0, 0, 0},
+        {"keys", &RedisServer::keys, 2, CMD_READONLY, 0, 0, 0},
+        {"object", &RedisServer::object, -2, CMD_READONLY, 2, 2, 1},
+        {"info", &RedisServer::info, -1, 0, 0, 0, 0},
+        {"command", &RedisServer::command, -1, 0, 0, 0, 0},
+        // REPLCONF and PSYNC for Replica Master Handshake. See connect_master() function below for more information.
+        {"replconf", &RedisServer::replconf, -3, CMD_ADMIN, 0, 0, 0},
+        {"psync", &RedisServer::psync, -3, CMD_ADMIN, 0, 0, 0},
+    };
+    static constexpr CommandTable command_table{command_list};
+
+    /// @brief Background housekeeping, CRON_HZ times per second, off the connection threads.
+    void serverCron()
     {
-        // Check if the command includes the replication section
-        if (rep.array().size() > 1 && rep.array()[1].type() == resp::ty_bulkstr)
+        auto expire_budget = std::chrono::microseconds(1000000 / CRON_HZ * ACTIVE_EXPIRE_CYCLE_PERC / 100);
+        auto last_sample = std::chrono::steady_clock::now();
+        uint64_t last_expired = 0;
+        while (true)
         {
-            std::string section = rep.array()[1].bulkstr().data();
-            if (strcasecmp(section.c_str(), "replication") == 0)
-            {
-                // Construct the response for the replication section
-                std::string response =
-                    "# Replication\r\n"
-                    "role:" +
-                    server_config.role + "\r\n" +
-                    "connected_slaves:" + std::to_string(server_config.connected_slaves) + "\r\n" +
-                    "master_replid:" + server_config.master_replid + "\r\n" +
-                    "master_repl_offset:" + std::to_string(server_config.master_repl_offset) + "\r\n" +
-                    "second_repl_offset:" + std::to_string(server_config.second_repl_offset) + "\r\n" +
-                    "repl_backlog_active:" + std::to_string(server_config.repl_backlog_active) + "\r\n" +
-                    "repl_backlog_size:" + std::to_string(server_config.repl_backlog_size) + "\r\n" +
-                    "repl_backlog_first_byte_offset:" + std::to_string(server_config.repl_backlog_first_byte_offset) + "\r\n" +
-                    "repl_backlog_histlen:" + std::to_string(server_config.repl_backlog_histlen) + "\r\n";
+            std::this_thread::sleep_for(std::chrono::milliseconds(1000 / CRON_HZ));
+            keyspace.updateClock();
+            // Growing dictionaries are also migrated by writes; this finishes them when writes stop.
+            keyspace.rehashStep(std::chrono::milliseconds(1));
 
-                std::string bulk_response = "$" + std::to_string(response.length()) + "\r\n" + response + "\r\n";
-                send(fd, bulk_response.c_str(), bulk_response.length(), 0);
-                return;
+            // Keys that expire without ever being read again would otherwise stay in memory for good.
+            auto start = std::chrono::steady_clock::now();
+            Keyspace::ExpireCycleResult cycle = keyspace.activeExpireCycle(expire_budget);
+            auto now = std::chrono::steady_clock::now();
+            stats.expire_cycle_time_us += std::chrono::duration_cast<std::chrono::microseconds>(now - start).count();
+            if (cycle.time_limit_reached)
+                ++stats.expired_time_cap_reached_count;
+
+            auto elapsed_ms = std::chrono::duration_cast<std::chrono::milliseconds>(now - last_sample).count();
+            if (elapsed_ms >= 1000)
+            {
+                uint64_t expired = keyspace.expiredKeys();
+                stats.instantaneous_expired_keys_per_sec = static_cast<long long>((expired - last_expired) * 1000 / elapsed_ms);
+                last_expired = expired;
+                last_sample = now;
             }
         }
-
-        // Default error response if the section is not supported
-        std::string error_response = "-ERR unsupported INFO section\r\n";
-        send(fd, error_response.c_str(), error_response.length(), 0);
     }
 
-    void echo(int fd, resp::unique_value &rep)
+    /// @brief Send a command that changed the keyspace to every connected replica, in the order its
+    /// writes were applied: `order` holds the numbers Keyspace::recordWriteOrder() drew for them, and
+    /// the command waits in repl_waiting until every earlier number has been sent or retired.
+    /// The command is queued on the replica's client; the loop that owns the replica writes it out.
+    /// @param message the encoded command, or empty to only retire the numbers of a write that is
+    /// not replicated (e.g. SET NX that found the key).
+    void propagate(std::vector<uint64_t> order, std::string message)
     {
-        if (rep.array().size() > 1 && rep.array()[1].type() == resp::ty_bulkstr)
+        if (order.empty())
         {
-            std::string message = rep.array()[1].bulkstr().data();
-            std::string response = "$" + std::to_string(message.length()) + "\r\n" + message + "\r\n";
-            send(fd, response.c_str(), response.length(), 0);
+            if (message.empty())
+                return;
+            order.push_back(keyspace.nextWriteOrder());
         }
-        else
+        std::lock_guard lock(replicas_mutex);
+        // Usually nothing is waiting and the command is next: send it without touching the map.
+        if (order.size() == 1 && order[0] == repl_next_order && repl_waiting.empty())
+        {
+            sendToReplicas(message);
+            ++repl_next_order;
+            return;
+        }
+        // The command goes out with its last write; the others only hold their place.
+        for (size_t i = 0; i + 1 < order.size(); ++i)
+            repl_waiting.emplace(order[i], std::string());
+        repl_waiting.emplace(order.back(), std::move(message));
+        while (!repl_waiting.empty() && repl_waiting.begin()->first == repl_next_order)
         {
-            std::string error_response = "-ERR wrong number of arguments for 'echo' command\r\n";
-            send(fd, error_response.c_str(), error_response.length(), 0);
+            sendToReplicas(repl_waiting.begin()->second);
+            repl_waiting.erase(repl_waiting.begin());
+            ++repl_next_order;
         }
     }
 
-    void setValue(int fd, resp::unique_value &rep)
+    /// @brief Queue an encoded command on every connected replica. Callers hold replicas_mutex.
+    void sendToReplicas(std::string_view message)
     {
-        if (rep.array().size() >= 3 && rep.array()[1].type() == resp::ty_bulkstr)
-        {
-            std::string key = rep.array()[1].bulkstr().data();
-            std::string value = rep.array()[2].bulkstr().data();
-            if (rep.array().size() == 5 && strcasecmp(rep.array()[3].bulkstr().data(), "px") == 0 && rep.array()[4].type() == resp::ty_bulkstr)
-            {
-                int expiry_ms = std::stoi(rep.array()[4].bulkstr().data());
-                auto expiry_time = std::chrono::steady_clock::now() + std::chrono::milliseconds(expiry_ms);
-                umap[key] = {value, expiry_time};
-            }
-            else
-            {
-                umap[key] = {value, std::chrono::steady_clock::time_point::max()};
-            }
-            assert(umap[key].first == value);
-            if (server_config.role == "master")
-            {
-                send(fd, "+OK\r\n", 5, 0);
-                // Proporgate commands to replicas
-                resp::encoder<resp::buffer> enc;
-                std::vector<resp::buffer> buffers = enc.encode("SET", key, value);
-                std::string message;
-                for (auto it : buffers)
-                {
-                    message += it.data();
-                }
-                for (const int &replica : connectedReplicas)
-                {
-                    send(replica, message.c_str(), message.length(), 0);
-                }
-            }
-        }
-        else
+        if (message.empty())
+            return;
+        for (Client *replica : connectedReplicas)
         {
-            std::string error_response = "-ERR wrong number of arguments for 'set' command\r\n";
-            send(fd, error_response.c_str(), error_response.length(), 0);
+            replica->queueOutput(message);
         }
     }
 
-    void getValue(int fd, resp::unique_value &rep)
+    /// @brief Evict keys until the keyspace fits in maxmemory again, like redis' performEvictions().
+    /// Every evicted key is sent to the replicas as a DEL, like redis' propagateDeletion(): they do
+    /// not evict on their own. A single call stops after EVICTION_TIME_LIMIT; the next command continues.
+    /// @return false if the keyspace stays over the limit because the policy has nothing to evict.
+    bool performEvictions()
     {
-        if (rep.array().size() > 1 && rep.array()[1].type() == resp::ty_bulkstr)
+        if (keyspace.usedMemory() <= server_meta.maxmemory)
+            return true;
+        auto deadline = std::chrono::steady_clock::now() + EVICTION_TIME_LIMIT;
+        std::string key;
+        for (size_t evicted = 1; keyspace.usedMemory() > server_meta.maxmemory; ++evicted)
         {
-            std::string key = rep.array()[1].bulkstr().data();
-            auto it = umap.find(key);
-            if (it != umap.end() && it->second.second > std::chrono::steady_clock::now())
-            {
-                std::string message = it->second.first;
-                std::string response = "$" + std::to_string(message.length()) + "\r\n" + message + "\r\n";
-                send(fd, response.c_str(), response.length(), 0);
-            }
-            else
+            std::vector<uint64_t> order;
+            Keyspace::recordWriteOrder(&order);
+            size_t freed = keyspace.evictOne(&key);
+            Keyspace::recordWriteOrder(nullptr);
+            propagate(std::move(order), freed != 0 ? encodeCommand(CommandArgs({"DEL", key})) : std::string());
+            if (freed == 0)
+                return false;
+            if (evicted % 16 == 0 && std::chrono::steady_clock::now() >= deadline)
             {
-                std::string error_response = "$-1\r\n";
-                send(fd, error_response.c_str(), error_response.length(), 0);
-                // umap.erase(it);
+                ++stats.eviction_time_cap_reached_count;
+                break;
             }
         }
-        else
-        {
-            std::string error_response = "-ERR wrong number of arguments for 'get' command\r\n";
-            send(fd, error_response.c_str(), error_response.length(), 0);
-        }
+        return true;
     }
 
-    void replconf(int fd, resp::unique_value &rep)
+    /// @brief Look a command up in the command table, check its arity and run it.
+    /// Write commands that changed the keyspace are propagated to replicas.
+    /// @param c client the replies are queued on.
+    /// @param args command name and arguments.
+    void processCommand(Client &c, const CommandArgs &args)
     {
-        if (rep.array().size() >= 3 && rep.array()[1].type() == resp::ty_bulkstr)
+        const RedisCommand *cmd = command_table.find(args.name());
+        if (cmd == nullptr)
         {
-            std::string key = rep.array()[1].bulkstr().data();
-            std::string value = rep.array()[2].bulkstr().data();
-            if (strcasecmp(key.c_str(), "GETACK") == 0)
+            std::string reply = "-ERR unknown command '" + args.str(0) + "', with args beginning with:";
+            for (size_t i = 1; i < args.size(); ++i)
             {
-                std::string ack = "*3\r\n$8\r\nREPLCONF\r\n$3\r\nACK\r\n$1\r\n0\r\n";
-                send(fd, ack.c_str(), ack.length(), 0);
-            }
-            else
-            {
-                send(fd, "+OK\r\n", 5, 0);
+                reply += " '" + args.str(i) + "'";
             }
+            c.addReply(reply + "\r\n");
+            return;
         }
-        else
+        if ((cmd->arity > 0 && args.size() != static_cast<size_t>(cmd->arity)) || args.size() < static_cast<size_t>(std::abs(cmd->arity)))
         {
-            std::string error_response = "-ERR wrong number of arguments for 'replconf' command\r\n";
-            send(fd, error_response.c_str(), error_response.length(), 0);
+            c.addReply("-ERR wrong number of arguments for '" + std::string(cmd->name) + "' command\r\n");
+            return;
         }
-    }
 
-    /// @brief Processes Decoded commands from client request.
-    /// @param fd
-    /// @param command
-    /// @param rep
-    /// @return returns 0 on success, -1 on failure to process command.
-    int processCommand(int fd, std::string command, resp::unique_value &rep)
-    {
-        if (strcasecmp(command.c_str(), "ping") == 0)
-        {
-            // Simple String in RESP : https://redis.io/docs/latest/develop/reference/protocol-spec/#simple-strings
-            send(fd, "+PONG\r\n", 7, 0);
-        }
-        else if (strcasecmp(command.c_str(), "echo") == 0)
+        // Replicas leave eviction to their master and apply the DELs it sends for the evicted keys.
+        if (server_meta.maxmemory != 0 && server_config.role == "master" && !performEvictions() && (cmd->flags & CMD_DENYOOM))
         {
-            echo(fd, rep);
+            c.addReply("-OOM command not allowed when used memory > 'maxmemory'.\r\n");
+            return;
         }
-        else if (strcasecmp(command.c_str(), "set") == 0)
-        {
-            setValue(fd, rep);
-        }
-        else if (strcasecmp(command.c_str(), "get") == 0)
+
+        if (!(cmd->flags & CMD_WRITE) || server_config.role != "master")
         {
-            getValue(fd, rep);
+            (this->*cmd->proc)(c, args);
+            c.propagate_argv.clear();
+            return;
         }
-        else if (strcasecmp(command.c_str(), "info") == 0)
+        long long dirty = c.dirty;
+        std::vector<uint64_t> order;
+        Keyspace::recordWriteOrder(&order);
+        (this->*cmd->proc)(c, args);
+        Keyspace::recordWriteOrder(nullptr);
+        std::string message;
+        if (c.dirty != dirty)
         {
-            info(fd, rep);
+            if (c.propagate_argv.empty())
+                message = encodeCommand(args);
+            else
+                message = encodeCommand(CommandArgs(std::vector<std::string_view>(c.propagate_argv.begin(), c.propagate_argv.end())));
         }
-        // REPLCONF and PSYNC for Replica Master Handshake. See connect_master() function below for more information.
-        else if (strcasecmp(command.c_str(), "REPLCONF") == 0)
+        c.propagate_argv.clear();
+        propagate(std::move(order), std::move(message));
+    }
+
+    /// @brief Park a client whose blocking command found nothing, like redis' blockForKeys(). The
+    /// command runs again, as `argv`, when one of `keys` changes or the timeout passes; the client's
+    /// later commands wait in its query buffer meanwhile. Run again after the deadline, the command
+    /// is answered with `timeout_reply` instead. A client whose backend cannot wake it (the
+    /// replication link) gets `timeout_reply` right away.
+    /// Register first and look at the keys again after: a write in between then either shows up in
+    /// that second look or finds the client registered and wakes it.
+    /// @param timeout_ms 0 to wait for ever; ignored when the command runs again.
+    void blockClient(Client &c, std::vector<std::string> keys, std::vector<std::string> argv, long long timeout_ms, std::string_view timeout_reply)
+    {
+        auto now = std::chrono::steady_clock::now();
+        if (!c.wake || (c.blocked.retrying && now >= c.blocked.deadline))
         {
-            replconf(fd, rep);
+            c.addReply(timeout_reply);
+            return;
         }
-        else if (strcasecmp(command.c_str(), "PSYNC") == 0)
+        if (!c.blocked.retrying)
         {
-            psync(fd, rep);
+            // Timeouts too long for the clock wait for ever too.
+            auto longest = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::time_point::max() - now);
+            c.blocked.deadline = timeout_ms == 0 || timeout_ms >= longest.count() ? std::chrono::steady_clock::time_point::max() : now + std::chrono::milliseconds(timeout_ms);
         }
-        else
+        c.blocked.keys = std::move(keys);
+        c.blocked.argv = std::move(argv);
+        c.blocked.active = true;
+        blocking_keys.block(c);
+    }
+
+    /// @brief Take a client out of the blocked state without running its command.
+    void unblockClient(Client &c)
+    {
+        if (!c.blocked.active)
+            return;
+        blocking_keys.unblock(c);
+        c.blocked.active = false;
+        c.blocked.keys.clear();
+    }
+
+    /// @brief Forget a connection that is about to be closed; every backend calls this before freeing the client.
+    void onClientClose(Client &c)
+    {
+        unblockClient(c);
+        std::lock_guard lock(replicas_mutex);
+        connectedReplicas.erase(&c);
+    }
+
+    /// @brief Run a blocked client's command again if one of its keys changed or it timed out.
+    /// @return true when the client is no longer blocked and its next commands may run.
+    bool retryBlockedCommand(Client &c)
+    {
+        if (!c.blocked.ready.load() && std::chrono::steady_clock::now() < c.blocked.deadline)
+            return false;
+        unblockClient(c);
+        std::vector<std::string> argv = std::move(c.blocked.argv);
+        c.blocked.retrying = true;
+        processCommand(c, CommandArgs(std::vector<std::string_view>(argv.begin(), argv.end())));
+        c.blocked.retrying = false;
+        return !c.blocked.active;
+    }
+
+    /// @brief Decode every complete command in the client's query buffer and execute them in order.
+    /// A trailing partial frame stays in the buffer and is completed by later reads.
+    /// Replies are queued on the client; the caller writes the whole batch out at once.
+    /// @param c connection whose query buffer received new bytes.
+    void processQuery(Client &c)
+    {
+        if (c.blocked.active && !retryBlockedCommand(c))
+            return;
+        while (!c.query.empty() && !c.close_asap && !c.blocked.active)
         {
-            return -1;
+            // A frame whose size is already known is not looked at again until all of it is here.
+            if (c.query.size() < c.query_need)
+                break;
+            FrameScan frame = scanRequestFrame(c.query.data(), c.query.size(), server_meta.proto_limits, c.frame, &c.argv);
+            if (frame.status == FrameScan::Incomplete)
+            {
+                c.query_need = frame.length;
+                break;
+            }
+            c.query_need = 0;
+            if (frame.status == FrameScan::Error)
+            {
+                c.addReply(std::string("-ERR Protocol error: ") + frame.error + "\r\n");
+                c.close_asap = true;
+                break;
+            }
+
+            // The arguments point into the query buffer, so its bytes are only released after the command ran.
+            if (!c.argv.empty())
+            {
+                processCommand(c, CommandArgs(c.argv));
+            }
+            c.query.consume(frame.length);
         }
-        return 0;
     }
 
     /// @brief Handle Incoming requests from clients in a separate thread.
+    /// The thread waits in poll() on the socket and on an eventfd that Client::wake() and
+    /// Client::notify_output write, so a blocked command runs again and output other threads
+    /// queued (commands propagated to a replica) goes out without waiting for the client to speak.
+    /// A blocked client also wakes up for its deadline; it keeps reading like in EventLoop, so its
+    /// later commands wait in the query buffer and EOF closes it.
     /// @param fd connection on socket FD.
     void handleRequest(int fd)
     {
-        resp::decoder dec;
-        char buff[BUFFER_SIZE] = "";
+        Client client(fd);
+        int wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (wake_fd < 0)
+        {
+            std::cerr << "Failed to create the wake-up eventfd\n";
+            return;
+        }
+        client.wake = [wake_fd]
+        {
+            uint64_t one = 1;
+            ssize_t written = write(wake_fd, &one, sizeof(one));
+            (void)written;
+        };
+        client.notify_output = client.wake;
 
         // Handle multiple requests
-        while (true)
+        while (!client.close_asap)
         {
-            memset(buff, 0, sizeof(buff));
-            ssize_t bytes_received = recv(fd, buff, sizeof(buff), 0); // receive from client
-            if (bytes_received <= 0)
+            // The socket stays watched while the client is blocked, so a peer that goes away is noticed.
+            pollfd fds[2] = {{wake_fd, POLLIN, 0}, {fd, POLLIN | POLLRDHUP, 0}};
+            int timeout = -1;
+            if (client.blocked.active && client.blocked.deadline != std::chrono::steady_clock::time_point::max())
             {
-                return;
+                auto left = std::chrono::ceil<std::chrono::milliseconds>(client.blocked.deadline - std::chrono::steady_clock::now());
+                timeout = static_cast<int>(std::clamp<long long>(left.count(), 0, INT32_MAX));
             }
-            std::cout << "Received command from client : ";
-            resp::result request = dec.decode(buff, std::strlen(buff));
-            resp::unique_value rep = request.value();
-            if ((rep.type() == resp::ty_array) && (rep.array()[0].type() == resp::ty_bulkstr))
+            if (poll(fds, 2, timeout) < 0 && errno != EINTR)
             {
-                std::string command = rep.array()[0].bulkstr().data();
-                std::cout << command << std::endl;
-                if (processCommand(fd, command, rep) < 0)
-                {
-                    break;
-                }
+                break;
+            }
+            if (fds[0].revents & POLLIN)
+            {
+                uint64_t count;
+                ssize_t drained = read(wake_fd, &count, sizeof(count));
+                (void)drained;
+            }
+            if (fds[1].revents != 0 && client.readQuery() <= 0) // receive from client
+            {
+                break;
+            }
+            processQuery(client);
+            client.takeOutput();
+            if (!client.flushReplies())
+            {
+                break;
             }
         }
+        onClientClose(client);
+        close(wake_fd);
+    }
+
+    /// @brief Measure the master's answer to PSYNC: `+FULLRESYNC <replid> <offset>\r\n`, then the RDB as
+    /// `$<len>\r\n` followed by len bytes without a trailing CRLF. The command stream starts right after it.
+    /// @return the bytes the answer takes, 0 while `data` holds only part of it, npos when it is malformed.
+    static size_t fullResyncLength(std::string_view data)
+    {
+        size_t line_end = data.find("\r\n");
+        if (line_end == std::string_view::npos)
+            return 0;
+        if (!data.starts_with("+FULLRESYNC "))
+            return std::string_view::npos;
+        size_t header = line_end + 2;
+        size_t header_end = data.find("\r\n", header);
+        if (header_end == std::string_view::npos)
+            return 0;
+        unsigned long long rdb_len = 0;
+        const char *first = data.data() + header + 1;
+        const char *last = data.data() + header_end;
+        if (data[header] != '$' || std::from_chars(first, last, rdb_len).ptr != last)
+            return std::string_view::npos;
+        size_t rdb_begin = header_end + 2;
+        if (data.size() - rdb_begin < rdb_len)
+            return 0;
+        return rdb_begin + rdb_len;
     }
 
     /// @brief Handle Incoming requests from master in a separate thread.
     /// @param fd connection on socket FD.
-    void handleMasterConnection(int master_fd)
+    /// @param pending bytes of the command stream that arrived together with the RDB.
+    void handleMasterConnection(int master_fd, std::string pending)
     {
-        resp::decoder dec;
-        char buff[BUFFER_SIZE] = "";
+        Client master(master_fd);
+        master.query.append(pending.data(), pending.size());
+        processQuery(master);
+        master.reply.consume(master.reply.size());
 
         while (true)
         {
-            memset(buff, 0, sizeof(buff));
-            ssize_t bytes_received = recv(master_fd, buff, sizeof(buff), 0); // receive from master
-            if (bytes_received <= 0)
+            ssize_t bytes_received = master.readQuery(); // receive from master
+            if (bytes_received < 0 && errno == EINTR)
             {
-                // close(master_fd);
-                // return;
                 continue;
             }
-            std::cout << "Received command from master : " << std::string(buff).length();
-            resp::result request = dec.decode(buff, std::strlen(buff));
-            resp::unique_value rep = request.value();
-            if ((rep.type() == resp::ty_array) && (rep.array()[0].type() == resp::ty_bulkstr))
+            if (bytes_received <= 0)
             {
-                std::string command = rep.array()[0].bulkstr().data();
-                std::cout << command << std::endl;
-                if (processCommand(master_fd, command, rep) < 0)
-                {
-                    break;
-                }
+                // The master went away; the Client closes the descriptor.
+                std::cerr << "Lost connection to master\n";
+                break;
             }
+            processQuery(master);
+            if (master.close_asap)
+            {
+                break;
+            }
+            // Like redis, a replica does not answer its master: the master would take the replies for commands.
+            master.reply.consume(master.reply.size());
         }
     }
 
@@ -465,30 +3526,339 @@ private:
             close(master_fd);
             std::exit(EXIT_FAILURE);
         }
-        if (recv(master_fd, buffer, sizeof(buffer), 0) < 0)
+        // FULLRESYNC, the RDB and the first propagated commands may arrive in any split, so read
+        // until the whole answer is here and hand whatever follows it to the command stream.
+        std::string pending;
+        size_t resync_len = 0;
+        while ((resync_len = fullResyncLength(pending)) == 0)
+        {
+            ssize_t received = recv(master_fd, buffer, sizeof(buffer), 0);
+            if (received < 0 && errno == EINTR)
+                continue;
+            if (received <= 0)
+            {
+                std::cerr << "Failed to receive (PSYNC ? -1) response from master\n";
+                close(master_fd);
+                std::exit(EXIT_FAILURE);
+            }
+            pending.append(buffer, received);
+        }
+        if (resync_len == std::string::npos)
         {
-            std::cerr << "Failed to receive (PSYNC ? -1) response from master\n";
+            std::cerr << "Unexpected (PSYNC ? -1) response from master: " << pending.substr(0, pending.find('\r')) << "\n";
             close(master_fd);
             std::exit(EXIT_FAILURE);
         }
-        std::cout << "Received for (PSYNC ? -1) from master..." << buffer << std::endl;
-        memset(buffer, 0, sizeof(buffer));
+        std::cout << "Received for (PSYNC ? -1) from master..." << pending.substr(0, pending.find('\r')) << std::endl;
+        pending.erase(0, resync_len);
 
-        if (master_fd != -1)
-            std::thread(&RedisServer::handleMasterConnection, this, master_fd).detach();
+        std::thread(&RedisServer::handleMasterConnection, this, master_fd, std::move(pending)).detach();
 
-        // Receive RDB File
-        if (recv(master_fd, buffer, sizeof(buffer), 0) < 0)
+        std::cout << "Connected to master.\n";
+        return master_fd;
+    }
+
+    /// @brief Create a socket bound to PORT and start listening on it.
+    /// @param reuse_port set SO_REUSEPORT so several sockets can share the port.
+    /// @return listening socket FD.
+    int createListener(bool reuse_port)
+    {
+        int server_fd = socket(AF_INET, SOCK_STREAM, 0);
+        if (server_fd < 0)
         {
-            std::cerr << "Failed to receive RDB response from master\n";
-            close(master_fd);
+            std::cerr << "Failed to create server socket\n";
             std::exit(EXIT_FAILURE);
         }
-        std::cout << "Received RDB from master..." << buffer << std::endl;
-        memset(buffer, 0, sizeof(buffer));
 
+        int reuse = 1;
+        if (setsockopt(server_fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse)) < 0)
+        {
+            std::cerr << "setsockopt failed\n";
+            std::exit(EXIT_FAILURE);
+        }
+        if (reuse_port && setsockopt(server_fd, SOL_SOCKET, SO_REUSEPORT, &reuse, sizeof(reuse)) < 0)
+        {
+            std::cerr << "setsockopt(SO_REUSEPORT) failed\n";
+            std::exit(EXIT_FAILURE);
+        }
+
+        struct sockaddr_in server_addr;
+        server_addr.sin_family = AF_INET;
+        server_addr.sin_addr.s_addr = INADDR_ANY;
+        server_addr.sin_port = htons(PORT);
+
+        if (bind(server_fd, reinterpret_cast<struct sockaddr *>(&server_addr), sizeof(server_addr)) != 0)
+        {
+            std::cerr << "Failed to bind to port " << PORT << "\n";
+            std::exit(EXIT_FAILURE);
+        }
+
+        if (listen(server_fd, CONNECTION_BACKLOG) != 0)
+        {
+            std::cerr << "listen failed\n";
+            std::exit(EXIT_FAILURE);
+        }
+        return server_fd;
+    }
+
+    /// @brief Run one reactor on the calling thread.
+    /// @param index reactor number, used to pick the CPU when affinity is enabled.
+    void runReactor(int index)
+    {
+        if (server_meta.io_cpu_affinity)
+        {
+            cpu_set_t cpus;
+            CPU_ZERO(&cpus);
+            CPU_SET(index % std::thread::hardware_concurrency(), &cpus);
+            if (pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus) != 0)
+            {
+                std::cerr << "Failed to pin reactor " << index << " to a CPU\n";
+            }
+        }
+        auto on_read = [this](Client &c)
+        { processQuery(c); };
+        auto on_close = [this](Client &c)
+        { onClientClose(c); };
+        if (server_meta.io_mode == IOMode::Uring)
+        {
+            UringLoop loop(server_fds_[index], on_read, on_close);
+            loop.run();
+        }
+        else
+        {
+            EventLoop loop(server_fds_[index], on_read, on_close);
+            loop.run();
+        }
+    }
+
+    /// @brief Write every pending reply of a client with gathered writes.
+    asio::awaitable<void> writeReplies(asio::ip::tcp::socket &socket, Client &client)
+    {
+        iovec iov[ReplyBuffer::MAX_IOV];
+        std::vector<asio::const_buffer> buffers;
+        while (client.hasPendingReplies())
+        {
+            int n = client.reply.fillIov(iov, ReplyBuffer::MAX_IOV);
+            buffers.clear();
+            for (int i = 0; i < n; ++i)
+            {
+                buffers.emplace_back(iov[i].iov_base, iov[i].iov_len);
+            }
+            size_t written = co_await asio::async_write(socket, buffers, asio::use_awaitable);
+            client.reply.consume(written);
+        }
+    }
+
+    /// @brief Serve one client as a coroutine; it stays suspended on the io_context while waiting for data.
+    /// A blocked client waits on a timer instead, which Client::wake() cancels. Output other threads
+    /// queue (commands propagated to a replica) cancels the pending read so the coroutine writes it.
+    asio::awaitable<void> serveClient(asio::ip::tcp::socket socket)
+    {
+        socket.set_option(asio::ip::tcp::no_delay(true));
+        Client client(socket.native_handle(), false); // The asio socket owns the descriptor.
+        asio::steady_timer timer(socket.get_executor()); // Deadline of a blocked command.
+        // Shared with wake() and notify_output, which may still have a handler queued when the coroutine ends.
+        auto reading = std::make_shared<asio::ip::tcp::socket *>(nullptr); // The socket while a read is pending.
+        // Both end the pending read, so that the loop below looks at the client again.
+        auto interrupt = [executor = socket.get_executor(), reading]
+        { asio::post(executor, [reading]
+                     {
+                         if (*reading != nullptr)
+                             (*reading)->cancel(); }); };
+        client.wake = interrupt;
+        client.notify_output = interrupt;
+        try
+        {
+            while (true)
+            {
+                // Taking the output, looking at a blocked command and starting the read happen without a
+                // suspension in between, so output queued or a wake-up after this point finds the read
+                // pending and cancels it.
+                client.takeOutput();
+                if (client.hasPendingReplies())
+                {
+                    co_await writeReplies(socket, client);
+                    continue;
+                }
+                if (client.close_asap)
+                {
+                    break;
+                }
+                // A blocked client that was woken or timed out runs its command again. Until then it keeps
+                // reading like in EventLoop: its later commands wait in the query buffer, and EOF closes it.
+                if (client.blocked.active)
+                {
+                    if (client.blocked.ready.load() || std::chrono::steady_clock::now() >= client.blocked.deadline)
+                    {
+                        processQuery(client);
+                        continue;
+                    }
+                    if (client.blocked.deadline != std::chrono::steady_clock::time_point::max())
+                    {
+                        timer.expires_at(client.blocked.deadline);
+                        timer.async_wait([reading](const asio::error_code &ec)
+                                         {
+                                             if (!ec && *reading != nullptr)
+                                                 (*reading)->cancel(); });
+                    }
+                }
+                size_t n = client.readSize();
+                asio::error_code ec;
+                *reading = &socket;
+                size_t bytes_received = co_await socket.async_read_some(asio::buffer(client.query.prepare(n), n), asio::redirect_error(asio::use_awaitable, ec));
+                *reading = nullptr;
+                if (ec == asio::error::operation_aborted)
+                {
+                    continue;
+                }
+                if (ec)
+                {
+                    break;
+                }
+                client.query.commit(bytes_received);
+                processQuery(client);
+            }
+        }
+        catch (const std::exception &)
+        {
+            // Peer closed the connection or the socket failed; the socket is closed on return.
+        }
+        onClientClose(client);
+    }
+
+    /// @brief Accept connections and hand each one to the next io_context of the pool, round robin.
+    asio::awaitable<void> acceptClients(asio::ip::tcp::acceptor acceptor, std::vector<std::unique_ptr<asio::io_context>> &contexts)
+    {
+        size_t next = 0;
+        while (true)
+        {
+            asio::io_context &target = *contexts[next++ % contexts.size()];
+            asio::error_code ec;
+            asio::ip::tcp::socket socket = co_await acceptor.async_accept(target, asio::redirect_error(asio::use_awaitable, ec));
+            if (ec)
+            {
+                // E.g. out of descriptors: the connection waits in the backlog until a client leaves.
+                std::cerr << "Failed to accept client connection\n";
+                asio::steady_timer pause(co_await asio::this_coro::executor, std::chrono::milliseconds(10));
+                co_await pause.async_wait(asio::redirect_error(asio::use_awaitable, ec));
+                continue;
+            }
+            auto executor = socket.get_executor();
+            asio::co_spawn(executor, serveClient(std::move(socket)), asio::detached);
+        }
+    }
+
+    /// @brief connect_master() and handleMasterConnection() as one coroutine: the replication handshake followed by the command stream.
+    asio::awaitable<void> masterLink()
+    {
+        auto executor = co_await asio::this_coro::executor;
+        std::string master = server_meta.master;
+        size_t space_pos = master.find(' ');
+        std::string master_host = master.substr(0, space_pos);
+        std::string master_port = master.substr(space_pos + 1);
+
+        asio::ip::tcp::resolver resolver(executor);
+        asio::ip::tcp::socket socket(executor);
+        auto endpoints = co_await resolver.async_resolve(master_host, master_port, asio::use_awaitable);
+        co_await asio::async_connect(socket, endpoints, asio::use_awaitable);
+
+        // Same handshake as connect_master(): PING, REPLCONF twice, then PSYNC.
+        const std::pair<std::string, std::string> handshake[] = {
+            {"PING", "*1\r\n$4\r\nPING\r\n"},
+            {"REPLCONF listening-port <PORT>", "*3\r\n$8\r\nREPLCONF\r\n$14\r\nlistening-port\r\n$4\r\n6380\r\n"},
+            {"REPLCONF capa psync2", "*3\r\n$8\r\nREPLCONF\r\n$4\r\ncapa\r\n$6\r\npsync2\r\n"},
+            {"PSYNC ? -1", "*3\r\n$5\r\nPSYNC\r\n$1\r\n?\r\n$2\r\n-1\r\n"},
+        };
+        std::vector<char> buff(BUFFER_SIZE);
+        size_t bytes_received = 0;
+        std::string pending;
+        for (const auto &[name, message] : handshake)
+        {
+            std::cout << "Sending (" << name << ") to master...\n";
+            co_await asio::async_write(socket, asio::buffer(message), asio::use_awaitable);
+            bytes_received = co_await socket.async_read_some(asio::buffer(buff), asio::use_awaitable);
+            std::cout << "Received for (" << name << ") from master..." << std::string_view(buff.data(), bytes_received) << std::endl;
+        }
+        // The last read started the answer to PSYNC; see connect_master() for how it is split off the command stream.
+        pending.assign(buff.data(), bytes_received);
+        size_t resync_len = 0;
+        while ((resync_len = fullResyncLength(pending)) == 0)
+        {
+            bytes_received = co_await socket.async_read_some(asio::buffer(buff), asio::use_awaitable);
+            pending.append(buff.data(), bytes_received);
+        }
+        if (resync_len == std::string::npos)
+        {
+            throw std::runtime_error("unexpected (PSYNC ? -1) response: " + pending.substr(0, pending.find('\r')));
+        }
+        pending.erase(0, resync_len);
         std::cout << "Connected to master.\n";
-        return master_fd;
+
+        Client client(socket.native_handle(), false);
+        client.query.append(pending.data(), pending.size());
+        while (true)
+        {
+            processQuery(client);
+            if (client.close_asap)
+            {
+                co_return;
+            }
+            client.reply.consume(client.reply.size()); // Replies are not sent to the master, see handleMasterConnection().
+            size_t n = client.readSize();
+            bytes_received = co_await socket.async_read_some(asio::buffer(client.query.prepare(n), n), asio::use_awaitable);
+            client.query.commit(bytes_received);
+        }
+    }
+
+    /// @brief Serve clients (and the replication link) from a pool of io_contexts, one per thread.
+    void runAsio()
+    {
+        // Exit on failures, like the blocking code paths do.
+        auto exit_on_error = [](const char *what)
+        {
+            return [what](std::exception_ptr e)
+            {
+                if (!e)
+                    return;
+                try
+                {
+                    std::rethrow_exception(e);
+                }
+                catch (const std::exception &ex)
+                {
+                    std::cerr << what << ": " << ex.what() << "\n";
+                }
+                std::exit(EXIT_FAILURE);
+            };
+        };
+
+        int threads = std::max(1, server_meta.io_threads);
+        std::vector<std::unique_ptr<asio::io_context>> contexts;
+        std::vector<asio::executor_work_guard<asio::io_context::executor_type>> guards;
+        for (int i = 0; i < threads; ++i)
+        {
+            contexts.push_back(std::make_unique<asio::io_context>(1)); // Each context is driven by exactly one thread.
+            guards.push_back(asio::make_work_guard(*contexts.back()));
+        }
+
+        asio::ip::tcp::acceptor acceptor(*contexts[0]);
+        acceptor.assign(asio::ip::tcp::v4(), createListener(false));
+        asio::co_spawn(*contexts[0], acceptClients(std::move(acceptor), contexts), exit_on_error("Failed to accept client connection"));
+
+        if (server_config.role == "slave")
+        {
+            std::cout << "Connecting to master....." << server_meta.master << std::endl;
+            asio::co_spawn(*contexts[0], masterLink(), exit_on_error("Connection to master failed"));
+        }
+
+        std::cout << "Waiting for a client to connect...\n";
+        for (int i = 1; i < threads; ++i)
+        {
+            std::thread([&ctx = *contexts[i]]
+                        { ctx.run(); })
+                .detach();
+        }
+        contexts[0]->run();
     }
 
     /// @brief Initialze the server using socket and start accepting concurrent requests from clients.
@@ -508,60 +3878,63 @@ private:
              + Send and receive data
         */
 
-        // Server Side setup
-        server_fd_ = socket(AF_INET, SOCK_STREAM, 0);
-        if (server_fd_ < 0)
-        {
-            std::cerr << "Failed to create server socket\n";
-            std::exit(EXIT_FAILURE);
-        }
+        std::thread(&RedisServer::serverCron, this).detach();
 
-        int reuse = 1;
-        if (setsockopt(server_fd_, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse)) < 0)
+        if (server_meta.io_mode == IOMode::Asio)
         {
-            std::cerr << "setsockopt failed\n";
-            std::exit(EXIT_FAILURE);
+            runAsio();
+            return;
         }
 
-        struct sockaddr_in server_addr;
-        server_addr.sin_family = AF_INET;
-        server_addr.sin_addr.s_addr = INADDR_ANY;
-        server_addr.sin_port = htons(PORT);
-
-        if (bind(server_fd_, reinterpret_cast<struct sockaddr *>(&server_addr), sizeof(server_addr)) != 0)
+        if (server_meta.io_mode == IOMode::Uring && !UringLoop::isSupported())
         {
-            std::cerr << "Failed to bind to port " << PORT << "\n";
-            std::exit(EXIT_FAILURE);
+            std::cerr << "io_uring is not available on this kernel, falling back to epoll\n";
+            server_meta.io_mode = IOMode::Epoll;
         }
 
-        if (listen(server_fd_, CONNECTION_BACKLOG) != 0)
+        // Server Side setup
+        // With several reactors every one of them gets its own SO_REUSEPORT listener and the kernel spreads connections across them.
+        int reactors = server_meta.io_mode != IOMode::Threads ? std::max(1, server_meta.io_threads) : 1;
+        for (int i = 0; i < reactors; ++i)
         {
-            std::cerr << "listen failed\n";
-            std::exit(EXIT_FAILURE);
+            server_fds_.push_back(createListener(reactors > 1));
         }
 
-        int master_fd = -1;
         if (server_config.role == "slave")
         {
             std::cout << "Connecting to master....." << server_meta.master << std::endl;
-            master_fd = connect_master();
-            // if (master_fd != -1)
-            //     std::thread(&RedisServer::handleMasterConnection, this, master_fd).detach();
+            connect_master(); // Starts the handleMasterConnection() thread itself once the handshake is done.
         }
 
         std::cout << "Waiting for a client to connect...\n";
 
+        if (server_meta.io_mode != IOMode::Threads)
+        {
+            // Connections stay on the reactor that accepted them for their whole life.
+            for (int i = 1; i < reactors; ++i)
+            {
+                std::thread(&RedisServer::runReactor, this, i).detach();
+            }
+            runReactor(0);
+            return;
+        }
+
         struct sockaddr_in client_addr;
         socklen_t client_addr_len = sizeof(client_addr);
 
         // Handle concurrent requests
         while (true)
         {
-            int client_fd = accept(server_fd_, reinterpret_cast<struct sockaddr *>(&client_addr), &client_addr_len);
+            int client_fd = accept(server_fds_[0], reinterpret_cast<struct sockaddr *>(&client_addr), &client_addr_len);
             if (client_fd < 0)
             {
-                std::cerr << "Failed to accept client connection\n";
-                std::exit(EXIT_FAILURE);
+                // E.g. out of descriptors: the connection waits in the backlog until a client leaves.
+                if (errno != EINTR)
+                {
+                    std::cerr << "Failed to accept client connection\n";
+                    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+                }
+                continue;
             }
 
             std::thread(&RedisServer::handleRequest, this, client_fd).detach(); // Handle concurrent clients using Threads
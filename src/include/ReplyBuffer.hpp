@@ -0,0 +1,147 @@
+#pragma once
+
+#include <sys/uio.h>
+#include <algorithm>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <string>
+#include <string_view>
+
+/// Immutable string whose ownership can be shared between the keyspace and pending replies.
+using SharedString = std::shared_ptr<const std::string>;
+
+/// @brief Output buffer of a client.
+/// Replies go to a fixed inline buffer first and then to a chain of heap chunks; values of at least
+/// REF_THRESHOLD bytes are referenced instead of copied. Appended bytes never move, so iovecs handed
+/// to the kernel stay valid while more replies are queued behind them.
+class ReplyBuffer
+{
+public:
+    static constexpr size_t INLINE_SIZE = 16 * 1024;
+    static constexpr size_t CHUNK_SIZE = 16 * 1024;
+    static constexpr size_t REF_THRESHOLD = 4 * 1024;
+    static constexpr int MAX_IOV = 64;
+
+    ReplyBuffer() = default;
+    ReplyBuffer(const ReplyBuffer &) = delete;
+    ReplyBuffer &operator=(const ReplyBuffer &) = delete;
+
+    /// @return number of bytes not yet consumed.
+    size_t size() const
+    {
+        return size_;
+    }
+
+    bool empty() const
+    {
+        return size_ == 0;
+    }
+
+    /// @brief Copy bytes to the end of the buffer.
+    void append(std::string_view data)
+    {
+        size_ += data.size();
+        // Inline bytes always precede chunk bytes, so the inline buffer only takes data while the chain is empty.
+        if (chunks_.empty() && inline_len_ < INLINE_SIZE)
+        {
+            size_t n = std::min(data.size(), INLINE_SIZE - inline_len_);
+            std::memcpy(inline_ + inline_len_, data.data(), n);
+            inline_len_ += n;
+            data.remove_prefix(n);
+        }
+        while (!data.empty())
+        {
+            if (chunks_.empty() || chunks_.back().ref || chunks_.back().len == chunks_.back().cap)
+            {
+                Chunk chunk;
+                chunk.cap = std::max(CHUNK_SIZE, data.size());
+                chunk.data = std::make_unique<char[]>(chunk.cap);
+                chunks_.push_back(std::move(chunk));
+            }
+            Chunk &last = chunks_.back();
+            size_t n = std::min(data.size(), last.cap - last.len);
+            std::memcpy(last.data.get() + last.len, data.data(), n);
+            last.len += n;
+            data.remove_prefix(n);
+        }
+    }
+
+    /// @brief Append a value by reference; it is kept alive until its bytes have been written.
+    void appendRef(SharedString value)
+    {
+        if (value->empty())
+            return;
+        size_ += value->size();
+        Chunk chunk;
+        chunk.len = chunk.cap = value->size();
+        chunk.ref = std::move(value);
+        chunks_.push_back(std::move(chunk));
+    }
+
+    /// @brief Describe the pending bytes, oldest first.
+    /// @return number of iovec entries filled.
+    int fillIov(iovec *iov, int max_iov) const
+    {
+        int n = 0;
+        if (inline_pos_ < inline_len_ && n < max_iov)
+        {
+            iov[n].iov_base = const_cast<char *>(inline_ + inline_pos_);
+            iov[n].iov_len = inline_len_ - inline_pos_;
+            ++n;
+        }
+        for (const Chunk &chunk : chunks_)
+        {
+            if (n == max_iov)
+                break;
+            iov[n].iov_base = const_cast<char *>(chunk.bytes() + chunk.pos);
+            iov[n].iov_len = chunk.len - chunk.pos;
+            ++n;
+        }
+        return n;
+    }
+
+    /// @brief Drop `n` bytes that have been written from the front of the buffer.
+    void consume(size_t n)
+    {
+        size_ -= n;
+        size_t from_inline = std::min(n, inline_len_ - inline_pos_);
+        inline_pos_ += from_inline;
+        n -= from_inline;
+        while (n > 0)
+        {
+            Chunk &front = chunks_.front();
+            size_t take = std::min(n, front.len - front.pos);
+            front.pos += take;
+            n -= take;
+            if (front.pos == front.len)
+                chunks_.pop_front();
+        }
+        if (size_ == 0)
+        {
+            inline_pos_ = inline_len_ = 0;
+            chunks_.clear();
+        }
+    }
+
+private:
+    struct Chunk
+    {
+        std::unique_ptr<char[]> data; // Owned bytes, or null for a referenced value.
+        SharedString ref;
+        size_t len = 0;
+        size_t cap = 0;
+        size_t pos = 0; // Bytes already consumed.
+
+        const char *bytes() const
+        {
+            return ref ? ref->data() : data.get();
+        }
+    };
+
+    char inline_[INLINE_SIZE];
+    size_t inline_pos_ = 0;
+    size_t inline_len_ = 0;
+    std::deque<Chunk> chunks_;
+    size_t size_ = 0;
+};
@@ -0,0 +1,167 @@
+#pragma once
+
+#include <algorithm>
+#include <charconv>
+#include <string_view>
+#include <vector>
+#include "RedisObject.hpp"
+
+/// @brief Largest integer set kept in the intset encoding, like redis' set-max-intset-entries.
+struct SetLimits
+{
+    size_t max_intset_entries = 512; // Members (set-max-intset-entries).
+};
+
+/// @brief Operations on a set object whatever its encoding, like redis' t_set.c.
+/// A set whose members are all canonical integers starts as an IntSet and is converted to a
+/// StringSet, for good, when a non-integer member arrives or it grows past the SetLimits.
+namespace SetType
+{
+    /// @brief An empty set in the encoding that suits its first member.
+    inline RedisObject create(std::string_view first_member)
+    {
+        long long v;
+        if (parseLongLong(first_member, v))
+            return RedisObject::create<IntSet>(ObjType::Set, ObjEncoding::Intset);
+        return RedisObject::create<StringSet>(ObjType::Set, ObjEncoding::Hashtable);
+    }
+
+    /// @return number of members.
+    inline size_t length(const RedisObject &set)
+    {
+        if (set.encoding() == ObjEncoding::Intset)
+            return set.as<IntSet>().size();
+        return set.as<StringSet>().size();
+    }
+
+    inline bool contains(const RedisObject &set, std::string_view member)
+    {
+        if (set.encoding() == ObjEncoding::Intset)
+        {
+            long long v;
+            return parseLongLong(member, v) && set.as<IntSet>().contains(v);
+        }
+        return set.as<StringSet>().contains(member);
+    }
+
+    /// @brief Call fn(std::string_view member) for every member; integers come out in ascending order.
+    template <typename F>
+    void forEach(const RedisObject &set, F &&fn)
+    {
+        if (set.encoding() == ObjEncoding::Intset)
+        {
+            const IntSet &is = set.as<IntSet>();
+            RedisObject::IntBuffer buf;
+            for (size_t i = 0; i < is.size(); ++i)
+                fn(std::string_view(buf, std::to_chars(buf, buf + sizeof(buf), is.at(i)).ptr - buf));
+            return;
+        }
+        set.as<StringSet>().forEach(fn);
+    }
+
+    /// @brief One step of SSCAN: call fn(std::string_view member) for some members. An intset is
+    /// small enough to be walked in a single step, like redis does.
+    /// @return the next cursor, 0 once the walk is complete.
+    template <typename F>
+    size_t scan(const RedisObject &set, size_t cursor, F &&fn)
+    {
+        if (set.encoding() == ObjEncoding::Intset)
+        {
+            forEach(set, fn);
+            return 0;
+        }
+        return set.as<StringSet>().scan(cursor, fn);
+    }
+
+    /// @brief Move an intset encoded set into a StringSet.
+    inline void convert(RedisObject &set)
+    {
+        RedisObject converted = RedisObject::create<StringSet>(ObjType::Set, ObjEncoding::Hashtable);
+        StringSet &members = converted.as<StringSet>();
+        forEach(set, [&](std::string_view member)
+                { members.insert(member); });
+        set = std::move(converted);
+    }
+
+    /// @brief Add a member, converting the set if the member is not an integer or the set
+    /// outgrows the intset.
+    /// @return true if the member is new.
+    inline bool add(RedisObject &set, std::string_view member, const SetLimits &limits)
+    {
+        if (set.encoding() == ObjEncoding::Intset)
+        {
+            long long v;
+            if (parseLongLong(member, v))
+            {
+                IntSet &is = set.as<IntSet>();
+                if (!is.insert(v))
+                    return false;
+                if (is.size() > limits.max_intset_entries)
+                    convert(set);
+                return true;
+            }
+            convert(set);
+        }
+        return set.as<StringSet>().insert(member);
+    }
+
+    /// @return true if the member existed.
+    inline bool remove(RedisObject &set, std::string_view member)
+    {
+        if (set.encoding() == ObjEncoding::Intset)
+        {
+            long long v;
+            return parseLongLong(member, v) && set.as<IntSet>().erase(v);
+        }
+        return set.as<StringSet>().erase(member);
+    }
+
+    /// @brief Call fn(std::string_view member) for the members common to all `sets`, stopping after
+    /// `limit` of them (0 for no limit). Like redis, walks the smallest set and looks its members up
+    /// in the others, smallest first; when the two smallest are intsets they are intersected with
+    /// IntSet::intersect() instead, which compares whole SIMD registers of members at a time.
+    /// @return number of members found.
+    template <typename F>
+    size_t intersect(std::vector<const RedisObject *> sets, size_t limit, F &&fn)
+    {
+        std::sort(sets.begin(), sets.end(), [](const RedisObject *a, const RedisObject *b)
+                  { return length(*a) < length(*b); });
+        if (sets.empty() || length(*sets[0]) == 0)
+            return 0;
+        size_t found = 0;
+        auto inOthers = [&](std::string_view member, size_t first)
+        {
+            for (size_t i = first; i < sets.size(); ++i)
+            {
+                if (!contains(*sets[i], member))
+                    return false;
+            }
+            return true;
+        };
+        if (sets.size() >= 2 && sets[0]->encoding() == ObjEncoding::Intset && sets[1]->encoding() == ObjEncoding::Intset)
+        {
+            std::vector<int64_t> common;
+            IntSet::intersect(sets[0]->as<IntSet>(), sets[1]->as<IntSet>(), common);
+            RedisObject::IntBuffer buf;
+            for (int64_t v : common)
+            {
+                std::string_view member(buf, std::to_chars(buf, buf + sizeof(buf), v).ptr - buf);
+                if (!inOthers(member, 2))
+                    continue;
+                fn(member);
+                if (++found == limit)
+                    break;
+            }
+            return found;
+        }
+        // forEach() has no early exit: once the limit is reached, skip the remaining members.
+        forEach(*sets[0], [&](std::string_view member)
+                {
+                    if ((limit == 0 || found < limit) && inOthers(member, 1))
+                    {
+                        fn(member);
+                        ++found;
+                    } });
+        return found;
+    }
+}
@@ -0,0 +1,375 @@
+#pragma once
+
+#include <cstdint>
+#include <new>
+#include <optional>
+#include <string_view>
+#include "CompactString.hpp"
+#include "Dict.hpp"
+
+/// @brief Score interval of ZRANGEBYSCORE, each end inclusive or exclusive.
+struct ScoreRange
+{
+    double min = 0;
+    double max = 0;
+    bool min_exclusive = false;
+    bool max_exclusive = false;
+
+    bool aboveMin(double score) const
+    {
+        return min_exclusive ? score > min : score >= min;
+    }
+
+    bool belowMax(double score) const
+    {
+        return max_exclusive ? score < max : score <= max;
+    }
+
+    bool empty() const
+    {
+        return min > max || (min == max && (min_exclusive || max_exclusive));
+    }
+};
+
+/// @brief Sorted set that outgrew its listpack encoding: a skiplist ordered by (score, member) plus
+/// a Dict from member to score, like redis' zset. The dict answers ZSCORE in O(1); the skiplist keeps
+/// every forward link's span (the number of elements it skips), so ranks are found in O(log n) on the
+/// way down to an element, and the element at a rank likewise.
+class SortedSet
+{
+public:
+    static constexpr int MAX_LEVEL = 32;
+    static constexpr uint32_t LEVEL_P = UINT32_MAX / 4; // Chance of a node reaching one more level: 1/4.
+
+    /// @brief Skiplist node: member, score, backward link, then level() forward links.
+    class Node
+    {
+    public:
+        std::string_view member() const
+        {
+            return member_.view();
+        }
+
+        double score() const
+        {
+            return score_;
+        }
+
+        const Node *next() const
+        {
+            return level(0).forward;
+        }
+
+        /// @return the previous node, or nullptr for the first one.
+        const Node *prev() const
+        {
+            return backward_;
+        }
+
+    private:
+        friend class SortedSet;
+
+        struct Level
+        {
+            Node *forward = nullptr;
+            size_t span = 0; // Elements between this node and `forward`, `forward` included.
+        };
+
+        CompactString member_;
+        double score_ = 0;
+        Node *backward_ = nullptr;
+        int levels_ = 0;
+
+        Level &level(int i)
+        {
+            return reinterpret_cast<Level *>(this + 1)[i];
+        }
+
+        const Level &level(int i) const
+        {
+            return reinterpret_cast<const Level *>(this + 1)[i];
+        }
+    };
+
+    SortedSet()
+    {
+        header_ = allocNode(MAX_LEVEL, 0, "");
+    }
+
+    SortedSet(const SortedSet &) = delete;
+    SortedSet &operator=(const SortedSet &) = delete;
+
+    ~SortedSet()
+    {
+        Node *node = header_;
+        while (node != nullptr)
+        {
+            Node *next = node->level(0).forward;
+            freeNode(node);
+            node = next;
+        }
+    }
+
+    size_t size() const
+    {
+        return length_;
+    }
+
+    /// @return bytes held by the dict, the nodes and the members' heap parts.
+    size_t memoryUsage() const
+    {
+        return sizeof(*this) + scores_.memoryUsage() + node_bytes_;
+    }
+
+    const double *score(std::string_view member) const
+    {
+        return scores_.find(member);
+    }
+
+    /// @brief One Dict::stableScan() step over the members: calls fn(std::string_view member, double score).
+    /// @return the next cursor, 0 once the walk is complete.
+    template <typename F>
+    size_t scan(size_t cursor, F &&fn) const
+    {
+        return scores_.stableScan(cursor, [&](std::string_view member, double score)
+                                  { fn(member, score); });
+    }
+
+    /// @brief Add a member or change its score.
+    /// @return true if the member is new.
+    bool set(std::string_view member, double score)
+    {
+        auto [current, inserted] = scores_.tryEmplace(member);
+        if (!inserted)
+        {
+            if (*current == score)
+                return false;
+            // A new score usually means a new position: unlink and insert again.
+            eraseNode(*current, member);
+        }
+        *current = score;
+        insertNode(score, member);
+        return inserted;
+    }
+
+    /// @return true if the member existed.
+    bool erase(std::string_view member)
+    {
+        const double *current = scores_.find(member);
+        if (current == nullptr)
+            return false;
+        eraseNode(*current, member);
+        scores_.erase(member);
+        return true;
+    }
+
+    /// @return the 0-based position of a member in ascending order.
+    std::optional<size_t> rank(std::string_view member) const
+    {
+        const double *score = scores_.find(member);
+        if (score == nullptr)
+            return std::nullopt;
+        size_t rank = 0;
+        const Node *x = header_;
+        for (int i = level_ - 1; i >= 0; --i)
+        {
+            while (x->level(i).forward != nullptr && (before(x->level(i).forward, *score, member) || x->level(i).forward->member_.view() == member))
+            {
+                rank += x->level(i).span;
+                x = x->level(i).forward;
+            }
+        }
+        return rank - 1;
+    }
+
+    const Node *first() const
+    {
+        return header_->level(0).forward;
+    }
+
+    const Node *last() const
+    {
+        return tail_;
+    }
+
+    /// @return the node at 0-based position `rank` in ascending order, or nullptr.
+    const Node *byRank(size_t rank) const
+    {
+        if (rank >= length_)
+            return nullptr;
+        size_t traversed = 0;
+        const Node *x = header_;
+        for (int i = level_ - 1; i >= 0; --i)
+        {
+            while (x->level(i).forward != nullptr && traversed + x->level(i).span <= rank + 1)
+            {
+                traversed += x->level(i).span;
+                x = x->level(i).forward;
+            }
+            if (traversed == rank + 1)
+                return x;
+        }
+        return nullptr;
+    }
+
+    /// @return the lowest node within `range`, or nullptr.
+    const Node *firstInRange(const ScoreRange &range) const
+    {
+        if (range.empty() || tail_ == nullptr || !range.aboveMin(tail_->score_))
+            return nullptr;
+        const Node *x = header_;
+        for (int i = level_ - 1; i >= 0; --i)
+        {
+            while (x->level(i).forward != nullptr && !range.aboveMin(x->level(i).forward->score_))
+                x = x->level(i).forward;
+        }
+        x = x->level(0).forward;
+        return x != nullptr && range.belowMax(x->score_) ? x : nullptr;
+    }
+
+    /// @return the highest node within `range`, or nullptr.
+    const Node *lastInRange(const ScoreRange &range) const
+    {
+        if (range.empty() || tail_ == nullptr || !range.belowMax(first()->score_))
+            return nullptr;
+        const Node *x = header_;
+        for (int i = level_ - 1; i >= 0; --i)
+        {
+            while (x->level(i).forward != nullptr && range.belowMax(x->level(i).forward->score_))
+                x = x->level(i).forward;
+        }
+        return x != header_ && range.aboveMin(x->score_) ? x : nullptr;
+    }
+
+private:
+    Dict<double> scores_;
+    Node *header_ = nullptr; // Sentinel with MAX_LEVEL links; not an element.
+    Node *tail_ = nullptr;
+    size_t length_ = 0;
+    int level_ = 1;         // Levels in use by the tallest node.
+    size_t node_bytes_ = 0; // Element nodes with their links and members' heap parts, for memoryUsage().
+
+    /// @return true if `node` sorts before (score, member): by score, then by member.
+    static bool before(const Node *node, double score, std::string_view member)
+    {
+        return node->score_ < score || (node->score_ == score && node->member_.view() < member);
+    }
+
+    static int randomLevel()
+    {
+        // xorshift, like the LFU counter: cheap and good enough for coin flips.
+        thread_local uint32_t state = 2463534242u;
+        int level = 1;
+        while (level < MAX_LEVEL)
+        {
+            state ^= state << 13;
+            state ^= state >> 17;
+            state ^= state << 5;
+            if (state >= LEVEL_P)
+                break;
+            ++level;
+        }
+        return level;
+    }
+
+    Node *allocNode(int levels, double score, std::string_view member)
+    {
+        size_t bytes = sizeof(Node) + levels * sizeof(Node::Level);
+        Node *node = new (::operator new(bytes)) Node;
+        for (int i = 0; i < levels; ++i)
+            new (&node->level(i)) Node::Level;
+        node->member_ = CompactString(member);
+        node->score_ = score;
+        node->levels_ = levels;
+        if (header_ != nullptr)
+            node_bytes_ += bytes + node->member_.heapBytes();
+        return node;
+    }
+
+    void freeNode(Node *node)
+    {
+        if (node != header_)
+            node_bytes_ -= sizeof(Node) + node->levels_ * sizeof(Node::Level) + node->member_.heapBytes();
+        node->~Node();
+        ::operator delete(node);
+    }
+
+    void insertNode(double score, std::string_view member)
+    {
+        Node *update[MAX_LEVEL];
+        size_t rank[MAX_LEVEL];
+        Node *x = header_;
+        for (int i = level_ - 1; i >= 0; --i)
+        {
+            rank[i] = i == level_ - 1 ? 0 : rank[i + 1];
+            while (x->level(i).forward != nullptr && before(x->level(i).forward, score, member))
+            {
+                rank[i] += x->level(i).span;
+                x = x->level(i).forward;
+            }
+            update[i] = x;
+        }
+        int levels = randomLevel();
+        if (levels > level_)
+        {
+            for (int i = level_; i < levels; ++i)
+            {
+                rank[i] = 0;
+                update[i] = header_;
+                header_->level(i).span = length_;
+            }
+            level_ = levels;
+        }
+        x = allocNode(levels, score, member);
+        for (int i = 0; i < levels; ++i)
+        {
+            x->level(i).forward = update[i]->level(i).forward;
+            update[i]->level(i).forward = x;
+            x->level(i).span = update[i]->level(i).span - (rank[0] - rank[i]);
+            update[i]->level(i).span = rank[0] - rank[i] + 1;
+        }
+        for (int i = levels; i < level_; ++i)
+            ++update[i]->level(i).span;
+        x->backward_ = update[0] == header_ ? nullptr : update[0];
+        if (x->level(0).forward != nullptr)
+            x->level(0).forward->backward_ = x;
+        else
+            tail_ = x;
+        ++length_;
+    }
+
+    void eraseNode(double score, std::string_view member)
+    {
+        Node *update[MAX_LEVEL];
+        Node *x = header_;
+        for (int i = level_ - 1; i >= 0; --i)
+        {
+            while (x->level(i).forward != nullptr && before(x->level(i).forward, score, member))
+                x = x->level(i).forward;
+            update[i] = x;
+        }
+        x = x->level(0).forward;
+        if (x == nullptr || x->score_ != score || x->member_.view() != member)
+            return;
+        for (int i = 0; i < level_; ++i)
+        {
+            if (update[i]->level(i).forward == x)
+            {
+                update[i]->level(i).span += x->level(i).span - 1;
+                update[i]->level(i).forward = x->level(i).forward;
+            }
+            else
+            {
+                --update[i]->level(i).span;
+            }
+        }
+        if (x->level(0).forward != nullptr)
+            x->level(0).forward->backward_ = x->backward_;
+        else
+            tail_ = x->backward_;
+        while (level_ > 1 && header_->level(level_ - 1).forward == nullptr)
+            --level_;
+        --length_;
+        freeNode(x);
+    }
+};
@@ -0,0 +1,529 @@
+#pragma once
+
+#include <array>
+#include <charconv>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <span>
+#include <string_view>
+#include <utility>
+#include <vector>
+#include "RadixTree.hpp"
+
+/// @brief ID of a stream entry: milliseconds, then a sequence number within the millisecond.
+struct StreamID
+{
+    /// Room for the longest formatted ID: two 20 digit numbers and the dash.
+    static constexpr size_t MAX_CHARS = 41;
+
+    uint64_t ms = 0;
+    uint64_t seq = 0;
+
+    auto operator<=>(const StreamID &) const = default;
+
+    static constexpr StreamID max()
+    {
+        return {UINT64_MAX, UINT64_MAX};
+    }
+
+    /// @brief Move to the next possible ID.
+    /// @return false, leaving the ID alone, when it already is max().
+    bool increment()
+    {
+        if (seq != UINT64_MAX)
+            ++seq;
+        else if (ms != UINT64_MAX)
+            *this = {ms + 1, 0};
+        else
+            return false;
+        return true;
+    }
+
+    /// @brief Move to the previous possible ID.
+    /// @return false, leaving the ID alone, when it is 0-0.
+    bool decrement()
+    {
+        if (seq != 0)
+            --seq;
+        else if (ms != 0)
+            *this = {ms - 1, UINT64_MAX};
+        else
+            return false;
+        return true;
+    }
+
+    std::string_view format(char (&buf)[MAX_CHARS]) const
+    {
+        char *p = std::to_chars(buf, buf + 20, ms).ptr; // At most 20 digits.
+        *p++ = '-';
+        p = std::to_chars(p, buf + MAX_CHARS, seq).ptr;
+        return std::string_view(buf, p - buf);
+    }
+
+    /// @brief The ID as a radix tree key: big-endian, so byte order is ID order.
+    std::array<uint8_t, 16> key() const
+    {
+        std::array<uint8_t, 16> k;
+        for (int i = 0; i < 8; ++i)
+        {
+            k[i] = static_cast<uint8_t>(ms >> (56 - 8 * i));
+            k[8 + i] = static_cast<uint8_t>(seq >> (56 - 8 * i));
+        }
+        return k;
+    }
+
+    /// @brief Parse "<ms>-<seq>", or a bare "<ms>" whose sequence number is `missing_seq`.
+    /// @param seq_given if not null, receives whether the sequence number was there.
+    static bool parse(std::string_view s, StreamID &id, uint64_t missing_seq, bool *seq_given = nullptr)
+    {
+        size_t dash = s.find('-');
+        std::string_view ms_part = s.substr(0, dash);
+        if (!parseU64(ms_part, id.ms))
+            return false;
+        if (seq_given != nullptr)
+            *seq_given = dash != std::string_view::npos;
+        if (dash == std::string_view::npos)
+        {
+            id.seq = missing_seq;
+            return true;
+        }
+        return parseU64(s.substr(dash + 1), id.seq);
+    }
+
+private:
+    static bool parseU64(std::string_view s, uint64_t &value)
+    {
+        if (s.empty() || s.size() > 20)
+            return false;
+        auto [ptr, ec] = std::from_chars(s.data(), s.data() + s.size(), value);
+        return ec == std::errc() && ptr == s.data() + s.size();
+    }
+};
+
+/// @brief Size of a stream's entry blocks, like redis' stream-node-max-* settings.
+struct StreamLimits
+{
+    size_t max_block_bytes = 4096;  // Bytes of packed entries in one block (stream-node-max-bytes); 0 for no limit.
+    size_t max_block_entries = 100; // Entries in one block (stream-node-max-entries); 0 for no limit.
+};
+
+/// @brief Run of consecutive stream entries packed into one buffer, like the listpacks of redis' streams.
+/// The buffer starts with the field names of the block's first entry (the master fields). Every entry
+/// is then
+///
+///     [flags] [ms delta] [seq] [fields and values | values]
+///
+/// with integers as LEB128 varints. The ID is delta-encoded against the entry before it: the ms part
+/// as a difference, and the seq part as the gap minus one when the ms part repeats. An entry with the
+/// same fields as the master only stores its values (SAME_FIELDS), which for event streams whose
+/// entries share a schema leaves a few bytes of framing per entry besides the values themselves.
+class StreamBlock
+{
+public:
+    static constexpr uint8_t DELETED = 1;     // Trimmed from the stream; skipped, the bytes stay.
+    static constexpr uint8_t SAME_FIELDS = 2; // Only values follow: the fields are the master fields.
+
+    /// @brief A decoded entry. The views point into the block.
+    struct Entry
+    {
+        StreamID id;
+        uint8_t flags = 0;
+        std::vector<std::pair<std::string_view, std::string_view>> fields;
+    };
+
+    /// @brief Decodes the entries of a block in order.
+    class Cursor
+    {
+    public:
+        explicit Cursor(const StreamBlock &block) : block_(block)
+        {
+            uint64_t n = block.readVarint(pos_);
+            for (uint64_t i = 0; i < n; ++i)
+                master_fields_.push_back(block.readString(pos_));
+            id_ = block.master_;
+        }
+
+        /// @brief Decode the next entry into `entry`.
+        /// @return false past the last entry.
+        bool next(Entry &entry)
+        {
+            if (index_ == block_.count_)
+                return false;
+            entry_pos_ = pos_;
+            entry.flags = block_.bytes_[pos_++];
+            uint64_t ms_delta = block_.readVarint(pos_);
+            uint64_t seq = block_.readVarint(pos_);
+            if (index_ != 0)
+                id_ = ms_delta == 0 ? StreamID{id_.ms, id_.seq + seq + 1} : StreamID{id_.ms + ms_delta, seq};
+            entry.id = id_;
+            entry.fields.clear();
+            if (entry.flags & SAME_FIELDS)
+            {
+                for (std::string_view field : master_fields_)
+                    entry.fields.emplace_back(field, block_.readString(pos_));
+            }
+            else
+            {
+                uint64_t n = block_.readVarint(pos_);
+                for (uint64_t i = 0; i < n; ++i)
+                {
+                    std::string_view field = block_.readString(pos_);
+                    entry.fields.emplace_back(field, block_.readString(pos_));
+                }
+            }
+            ++index_;
+            return true;
+        }
+
+        /// @return offset of the flags of the entry last returned by next().
+        size_t entryPos() const
+        {
+            return entry_pos_;
+        }
+
+    private:
+        const StreamBlock &block_;
+        std::vector<std::string_view> master_fields_;
+        size_t pos_ = 0;
+        size_t entry_pos_ = 0;
+        size_t index_ = 0;
+        StreamID id_;
+    };
+
+    /// @param fields alternating field names and values of the first entry.
+    StreamBlock(StreamID id, std::span<const std::string_view> fields) : master_(id), last_(id)
+    {
+        writeVarint(fields.size() / 2);
+        for (size_t i = 0; i < fields.size(); i += 2)
+            writeString(fields[i]);
+        append(id, fields);
+    }
+
+    StreamBlock(const StreamBlock &) = delete;
+    StreamBlock &operator=(const StreamBlock &) = delete;
+
+    StreamID master() const
+    {
+        return master_;
+    }
+
+    StreamID last() const
+    {
+        return last_;
+    }
+
+    /// @return entries, trimmed ones included.
+    size_t count() const
+    {
+        return count_;
+    }
+
+    /// @return entries not trimmed yet.
+    size_t live() const
+    {
+        return live_;
+    }
+
+    size_t bytes() const
+    {
+        return bytes_.size();
+    }
+
+    size_t memoryUsage() const
+    {
+        return sizeof(*this) + bytes_.capacity();
+    }
+
+    /// @brief Append an entry; `id` must be above last().
+    void append(StreamID id, std::span<const std::string_view> fields)
+    {
+        bool same = count_ == 0 || sameAsMaster(fields);
+        bytes_.push_back(same ? SAME_FIELDS : 0);
+        if (count_ == 0 || id.ms != last_.ms)
+        {
+            writeVarint(id.ms - last_.ms);
+            writeVarint(id.seq);
+        }
+        else
+        {
+            writeVarint(0);
+            writeVarint(id.seq - last_.seq - 1);
+        }
+        if (!same)
+            writeVarint(fields.size() / 2);
+        for (size_t i = same ? 1 : 0; i < fields.size(); i += same ? 2 : 1)
+            writeString(fields[i]);
+        last_ = id;
+        ++count_;
+        ++live_;
+    }
+
+    /// @brief Flag the entry at `pos` (see Cursor::entryPos()) as trimmed.
+    void markDeleted(size_t pos)
+    {
+        bytes_[pos] |= DELETED;
+        --live_;
+    }
+
+    /// @brief Give back the spare capacity, once no more entries will be appended.
+    void seal()
+    {
+        bytes_.shrink_to_fit();
+    }
+
+    StreamBlock *prev = nullptr;
+    StreamBlock *next = nullptr;
+
+private:
+    StreamID master_; // ID of the first entry, the block's key in the stream's radix tree.
+    StreamID last_;
+    std::vector<uint8_t> bytes_;
+    size_t count_ = 0;
+    size_t live_ = 0;
+
+    void writeVarint(uint64_t value)
+    {
+        for (; value >= 128; value >>= 7)
+            bytes_.push_back(static_cast<uint8_t>((value & 127) | 128));
+        bytes_.push_back(static_cast<uint8_t>(value));
+    }
+
+    void writeString(std::string_view s)
+    {
+        writeVarint(s.size());
+        bytes_.insert(bytes_.end(), s.begin(), s.end());
+    }
+
+    uint64_t readVarint(size_t &pos) const
+    {
+        uint64_t value = 0;
+        for (size_t shift = 0;; shift += 7)
+        {
+            uint8_t b = bytes_[pos++];
+            value |= static_cast<uint64_t>(b & 127) << shift;
+            if ((b & 128) == 0)
+                return value;
+        }
+    }
+
+    std::string_view readString(size_t &pos) const
+    {
+        size_t len = readVarint(pos);
+        std::string_view s(reinterpret_cast<const char *>(bytes_.data() + pos), len);
+        pos += len;
+        return s;
+    }
+
+    bool sameAsMaster(std::span<const std::string_view> fields) const
+    {
+        size_t pos = 0;
+        if (readVarint(pos) != fields.size() / 2)
+            return false;
+        for (size_t i = 0; i < fields.size(); i += 2)
+        {
+            if (readString(pos) != fields[i])
+                return false;
+        }
+        return true;
+    }
+};
+
+/// @brief Append-only log of entries with increasing IDs, like redis' stream: StreamBlocks in a
+/// RadixTree keyed by the ID of their first entry, and linked in ID order. Appending only touches the
+/// last block; a range scan seeks its first block in the tree and then reads blocks sequentially.
+/// Trimming drops whole blocks from the front, and flags entries in the first block when it must be
+/// exact.
+class Stream
+{
+public:
+    using Entry = StreamBlock::Entry;
+
+    Stream() = default;
+    Stream(const Stream &) = delete;
+    Stream &operator=(const Stream &) = delete;
+
+    ~Stream()
+    {
+        while (first_ != nullptr)
+            removeFirstBlock();
+    }
+
+    /// @return number of entries.
+    size_t size() const
+    {
+        return length_;
+    }
+
+    /// @return the ID of the last entry ever added, 0-0 for none.
+    StreamID lastId() const
+    {
+        return last_id_;
+    }
+
+    size_t memoryUsage() const
+    {
+        return sizeof(*this) + blocks_.memoryUsage() + block_bytes_;
+    }
+
+    /// @brief Add an entry; `id` must be above lastId().
+    /// @param fields alternating field names and values.
+    void append(StreamID id, std::span<const std::string_view> fields, const StreamLimits &limits)
+    {
+        if (last_ != nullptr && (limits.max_block_entries == 0 || last_->count() < limits.max_block_entries) &&
+            (limits.max_block_bytes == 0 || last_->bytes() < limits.max_block_bytes))
+        {
+            block_bytes_ -= last_->memoryUsage();
+            last_->append(id, fields);
+            block_bytes_ += last_->memoryUsage();
+        }
+        else
+        {
+            if (last_ != nullptr)
+            {
+                block_bytes_ -= last_->memoryUsage();
+                last_->seal();
+                block_bytes_ += last_->memoryUsage();
+            }
+            auto block = std::make_unique<StreamBlock>(id, fields);
+            StreamBlock *added = block.get();
+            block_bytes_ += added->memoryUsage();
+            blocks_.insert(id.key(), std::move(block));
+            added->prev = last_;
+            (last_ != nullptr ? last_->next : first_) = added;
+            last_ = added;
+        }
+        last_id_ = id;
+        ++length_;
+    }
+
+    /// @brief Call fn(const Entry &) for the entries with IDs in [start, end], at most `count` of
+    /// them (0 for no limit). The entry's views are valid until the stream changes.
+    /// @param reverse from `end` down.
+    template <typename F>
+    void range(StreamID start, StreamID end, bool reverse, size_t count, F &&fn) const
+    {
+        if (start > end || length_ == 0)
+            return;
+        Entry entry;
+        size_t emitted = 0;
+        if (!reverse)
+        {
+            auto *found = blocks_.floor(start.key());
+            for (const StreamBlock *block = found != nullptr ? found->get() : first_; block != nullptr; block = block->next)
+            {
+                if (block->master() > end)
+                    return;
+                if (block->last() < start)
+                    continue;
+                StreamBlock::Cursor cursor(*block);
+                while (cursor.next(entry))
+                {
+                    if (entry.id > end)
+                        return;
+                    if (entry.id < start || (entry.flags & StreamBlock::DELETED))
+                        continue;
+                    fn(static_cast<const Entry &>(entry));
+                    if (++emitted == count)
+                        return;
+                }
+            }
+            return;
+        }
+        auto *found = blocks_.floor(end.key());
+        // Entries only decode forwards: collect a block's entries and walk them backwards.
+        std::vector<Entry> entries;
+        for (const StreamBlock *block = found != nullptr ? found->get() : nullptr; block != nullptr; block = block->prev)
+        {
+            if (block->last() < start)
+                return;
+            entries.resize(block->count());
+            StreamBlock::Cursor cursor(*block);
+            for (Entry &e : entries)
+                cursor.next(e);
+            for (size_t i = entries.size(); i-- > 0;)
+            {
+                const Entry &e = entries[i];
+                if (e.id < start)
+                    return;
+                if (e.id > end || (e.flags & StreamBlock::DELETED))
+                    continue;
+                fn(e);
+                if (++emitted == count)
+                    return;
+            }
+        }
+    }
+
+    /// @brief Remove entries from the front until at most `max_length` are left, like XTRIM MAXLEN.
+    /// @param approx only remove whole blocks, which is much cheaper and may leave a few extra entries.
+    /// @param limit in approx mode, remove at most this many entries (0 for no limit).
+    /// @return number of entries removed.
+    size_t trimMaxLen(size_t max_length, bool approx, size_t limit)
+    {
+        return trim(approx, limit, [&](const StreamBlock &block)
+                    { return length_ - block.live() >= max_length; },
+                    [&](const Entry &)
+                    { return length_ > max_length; });
+    }
+
+    /// @brief Remove the entries with IDs below `min_id`, like XTRIM MINID.
+    /// @param approx only remove whole blocks, which is much cheaper and may leave a few extra entries.
+    /// @param limit in approx mode, remove at most this many entries (0 for no limit).
+    /// @return number of entries removed.
+    size_t trimMinId(StreamID min_id, bool approx, size_t limit)
+    {
+        return trim(approx, limit, [&](const StreamBlock &block)
+                    { return block.last() < min_id; },
+                    [&](const Entry &entry)
+                    { return entry.id < min_id; });
+    }
+
+private:
+    RadixTree<std::unique_ptr<StreamBlock>> blocks_;
+    StreamBlock *first_ = nullptr;
+    StreamBlock *last_ = nullptr;
+    size_t length_ = 0;
+    StreamID last_id_;
+    size_t block_bytes_ = 0; // memoryUsage() of every block.
+
+    void removeFirstBlock()
+    {
+        StreamBlock *block = first_;
+        length_ -= block->live();
+        block_bytes_ -= block->memoryUsage();
+        first_ = block->next;
+        (first_ != nullptr ? first_->prev : last_) = nullptr;
+        blocks_.erase(block->master().key()); // Frees the block.
+    }
+
+    /// @brief Drop first blocks while whole_block(block) holds, then, unless `approx`, flag the
+    /// entries of the first block while entry_goes(entry) holds.
+    template <typename WholeBlock, typename EntryGoes>
+    size_t trim(bool approx, size_t limit, WholeBlock &&whole_block, EntryGoes &&entry_goes)
+    {
+        size_t before = length_;
+        while (first_ != nullptr && whole_block(*first_))
+        {
+            if (approx && limit != 0 && before - length_ + first_->live() > limit)
+                break;
+            removeFirstBlock();
+        }
+        if (approx || first_ == nullptr)
+            return before - length_;
+        StreamBlock::Cursor cursor(*first_);
+        Entry entry;
+        while (cursor.next(entry))
+        {
+            if (entry.flags & StreamBlock::DELETED)
+                continue;
+            if (!entry_goes(entry))
+                break;
+            first_->markDeleted(cursor.entryPos());
+            --length_;
+        }
+        if (first_->live() == 0)
+            removeFirstBlock();
+        return before - length_;
+    }
+};
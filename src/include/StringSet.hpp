@@ -0,0 +1,61 @@
+#pragma once
+
+#include <string_view>
+#include "Dict.hpp"
+
+/// @brief Members of a set that outgrew its intset encoding: a Dict whose values are empty, so a
+/// slot is just the member.
+class StringSet
+{
+public:
+    size_t size() const
+    {
+        return members_.size();
+    }
+
+    size_t memoryUsage() const
+    {
+        return sizeof(*this) + members_.memoryUsage();
+    }
+
+    bool contains(std::string_view member) const
+    {
+        return members_.find(member) != nullptr;
+    }
+
+    /// @return true if the member is new.
+    bool insert(std::string_view member)
+    {
+        return members_.tryEmplace(member).second;
+    }
+
+    /// @return true if the member existed.
+    bool erase(std::string_view member)
+    {
+        return members_.erase(member);
+    }
+
+    /// @brief Call fn(std::string_view member) for every member.
+    template <typename F>
+    void forEach(F &&fn) const
+    {
+        members_.forEach([&](std::string_view member, const Empty &)
+                         { fn(member); });
+    }
+
+    /// @brief One Dict::stableScan() step: calls fn(std::string_view member).
+    /// @return the next cursor, 0 once the walk is complete.
+    template <typename F>
+    size_t scan(size_t cursor, F &&fn) const
+    {
+        return members_.stableScan(cursor, [&](std::string_view member, const Empty &)
+                                   { fn(member); });
+    }
+
+private:
+    struct Empty
+    {
+    };
+
+    Dict<Empty> members_;
+};
@@ -0,0 +1,521 @@
+#pragma once
+
+#include <atomic>
+#include <csignal>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include <linux/io_uring.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/utsname.h>
+#include "EventLoop.hpp"
+
+/// @brief io_uring reactor: one multishot accept on the listener, one multishot recv per client fed from a
+/// provided-buffer group, and every pending reply submitted as a batch together with the next wait.
+/// Talks to the kernel through the raw syscalls so it needs no extra dependency.
+/// Blocked clients are handled like in EventLoop: an eventfd read stays armed for Client::wake(),
+/// and the wait is bounded by the nearest deadline. Output other threads queue for a client
+/// (Client::queueOutput()) is announced through the same eventfd.
+class UringLoop
+{
+public:
+    using ReadHandler = EventLoop::ReadHandler;
+    using CloseHandler = EventLoop::CloseHandler;
+
+    /// @brief Check whether the running kernel supports everything this backend needs.
+    /// Multishot accept arrived in 5.19 and multishot recv in 6.0.
+    static bool isSupported()
+    {
+        utsname u;
+        int major = 0, minor = 0;
+        if (uname(&u) != 0 || std::sscanf(u.release, "%d.%d", &major, &minor) != 2 || major < 6)
+            return false;
+        io_uring_params params{};
+        int fd = setup(4, &params);
+        if (fd < 0)
+            return false;
+        close(fd);
+        return (params.features & IORING_FEAT_SINGLE_MMAP) != 0 && (params.features & IORING_FEAT_EXT_ARG) != 0;
+    }
+
+    UringLoop(int listen_fd, ReadHandler on_read, CloseHandler on_close) : listen_fd_(listen_fd), on_read_(std::move(on_read)), on_close_(std::move(on_close))
+    {
+        io_uring_params params{};
+        ring_fd_ = setup(QUEUE_DEPTH, &params);
+        if (ring_fd_ < 0)
+        {
+            std::cerr << "io_uring_setup failed\n";
+            std::exit(EXIT_FAILURE);
+        }
+        mapRings(params);
+        setupBufferPool();
+        wake_fd_ = eventfd(0, EFD_CLOEXEC);
+        if (wake_fd_ < 0)
+        {
+            std::cerr << "Failed to create the wake-up eventfd\n";
+            std::exit(EXIT_FAILURE);
+        }
+    }
+
+    ~UringLoop()
+    {
+        for (auto &[id, conn] : conns_)
+            on_close_(*conn.client);
+        conns_.clear();
+        if (wake_fd_ != -1)
+            close(wake_fd_);
+        if (sqes_ != nullptr)
+            munmap(sqes_, sqes_len_);
+        if (ring_ptr_ != nullptr)
+            munmap(ring_ptr_, ring_len_);
+        if (ring_fd_ != -1)
+            close(ring_fd_);
+    }
+
+    UringLoop(const UringLoop &) = delete;
+    UringLoop &operator=(const UringLoop &) = delete;
+
+    /// @brief Run the reactor forever.
+    void run()
+    {
+        armAccept();
+        armWake();
+        while (true)
+        {
+            queueSends();
+            submitAndWait(1, blockedTimeout());
+
+            unsigned head = *cq_head_;
+            unsigned tail = std::atomic_ref<unsigned>(*cq_tail_).load(std::memory_order_acquire);
+            for (; head != tail; ++head)
+            {
+                io_uring_cqe &cqe = cqes_[head & cq_mask_];
+                uint64_t id = cqe.user_data >> 8;
+                switch (static_cast<Op>(cqe.user_data & 0xff))
+                {
+                case Op::Accept:
+                    onAccept(cqe.res, cqe.flags);
+                    break;
+                case Op::Recv:
+                    onRecv(id, cqe.res, cqe.flags);
+                    break;
+                case Op::Send:
+                    onSend(id, cqe.res);
+                    break;
+                case Op::Provide:
+                    break;
+                case Op::Wake:
+                    armWake();
+                    takePostedOutput();
+                    break;
+                }
+            }
+            std::atomic_ref<unsigned>(*cq_head_).store(head, std::memory_order_release);
+            if (!blocked_.empty())
+                serveBlockedClients();
+        }
+    }
+
+private:
+    static constexpr unsigned QUEUE_DEPTH = 4096;
+    static constexpr unsigned BUF_COUNT = 4096;
+    static constexpr unsigned BUF_SIZE = 16 * 1024;
+    static constexpr uint16_t BUF_GROUP = 0;
+
+    enum class Op : uint8_t
+    {
+        Accept = 1,
+        Recv = 2,
+        Send = 3,
+        Provide = 4,
+        Wake = 5,
+    };
+
+    /// While a send is in flight the kernel reads straight from the client's ReplyBuffer through `iov`;
+    /// replies queued meanwhile are appended behind it and never move the bytes being sent.
+    struct Conn
+    {
+        std::unique_ptr<Client> client;
+        msghdr msg{};
+        iovec iov[ReplyBuffer::MAX_IOV];
+        bool recv_armed = false;
+        bool send_inflight = false;
+        bool closing = false;
+        bool dirty = false; // Already in dirty_ for this iteration.
+    };
+
+    int listen_fd_;
+    int ring_fd_ = -1;
+    int wake_fd_ = -1;     // Written by Client::wake() and Client::notify_output from any thread.
+    uint64_t wake_count_; // Where the armed eventfd read lands.
+    ReadHandler on_read_;
+    CloseHandler on_close_;
+
+    void *ring_ptr_ = nullptr;
+    size_t ring_len_ = 0;
+    io_uring_sqe *sqes_ = nullptr;
+    size_t sqes_len_ = 0;
+    unsigned *sq_head_, *sq_tail_, *sq_array_, *cq_head_, *cq_tail_;
+    unsigned sq_mask_, sq_entries_, cq_mask_;
+    io_uring_cqe *cqes_;
+    unsigned sqe_tail_ = 0;
+
+    std::unique_ptr<char[]> buf_pool_;
+    __kernel_timespec wait_timeout_{};
+
+    uint64_t next_id_ = 1;
+    std::unordered_map<uint64_t, Conn> conns_;
+    std::vector<uint64_t> dirty_; // Connections that may have replies to send.
+    std::unordered_set<uint64_t> blocked_; // Connections whose client waits in a blocking command.
+    std::mutex posted_mutex_;
+    std::vector<uint64_t> posted_; // Connections other threads queued output for, see Client::notify_output.
+
+    static int setup(unsigned entries, io_uring_params *params)
+    {
+        return static_cast<int>(syscall(__NR_io_uring_setup, entries, params));
+    }
+
+    void mapRings(const io_uring_params &params)
+    {
+        size_t sq_len = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        size_t cq_len = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        ring_len_ = std::max(sq_len, cq_len);
+        ring_ptr_ = mmap(nullptr, ring_len_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_SQ_RING);
+        sqes_len_ = params.sq_entries * sizeof(io_uring_sqe);
+        void *sqes = mmap(nullptr, sqes_len_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_SQES);
+        if (ring_ptr_ == MAP_FAILED || sqes == MAP_FAILED)
+        {
+            std::cerr << "Failed to map io_uring rings\n";
+            std::exit(EXIT_FAILURE);
+        }
+        sqes_ = static_cast<io_uring_sqe *>(sqes);
+
+        char *base = static_cast<char *>(ring_ptr_);
+        sq_head_ = reinterpret_cast<unsigned *>(base + params.sq_off.head);
+        sq_tail_ = reinterpret_cast<unsigned *>(base + params.sq_off.tail);
+        sq_mask_ = *reinterpret_cast<unsigned *>(base + params.sq_off.ring_mask);
+        sq_entries_ = params.sq_entries;
+        sq_array_ = reinterpret_cast<unsigned *>(base + params.sq_off.array);
+        cq_head_ = reinterpret_cast<unsigned *>(base + params.cq_off.head);
+        cq_tail_ = reinterpret_cast<unsigned *>(base + params.cq_off.tail);
+        cq_mask_ = *reinterpret_cast<unsigned *>(base + params.cq_off.ring_mask);
+        cqes_ = reinterpret_cast<io_uring_cqe *>(base + params.cq_off.cqes);
+        sqe_tail_ = *sq_tail_;
+    }
+
+    void setupBufferPool()
+    {
+        buf_pool_ = std::make_unique<char[]>(static_cast<size_t>(BUF_COUNT) * BUF_SIZE);
+        provideBuffers(0, BUF_COUNT);
+    }
+
+    /// @brief Hand `count` consecutive buffers starting at `bid` to the kernel's buffer group.
+    /// The request rides along with the next io_uring_enter, so recycling costs no extra syscall.
+    void provideBuffers(uint16_t bid, unsigned count)
+    {
+        io_uring_sqe *sqe = getSqe();
+        sqe->opcode = IORING_OP_PROVIDE_BUFFERS;
+        sqe->fd = static_cast<int>(count);
+        sqe->addr = reinterpret_cast<uint64_t>(buf_pool_.get() + static_cast<size_t>(bid) * BUF_SIZE);
+        sqe->len = BUF_SIZE;
+        sqe->off = bid;
+        sqe->buf_group = BUF_GROUP;
+        sqe->user_data = userData(0, Op::Provide);
+    }
+
+    io_uring_sqe *getSqe()
+    {
+        unsigned head = std::atomic_ref<unsigned>(*sq_head_).load(std::memory_order_acquire);
+        if (sqe_tail_ - head >= sq_entries_)
+        {
+            // Submission queue is full: hand what we have to the kernel without waiting.
+            submitAndWait(0);
+        }
+        unsigned idx = sqe_tail_ & sq_mask_;
+        io_uring_sqe *sqe = &sqes_[idx];
+        std::memset(sqe, 0, sizeof(*sqe));
+        sq_array_[idx] = idx;
+        ++sqe_tail_;
+        return sqe;
+    }
+
+    /// @param timeout bounds the wait when not null.
+    void submitAndWait(unsigned wait_nr, const __kernel_timespec *timeout = nullptr)
+    {
+        std::atomic_ref<unsigned>(*sq_tail_).store(sqe_tail_, std::memory_order_release);
+        unsigned to_submit = sqe_tail_ - std::atomic_ref<unsigned>(*sq_head_).load(std::memory_order_acquire);
+        unsigned flags = wait_nr > 0 ? IORING_ENTER_GETEVENTS : 0;
+        io_uring_getevents_arg arg{};
+        void *argp = nullptr;
+        size_t argsz = 0;
+        if (timeout != nullptr)
+        {
+            arg.sigmask_sz = _NSIG / 8;
+            arg.ts = reinterpret_cast<uint64_t>(timeout);
+            flags |= IORING_ENTER_EXT_ARG;
+            argp = &arg;
+            argsz = sizeof(arg);
+        }
+        while (syscall(__NR_io_uring_enter, ring_fd_, to_submit, wait_nr, flags, argp, argsz) < 0)
+        {
+            if (errno == ETIME)
+                break; // A blocked client's deadline is up.
+            if (errno != EINTR && errno != EAGAIN && errno != EBUSY)
+            {
+                std::cerr << "io_uring_enter failed\n";
+                std::exit(EXIT_FAILURE);
+            }
+            if (errno != EINTR)
+                break; // Completion queue backed up; drain it before submitting more.
+        }
+    }
+
+    static uint64_t userData(uint64_t id, Op op)
+    {
+        return (id << 8) | static_cast<uint8_t>(op);
+    }
+
+    void armAccept()
+    {
+        io_uring_sqe *sqe = getSqe();
+        sqe->opcode = IORING_OP_ACCEPT;
+        sqe->fd = listen_fd_;
+        sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+        sqe->accept_flags = SOCK_CLOEXEC;
+        sqe->user_data = userData(0, Op::Accept);
+    }
+
+    void armWake()
+    {
+        io_uring_sqe *sqe = getSqe();
+        sqe->opcode = IORING_OP_READ;
+        sqe->fd = wake_fd_;
+        sqe->addr = reinterpret_cast<uint64_t>(&wake_count_);
+        sqe->len = sizeof(wake_count_);
+        sqe->user_data = userData(0, Op::Wake);
+    }
+
+    /// @return how long the wait may last before a blocked client times out, nullptr for no limit.
+    const __kernel_timespec *blockedTimeout()
+    {
+        auto deadline = std::chrono::steady_clock::time_point::max();
+        for (uint64_t id : blocked_)
+            deadline = std::min(deadline, conns_[id].client->blocked.deadline);
+        if (deadline == std::chrono::steady_clock::time_point::max())
+            return nullptr;
+        auto left = std::max(deadline - std::chrono::steady_clock::now(), std::chrono::steady_clock::duration::zero());
+        auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(left).count();
+        wait_timeout_.tv_sec = ns / 1000000000;
+        wait_timeout_.tv_nsec = ns % 1000000000;
+        return &wait_timeout_;
+    }
+
+    /// @brief Run the blocked commands of the clients that were woken or timed out.
+    void serveBlockedClients()
+    {
+        auto now = std::chrono::steady_clock::now();
+        for (auto it = blocked_.begin(); it != blocked_.end();)
+        {
+            Conn &conn = conns_[*it];
+            Client &client = *conn.client;
+            if (!conn.closing && (client.blocked.ready.load() || now >= client.blocked.deadline))
+            {
+                on_read_(client);
+                markDirty(*it, conn);
+            }
+            it = client.blocked.active && !conn.closing ? std::next(it) : blocked_.erase(it);
+        }
+    }
+
+    void armRecv(uint64_t id, Conn &conn)
+    {
+        io_uring_sqe *sqe = getSqe();
+        sqe->opcode = IORING_OP_RECV;
+        sqe->fd = conn.client->fd;
+        sqe->ioprio = IORING_RECV_MULTISHOT;
+        sqe->flags = IOSQE_BUFFER_SELECT;
+        sqe->buf_group = BUF_GROUP;
+        sqe->user_data = userData(id, Op::Recv);
+        conn.recv_armed = true;
+    }
+
+    void armSend(uint64_t id, Conn &conn)
+    {
+        conn.msg = msghdr{};
+        conn.msg.msg_iov = conn.iov;
+        conn.msg.msg_iovlen = conn.client->reply.fillIov(conn.iov, ReplyBuffer::MAX_IOV);
+        io_uring_sqe *sqe = getSqe();
+        sqe->opcode = IORING_OP_SENDMSG;
+        sqe->fd = conn.client->fd;
+        sqe->addr = reinterpret_cast<uint64_t>(&conn.msg);
+        sqe->len = 1;
+        sqe->msg_flags = MSG_NOSIGNAL;
+        sqe->user_data = userData(id, Op::Send);
+        conn.send_inflight = true;
+    }
+
+    void markDirty(uint64_t id, Conn &conn)
+    {
+        if (!conn.dirty)
+        {
+            conn.dirty = true;
+            dirty_.push_back(id);
+        }
+    }
+
+    /// @brief Queue one send per connection that produced replies since the last wait; they go out with the next io_uring_enter.
+    void queueSends()
+    {
+        for (uint64_t id : dirty_)
+        {
+            auto it = conns_.find(id);
+            if (it == conns_.end())
+                continue;
+            Conn &conn = it->second;
+            conn.dirty = false;
+            if (conn.closing || conn.send_inflight)
+                continue;
+            Client &client = *conn.client;
+            if (client.hasPendingReplies())
+            {
+                armSend(id, conn);
+            }
+            else if (client.close_asap)
+            {
+                startClose(id, conn);
+            }
+        }
+        dirty_.clear();
+    }
+
+    /// @brief Move the output other threads queued for connections of this loop behind their replies; queueSends() submits it.
+    void takePostedOutput()
+    {
+        std::vector<uint64_t> posted;
+        {
+            std::lock_guard lock(posted_mutex_);
+            posted.swap(posted_);
+        }
+        for (uint64_t id : posted)
+        {
+            auto it = conns_.find(id);
+            if (it == conns_.end() || it->second.closing)
+                continue;
+            it->second.client->takeOutput();
+            markDirty(id, it->second);
+        }
+    }
+
+    void onAccept(int res, uint32_t flags)
+    {
+        if (res >= 0)
+        {
+            int one = 1;
+            setsockopt(res, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+            uint64_t id = next_id_++;
+            Conn &conn = conns_[id];
+            conn.client = std::make_unique<Client>(res);
+            conn.client->wake = [wake_fd = wake_fd_]
+            {
+                uint64_t one = 1;
+                ssize_t written = write(wake_fd, &one, sizeof(one));
+                (void)written;
+            };
+            conn.client->notify_output = [this, id]
+            {
+                {
+                    std::lock_guard lock(posted_mutex_);
+                    posted_.push_back(id);
+                }
+                uint64_t one = 1;
+                ssize_t written = write(wake_fd_, &one, sizeof(one));
+                (void)written;
+            };
+            armRecv(id, conn);
+        }
+        if (!(flags & IORING_CQE_F_MORE))
+            armAccept();
+    }
+
+    void onRecv(uint64_t id, int res, uint32_t flags)
+    {
+        auto it = conns_.find(id);
+        Conn *conn = it == conns_.end() ? nullptr : &it->second;
+        if (flags & IORING_CQE_F_BUFFER)
+        {
+            uint16_t bid = static_cast<uint16_t>(flags >> IORING_CQE_BUFFER_SHIFT);
+            if (conn != nullptr && res > 0 && !conn->closing && !conn->client->close_asap)
+            {
+                // The kernel picked a pool buffer, so this is the one read that has to be copied.
+                conn->client->query.append(buf_pool_.get() + static_cast<size_t>(bid) * BUF_SIZE, static_cast<size_t>(res));
+                on_read_(*conn->client);
+                if (conn->client->blocked.active)
+                    blocked_.insert(id);
+                markDirty(id, *conn);
+            }
+            provideBuffers(bid, 1);
+        }
+        if (conn == nullptr || (flags & IORING_CQE_F_MORE))
+            return;
+
+        conn->recv_armed = false;
+        if (res == 0 || (res < 0 && res != -ENOBUFS))
+        {
+            startClose(id, *conn);
+        }
+        else if (!conn->closing)
+        {
+            // The kernel ended the multishot (e.g. ran out of provided buffers); buffers were handed back above.
+            armRecv(id, *conn);
+        }
+        else
+        {
+            finishClose(id, *conn);
+        }
+    }
+
+    void onSend(uint64_t id, int res)
+    {
+        auto it = conns_.find(id);
+        if (it == conns_.end())
+            return;
+        Conn &conn = it->second;
+        conn.send_inflight = false;
+        if (res < 0)
+        {
+            startClose(id, conn);
+            return;
+        }
+        conn.client->reply.consume(res);
+        if (conn.closing)
+            finishClose(id, conn);
+        else
+            markDirty(id, conn); // A short write, or replies queued while this send was in flight.
+    }
+
+    /// @brief Shut the socket down; the connection is freed once the kernel has released its recv and send.
+    void startClose(uint64_t id, Conn &conn)
+    {
+        if (!conn.closing)
+        {
+            conn.closing = true;
+            shutdown(conn.client->fd, SHUT_RDWR); // Terminates the multishot recv with EOF.
+        }
+        finishClose(id, conn);
+    }
+
+    void finishClose(uint64_t id, Conn &conn)
+    {
+        if (conn.closing && !conn.recv_armed && !conn.send_inflight)
+        {
+            on_close_(*conn.client);
+            blocked_.erase(id);
+            conns_.erase(id); // Client destructor closes the socket.
+        }
+    }
+};
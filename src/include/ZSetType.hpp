@@ -0,0 +1,263 @@
+#pragma once
+
+#include <string_view>
+#include <utility>
+#include <vector>
+#include "RedisObject.hpp"
+
+/// @brief Largest sorted set kept in the listpack encoding, like redis' zset-max-listpack-* settings.
+struct ZSetLimits
+{
+    size_t max_listpack_entries = 128; // Members (zset-max-listpack-entries).
+    size_t max_listpack_value = 64;    // Bytes of a member (zset-max-listpack-value).
+};
+
+/// @brief Operations on a sorted set object whatever its encoding, like redis' t_zset.c.
+/// A sorted set starts as a Listpack of alternating members and scores, kept sorted by score and
+/// then member, and is converted to a SortedSet, for good, once it grows past the ZSetLimits.
+/// Listpack scores are stored as text (formatDouble()), which keeps integer scores to a few bytes.
+namespace ZSetType
+{
+    inline RedisObject create()
+    {
+        return RedisObject::create<Listpack>(ObjType::ZSet, ObjEncoding::Listpack);
+    }
+
+    /// @return number of members.
+    inline size_t length(const RedisObject &zset)
+    {
+        if (zset.encoding() == ObjEncoding::Listpack)
+            return zset.as<Listpack>().size() / 2;
+        return zset.as<SortedSet>().size();
+    }
+
+    /// @brief Parse one end of a score range: a score, or "(" and a score for an exclusive end.
+    inline bool parseScoreBound(std::string_view s, double &score, bool &exclusive)
+    {
+        exclusive = !s.empty() && s[0] == '(';
+        if (exclusive)
+            s.remove_prefix(1);
+        return parseDouble(s, score);
+    }
+
+    /// @brief Parse the min and max arguments of ZRANGEBYSCORE.
+    inline bool parseScoreRange(std::string_view min, std::string_view max, ScoreRange &range)
+    {
+        return parseScoreBound(min, range.min, range.min_exclusive) && parseScoreBound(max, range.max, range.max_exclusive);
+    }
+
+    inline double listpackScore(const Listpack &lp, size_t pos)
+    {
+        double score = 0;
+        parseDouble(lp.get(pos), score);
+        return score;
+    }
+
+    inline bool score(const RedisObject &zset, std::string_view member, double &score)
+    {
+        if (zset.encoding() == ObjEncoding::Listpack)
+        {
+            const Listpack &lp = zset.as<Listpack>();
+            size_t pos = lp.find(member, 1);
+            if (pos == lp.end())
+                return false;
+            score = listpackScore(lp, lp.next(pos));
+            return true;
+        }
+        const double *found = zset.as<SortedSet>().score(member);
+        if (found == nullptr)
+            return false;
+        score = *found;
+        return true;
+    }
+
+    /// @brief Move a listpack encoded sorted set into a SortedSet.
+    inline void convert(RedisObject &zset)
+    {
+        RedisObject converted = RedisObject::create<SortedSet>(ObjType::ZSet, ObjEncoding::Skiplist);
+        SortedSet &set = converted.as<SortedSet>();
+        const Listpack &lp = zset.as<Listpack>();
+        for (size_t pos = lp.begin(); pos != lp.end();)
+        {
+            std::string_view member = lp.get(pos, &pos);
+            set.set(member, listpackScore(lp, pos));
+            pos = lp.next(pos);
+        }
+        zset = std::move(converted);
+    }
+
+    /// @brief Add a member or change its score, converting the set if it outgrows the listpack.
+    /// @return true if the member is new.
+    inline bool set(RedisObject &zset, std::string_view member, double score, const ZSetLimits &limits)
+    {
+        if (zset.encoding() == ObjEncoding::Listpack && member.size() > limits.max_listpack_value)
+            convert(zset);
+        if (zset.encoding() == ObjEncoding::Skiplist)
+            return zset.as<SortedSet>().set(member, score);
+        Listpack &lp = zset.as<Listpack>();
+        bool added = true;
+        size_t pos = lp.find(member, 1);
+        if (pos != lp.end())
+        {
+            if (listpackScore(lp, lp.next(pos)) == score)
+                return false;
+            lp.erase(pos, 2);
+            added = false;
+        }
+        // Insert before the first pair that sorts after (score, member).
+        for (pos = lp.begin(); pos != lp.end();)
+        {
+            size_t score_pos;
+            std::string_view other = lp.get(pos, &score_pos);
+            double other_score = listpackScore(lp, score_pos);
+            if (other_score > score || (other_score == score && other > member))
+                break;
+            pos = lp.next(score_pos);
+        }
+        char buf[MAX_DOUBLE_CHARS];
+        lp.insert(pos, member);
+        lp.insert(pos + Listpack::entrySize(member.size()), formatDouble(score, buf));
+        if (lp.size() / 2 > limits.max_listpack_entries)
+            convert(zset);
+        return added;
+    }
+
+    /// @return true if the member existed.
+    inline bool remove(RedisObject &zset, std::string_view member)
+    {
+        if (zset.encoding() == ObjEncoding::Skiplist)
+            return zset.as<SortedSet>().erase(member);
+        Listpack &lp = zset.as<Listpack>();
+        size_t pos = lp.find(member, 1);
+        if (pos == lp.end())
+            return false;
+        lp.erase(pos, 2);
+        return true;
+    }
+
+    /// @param reverse count from the highest score instead of the lowest.
+    /// @return the 0-based rank of a member.
+    inline bool rank(const RedisObject &zset, std::string_view member, bool reverse, size_t &rank)
+    {
+        size_t length = ZSetType::length(zset);
+        if (zset.encoding() == ObjEncoding::Skiplist)
+        {
+            std::optional<size_t> found = zset.as<SortedSet>().rank(member);
+            if (!found)
+                return false;
+            rank = reverse ? length - 1 - *found : *found;
+            return true;
+        }
+        const Listpack &lp = zset.as<Listpack>();
+        size_t i = 0;
+        for (size_t pos = lp.begin(); pos != lp.end(); ++i)
+        {
+            if (lp.get(pos, &pos) == member)
+            {
+                rank = reverse ? length - 1 - i : i;
+                return true;
+            }
+            pos = lp.next(pos);
+        }
+        return false;
+    }
+
+    /// @brief The members of a listpack encoded set with their scores, in ascending order.
+    inline std::vector<std::pair<std::string_view, double>> listpackEntries(const Listpack &lp)
+    {
+        std::vector<std::pair<std::string_view, double>> entries;
+        entries.reserve(lp.size() / 2);
+        for (size_t pos = lp.begin(); pos != lp.end();)
+        {
+            std::string_view member = lp.get(pos, &pos);
+            entries.emplace_back(member, listpackScore(lp, pos));
+            pos = lp.next(pos);
+        }
+        return entries;
+    }
+
+    /// @brief Call fn(std::string_view member, double score) for `count` members from rank `start` on.
+    /// @param reverse walk from the highest score down.
+    template <typename F>
+    void rangeByRank(const RedisObject &zset, size_t start, size_t count, bool reverse, F &&fn)
+    {
+        size_t length = ZSetType::length(zset);
+        if (start >= length)
+            return;
+        count = std::min(count, length - start);
+        if (zset.encoding() == ObjEncoding::Listpack)
+        {
+            auto entries = listpackEntries(zset.as<Listpack>());
+            for (size_t i = start; i < start + count; ++i)
+            {
+                const auto &[member, score] = entries[reverse ? length - 1 - i : i];
+                fn(member, score);
+            }
+            return;
+        }
+        const SortedSet &set = zset.as<SortedSet>();
+        const SortedSet::Node *node = set.byRank(reverse ? length - 1 - start : start);
+        for (; count > 0; --count)
+        {
+            fn(node->member(), node->score());
+            node = reverse ? node->prev() : node->next();
+        }
+    }
+
+    /// @brief Call fn(std::string_view member, double score) for the members within `range`,
+    /// skipping the first `offset` and stopping after `limit` (negative for no limit).
+    /// @param reverse walk from the highest score down.
+    template <typename F>
+    void rangeByScore(const RedisObject &zset, const ScoreRange &range, bool reverse, size_t offset, long long limit, F &&fn)
+    {
+        if (range.empty())
+            return;
+        if (zset.encoding() == ObjEncoding::Listpack)
+        {
+            auto entries = listpackEntries(zset.as<Listpack>());
+            size_t n = entries.size();
+            for (size_t i = 0; i < n && limit != 0; ++i)
+            {
+                const auto &[member, score] = entries[reverse ? n - 1 - i : i];
+                if (!(reverse ? range.belowMax(score) : range.aboveMin(score)))
+                    continue;
+                if (!(reverse ? range.aboveMin(score) : range.belowMax(score)))
+                    break;
+                if (offset > 0)
+                {
+                    --offset;
+                    continue;
+                }
+                fn(member, score);
+                --limit;
+            }
+            return;
+        }
+        const SortedSet &set = zset.as<SortedSet>();
+        const SortedSet::Node *node = reverse ? set.lastInRange(range) : set.firstInRange(range);
+        for (; node != nullptr && offset > 0; --offset)
+            node = reverse ? node->prev() : node->next();
+        for (; node != nullptr && limit != 0; --limit)
+        {
+            if (!(reverse ? range.aboveMin(node->score()) : range.belowMax(node->score())))
+                break;
+            fn(node->member(), node->score());
+            node = reverse ? node->prev() : node->next();
+        }
+    }
+
+    /// @brief One step of ZSCAN: call fn(std::string_view member, double score) for some members.
+    /// A listpack is small enough to be walked in a single step, like redis does.
+    /// @return the next cursor, 0 once the walk is complete.
+    template <typename F>
+    size_t scan(const RedisObject &zset, size_t cursor, F &&fn)
+    {
+        if (zset.encoding() == ObjEncoding::Listpack)
+        {
+            for (const auto &[member, score] : listpackEntries(zset.as<Listpack>()))
+                fn(member, score);
+            return 0;
+        }
+        return zset.as<SortedSet>().scan(cursor, fn);
+    }
+}
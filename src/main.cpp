@@ -33,6 +33,91 @@ int main(int argc, char *argv[])
       serv_meta.master = argv[i + 1];
       serv_meta.is_replica = true;
     }
+    else if (arg == "--io-mode" && i + 1 < argc)
+    {
+      std::string mode = argv[i + 1];
+      if (mode == "threads")
+        serv_meta.io_mode = IOMode::Threads;
+      else if (mode == "epoll")
+        serv_meta.io_mode = IOMode::Epoll;
+      else if (mode == "uring")
+        serv_meta.io_mode = IOMode::Uring;
+      else if (mode == "asio")
+        serv_meta.io_mode = IOMode::Asio;
+      else
+      {
+        std::cerr << "Unknown --io-mode " << mode << " (expected threads, epoll, uring or asio)\n";
+        return EXIT_FAILURE;
+      }
+    }
+    else if (arg == "--io-threads" && i + 1 < argc)
+    {
+      serv_meta.io_threads = std::stoi(argv[i + 1]);
+    }
+    else if (arg == "--io-cpu-affinity")
+    {
+      serv_meta.io_cpu_affinity = true;
+    }
+    else if (arg == "--proto-max-bulk-len" && i + 1 < argc)
+    {
+      serv_meta.proto_limits.max_bulk_len = std::stoull(argv[i + 1]);
+    }
+    else if (arg == "--max-multibulk-len" && i + 1 < argc)
+    {
+      serv_meta.proto_limits.max_multibulk_len = std::stoull(argv[i + 1]);
+    }
+    else if (arg == "--maxmemory" && i + 1 < argc)
+    {
+      if (!parseMemorySize(argv[i + 1], serv_meta.maxmemory))
+      {
+        std::cerr << "Invalid --maxmemory " << argv[i + 1] << " (expected bytes, or a size such as 100mb)\n";
+        return EXIT_FAILURE;
+      }
+    }
+    else if (arg == "--hash-max-listpack-entries" && i + 1 < argc)
+    {
+      serv_meta.hash_limits.max_listpack_entries = std::stoull(argv[i + 1]);
+    }
+    else if (arg == "--hash-max-listpack-value" && i + 1 < argc)
+    {
+      serv_meta.hash_limits.max_listpack_value = std::stoull(argv[i + 1]);
+    }
+    else if (arg == "--set-max-intset-entries" && i + 1 < argc)
+    {
+      serv_meta.set_limits.max_intset_entries = std::stoull(argv[i + 1]);
+    }
+    else if (arg == "--zset-max-listpack-entries" && i + 1 < argc)
+    {
+      serv_meta.zset_limits.max_listpack_entries = std::stoull(argv[i + 1]);
+    }
+    else if (arg == "--zset-max-listpack-value" && i + 1 < argc)
+    {
+      serv_meta.zset_limits.max_listpack_value = std::stoull(argv[i + 1]);
+    }
+    else if (arg == "--stream-node-max-bytes" && i + 1 < argc)
+    {
+      serv_meta.stream_limits.max_block_bytes = std::stoull(argv[i + 1]);
+    }
+    else if (arg == "--stream-node-max-entries" && i + 1 < argc)
+    {
+      serv_meta.stream_limits.max_block_entries = std::stoull(argv[i + 1]);
+    }
+    else if (arg == "--hll-sparse-max-bytes" && i + 1 < argc)
+    {
+      serv_meta.hll_limits.sparse_max_bytes = std::stoull(argv[i + 1]);
+    }
+    else if (arg == "--prefetch-batch-max-size" && i + 1 < argc)
+    {
+      serv_meta.prefetch_batch = std::stoull(argv[i + 1]);
+    }
+    else if (arg == "--maxmemory-policy" && i + 1 < argc)
+    {
+      if (!parseEvictionPolicy(argv[i + 1], serv_meta.maxmemory_policy))
+      {
+        std::cerr << "Unknown --maxmemory-policy " << argv[i + 1] << " (expected noeviction, allkeys-lru, allkeys-lfu, allkeys-random, volatile-lru or volatile-ttl)\n";
+        return EXIT_FAILURE;
+      }
+    }
   }
 
   // Start the Redis Server
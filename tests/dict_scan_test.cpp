@@ -0,0 +1,91 @@
+// Dict::stableScan() must return every key that is present for the whole walk, even when keys are
+// inserted and erased between steps and the table grows, shrinks or rehashes meanwhile.
+#include <algorithm>
+#include <cstdio>
+#include <iterator>
+#include <random>
+#include <set>
+#include <string>
+#include "Dict.hpp"
+
+int main()
+{
+    std::mt19937_64 rng(7);
+    size_t grows = 0, shrinks = 0;
+    for (int round = 0; round < 60; ++round)
+    {
+        // Rounds alternate between inserting, erasing and both while the walk runs.
+        enum Mode
+        {
+            Grow,
+            Shrink,
+            Mixed
+        };
+        Mode mode = static_cast<Mode>(round % 3);
+        Dict<int> dict;
+        std::set<std::string> stable, transient;
+        size_t n = 1 + rng() % 20000;
+        for (size_t i = 0; i < n; ++i)
+        {
+            std::string key = "s" + std::to_string(i);
+            dict.tryEmplace(key);
+            stable.insert(key);
+        }
+        // Shrinking rounds start with many transient keys so erasing them empties the table enough to shrink it.
+        size_t next = 0;
+        for (size_t i = 0; i < (mode == Shrink ? n * 12 : n); ++i)
+        {
+            std::string key = "t" + std::to_string(next++);
+            dict.tryEmplace(key);
+            transient.insert(key);
+        }
+
+        std::set<std::string> seen;
+        size_t cursor = 0;
+        size_t capacity = dict.capacity();
+        do
+        {
+            cursor = dict.stableScan(cursor, [&](std::string_view key, const int &)
+                                     { seen.emplace(key); });
+            int ops = mode == Shrink ? rng() % 60 : rng() % 12;
+            for (int op = 0; op < ops; ++op)
+            {
+                bool insert = mode == Grow || (mode == Mixed && rng() % 2 == 0);
+                if (insert)
+                {
+                    std::string key = "t" + std::to_string(next++);
+                    dict.tryEmplace(key);
+                    transient.insert(key);
+                }
+                else if (!transient.empty())
+                {
+                    auto it = std::next(transient.begin(), rng() % std::min<size_t>(transient.size(), 8));
+                    dict.erase(*it);
+                    transient.erase(it);
+                }
+            }
+            if (rng() % 4 == 0)
+                dict.rehashStep(rng() % 4);
+            grows += dict.capacity() > capacity;
+            shrinks += dict.capacity() < capacity;
+            capacity = dict.capacity();
+        } while (cursor != 0);
+
+        for (const std::string &key : stable)
+        {
+            if (!seen.contains(key))
+            {
+                std::printf("round %d: %s was never returned (%zu stable keys)\n", round, key.c_str(), n);
+                return 1;
+            }
+        }
+    }
+    // Without a resize during some walk the test proves nothing about cursors surviving one.
+    if (grows == 0 || shrinks == 0)
+    {
+        std::printf("walks crossed %zu grows and %zu shrinks, expected both\n", grows, shrinks);
+        return 1;
+    }
+    std::printf("stableScan ok: walks crossed %zu grows and %zu shrinks\n", grows, shrinks);
+    return 0;
+}
@@ -0,0 +1,104 @@
+// PFCOUNT's relative error from 10 to 10M distinct elements must stay within a few standard
+// errors of 1.04 / sqrt(16384), about 0.81%, and every encoding must give the same answer: one
+// HLL kept sparse throughout, one dense from the start, one converted when it outgrows the
+// default hll-sparse-max-bytes, and one rebuilt from merged registers the way PFMERGE does.
+// Several independent streams at a few sizes also check the RMS error itself.
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include "HyperLogLogType.hpp"
+
+namespace
+{
+    const double STANDARD_ERROR = 1.04 / std::sqrt(static_cast<double>(Hll::REGISTERS));
+
+    std::vector<uint8_t> registersOf(const RedisObject &hll)
+    {
+        std::vector<uint8_t> registers(Hll::REGISTERS, 0);
+        HyperLogLogType::mergeInto(hll, registers.data());
+        return registers;
+    }
+
+    double relativeError(uint64_t estimate, uint64_t n)
+    {
+        return (static_cast<double>(estimate) - static_cast<double>(n)) / static_cast<double>(n);
+    }
+}
+
+int main()
+{
+    bool ok = true;
+
+    HllLimits converting;
+    HllLimits sparse_only;
+    sparse_only.sparse_max_bytes = SIZE_MAX;
+    RedisObject sparse = HyperLogLogType::create();
+    RedisObject dense = HyperLogLogType::create();
+    HyperLogLogType::convert(dense);
+    RedisObject converted = HyperLogLogType::create();
+
+    std::printf("%10s %10s %9s  %s\n", "elements", "estimate", "error", "encoding");
+    uint64_t n = 0;
+    for (uint64_t checkpoint = 10; checkpoint <= 10000000; checkpoint *= 10)
+    {
+        for (; n < checkpoint; ++n)
+        {
+            std::string element = "element:" + std::to_string(n);
+            HyperLogLogType::add(sparse, element, sparse_only);
+            HyperLogLogType::add(dense, element, converting);
+            HyperLogLogType::add(converted, element, converting);
+        }
+        std::vector<uint8_t> registers = registersOf(sparse);
+        RedisObject merged = HyperLogLogType::create();
+        HyperLogLogType::assign(merged, registers.data(), converting);
+
+        uint64_t estimate = HyperLogLogType::count(sparse);
+        double error = relativeError(estimate, n);
+        std::printf("%10llu %10llu %8.3f%%  %s\n", static_cast<unsigned long long>(n),
+                    static_cast<unsigned long long>(estimate), error * 100, converted.encodingName());
+        if (std::fabs(error) > 3 * STANDARD_ERROR)
+        {
+            std::fprintf(stderr, "FAILED: error %.3f%% at %llu elements is over 3 standard errors\n", error * 100,
+                         static_cast<unsigned long long>(n));
+            ok = false;
+        }
+        for (const RedisObject *other : {&dense, &converted, &merged})
+        {
+            if (HyperLogLogType::count(*other) != estimate || registersOf(*other) != registers)
+            {
+                std::fprintf(stderr, "FAILED: %s HLL disagrees with the sparse one at %llu elements\n",
+                             other->encodingName(), static_cast<unsigned long long>(n));
+                ok = false;
+            }
+        }
+    }
+
+    // One stream says little about the spread; the RMS error of independent streams should be
+    // close to the standard error. Over 32 streams it strays by 1.5x only by very bad luck.
+    constexpr int STREAMS = 32;
+    for (uint64_t size : {1000, 20000, 200000})
+    {
+        double squares = 0;
+        for (int stream = 0; stream < STREAMS; ++stream)
+        {
+            RedisObject hll = HyperLogLogType::create();
+            std::string prefix = "stream:" + std::to_string(stream) + ":";
+            for (uint64_t i = 0; i < size; ++i)
+                HyperLogLogType::add(hll, prefix + std::to_string(i), converting);
+            double error = relativeError(HyperLogLogType::count(hll), size);
+            squares += error * error;
+        }
+        double rms = std::sqrt(squares / STREAMS);
+        std::printf("%d streams of %llu elements: RMS error %.3f%% (standard error %.3f%%)\n", STREAMS,
+                    static_cast<unsigned long long>(size), rms * 100, STANDARD_ERROR * 100);
+        if (rms > 1.5 * STANDARD_ERROR)
+        {
+            std::fprintf(stderr, "FAILED: RMS error over 1.5 standard errors\n");
+            ok = false;
+        }
+    }
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,99 @@
+// Several threads GET and SET (and MSET, DEL and expire) overlapping keys of one Keyspace while
+// another thread runs the rehash and active expire cycles, like the connection threads and
+// serverCron() do. Every value read must be the one its key was written with. Build with
+// -DENABLE_TSAN=ON to have ThreadSanitizer check the shard locking; the ops/s figure is printed
+// as a rough throughput number.
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <vector>
+#include "Keyspace.hpp"
+
+int main()
+{
+    constexpr int THREADS = 8;
+    constexpr int OPS_PER_THREAD = 200000;
+    constexpr int KEYS = 200000;
+
+    Keyspace keyspace;
+    std::atomic<long long> ops{0};
+    std::atomic<bool> corrupt{false};
+    std::atomic<bool> stop{false};
+
+    // A value is its own key, so any reader can check what it got.
+    auto check = [&](std::string_view key, const RedisObject &value)
+    {
+        RedisObject::IntBuffer buf;
+        if (value.stringView(buf) != key)
+            corrupt.store(true);
+    };
+
+    auto start = std::chrono::steady_clock::now();
+    std::thread cron([&]
+                     {
+                         while (!stop.load())
+                         {
+                             keyspace.rehashStep(std::chrono::microseconds(200));
+                             keyspace.activeExpireCycle(std::chrono::microseconds(200));
+                         } });
+    std::vector<std::thread> workers;
+    for (int t = 0; t < THREADS; ++t)
+    {
+        workers.emplace_back([&, t]
+                             {
+                                 for (int i = 0; i < OPS_PER_THREAD; ++i)
+                                 {
+                                     std::string key = "key:" + std::to_string((i * 7 + t) % KEYS);
+                                     switch (i % 16)
+                                     {
+                                     case 0:
+                                     case 1:
+                                     case 2:
+                                         keyspace.set(key, RedisObject::fromString(key));
+                                         break;
+                                     case 3:
+                                         keyspace.set(key, RedisObject::fromString(key), Keyspace::nowMs() + 1);
+                                         break;
+                                     case 4:
+                                     {
+                                         std::string other = "key:" + std::to_string((i * 13 + t) % KEYS);
+                                         std::vector<std::string_view> keys{key, other};
+                                         std::vector<RedisObject> values;
+                                         values.push_back(RedisObject::fromString(key));
+                                         values.push_back(RedisObject::fromString(other));
+                                         keyspace.setMany(keys, std::move(values));
+                                         break;
+                                     }
+                                     case 5:
+                                         keyspace.eraseMany({key});
+                                         break;
+                                     case 6:
+                                         keyspace.read(key, [&](const RedisObject *value)
+                                                       {
+                                                           if (value != nullptr)
+                                                               check(key, *value); });
+                                         break;
+                                     default:
+                                         if (auto value = keyspace.get(key))
+                                             check(key, *value);
+                                         break;
+                                     }
+                                 }
+                                 ops.fetch_add(OPS_PER_THREAD); });
+    }
+    for (std::thread &worker : workers)
+        worker.join();
+    stop.store(true);
+    cron.join();
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    if (corrupt.load())
+    {
+        std::printf("a key read back a value it was never set to\n");
+        return 1;
+    }
+    std::printf("%d threads, %lld ops, %.0f ops/s, %zu keys left\n", THREADS, ops.load(), ops.load() / seconds, keyspace.size());
+    return 0;
+}
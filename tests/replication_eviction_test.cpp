@@ -0,0 +1,138 @@
+// A master with maxmemory evicts keys while it is written to; its replica, which does not evict on
+// its own, must lose the same keys through the DELs the master propagates, and so end up with the
+// master's key count and stay near its memory limit. Both servers run in this process, on
+// loopback ports derived from the pid.
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "RedisServer.hpp"
+
+namespace
+{
+    int connectTo(int port)
+    {
+        for (int attempt = 0; attempt < 100; ++attempt)
+        {
+            int fd = socket(AF_INET, SOCK_STREAM, 0);
+            sockaddr_in addr{};
+            addr.sin_family = AF_INET;
+            addr.sin_port = htons(port);
+            addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+            if (connect(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) == 0)
+                return fd;
+            close(fd);
+            std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        }
+        std::fprintf(stderr, "cannot connect to port %d\n", port);
+        std::_Exit(EXIT_FAILURE);
+    }
+
+    /// @brief Send a command and read its reply: a status, error or integer line, or a bulk string.
+    std::string command(int fd, const std::vector<std::string> &args)
+    {
+        std::string out = "*" + std::to_string(args.size()) + "\r\n";
+        for (const std::string &arg : args)
+            out += "$" + std::to_string(arg.size()) + "\r\n" + arg + "\r\n";
+        if (send(fd, out.data(), out.size(), MSG_NOSIGNAL) != static_cast<ssize_t>(out.size()))
+            std::_Exit(EXIT_FAILURE);
+        std::string in;
+        char buf[4096];
+        while (true)
+        {
+            size_t eol = in.find("\r\n");
+            if (eol != std::string::npos)
+            {
+                if (in[0] != '$')
+                    return in.substr(0, eol);
+                long long len = std::stoll(in.substr(1, eol - 1));
+                if (len < 0)
+                    return "(nil)";
+                if (in.size() >= eol + 2 + len + 2)
+                    return in.substr(eol + 2, len);
+            }
+            ssize_t n = recv(fd, buf, sizeof(buf), 0);
+            if (n <= 0)
+                std::_Exit(EXIT_FAILURE);
+            in.append(buf, n);
+        }
+    }
+
+    /// @return the value of `field` in an INFO section.
+    long long infoField(int fd, const std::string &section, const std::string &field)
+    {
+        std::string info = command(fd, {"INFO", section});
+        size_t pos = info.find(field + ":");
+        if (pos == std::string::npos)
+            pos = info.find(field + "=");
+        return pos == std::string::npos ? -1 : std::stoll(info.substr(pos + field.size() + 1));
+    }
+
+    /// @brief Wait until the replica has applied everything the master sent before `marker`.
+    bool waitForMarker(int master, int replica, const std::string &marker)
+    {
+        command(master, {"SET", marker, "1"});
+        for (int attempt = 0; attempt < 200; ++attempt)
+        {
+            if (command(replica, {"GET", marker}) == "1")
+                return true;
+            std::this_thread::sleep_for(std::chrono::milliseconds(25));
+        }
+        return false;
+    }
+}
+
+int main()
+{
+    constexpr unsigned long long MAXMEMORY = 2 * 1024 * 1024;
+    constexpr int KEYS = 6000;
+    const int master_port = 20000 + getpid() % 20000;
+    const int replica_port = master_port + 1;
+
+    server_metadata master_meta(master_port, false, "");
+    master_meta.maxmemory = MAXMEMORY;
+    master_meta.maxmemory_policy = EvictionPolicy::AllKeysLru;
+    std::thread([master_meta]
+                { RedisServer server(master_meta); })
+        .detach();
+    int master = connectTo(master_port);
+
+    server_metadata replica_meta(replica_port, true, "127.0.0.1 " + std::to_string(master_port));
+    std::thread([replica_meta]
+                { RedisServer server(replica_meta); })
+        .detach();
+    int replica = connectTo(replica_port);
+    if (!waitForMarker(master, replica, "marker:start"))
+    {
+        std::fprintf(stderr, "replica never caught up with the master\n");
+        std::_Exit(EXIT_FAILURE);
+    }
+
+    std::string value(1000, 'v');
+    for (int i = 0; i < KEYS; ++i)
+        command(master, {"SET", "key:" + std::to_string(i), value});
+    bool synced = waitForMarker(master, replica, "marker:end");
+
+    long long evicted = infoField(master, "stats", "evicted_keys");
+    long long master_keys = infoField(master, "keyspace", "keys");
+    long long replica_keys = infoField(replica, "keyspace", "keys");
+    long long replica_memory = infoField(replica, "memory", "used_memory");
+    std::string first = command(replica, {"GET", "key:0"});
+    std::printf("evicted %lld keys; master %lld keys, replica %lld keys, replica used_memory %lld\n",
+                evicted, master_keys, replica_keys, replica_memory);
+    std::cout << std::flush;
+
+    bool ok = synced && evicted > 0 && master_keys == replica_keys && first == "(nil)" &&
+              replica_memory <= static_cast<long long>(MAXMEMORY) * 2;
+    if (!ok)
+        std::fprintf(stderr, "FAILED: the replica kept keys its master evicted\n");
+    // The servers never return; leave without unwinding their threads.
+    std::_Exit(ok ? EXIT_SUCCESS : EXIT_FAILURE);
+}